@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui serialport network
+QT       += core gui serialport network sql concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -22,21 +22,80 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
-CONFIG += c++11
+CONFIG += c++17
 
 SOURCES += \
+        approachaggregator.cpp \
+        backfilljob.cpp \
+        clockmodel.cpp \
         commands.cpp \
+        configcache.cpp \
+        configtablemodel.cpp \
+        derivedmetrics.cpp \
+        gapscanner.cpp \
+        interval_codec.cpp \
+        intervalindex.cpp \
+        intervalpipeline.cpp \
+        intervalquery.cpp \
+        intervalstore.cpp \
+        lanechart.cpp \
+        liveviewfeed.cpp \
+        lttb.cpp \
         main.cpp \
         mainwindow.cpp \
+        pollscheduler.cpp \
+        portwatcher.cpp \
+        qualitymonitor.cpp \
+        recordformatter.cpp \
+        recordjournal.cpp \
+        recordtablemodel.cpp \
+        rollupengine.cpp \
         sensor_utils.cpp \
+        sensorfleetmodel.cpp \
+        sensorlink.cpp \
+        sensorsnapshot.cpp \
+        sensorstatestore.cpp \
         serialworker.cpp \
+        snapshotstore.cpp \
+        speedsketch.cpp \
+        sqlitesink.cpp \
         tcpworker.cpp
 
 HEADERS += \
+        approachaggregator.h \
+        backfilljob.h \
+        clockmodel.h \
         commands.h \
+        configcache.h \
+        configtablemodel.h \
+        derivedmetrics.h \
+        gapscanner.h \
+        interval_codec.h \
+        intervalindex.h \
+        intervalpipeline.h \
+        intervalquery.h \
+        intervalstore.h \
+        lanechart.h \
+        liveviewfeed.h \
+        lttb.h \
         mainwindow.h \
+        pollscheduler.h \
+        portwatcher.h \
+        qualitymonitor.h \
+        recordformatter.h \
+        recordjournal.h \
+        recordtablemodel.h \
+        rollupengine.h \
         sensor_utils.h \
+        sensorfleetmodel.h \
+        sensorlink.h \
+        sensorsnapshot.h \
+        sensorstatestore.h \
         serialworker.h \
+        snapshotstore.h \
+        speedsketch.h \
+        spscqueue.h \
+        sqlitesink.h \
         tcpworker.h
 
 FORMS += \
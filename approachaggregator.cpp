@@ -0,0 +1,204 @@
+#include "approachaggregator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// a derived speed further than this from the sensor's (1 mph/kph, raw units)
+// counts as a mismatch
+#define APPROACH_SPEED_TOLERANCE 256
+#define APPROACH_REPORT_EVERY 100
+
+ApproachAggregator::ApproachAggregator()
+{
+    verifyOn = false;
+    derivedCount = 0;
+    incompleteCount = 0;
+    compared = 0;
+    volumeMismatches = 0;
+    speedMismatches = 0;
+    absVolumeError = 0;
+    absSpeedError = 0.0;
+    absOccupancyError = 0.0;
+}
+
+/**
+ * @brief ApproachAggregator::setApproaches: Takes the lane-to-approach mapping
+ * for a sensor, as filled in by parse_approach_info_read_resp. Approach i of
+ * the array is approach number i in the sensor's interval data.
+ * @param sensorId
+ * @param appr
+ * @param numApproaches
+ */
+void ApproachAggregator::setApproaches(uint16_t sensorId, const approach *appr,
+                                       int numApproaches)
+{
+    QVector<QVector<uint8_t> > lanes;
+    for (int a=0; a<numApproaches; a++) {
+        QVector<uint8_t> l;
+        if (appr[a].lanesAssigned != nullptr) {
+            for (int i=0; i<appr[a].numLanes && i<64; i++) {
+                l.append(appr[a].lanesAssigned[i]);
+            }
+        }
+        lanes.append(l);
+    }
+
+    // anything half built was built against the old mapping
+    QHash<quint64, pending_approach>::iterator it = pending.begin();
+    while (it != pending.end()) {
+        if (it.value().sum.acc.sensor_id == sensorId) {
+            it = pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    lanesOf[sensorId] = lanes;
+    printf("Sensor %u: deriving %d approaches from lane data\n", sensorId, numApproaches);
+}
+
+bool ApproachAggregator::hasApproaches(uint16_t sensorId) const
+{
+    return lanesOf.contains(sensorId) && !lanesOf.value(sensorId).isEmpty();
+}
+
+void ApproachAggregator::setVerify(bool on)
+{
+    verifyOn = on;
+}
+
+bool ApproachAggregator::verifying() const
+{
+    return verifyOn;
+}
+
+quint64 ApproachAggregator::pendingKey(uint16_t sensorId, int approachIdx, qint64 timestamp)
+{
+    return (static_cast<quint64>(timestamp) << 24) |
+            (static_cast<quint64>(sensorId) << 8) | static_cast<quint8>(approachIdx);
+}
+
+/**
+ * @brief ApproachAggregator::add: Folds a lane interval into the approach it
+ * is assigned to
+ * @param laneRec: request type 1 interval
+ * @param derived: approach intervals completed by this lane are appended here
+ * (request type 2, lane_appr_num = approach number). When verifying they are
+ * kept for verify() instead.
+ * @return number of approach intervals completed
+ */
+int ApproachAggregator::add(const interval_record &laneRec, QVector<interval_record> *derived)
+{
+    QHash<uint16_t, QVector<QVector<uint8_t> > >::const_iterator m =
+            lanesOf.constFind(laneRec.sensor_id);
+    if (laneRec.request_type != 1 || m == lanesOf.constEnd()) {
+        return 0;
+    }
+    const QVector<QVector<uint8_t> > &lanes = m.value();
+    int n = 0;
+
+    for (int a=0; a<lanes.size(); a++) {
+        int pos = lanes.at(a).indexOf(laneRec.lane_appr_num);
+        if (pos < 0) {
+            continue;
+        }
+        quint64 key = pendingKey(laneRec.sensor_id, a, laneRec.timestamp);
+        QHash<quint64, pending_approach>::iterator it = pending.find(key);
+        if (it == pending.end()) {
+            pending_approach p;
+            interval_sum_open(&p.sum, laneRec, laneRec.timestamp, laneRec.interval_duration);
+            p.sum.acc.request_type = 2;
+            p.sum.acc.lane_appr_num = static_cast<uint8_t>(a);
+            p.lanesSeen = 0;
+            it = pending.insert(key, p);
+        }
+        pending_approach &p = it.value();
+        quint64 bit = static_cast<quint64>(1) << pos;
+        if (p.lanesSeen & bit) {
+            continue;
+        }
+        p.lanesSeen |= bit;
+        interval_sum_add(&p.sum, laneRec);
+        if (p.lanesSeen != (static_cast<quint64>(1) << lanes.at(a).size()) - 1) {
+            continue;
+        }
+
+        interval_record r = interval_sum_finish(p.sum);
+        // interval_sum counts lane-seconds; an approach covers the interval once
+        r.interval_duration = laneRec.interval_duration;
+        pending.erase(it);
+        derivedCount++;
+        n++;
+        if (verifyOn) {
+            lastDerived[interval_key(r.sensor_id, 2, r.lane_appr_num)] = r;
+        } else {
+            derived->append(r);
+        }
+
+        // an older interval of this approach that never completed won't now
+        QHash<quint64, pending_approach>::iterator old = pending.begin();
+        while (old != pending.end()) {
+            const interval_record &o = old.value().sum.acc;
+            if (o.sensor_id == r.sensor_id && o.lane_appr_num == r.lane_appr_num &&
+                    o.timestamp < r.timestamp) {
+                old = pending.erase(old);
+                incompleteCount++;
+            } else {
+                ++old;
+            }
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief ApproachAggregator::verify: Compares the sensor's own approach
+ * interval with the one derived from its lanes for the same timestamp
+ * @param sensorRec: request type 2 interval
+ */
+void ApproachAggregator::verify(const interval_record &sensorRec)
+{
+    QHash<quint32, interval_record>::const_iterator it =
+            lastDerived.constFind(interval_key(sensorRec.sensor_id, 2, sensorRec.lane_appr_num));
+    if (it == lastDerived.constEnd() || it.value().timestamp != sensorRec.timestamp) {
+        return;
+    }
+    const interval_record &d = it.value();
+    compared++;
+
+    qint64 volumeErr = static_cast<qint64>(d.volume) - sensorRec.volume;
+    absVolumeError += llabs(volumeErr);
+    if (volumeErr != 0) {
+        volumeMismatches++;
+    }
+    int speedErr = 0;
+    if ((d.avg_speed & 0x800000) && (sensorRec.avg_speed & 0x800000)) {
+        speedErr = static_cast<int>(d.avg_speed & 0x7FFFFF) -
+                static_cast<int>(sensorRec.avg_speed & 0x7FFFFF);
+        absSpeedError += abs(speedErr) / 256.0;
+    }
+    if (abs(speedErr) > APPROACH_SPEED_TOLERANCE) {
+        speedMismatches++;
+    }
+    absOccupancyError += abs(static_cast<int>(d.avg_occupancy) -
+                             static_cast<int>(sensorRec.avg_occupancy)) / 256.0;
+
+    if (volumeErr != 0 || abs(speedErr) > APPROACH_SPEED_TOLERANCE) {
+        printf("Approach %u at %lld: derived volume %u speed %.1f, sensor volume %u speed %.1f\n",
+               sensorRec.lane_appr_num, static_cast<long long>(sensorRec.timestamp),
+               d.volume, (d.avg_speed & 0x7FFFFF) / 256.0,
+               sensorRec.volume, (sensorRec.avg_speed & 0x7FFFFF) / 256.0);
+    }
+    if (compared % APPROACH_REPORT_EVERY == 0) {
+        report();
+    }
+}
+
+void ApproachAggregator::report() const
+{
+    printf("Approach check: %lld intervals compared, %lld volume and %lld speed mismatches\n",
+           compared, volumeMismatches, speedMismatches);
+    printf("  mean abs error: volume %.2f, speed %.2f, occupancy %.2f%%; "
+           "%lld derived, %lld left incomplete\n",
+           static_cast<double>(absVolumeError) / compared, absSpeedError / compared,
+           absOccupancyError / compared, derivedCount, incompleteCount);
+}
@@ -0,0 +1,52 @@
+#ifndef APPROACHAGGREGATOR_H
+#define APPROACHAGGREGATOR_H
+
+#include <QHash>
+#include <QVector>
+
+#include "rollupengine.h"
+#include "sensor_utils.h"
+
+// Builds approach intervals out of lane intervals using the lane-to-approach
+// mapping from parse_approach_info_read_resp, so polling all lanes is enough
+// and the approach half of a request type 3 poll can be dropped. An approach
+// interval is complete once every lane assigned to it has reported that
+// interval; lanes are combined the way interval_sum combines intervals.
+// With verification on, derived intervals are held back and compared with
+// the sensor's own approach intervals instead.
+class ApproachAggregator
+{
+public:
+    ApproachAggregator();
+    void setApproaches(uint16_t sensorId, const approach *appr, int numApproaches);
+    bool hasApproaches(uint16_t sensorId) const;
+    void setVerify(bool on);
+    bool verifying() const;
+    int add(const interval_record &laneRec, QVector<interval_record> *derived);
+    void verify(const interval_record &sensorRec);
+
+private:
+    struct pending_approach {
+        interval_sum sum;
+        quint64 lanesSeen;      // bit per position in the approach's lane list
+    };
+
+    static quint64 pendingKey(uint16_t sensorId, int approachIdx, qint64 timestamp);
+    void report() const;
+
+    QHash<uint16_t, QVector<QVector<uint8_t> > > lanesOf;
+    QHash<quint64, pending_approach> pending;
+    QHash<quint32, interval_record> lastDerived;
+    bool verifyOn;
+
+    qint64 derivedCount;
+    qint64 incompleteCount;
+    qint64 compared;
+    qint64 volumeMismatches;
+    qint64 speedMismatches;
+    qint64 absVolumeError;
+    double absSpeedError;
+    double absOccupancyError;
+};
+
+#endif // APPROACHAGGREGATOR_H
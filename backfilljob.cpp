@@ -0,0 +1,465 @@
+#include "backfilljob.h"
+#include "commands.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QSaveFile>
+#include <QStringList>
+#include <QTextStream>
+
+// consecutive missing intervals before the stride starts doubling
+#define BACKFILL_MISS_RUN 8
+
+BackfillJob::BackfillJob(qint64 from, qint64 to, const QString &checkpointName,
+                         QObject *parent) : QObject(parent)
+{
+    rangeFrom = from;
+    rangeTo = to;
+    checkpointFile = checkpointName;
+    pipeline = nullptr;
+    intervalsDone = 0;
+    requestsSent = 0;
+    SmCommsGenerateCrc8Table(crc8Table, COMMS_CRC8_TABLE_LENGTH);
+
+    connect(&checkpointTimer, &QTimer::timeout, this, &BackfillJob::saveCheckpoint);
+    wakeTimer.setSingleShot(true);
+    connect(&wakeTimer, &QTimer::timeout, this, &BackfillJob::wake);
+}
+
+void BackfillJob::setPipelinePtr(IntervalPipeline *p)
+{
+    pipeline = p;
+}
+
+void BackfillJob::addTarget(const backfill_target &t)
+{
+    target_state s;
+    s.target = t;
+    if (s.target.interval_duration == 0) {
+        s.target.interval_duration = 60;
+    }
+    // intervals sit on multiples of their duration
+    qint64 d = s.target.interval_duration;
+    s.cursor = ((rangeFrom + d - 1) / d) * d;
+    s.lowWater = s.cursor;
+    s.stride = 1;
+    s.missRun = 0;
+    s.backoffUntil = 0;
+    s.backoffMs = 0;
+    s.finished = false;
+    targets.append(s);
+
+    if (!links.contains(t.link)) {
+        links.append(t.link);
+        roundRobin[t.link] = 0;
+        connect(t.link, &SensorLink::responseReady, this, &BackfillJob::onResponse);
+        connect(t.link, &SensorLink::requestTimedOut, this, &BackfillJob::onTimeout);
+    }
+}
+
+quint64 BackfillJob::pendingKey(SensorLink *link, int tag) const
+{
+    return (static_cast<quint64>(links.indexOf(link)) << 32) | static_cast<quint32>(tag);
+}
+
+void BackfillJob::start()
+{
+    loadCheckpoint();
+    for (int i=0; i<targets.size(); i++) {
+        target_state &s = targets[i];
+        quint32 key = interval_key(s.target.sensor_id, s.target.request_type,
+                                   s.target.lane_appr_num);
+        if (checkpoint.value(key, -1) > s.cursor) {
+            s.cursor = checkpoint.value(key);
+            s.lowWater = s.cursor;
+        }
+    }
+
+    printf("Backfill: %d sensors over %d links, %s to %s\n",
+           targets.size(), links.size(),
+           QDateTime::fromSecsSinceEpoch(rangeFrom, Qt::UTC)
+               .toString("MM/dd/yyyy hh:mm").toLatin1().constData(),
+           QDateTime::fromSecsSinceEpoch(rangeTo, Qt::UTC)
+               .toString("MM/dd/yyyy hh:mm").toLatin1().constData());
+
+    elapsed.start();
+    checkpointTimer.start(5000);
+    for (int i=0; i<links.size(); i++) {
+        fill(links.at(i));
+    }
+    checkFinished();
+}
+
+/**
+ * @brief BackfillJob::fill: Tops up a link's request window, taking turns
+ * between the sensors on it
+ * @param link
+ */
+void BackfillJob::fill(SensorLink *link)
+{
+    while (link->inFlight() + link->queued() < link->windowSize()) {
+        bool sent = false;
+        int n = targets.size();
+        for (int k=0; k<n && !sent; k++) {
+            int i = (roundRobin.value(link) + k) % n;
+            target_state &s = targets[i];
+            if (s.target.link != link || s.finished) {
+                continue;
+            }
+            qint64 ts;
+            if (!nextSlot(i, &ts)) {
+                continue;
+            }
+
+            QByteArray msg = getVarSizeIntervalDataByTimestamp(
+                        crc8Table, s.target.request_type, s.target.sensor_id, 0, 0,
+                        QDateTime::fromSecsSinceEpoch(ts, Qt::UTC),
+                        s.target.lane_appr_num);
+            int tag = link->send(msg, s.target.frames_per_interval);
+            pending_request p;
+            p.target = i;
+            p.ts = ts;
+            pending[pendingKey(link, tag)] = p;
+            requestsSent++;
+            roundRobin[link] = (i + 1) % n;
+            sent = true;
+        }
+        if (!sent) {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief BackfillJob::nextSlot: Picks the next interval to request for a sensor
+ * @param target
+ * @param ts: interval start, UTC seconds
+ * @return false if there is nothing to send right now
+ */
+bool BackfillJob::nextSlot(int target, qint64 *ts)
+{
+    target_state *s = &targets[target];
+    if (s->backoffUntil > QDateTime::currentMSecsSinceEpoch()) {
+        return false;
+    }
+    qint64 d = s->target.interval_duration;
+    // the last interval in the range, so a hop never runs off the end
+    qint64 last = ((rangeTo - 1) / d) * d;
+
+    if (!s->retry.isEmpty()) {
+        *ts = s->retry.takeFirst();
+        return true;
+    }
+
+    while (s->cursor < rangeTo) {
+        qint64 t = s->cursor;
+        if (pipeline != nullptr) {
+            // intervals already stored don't need asking for again
+            qint64 next = pipeline->firstMissing(s->target.sensor_id,
+                                                 s->target.request_type,
+                                                 s->target.lane_appr_num, t, d);
+            if (next > t) {
+                // a stored interval at the end of a hop counts as data
+                settleProbe(target, t, false);
+            }
+            for (; t<next && t<rangeTo; t+=d) {
+                s->done.insert(t);
+            }
+            if (t >= rangeTo) {
+                s->cursor = rangeTo;
+                break;
+            }
+        }
+        s->cursor = t + s->stride * d;
+        if (s->stride > 1 && t < last) {
+            // hopped-over intervals aren't known to be missing: they hold the
+            // low-water mark back until the probes either side have answered
+            s->cursor = qMin(s->cursor, last);
+            s->hops[t] = s->cursor;
+        }
+        *ts = t;
+        return true;
+    }
+    return false;
+}
+
+void BackfillJob::onResponse(int tag, QList<QByteArray> frames, uint16_t errorCode)
+{
+    SensorLink *link = qobject_cast<SensorLink*>(sender());
+    quint64 key = pendingKey(link, tag);
+    if (!pending.contains(key)) {
+        return;
+    }
+    pending_request p = pending.take(key);
+    target_state &s = targets[p.target];
+
+    if (errorCode == 0x0011) {
+        // FLASH busy: back off and ask again
+        s.backoffMs = s.backoffMs > 0 ? s.backoffMs * 2 : 100;
+        if (s.backoffMs > BACKFILL_MAX_BACKOFF_MS) {
+            s.backoffMs = BACKFILL_MAX_BACKOFF_MS;
+        }
+        s.backoffUntil = QDateTime::currentMSecsSinceEpoch() + s.backoffMs;
+        s.retry.prepend(p.ts);
+        if (!wakeTimer.isActive() || wakeTimer.remainingTime() > s.backoffMs) {
+            wakeTimer.start(s.backoffMs);
+        }
+    } else if (errorCode == 0x000F) {
+        // interval doesn't exist: skip it, and speed up over long outages
+        s.backoffMs = 0;
+        s.missRun++;
+        if (s.missRun >= BACKFILL_MISS_RUN && s.stride < BACKFILL_MAX_STRIDE) {
+            s.stride *= 2;
+        }
+        complete(p.target, p.ts);
+        settleProbe(p.target, p.ts, true);
+    } else if (errorCode != 0) {
+        printf("Backfill: sensor %u error %04X\n", s.target.sensor_id, errorCode);
+        retryLater(p.target, p.ts);
+    } else {
+        for (int i=0; i<frames.size(); i++) {
+            QByteArray frame = frames.at(i);
+            interval_record rec;
+            if (!parse_interval_data_resp(&frame, &rec)) {
+                continue;
+            }
+            rec.sensor_id = s.target.sensor_id;
+            if (s.target.request_type == 3) {
+                rec.request_type = (i < s.target.num_lanes) ? 1 : 2;
+            } else {
+                rec.request_type = s.target.request_type;
+            }
+            if (pipeline != nullptr) {
+                pipeline->ingest(rec);
+            }
+        }
+        s.backoffMs = 0;
+        s.missRun = 0;
+        s.stride = 1;
+        complete(p.target, p.ts);
+        // data is back: fetch what the hops next to it skipped over
+        settleProbe(p.target, p.ts, false);
+    }
+
+    fill(link);
+    checkFinished();
+}
+
+void BackfillJob::onTimeout(int tag)
+{
+    SensorLink *link = qobject_cast<SensorLink*>(sender());
+    quint64 key = pendingKey(link, tag);
+    if (!pending.contains(key)) {
+        return;
+    }
+    pending_request p = pending.take(key);
+    retryLater(p.target, p.ts);
+    fill(link);
+    checkFinished();
+}
+
+void BackfillJob::wake()
+{
+    for (int i=0; i<links.size(); i++) {
+        fill(links.at(i));
+    }
+    checkFinished();
+}
+
+void BackfillJob::retryLater(int target, qint64 ts)
+{
+    target_state &s = targets[target];
+    int n = ++s.attempts[ts];
+    if (n > BACKFILL_MAX_RETRIES) {
+        printf("Backfill: giving up on sensor %u at %s\n", s.target.sensor_id,
+               QDateTime::fromSecsSinceEpoch(ts, Qt::UTC)
+                   .toString("MM/dd/yyyy hh:mm:ss").toLatin1().constData());
+        complete(target, ts);
+        // nothing is known about this one, so a hop next to it gets fetched
+        settleProbe(target, ts, false);
+        return;
+    }
+    s.retry.append(ts);
+}
+
+void BackfillJob::complete(int target, qint64 ts)
+{
+    target_state &s = targets[target];
+    qint64 d = s.target.interval_duration;
+    s.attempts.remove(ts);
+    if (ts >= s.lowWater) {
+        s.done.insert(ts);
+    }
+    while (s.done.contains(s.lowWater)) {
+        s.done.remove(s.lowWater);
+        s.lowWater += d;
+    }
+
+    intervalsDone++;
+    if (intervalsDone % 1000 == 0) {
+        double secs = elapsed.elapsed() / 1000.0;
+        printf("Backfill: %lld intervals, %lld requests, %.0f intervals/s\n",
+               intervalsDone, requestsSent, secs > 0 ? intervalsDone / secs : 0.0);
+    }
+}
+
+/**
+ * @brief BackfillJob::hopEndingAt: Finds the hop whose far probe is ts
+ * @param s
+ * @param ts
+ * @return the hop's first probe, or -1 if no hop ends at ts
+ */
+qint64 BackfillJob::hopEndingAt(const target_state &s, qint64 ts) const
+{
+    QMap<qint64, qint64>::const_iterator it = s.hops.lowerBound(ts);
+    if (it == s.hops.constBegin()) {
+        return -1;
+    }
+    --it;
+    return (it.value() == ts) ? it.key() : -1;
+}
+
+/**
+ * @brief BackfillJob::settleProbe: Records the answer to a probe that bounds a
+ * hop and settles the hops on either side of it that now can be
+ * @param target
+ * @param ts
+ * @param missing: true if the sensor has no such interval
+ */
+void BackfillJob::settleProbe(int target, qint64 ts, bool missing)
+{
+    target_state &s = targets[target];
+    qint64 before = hopEndingAt(s, ts);
+    if (before < 0 && !s.hops.contains(ts)) {
+        return;
+    }
+    s.probeMissing[ts] = missing;
+    if (before >= 0) {
+        settleHop(target, before);
+    }
+    settleHop(target, ts);
+}
+
+/**
+ * @brief BackfillJob::settleHop: Once both probes around a hop have answered,
+ * takes the hopped-over intervals as missing if both were, or queues them to
+ * be asked for one by one otherwise
+ * @param target
+ * @param start: the hop's first probe
+ */
+void BackfillJob::settleHop(int target, qint64 start)
+{
+    target_state &s = targets[target];
+    if (!s.hops.contains(start)) {
+        return;
+    }
+    qint64 end = s.hops.value(start);
+    if (!s.probeMissing.contains(start) || !s.probeMissing.contains(end)) {
+        return;
+    }
+    bool outage = s.probeMissing.value(start) && s.probeMissing.value(end);
+    s.hops.remove(start);
+
+    qint64 d = s.target.interval_duration;
+    for (qint64 h=start+d; h<end; h+=d) {
+        if (outage) {
+            complete(target, h);
+        } else {
+            s.retry.append(h);
+        }
+    }
+    // answers stay around only while a hop still needs them
+    if (hopEndingAt(s, start) < 0) {
+        s.probeMissing.remove(start);
+    }
+    if (!s.hops.contains(end)) {
+        s.probeMissing.remove(end);
+    }
+}
+
+int BackfillJob::pendingFor(int target) const
+{
+    int n = 0;
+    QHash<quint64, pending_request>::const_iterator it;
+    for (it = pending.constBegin(); it != pending.constEnd(); ++it) {
+        if (it.value().target == target) {
+            n++;
+        }
+    }
+    return n;
+}
+
+void BackfillJob::checkFinished()
+{
+    bool allDone = true;
+    for (int i=0; i<targets.size(); i++) {
+        target_state &s = targets[i];
+        if (!s.finished && s.cursor >= rangeTo && s.hops.isEmpty() &&
+                s.retry.isEmpty() && pendingFor(i) == 0) {
+            s.finished = true;
+            s.lowWater = rangeTo;
+        }
+        allDone = allDone && s.finished;
+    }
+    if (!allDone) {
+        return;
+    }
+
+    checkpointTimer.stop();
+    wakeTimer.stop();
+    saveCheckpoint();
+    double secs = elapsed.elapsed() / 1000.0;
+    printf("Backfill finished: %lld intervals with %lld requests in %.1f s\n",
+           intervalsDone, requestsSent, secs);
+    emit finished();
+}
+
+void BackfillJob::loadCheckpoint()
+{
+    QFile f(checkpointFile);
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return;
+    }
+    QTextStream in(&f);
+
+    // only a checkpoint for the same range applies
+    QStringList range = in.readLine().split(' ');
+    if (range.size() != 3 || range.at(0) != "range" ||
+            range.at(1).toLongLong() != rangeFrom || range.at(2).toLongLong() != rangeTo) {
+        return;
+    }
+    while (!in.atEnd()) {
+        QStringList fields = in.readLine().split(' ');
+        if (fields.size() != 4) {
+            continue;
+        }
+        quint32 key = interval_key(static_cast<uint16_t>(fields.at(0).toUInt()),
+                                   static_cast<uint8_t>(fields.at(1).toUInt()),
+                                   static_cast<uint8_t>(fields.at(2).toUInt()));
+        checkpoint[key] = fields.at(3).toLongLong();
+    }
+    printf("Backfill: resuming %d sensors from %s\n", checkpoint.size(),
+           checkpointFile.toLatin1().constData());
+}
+
+/**
+ * @brief BackfillJob::saveCheckpoint: Writes each sensor's low-water mark,
+ * replacing the old checkpoint atomically
+ */
+void BackfillJob::saveCheckpoint()
+{
+    QSaveFile f(checkpointFile);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        return;
+    }
+    QTextStream out(&f);
+    out << "range " << rangeFrom << " " << rangeTo << "\n";
+    for (int i=0; i<targets.size(); i++) {
+        const target_state &s = targets.at(i);
+        out << s.target.sensor_id << " " << static_cast<int>(s.target.request_type)
+            << " " << static_cast<int>(s.target.lane_appr_num) << " "
+            << s.lowWater << "\n";
+    }
+    out.flush();
+    f.commit();
+}
@@ -0,0 +1,116 @@
+#ifndef BACKFILLJOB_H
+#define BACKFILLJOB_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QTimer>
+
+#include "intervalpipeline.h"
+#include "sensorlink.h"
+#include "sensor_utils.h"
+
+#define BACKFILL_MAX_RETRIES 3
+#define BACKFILL_MAX_BACKOFF_MS 5000
+#define BACKFILL_MAX_STRIDE 64
+
+// one sensor (and lane/approach selection) to backfill over a link
+struct backfill_target {
+    SensorLink *link;
+    uint16_t sensor_id;
+    uint8_t request_type;
+    uint8_t lane_appr_num;
+    int frames_per_interval;
+    uint8_t num_lanes;      // request type 3: frames before this are lanes
+    uint16_t interval_duration;
+};
+
+// Walks [from, to) for a set of sensors with 0x74 requests, keeping every
+// link's request window full and round-robining between the sensors that
+// share a link. Decoded intervals go through the pipeline like real-time ones.
+//  - 0x0011 (FLASH busy): the interval is retried after an exponential backoff
+//  - 0x000F (no such interval): skipped; after a run of them the stride
+//    doubles to hop over outages. When the probes on both sides of a hop come
+//    back 0x000F the hopped-over intervals are taken as missing too; when
+//    either side has data they are requested one by one
+// Progress (everything before each sensor's low-water mark is stored or known
+// to be missing) is checkpointed to a file, so a rerun over the same range
+// picks up from there. Unsettled hops hold the mark back.
+class BackfillJob : public QObject
+{
+    Q_OBJECT
+public:
+    BackfillJob(qint64 from, qint64 to, const QString &checkpointName,
+                QObject *parent = nullptr);
+    void addTarget(const backfill_target &t);
+    void setPipelinePtr(IntervalPipeline *p);
+    void start();
+
+signals:
+    void finished();
+
+private slots:
+    void onResponse(int tag, QList<QByteArray> frames, uint16_t errorCode);
+    void onTimeout(int tag);
+    void saveCheckpoint();
+    void wake();
+
+private:
+    struct target_state {
+        backfill_target target;
+        qint64 cursor;
+        qint64 lowWater;
+        QSet<qint64> done;
+        QList<qint64> retry;
+        QMap<qint64, qint64> hops;      // probe -> next probe, intervals between skipped
+        QHash<qint64, bool> probeMissing;  // answers for probes bounding a hop
+        QHash<qint64, int> attempts;
+        int stride;
+        int missRun;
+        qint64 backoffUntil;
+        int backoffMs;
+        bool finished;
+    };
+
+    struct pending_request {
+        int target;
+        qint64 ts;
+    };
+
+    quint64 pendingKey(SensorLink *link, int tag) const;
+
+    void loadCheckpoint();
+    void fill(SensorLink *link);
+    bool nextSlot(int target, qint64 *ts);
+    void complete(int target, qint64 ts);
+    void settleProbe(int target, qint64 ts, bool missing);
+    void settleHop(int target, qint64 start);
+    qint64 hopEndingAt(const target_state &s, qint64 ts) const;
+    void retryLater(int target, qint64 ts);
+    void checkFinished();
+    int pendingFor(int target) const;
+
+    qint64 rangeFrom;
+    qint64 rangeTo;
+    QString checkpointFile;
+    uint8_t crc8Table[COMMS_CRC8_TABLE_LENGTH];
+    IntervalPipeline *pipeline;
+
+    QList<target_state> targets;
+    QList<SensorLink*> links;
+    QHash<SensorLink*, int> roundRobin;
+    QHash<quint64, pending_request> pending;
+    QHash<quint32, qint64> checkpoint;
+    QTimer checkpointTimer;
+    QTimer wakeTimer;
+
+    qint64 intervalsDone;
+    qint64 requestsSent;
+    QElapsedTimer elapsed;
+};
+
+#endif // BACKFILLJOB_H
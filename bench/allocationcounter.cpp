@@ -0,0 +1,122 @@
+#include "allocationcounter.h"
+
+#include <atomic>
+#include <errno.h>
+#include <stddef.h>
+
+#if defined(__GLIBC__)
+
+static std::atomic<bool> counting(false);
+static std::atomic<qint64> allocations(0);
+
+static inline void counted()
+{
+    if (counting.load(std::memory_order_relaxed)) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// glibc's allocator under its internal names; replacing malloc means
+// replacing free, calloc, realloc and the aligned allocators with it, so
+// every block is handed out and taken back by the same allocator
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void *__libc_valloc(size_t size);
+void *__libc_pvalloc(size_t size);
+void __libc_free(void *p);
+
+void *malloc(size_t size)
+{
+    counted();
+    return __libc_malloc(size);
+}
+
+void free(void *p)
+{
+    __libc_free(p);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    counted();
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+    counted();
+    return __libc_realloc(p, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    counted();
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    counted();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **p, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    counted();
+    void *m = __libc_memalign(alignment, size);
+    if (m == nullptr) {
+        return ENOMEM;
+    }
+    *p = m;
+    return 0;
+}
+
+void *valloc(size_t size)
+{
+    counted();
+    return __libc_valloc(size);
+}
+
+void *pvalloc(size_t size)
+{
+    counted();
+    return __libc_pvalloc(size);
+}
+}
+
+/**
+ * @brief allocation_counting: Starts (from zero) or stops counting
+ * @param on
+ */
+void allocation_counting(bool on)
+{
+    if (on) {
+        allocations.store(0);
+    }
+    counting.store(on);
+}
+
+qint64 allocation_count()
+{
+    return allocations.load();
+}
+
+#else
+
+void allocation_counting(bool on)
+{
+    Q_UNUSED(on)
+}
+
+qint64 allocation_count()
+{
+    return -1;
+}
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <QtGlobal>
+
+// Counts heap allocations (malloc, calloc, realloc, the aligned variants and
+// everything built on them, i.e. operator new and Qt's containers) while
+// switched on. Only linked into the benchmark programs, never the app: it
+// replaces glibc's whole malloc family with wrappers around glibc's own
+// allocator (__libc_*), so it needs glibc; the count stays -1 elsewhere.
+void allocation_counting(bool on);
+qint64 allocation_count();
+
+#endif // ALLOCATIONCOUNTER_H
@@ -0,0 +1,220 @@
+#include "allocationcounter.h"
+#include "recordformatter.h"
+
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+
+#include <string.h>
+
+// RTDATA formatting, QTextStream/QString against RecordFormatter, with heap
+// allocation counts. A program of its own so the app never links the
+// allocation counter.
+//   formatbench [records]
+
+// the app's fixed-point conversions (commands.cpp), so the old code formats
+// exactly what it did without pulling in the workers
+static double fixedPt24ToDouble(uint32_t t)
+{
+    if (t & 0x800000) {
+        uint16_t intPart = (t >> 8) & 0x7FFF;
+        double decPart = (t & 0xFF) / 256.0;
+        return (intPart + decPart);
+    } else {
+        return 3.125;
+    }
+}
+
+static float fixedPtToFloat(uint16_t t)
+{
+    uint8_t tI = t >> 8;
+    float tD = (t & 0x00FF) / 256.0;
+    return (static_cast<float>(tI) + tD);
+}
+
+/**
+ * @brief legacy_format: The workers' way of writing an interval before
+ * RecordFormatter, a QTextStream for the file and a QString for the data
+ * view, one field at a time. Only kept so format_benchmark() can compare
+ * against it.
+ * @param rec
+ * @param stream: the RTDATA stream
+ * @return the line for the data view
+ */
+static QString legacy_format(const interval_record &rec, QTextStream *stream)
+{
+    QString newDataLine;
+    QDateTime recTime = QDateTime::fromSecsSinceEpoch(rec.timestamp, Qt::UTC);
+    uint16_t year = recTime.date().year();
+    uint8_t month = recTime.date().month();
+    uint8_t day = recTime.date().day();
+    uint8_t hrs = recTime.time().hour();
+    uint8_t mins = recTime.time().minute();
+    uint8_t secs = recTime.time().second();
+
+    stream->setPadChar('0');
+    (*stream) << qSetFieldWidth(2) << month << "/" << day << "/" <<
+                 qSetFieldWidth(4) << year << " " <<
+                 qSetFieldWidth(2) << hrs << ":" << mins <<
+                 ":" << secs << " ";
+    QChar z = QChar(48);
+    QString q = QString("%1/%2/%3 %4:%5:%6").arg(month, 2, 10, z).arg(day, 2, 10, z).arg(year, 4).arg(hrs, 2, 10, z).arg(mins, 2, 10, z).arg(secs, 2, 10, z);
+    newDataLine.append(q);
+
+    (*stream) << qSetFieldWidth(6) << rec.interval_duration;
+    q = QString("%1").arg(rec.interval_duration, 6);
+    newDataLine.append(q);
+
+    (*stream) << qSetFieldWidth(2) << rec.num_lanes;
+    q = QString("%1").arg(rec.num_lanes, 2);
+    newDataLine.append(q);
+    (*stream) << rec.num_apprs;
+    q = QString("%1").arg(rec.num_apprs, 2);
+    newDataLine.append(q);
+
+    double avgSpeed = fixedPt24ToDouble(rec.avg_speed);
+    (*stream) << qSetFieldWidth(6) << avgSpeed;
+    q = QString("%1").arg(avgSpeed, 6);
+    newDataLine.append(q);
+
+    (*stream) << qSetFieldWidth(6) << rec.volume;
+    q = QString("%1").arg(rec.volume, 6);
+    newDataLine.append(q);
+
+    double avgOccupancy = static_cast<double>(fixedPtToFloat(rec.avg_occupancy));
+    (*stream) << qSetFieldWidth(5) << avgOccupancy;
+    q = QString("%1").arg(avgOccupancy, 5);
+    newDataLine.append(q);
+
+    double eightyFifthPctlSpeed = fixedPt24ToDouble(rec.speed_85);
+    (*stream) << qSetFieldWidth(4) << eightyFifthPctlSpeed;
+    q = QString("%1").arg(eightyFifthPctlSpeed, 4);
+    newDataLine.append(q);
+
+    (*stream) << rec.headway;
+    q = QString("%1").arg(rec.headway);
+    newDataLine.append(q);
+
+    (*stream) << rec.gap;
+    q = QString("%1").arg(rec.gap);
+    newDataLine.append(q);
+
+    int j;
+    for (j=0; j<rec.num_class_bins; j++) {
+        (*stream) << rec.class_bins[j];
+        newDataLine.append(QString("%1").arg(rec.class_bins[j]));
+    }
+    for (j=0; j<rec.num_speed_bins; j++) {
+        (*stream) << rec.speed_bins[j];
+        newDataLine.append(QString("%1").arg(rec.speed_bins[j]));
+    }
+    for (j=0; j<rec.num_dir_bins; j++) {
+        (*stream) << rec.dir_bins[j];
+        newDataLine.append(QString("%1").arg(rec.dir_bins[j]));
+    }
+
+    (*stream) << "\n\n";
+    newDataLine.append("\n\n");
+    return newDataLine;
+}
+
+/**
+ * @brief format_benchmark: Formats the same intervals the old way
+ * (QTextStream + QString) and with RecordFormatter, and prints ns and heap
+ * allocations per interval for each. Output goes to memory, flushed every
+ * 1000 intervals, so file I/O doesn't enter into it.
+ * @param records
+ */
+static void format_benchmark(int records)
+{
+    QVector<interval_record> recs(records);
+    for (int i=0; i<records; i++) {
+        interval_record &r = recs[i];
+        memset(&r, 0, sizeof(r));
+        r.sensor_id = 0x0168;
+        r.request_type = 1;
+        r.lane_appr_num = static_cast<uint8_t>(i % 4);
+        r.timestamp = 1700000000 + (i / 4) * 60;
+        r.interval_duration = 60;
+        r.num_lanes = 4;
+        r.num_apprs = 2;
+        r.avg_speed = 0x800000 | (static_cast<uint32_t>(40 + i % 30) << 8) | (i % 256);
+        r.volume = static_cast<uint32_t>(i % 50);
+        r.avg_occupancy = static_cast<uint16_t>(((i % 60) << 8) | (i % 256));
+        r.speed_85 = 0x800000 | (static_cast<uint32_t>(50 + i % 30) << 8);
+        r.headway = static_cast<uint32_t>(1000 + i % 5000);
+        r.gap = static_cast<uint32_t>(800 + i % 4000);
+        r.num_class_bins = 8;
+        r.num_speed_bins = 15;
+        for (int j=0; j<8; j++) {
+            r.class_bins[j] = static_cast<uint32_t>((i + j) % 20);
+        }
+        for (int j=0; j<15; j++) {
+            r.speed_bins[j] = static_cast<uint32_t>((i * 3 + j) % 20);
+        }
+    }
+
+    // old: QTextStream into the file buffer plus a QString per interval
+    QByteArray oldOut;
+    oldOut.reserve(1 << 20);
+    QTextStream stream(&oldOut, QIODevice::WriteOnly);
+    qint64 oldBytes = 0;
+    QElapsedTimer timer;
+    allocation_counting(true);
+    timer.start();
+    for (int i=0; i<records; i++) {
+        QString line = legacy_format(recs.at(i), &stream);
+        oldBytes += line.size();
+        if (i % 1000 == 999) {
+            stream.flush();
+            oldOut.resize(0);
+        }
+    }
+    stream.flush();
+    qint64 oldNs = timer.nsecsElapsed();
+    allocation_counting(false);
+    qint64 oldAllocs = allocation_count();
+
+    // new: one reused buffer, appended to the file buffer
+    RecordFormatter f;
+    QByteArray newOut;
+    newOut.reserve(1 << 20);
+    qint64 newBytes = 0;
+    allocation_counting(true);
+    timer.start();
+    for (int i=0; i<records; i++) {
+        newBytes += f.format(recs.at(i));
+        newOut.append(f.data(), f.size());
+        if (i % 1000 == 999) {
+            newOut.resize(0);
+        }
+    }
+    qint64 newNs = timer.nsecsElapsed();
+    allocation_counting(false);
+    qint64 newAllocs = allocation_count();
+
+    double n = records > 0 ? records : 1;
+    printf("Format benchmark, %d intervals (8 length bins, 15 speed bins):\n", records);
+    printf("  QTextStream + QString: %8.1f ns/interval, %6.1f allocations/interval\n",
+           oldNs / n, oldAllocs < 0 ? -1.0 : oldAllocs / n);
+    printf("  RecordFormatter:       %8.1f ns/interval, %6.1f allocations/interval\n",
+           newNs / n, newAllocs < 0 ? -1.0 : newAllocs / n);
+    if (oldAllocs < 0) {
+        printf("  (allocation counts need glibc)\n");
+    }
+    printf("  (%lld / %lld characters formatted)\n", oldBytes, newBytes);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QStringList args = a.arguments();
+    int records = (args.size() > 1) ? args.at(1).toInt() : 100000;
+    format_benchmark(records > 0 ? records : 100000);
+    return 0;
+}
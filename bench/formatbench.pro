@@ -0,0 +1,29 @@
+#-------------------------------------------------
+#
+# RTDATA formatting benchmark, built apart from RSSHD so the allocation
+# counter's malloc replacement never ends up in the app
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = formatbench
+TEMPLATE = app
+CONFIG += console c++17
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += ..
+
+SOURCES += \
+        allocationcounter.cpp \
+        formatbench.cpp \
+        ../recordformatter.cpp \
+        ../sensor_utils.cpp
+
+HEADERS += \
+        allocationcounter.h \
+        ../recordformatter.h \
+        ../sensor_utils.h
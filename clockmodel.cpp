@@ -0,0 +1,237 @@
+#include "clockmodel.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <QDateTime>
+
+ClockModel::ClockModel()
+{
+    correctOn = true;
+}
+
+/**
+ * @brief ClockModel::setCorrecting: Off only estimates; sensor clocks are
+ * never set
+ * @param on
+ */
+void ClockModel::setCorrecting(bool on)
+{
+    correctOn = on;
+}
+
+/**
+ * @brief ClockModel::addSample: Adds a reading of the sensor's clock and refits
+ * @param sentMs: host time the read was sent
+ * @param receivedMs: host time the answer came back
+ * @param sensorMs: the sensor's time in the answer, UTC milliseconds
+ * @return false if the reading was dropped as too slow to be useful
+ */
+bool ClockModel::addSample(uint16_t sensorId, qint64 sentMs, qint64 receivedMs,
+                           qint64 sensorMs)
+{
+    if (!clocks.contains(sensorId)) {
+        sensor_clock c;
+        c.minRttMs = -1;
+        c.sampleGapS = CLOCK_SAMPLE_MIN_S;
+        c.nextSampleMs = 0;
+        c.fitRefMs = 0;
+        c.fitOffsetMs = 0;
+        c.fitSlope = 0;
+        c.dropped = 0;
+        c.corrections = 0;
+        clocks[sensorId] = c;
+    }
+    sensor_clock &c = clocks[sensorId];
+
+    clock_sample s;
+    s.rttMs = static_cast<int>(receivedMs - sentMs);
+    s.hostMs = sentMs + s.rttMs / 2;
+    s.offsetMs = sensorMs - s.hostMs;
+
+    c.nextSampleMs = receivedMs + c.sampleGapS * 1000LL;
+    if (c.minRttMs < 0 || s.rttMs < c.minRttMs) {
+        c.minRttMs = s.rttMs;
+    }
+    if (s.rttMs > c.minRttMs * CLOCK_NOISY_RTT_FACTOR + CLOCK_NOISY_RTT_SLACK) {
+        c.dropped++;
+        return false;
+    }
+
+    // a reading that agrees with the prediction lets the next one wait longer
+    if (c.samples.size() >= CLOCK_MIN_FIT_SAMPLES &&
+            llabs(s.offsetMs - offsetMs(sensorId, s.hostMs)) < c.minRttMs / 2 + CLOCK_NOISY_RTT_SLACK) {
+        c.sampleGapS = qMin(c.sampleGapS * 2, CLOCK_SAMPLE_MAX_S);
+    } else {
+        c.sampleGapS = CLOCK_SAMPLE_MIN_S;
+    }
+    c.nextSampleMs = receivedMs + c.sampleGapS * 1000LL;
+
+    if (c.samples.size() == CLOCK_MAX_SAMPLES) {
+        c.samples.remove(0);
+    }
+    c.samples.append(s);
+    fit(&c);
+    report(sensorId, c);
+    return true;
+}
+
+/**
+ * @brief ClockModel::fit: Least squares line through the samples' offsets.
+ * Too few samples, or too short a span, give a flat line at their mean.
+ * @param c
+ */
+void ClockModel::fit(sensor_clock *c)
+{
+    int n = c->samples.size();
+    if (n == 0) {
+        return;
+    }
+    c->fitRefMs = c->samples.last().hostMs;
+    double sx = 0;
+    double sy = 0;
+    for (int i=0; i<n; i++) {
+        sx += c->samples.at(i).hostMs - c->fitRefMs;
+        sy += c->samples.at(i).offsetMs;
+    }
+    double mx = sx / n;
+    double my = sy / n;
+    double sxx = 0;
+    double sxy = 0;
+    for (int i=0; i<n; i++) {
+        double dx = (c->samples.at(i).hostMs - c->fitRefMs) - mx;
+        sxx += dx * dx;
+        sxy += dx * (c->samples.at(i).offsetMs - my);
+    }
+
+    double slope = 0;
+    if (n >= CLOCK_MIN_FIT_SAMPLES &&
+            c->fitRefMs - c->samples.first().hostMs >= CLOCK_MIN_FIT_SPAN_MS && sxx > 0) {
+        slope = sxy / sxx;
+        double maxSlope = CLOCK_MAX_DRIFT_PPM / 1e6;
+        if (slope > maxSlope) {
+            slope = maxSlope;
+        } else if (slope < -maxSlope) {
+            slope = -maxSlope;
+        }
+    }
+    c->fitSlope = slope;
+    c->fitOffsetMs = my - slope * mx;
+}
+
+/**
+ * @brief ClockModel::offsetMs: Predicted sensor time minus host time
+ * @param hostMs: host UTC milliseconds
+ * @return milliseconds, 0 for a sensor never read
+ */
+qint64 ClockModel::offsetMs(uint16_t sensorId, qint64 hostMs) const
+{
+    QHash<uint16_t, sensor_clock>::const_iterator it = clocks.constFind(sensorId);
+    if (it == clocks.constEnd() || it.value().samples.isEmpty()) {
+        return 0;
+    }
+    const sensor_clock &c = it.value();
+    return static_cast<qint64>(llround(c.fitOffsetMs + c.fitSlope * (hostMs - c.fitRefMs)));
+}
+
+/**
+ * @brief ClockModel::driftPpm
+ * @return how much faster the sensor's clock runs than ours, parts per million
+ */
+double ClockModel::driftPpm(uint16_t sensorId) const
+{
+    return clocks.value(sensorId).fitSlope * 1e6;
+}
+
+int ClockModel::roundTripMs(uint16_t sensorId) const
+{
+    QHash<uint16_t, sensor_clock>::const_iterator it = clocks.constFind(sensorId);
+    return (it == clocks.constEnd() || it.value().minRttMs < 0) ? 0 : it.value().minRttMs;
+}
+
+bool ClockModel::sampleDue(uint16_t sensorId, qint64 hostMs) const
+{
+    QHash<uint16_t, sensor_clock>::const_iterator it = clocks.constFind(sensorId);
+    return it == clocks.constEnd() || hostMs >= it.value().nextSampleMs;
+}
+
+/**
+ * @brief ClockModel::correctionDue: Whether the sensor clock should be set now
+ * @param hostMs: host UTC milliseconds
+ */
+bool ClockModel::correctionDue(uint16_t sensorId, qint64 hostMs) const
+{
+    if (!correctOn) {
+        return false;
+    }
+    QHash<uint16_t, sensor_clock>::const_iterator it = clocks.constFind(sensorId);
+    if (it == clocks.constEnd() || it.value().samples.isEmpty()) {
+        return false;
+    }
+    qint64 error = llabs(offsetMs(sensorId, hostMs));
+    if (error > CLOCK_STEP_MS) {
+        return true;
+    }
+    return it.value().samples.size() >= CLOCK_MIN_FIT_SAMPLES && error > CLOCK_CORRECT_MS;
+}
+
+/**
+ * @brief ClockModel::stepped: The sensor clock was set, moving it by stepMs;
+ * past readings are shifted to match so the drift fit carries on, and the
+ * next reading comes soon to confirm the step
+ * @param stepMs: new sensor time minus old sensor time
+ */
+void ClockModel::stepped(uint16_t sensorId, qint64 stepMs)
+{
+    if (!clocks.contains(sensorId)) {
+        return;
+    }
+    sensor_clock &c = clocks[sensorId];
+    for (int i=0; i<c.samples.size(); i++) {
+        c.samples[i].offsetMs += stepMs;
+    }
+    fit(&c);
+    c.corrections++;
+    c.sampleGapS = CLOCK_SAMPLE_MIN_S;
+    c.nextSampleMs = 0;
+}
+
+/**
+ * @brief ClockModel::forget: Drops a sensor's readings, e.g. after its clock
+ * was set by hand
+ */
+void ClockModel::forget(uint16_t sensorId)
+{
+    clocks.remove(sensorId);
+}
+
+void ClockModel::report(uint16_t sensorId, const sensor_clock &c) const
+{
+    printf("Sensor 0x%04X clock: offset %lld ms, drift %+.1f ppm, %d readings "
+           "(%lld dropped), next in %d s, %lld corrections\n",
+           sensorId, static_cast<long long>(llround(c.fitOffsetMs)), c.fitSlope * 1e6,
+           c.samples.size(), c.dropped, c.sampleGapS, c.corrections);
+}
+
+/**
+ * @brief sensor_time_msecs: A sensor date and time as UTC milliseconds
+ * @param d
+ * @return -1 if it isn't a valid date and time
+ */
+qint64 sensor_time_msecs(const sensor_datetime &d)
+{
+    QDateTime t(QDate(d.yr, d.mon, d.day), QTime(d.hrs, d.mins, d.secs, d.ms), Qt::UTC);
+    return t.isValid() ? t.toMSecsSinceEpoch() : -1;
+}
+
+void sensor_time_from_msecs(qint64 ms, sensor_datetime *d)
+{
+    QDateTime t = QDateTime::fromMSecsSinceEpoch(ms, Qt::UTC);
+    d->yr = static_cast<uint16_t>(t.date().year());
+    d->mon = static_cast<uint8_t>(t.date().month());
+    d->day = static_cast<uint8_t>(t.date().day());
+    d->hrs = static_cast<uint8_t>(t.time().hour());
+    d->mins = static_cast<uint8_t>(t.time().minute());
+    d->secs = static_cast<uint8_t>(t.time().second());
+    d->ms = static_cast<uint16_t>(t.time().msec());
+}
@@ -0,0 +1,75 @@
+#ifndef CLOCKMODEL_H
+#define CLOCKMODEL_H
+
+#include <QHash>
+#include <QVector>
+
+#include "sensor_utils.h"
+
+#define CLOCK_MAX_SAMPLES       32
+#define CLOCK_MIN_FIT_SAMPLES   3       // before drift is trusted or small errors corrected
+#define CLOCK_MIN_FIT_SPAN_MS   60000   // samples closer together than this give no drift
+#define CLOCK_MAX_DRIFT_PPM     500.0   // anything steeper is noise, not a crystal
+#define CLOCK_SAMPLE_MIN_S      60
+#define CLOCK_SAMPLE_MAX_S      3600
+#define CLOCK_CORRECT_MS        500     // predicted error that gets the clock set
+#define CLOCK_STEP_MS           5000    // this far off, it's set on the first reading
+#define CLOCK_NOISY_RTT_FACTOR  3       // reads this much slower than the fastest are dropped
+#define CLOCK_NOISY_RTT_SLACK   20
+
+// one reading of a sensor's clock (0x0E time read)
+struct clock_sample {
+    qint64 hostMs;      // midpoint of the read, host UTC milliseconds
+    qint64 offsetMs;    // sensor time minus hostMs
+    int rttMs;
+};
+
+// Where each sensor's clock is and how fast it runs, from occasional reads of
+// the sensor time rather than a read per second. The offset (sensor minus
+// host) is fitted against host time by least squares over the last
+// CLOCK_MAX_SAMPLES readings, so between readings the sensor time is
+// predicted from the offset plus the drift. Readings whose round trip is much
+// slower than the fastest seen are dropped, as their midpoint says little
+// about when the sensor sampled its clock. Readings start a minute apart and
+// back off to an hour as they keep agreeing. Once the predicted error passes
+// CLOCK_CORRECT_MS (or CLOCK_STEP_MS on the first reading), correctionDue()
+// tells the worker to set the sensor clock; stepped() then shifts the
+// history by the step so the drift estimate carries on.
+class ClockModel
+{
+public:
+    ClockModel();
+    void setCorrecting(bool on);
+    bool addSample(uint16_t sensorId, qint64 sentMs, qint64 receivedMs, qint64 sensorMs);
+    qint64 offsetMs(uint16_t sensorId, qint64 hostMs) const;
+    double driftPpm(uint16_t sensorId) const;
+    int roundTripMs(uint16_t sensorId) const;
+    bool sampleDue(uint16_t sensorId, qint64 hostMs) const;
+    bool correctionDue(uint16_t sensorId, qint64 hostMs) const;
+    void stepped(uint16_t sensorId, qint64 stepMs);
+    void forget(uint16_t sensorId);
+
+private:
+    struct sensor_clock {
+        QVector<clock_sample> samples;
+        int minRttMs;
+        int sampleGapS;
+        qint64 nextSampleMs;
+        qint64 fitRefMs;        // host time the fit is centred on
+        double fitOffsetMs;     // offset at fitRefMs
+        double fitSlope;        // offset change per host millisecond
+        qint64 dropped;
+        qint64 corrections;
+    };
+
+    static void fit(sensor_clock *c);
+    void report(uint16_t sensorId, const sensor_clock &c) const;
+
+    QHash<uint16_t, sensor_clock> clocks;
+    bool correctOn;
+};
+
+qint64 sensor_time_msecs(const sensor_datetime &d);
+void sensor_time_from_msecs(qint64 ms, sensor_datetime *d);
+
+#endif // CLOCKMODEL_H
@@ -952,7 +952,7 @@ int parse_approach_info_read_resp(QByteArray *response,
         if (j <= numApprConfigured) {
             a = approaches + j - 1;
             int nL = a->numLanes;
-            a->lanesAssigned = new uint8_t[2];
+            a->lanesAssigned = new uint8_t[nL > 0 ? nL : 1];
             uint8_t *p = a->lanesAssigned;
             for (i=0; i<nL; i++) {
                 *(p+i) = response->at(locn);
@@ -1157,13 +1157,153 @@ double doubleFrom24BitFixedPt(QByteArray *arr, int i)
     }
 }
 
+/**
+ * @brief extract24Bit: Helper function. Extracts an unsigned 24-bit big-endian field starting at location i. Make sure that i+2 < arr.size() before calling.
+ * @param arr
+ * @param i
+ * @return
+ */
+uint32_t extract24Bit(QByteArray *arr, int i)
+{
+    if (i+2 < arr->size()) {
+        uint32_t t1 = static_cast<uint32_t>(arr->at(i) & 0xFF) << 16;
+        uint32_t t2 = static_cast<uint32_t>(arr->at(i+1) & 0xFF) << 8;
+        uint32_t t3 = static_cast<uint32_t>(arr->at(i+2) & 0xFF);
+        return (t1 | t2 | t3);
+    } else {
+        return 0;
+    }
+}
+
+/**
+ * @brief fixedPt24ToDouble: Converts a raw 24-bit speed field (as kept in interval_record) the same way doubleFrom24BitFixedPt does, including the 3.125 marker for invalid speeds.
+ * @param t
+ * @return
+ */
+double fixedPt24ToDouble(uint32_t t)
+{
+    if (t & 0x800000) {
+        uint16_t intPart = (t >> 8) & 0x7FFF;
+        double decPart = (t & 0xFF) / 256.0;
+        return (intPart + decPart);
+    } else {
+        return 3.125;
+    }
+}
+
+/**
+ * @brief parse_interval_data_resp: Decodes one interval data (0x74) response into an interval_record. Speed and occupancy stay in the sensor's fixed-point format.
+ * @param response
+ * @param r
+ * @return false if the response is too short to contain an interval, isn't
+ * a 0x74 data response or carries an impossible date
+ */
+bool parse_interval_data_resp(QByteArray *response, interval_record *r)
+{
+    // header, fixed interval fields and body CRC
+    if (response->size() < 44) {
+        return false;
+    }
+    // "Z1" header; msg ID at 11, msg type at 13 (2 = result response)
+    if (response->at(0) != 'Z' || response->at(1) != '1' ||
+            static_cast<uint8_t>(response->at(11)) != 0x74 || response->at(13) == 2) {
+        return false;
+    }
+
+    uint8_t tmpHi;
+    uint8_t tmpLo;
+
+    // lane/approach number: byte 17
+    r->lane_appr_num = response->at(17);
+
+    // extract year
+    uint8_t y1 = response->at(18);
+    uint8_t y2 = response->at(19);
+
+    // fill up lower 8 bits
+    if (y1 & 0x1) {
+        // bit @ index 7 should be 1
+        tmpLo = (y2 >> 1) | 0x80;
+    } else {
+        // bit @ index 7 should be 0
+        tmpLo = (y2 >> 1) & 0x7F;
+    }
+    // upper 8 bits: index 1-5 from upper byte
+    tmpHi = (y1 & 0x1E) >> 1;
+    uint16_t year = (tmpHi << 8) | ((tmpLo & 0x00FF));
+
+    // get lower 3 bits of month
+    uint8_t month = (response->at(20) >> 5) & 0x7;
+    if (y2 & 0x1) {
+        // MSB is 1
+        month |= 0x8;
+    }
+
+    // extract day: lower 5 bits
+    uint8_t day = response->at(21) & 0x1F;
+
+    tmpLo = (response->at(19) & 0xC0) >> 6;
+    tmpHi = (response->at(18) & 0x07) << 2;
+    uint8_t hrs = (tmpHi | tmpLo);
+    uint8_t mins = (response->at(19) & 0x3F);
+    uint8_t secs = (response->at(20) & 0xFC) >> 2;
+
+    // milliseconds
+    tmpHi = (response->at(20) & 0x3);
+    r->ms = (tmpHi << 8) | (response->at(21) & 0x00FF);
+
+    QDateTime dt(QDate(year, month, day), QTime(hrs, mins, secs), Qt::UTC);
+    if (!dt.isValid()) {
+        return false;
+    }
+    r->timestamp = dt.toSecsSinceEpoch();
+
+    int locn = 22;
+    r->interval_duration = extract16BitFixedPt(response, locn);  locn += 2;
+
+    // num lanes & approaches configured, respectively
+    r->num_lanes = response->at(locn);                  locn++;
+    r->num_apprs = response->at(locn);                  locn++;
+
+    r->avg_speed = extract24Bit(response, locn);        locn += 3;
+    r->volume = extract24Bit(response, locn);           locn += 3;
+    r->avg_occupancy = extract16BitFixedPt(response, locn); locn += 2;
+    r->speed_85 = extract24Bit(response, locn);         locn += 3;
+    r->headway = extract24Bit(response, locn);          locn += 3;
+    r->gap = extract24Bit(response, locn);              locn += 3;
+    r->quality = 0;
+
+    r->num_class_bins = 0;
+    r->num_speed_bins = 0;
+    r->num_dir_bins = 0;
+
+    // optional bins: (type, count, count x 3-byte value), up to the body CRC
+    int bodyEnd = response->size() - 1;
+    while (locn + 1 < bodyEnd) {
+        uint8_t binType = response->at(locn);   locn++;
+        uint8_t numBins = response->at(locn);   locn++;
+        for (int j=0; j<numBins && locn + 2 < bodyEnd; j++) {
+            uint32_t count = extract24Bit(response, locn);
+            locn += 3;
+            if (binType == 0 && r->num_class_bins < MAX_CLASS_BINS) {
+                r->class_bins[r->num_class_bins++] = count;
+            } else if (binType == 1 && r->num_speed_bins < MAX_SPEED_BINS) {
+                r->speed_bins[r->num_speed_bins++] = count;
+            } else if (binType == 2 && r->num_dir_bins < MAX_DIR_BINS) {
+                r->dir_bins[r->num_dir_bins++] = count;
+            }
+        }
+    }
+    return true;
+}
+
 /**
  * @brief parse_classif_read_resp: Parses sensor response to a Classification Configuration Read message.
  * @param response: pointer to byte array of sensor response
- * @param bounds: pointer to array where classifications currently on the sensor will be stored
+ * @param bounds: resized to hold the classifications currently on the sensor
  * @param errString
  */
-void parse_classif_read_resp(QByteArray *response, double *bounds, int *nC, QString eS)
+void parse_classif_read_resp(QByteArray *response, QVector<double> *bounds, int *nC, QString eS)
 {
     // error handling
     if ((*response).at(0) == 'E') {
@@ -1181,8 +1321,9 @@ void parse_classif_read_resp(QByteArray *response, double *bounds, int *nC, QStr
         return;
     }
 
-    int numClasses = response->at(12);
+    int numClasses = static_cast<uint8_t>(response->at(12));
     *nC = numClasses;
+    bounds->resize(numClasses);
     printf("\nNum Classes: %u\n", numClasses);
 
     int i;
@@ -1207,12 +1348,12 @@ void parse_classif_read_resp(QByteArray *response, double *bounds, int *nC, QStr
 
         // store bound
         d = static_cast<double>(tI) + tD;
-        *(bounds + i) = d;
+        (*bounds)[i] = d;
         locn += 2;
     }
 
     for (i=0; i<numClasses; i++) {
-        printf("Boundary %u: %03.3f\n", i+1, *(bounds + i));
+        printf("Boundary %u: %03.3f\n", i+1, bounds->at(i));
     }
 }
 
@@ -1305,7 +1446,7 @@ QByteArray gen_classif_write(uint8_t *Crc8Table,
  */
 
 
-void parse_active_lane_info_read_resp(QByteArray *response, lane *laneArray, int *numConfd, QString eS)
+void parse_active_lane_info_read_resp(QByteArray *response, QVector<lane> *laneArray, int *numConfd, QString eS)
 {
     // error handling
     if ((*response).at(0) == 'E') {
@@ -1325,8 +1466,14 @@ void parse_active_lane_info_read_resp(QByteArray *response, lane *laneArray, int
 
     int numLanesReturned = response->at(12);
     int locn = 14;
-    int numActiveConfiguredLanes = response->at(14);
+    int numActiveConfiguredLanes = static_cast<uint8_t>(response->at(14));
     *numConfd = numActiveConfiguredLanes;
+    // every lane gets a description, freed by the caller
+    laneArray->resize(numActiveConfiguredLanes);
+    for (int i=0; i<numActiveConfiguredLanes; i++) {
+        (*laneArray)[i].description = new char[8]();
+        (*laneArray)[i].direction = ' ';
+    }
     locn += 3;
 
 //    printf("Num Lanes Returned: %u\t", numLanesReturned);
@@ -1335,17 +1482,13 @@ void parse_active_lane_info_read_resp(QByteArray *response, lane *laneArray, int
     // extract each lane's information
     for (int i=1; i<=numLanesReturned; i++) {
         if (i <= numActiveConfiguredLanes) {
-            lane l = *(laneArray + i - 1);
-            (void)l;    // to shut up compiler warnings
-
-            (laneArray+i-1)->description = new char[8];
             int strLocn = 0;
             if (response->at(locn) == 0) {
                 int j;
                 char onChar = 0;
                 for (j=0; j<16; j++) {
                     if (onChar) {
-                        *((laneArray+i-1)->description + strLocn) = response->at(locn);
+                        (*laneArray)[i-1].description[strLocn] = response->at(locn);
                         strLocn++;
                         locn++;
                         onChar = 0;
@@ -1356,7 +1499,7 @@ void parse_active_lane_info_read_resp(QByteArray *response, lane *laneArray, int
                 }
             char dir = response->at(locn);
             if (dir) { dir = 'L'; } else { dir = 'R'; }
-            (laneArray+i-1)->direction = dir;
+            (*laneArray)[i-1].direction = dir;
             locn++;
             }
         }
@@ -1545,7 +1688,7 @@ QByteArray gen_global_all_uart_push_mode_write(uint8_t *Crc8Table,
     return msg;
 }
 
-void parse_speed_bin_conf_read(QByteArray *resp, int *nBins, float *fArr, QString eS)
+void parse_speed_bin_conf_read(QByteArray *resp, int *nBins, QVector<float> *fArr, QString eS)
 {
     // error handling
     if ((*resp).at(0) == 'E') {
@@ -1563,15 +1706,16 @@ void parse_speed_bin_conf_read(QByteArray *resp, int *nBins, float *fArr, QStrin
         return;
     }
 
-    int numBinsDefined = resp->at(12);
+    int numBinsDefined = static_cast<uint8_t>(resp->at(12));
     *nBins = numBinsDefined;
+    fArr->resize(numBinsDefined);
 
     int i;
     int locn = 14;
     for (i=0; i<numBinsDefined; i++) {
         uint16_t threshold = extract16BitFixedPt(resp, locn);
         float f = fixedPtToFloat(threshold);
-        *(fArr + i) = f;
+        (*fArr)[i] = f;
         locn += 2;
     }
 }
@@ -1770,6 +1914,41 @@ QByteArray gen_offset_sensor_time(uint8_t *Crc8Table,
     return msg;
 }
 
+/**
+ * @brief encode_interval_timestamp: Packs a date and time into the 8 bytes the
+ * 0x74 request uses (date, then time, both big-endian bit fields)
+ * @param out: 8 bytes
+ * @param dt
+ */
+static void encode_interval_timestamp(char *out, const QDateTime &dt)
+{
+    unsigned int y = static_cast<unsigned int>(dt.date().year());
+    unsigned int m = static_cast<unsigned int>(dt.date().month());
+    unsigned int d = static_cast<unsigned int>(dt.date().day());
+    unsigned int h = static_cast<unsigned int>(dt.time().hour());
+    unsigned int min = static_cast<unsigned int>(dt.time().minute());
+    unsigned int sec = static_cast<unsigned int>(dt.time().second());
+    unsigned int ms = 0;
+
+    // 31-24: blank (spares)
+    out[0] = 0;
+    // 23-16: upper 3 are blank, lower 5 are part of year
+    out[1] = static_cast<char>((y >> 7) & 0x1F);
+    // 15-8: upper 7 are year, LSB contains upper bit of month
+    out[2] = static_cast<char>(((y & 0x7F) << 1) | ((m >> 3) & 0x01));
+    // 7-0: upper 3 are remainder of month, lower 5 contain day
+    out[3] = static_cast<char>(((m & 0x07) << 5) | (d & 0x1F));
+
+    // 31-24: upper 5 are spares, lower 3 are hours
+    out[4] = static_cast<char>((h & 0x1C) >> 2);
+    // 23-16: upper 2 are hours, lower 6 are minutes
+    out[5] = static_cast<char>(((h & 0x03) << 6) | (min & 0x3F));
+    // 15-8: upper 6 are seconds, lower 2 are for ms
+    out[6] = static_cast<char>(((sec & 0x3F) << 2) | ((ms & 0x0300) >> 8));
+    // 7-0: ms
+    out[7] = static_cast<char>(ms & 0xFF);
+}
+
 QByteArray getVarSizeIntervalDataByTimestamp(uint8_t *Crc8Table,
                                              uint8_t requestType,
                                              uint16_t destId,
@@ -1821,63 +2000,10 @@ QByteArray getVarSizeIntervalDataByTimestamp(uint8_t *Crc8Table,
     // msg type (1, read)
     msg.append(zero);
 
-    // date (4)
-    int yr =  dt.date().year();
-    int mo = dt.date().month();
-    int day =  dt.date().day();
-
-    uint8_t d = static_cast<uint8_t>((day >> 24) & 0x000000FF);
-    uint8_t m = static_cast<uint8_t>((mo  >> 24) & 0x000000FF);
-    uint16_t y = static_cast<uint16_t>((yr >> 8) & 0x0000FFFF);
-
-    // 31-24: blank (spares)
-    msg.append(zero);
-
-    // 23-16: upper 3 are blank, lower 5 are part of year
-    uint8_t tmp;
-    tmp = static_cast<uint8_t>((y >> 7) & 0x001F);
-    msg.append(tmp);
-
-    // 15-8: upper 7 are year, LSB contains upper bit of month
-    tmp = static_cast<uint8_t>((y) & 0x007F);
-    tmp <<= 1;
-    tmp |= (m >> 3);
-    msg.append(tmp);
-
-    // 7-0: upper 3 are remainder of month, lower 5 contain day
-    tmp = ((m) & 0x07) << 5;
-    tmp |= (d);
-    msg.append(tmp);
-
-    // time (4)
-    int hrs = dt.time().hour();
-    int mins = dt.time().minute();
-    int secs = dt.time().second();
-
-    uint8_t h = static_cast<uint8_t>((hrs >> 24) & 0x000000FF);
-    uint8_t min = static_cast<uint8_t>((mins >> 24) & 0x000000FF);
-    uint8_t sec = static_cast<uint8_t>((secs >> 24) & 0x000000FF);
-    uint16_t ms = 0;
-
-    // 31-24: upper 5 are spares, lower 3 are hours
-    tmp = ((h) & 0x1C) >> 2;
-    msg.append(tmp);
-
-    // 23-16: upper 2 are hours, lower 6 are minutes
-    tmp = ((h) & 0x03) << 6;
-    tmp |= min;
-    msg.append(tmp);
-
-    // 15-8: upper 6 are seconds, lower 2 are for ms
-    tmp = (sec) << 2;
-    uint8_t tmp2;
-    tmp2 = static_cast<uint8_t>(((ms) & 0x0300) >> 8);
-    msg.append((tmp | tmp2));
-
-    // 7-0: ms
-    tmp = static_cast<uint8_t>(ms & 0x00FF);
-    msg.append(tmp);
-
+    // date (4), time (4)
+    char stamp[8];
+    encode_interval_timestamp(stamp, dt);
+    msg.append(stamp, 8);
 
     // lane/approach number (1)
     msg.append(singleNum);
@@ -1889,6 +2015,32 @@ QByteArray getVarSizeIntervalDataByTimestamp(uint8_t *Crc8Table,
     return msg;
 }
 
+/**
+ * @brief set_interval_request_time: Points a 0x74 request from
+ * getVarSizeIntervalDataByTimestamp at another time. Only the timestamp bytes
+ * and the body CRC are rewritten.
+ * @param Crc8Table
+ * @param msg
+ * @param dt
+ * @return false if msg isn't a 0x74 request
+ */
+bool set_interval_request_time(uint8_t *Crc8Table, QByteArray *msg, QDateTime dt)
+{
+    if (msg->size() != 24 || msg->at(11) != 0x74) {
+        return false;
+    }
+    char *p = msg->data();
+    encode_interval_timestamp(p + 14, dt);
+
+    // body CRC covers bytes 11-22
+    unsigned char crc = 0x00;
+    for (int i=11; i<23; i++) {
+        crc = Crc8Table[crc ^ (p[i] & 0xFF)];
+    }
+    p[23] = static_cast<char>(crc);
+    return true;
+}
+
 void startRealTimeDataRetrieval(uint8_t reqType, uint8_t laneApprNum,
                                 uint8_t *Crc8Table,
                                 sensor_data_config *sDC,
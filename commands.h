@@ -6,6 +6,7 @@
 #include <QDateTime>
 #include <QSerialPort>
 #include <QTime>
+#include <QVector>
 #include "sensor_utils.h"
 #include "serialworker.h"
 
@@ -59,12 +60,12 @@ int parse_approach_info_read_resp(QByteArray *response,
 QByteArray gen_approach_info_write(uint8_t *Crc8Table, uint8_t numAppr,
                                    approach *aW, uint16_t dest_id);
 
-void parse_classif_read_resp(QByteArray *resp, double *bounds, int *nC, QString eS);
+void parse_classif_read_resp(QByteArray *resp, QVector<double> *bounds, int *nC, QString eS);
 
 QByteArray gen_classif_write(uint8_t *Crc8Table, uint16_t *bounds,
                              uint8_t numClasses, uint16_t dest_id);
 
-void parse_active_lane_info_read_resp(QByteArray *resp, lane *l, int *nC, QString eS);
+void parse_active_lane_info_read_resp(QByteArray *resp, QVector<lane> *l, int *nC, QString eS);
 
 QByteArray gen_active_lane_info_write(uint8_t *Crc8Table,lane *laneData,
                                       int numActiveLanes, uint16_t destId);
@@ -78,7 +79,7 @@ QByteArray gen_global_all_uart_push_mode_write(uint8_t *Crc8Table,
 QByteArray gen_speed_bin_conf_write(uint8_t *Crc8Table, uint16_t *bins,
                                     int numBins, uint16_t destId);
 
-void parse_speed_bin_conf_read(QByteArray *resp, int *nBins, float *fArr, QString eS);
+void parse_speed_bin_conf_read(QByteArray *resp, int *nBins, QVector<float> *fArr, QString eS);
 
 QByteArray gen_dir_bin_conf_write(uint8_t *Crc8Table, char dirBinEnabled,
                                   uint16_t destId);
@@ -95,6 +96,7 @@ QByteArray getVarSizeIntervalDataByTimestamp(uint8_t *Crc8Table,
                                              uint8_t seqNumber,
                                              QDateTime dt,
                                              uint8_t singleNum = 0);
+bool set_interval_request_time(uint8_t *Crc8Table, QByteArray *msg, QDateTime dt);
 void startRealTimeDataRetrieval(uint8_t reqType, uint8_t laneApprNum,
                                 uint8_t *Crc8Table,
                                 sensor_data_config *sd, uint16_t sensorId,
@@ -104,5 +106,9 @@ void startRealTimeDataRetrieval(uint8_t reqType, uint8_t laneApprNum,
 float fixedPtToFloat(uint16_t t);
 uint16_t extract16BitFixedPt(QByteArray *arr, int locn);
 double doubleFrom24BitFixedPt(QByteArray *arr, int i);
+uint32_t extract24Bit(QByteArray *arr, int i);
+double fixedPt24ToDouble(uint32_t t);
+
+bool parse_interval_data_resp(QByteArray *response, interval_record *r);
 
 #endif // COMMANDS_H
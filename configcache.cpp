@@ -0,0 +1,410 @@
+#include "configcache.h"
+#include "commands.h"
+
+#include <QAbstractSocket>
+#include <QDateTime>
+
+// answers come back in this order, the time read first so its round trip
+// isn't stretched by the reads queued ahead of it
+static const int SNAPSHOT_ORDER[CONFIG_NUM_ITEMS] = {
+    CONFIG_TIME, CONFIG_GENERAL, CONFIG_DATA, CONFIG_PUSH_MODE,
+    CONFIG_APPROACHES, CONFIG_LANES, CONFIG_CLASSES, CONFIG_SPEED_BINS
+};
+
+// read on every reconnect, even with a stored snapshot: what polling depends
+// on most and what other tools change most often
+#define NUM_VALIDATE_ITEMS 4
+static const int VALIDATE_ITEMS[NUM_VALIDATE_ITEMS] = {
+    CONFIG_TIME, CONFIG_GENERAL, CONFIG_DATA, CONFIG_LANES
+};
+
+ConfigCache::ConfigCache(QObject *parent) : QObject(parent)
+{
+    device = nullptr;
+    snapshotStore = nullptr;
+    link = nullptr;
+    sensorId = 0;
+    suspendDepth = 0;
+    snapshotting = false;
+    validating = false;
+    for (int i=0; i<CONFIG_NUM_ITEMS; i++) {
+        cached[i] = false;
+        pending[i] = false;
+        tags[i] = 0;
+        sentMs[i] = 0;
+        receivedMs[i] = 0;
+    }
+    SmCommsGenerateCrc8Table(crc8Table, COMMS_CRC8_TABLE_LENGTH);
+}
+
+void ConfigCache::setSnapshotStorePtr(SnapshotStore *s)
+{
+    snapshotStore = s;
+}
+
+/**
+ * @brief ConfigCache::attach: Starts caching for a newly connected sensor;
+ * anything cached for the previous one is dropped
+ * @param dev: open serial port or connected socket
+ * @param id: sensor id
+ */
+void ConfigCache::attach(QIODevice *dev, uint16_t id)
+{
+    detach();
+    device = dev;
+    sensorId = id;
+}
+
+void ConfigCache::detach()
+{
+    dropLink();
+    device = nullptr;
+    snapshotting = false;
+    validating = false;
+    for (int i=0; i<CONFIG_NUM_ITEMS; i++) {
+        cached[i] = false;
+        pending[i] = false;
+        responses[i].clear();
+    }
+}
+
+/**
+ * @brief ConfigCache::suspend: Hands the device over to blocking reads.
+ * Nests; requests wait until the matching resume().
+ */
+void ConfigCache::suspend()
+{
+    suspendDepth++;
+    dropLink();
+}
+
+void ConfigCache::resume()
+{
+    if (suspendDepth > 0) {
+        suspendDepth--;
+    }
+    if (suspendDepth == 0) {
+        for (int i=0; i<CONFIG_NUM_ITEMS; i++) {
+            if (pending[i]) {
+                send(i);
+            }
+        }
+    }
+}
+
+bool ConfigCache::suspended() const
+{
+    return suspendDepth > 0;
+}
+
+/**
+ * @brief ConfigCache::fetch: Asks for an item unless it is cached or already
+ * on its way; loaded() or failed() follows
+ * @param item: CONFIG_*
+ * @return true if the item is already cached
+ */
+bool ConfigCache::fetch(int item)
+{
+    if (item < 0 || item >= CONFIG_NUM_ITEMS) {
+        return false;
+    }
+    if (cached[item]) {
+        return true;
+    }
+    if (!pending[item]) {
+        pending[item] = true;
+        send(item);
+    }
+    return false;
+}
+
+void ConfigCache::prefetch()
+{
+    for (int i=0; i<CONFIG_NUM_ITEMS; i++) {
+        fetch(i);
+    }
+}
+
+/**
+ * @brief ConfigCache::snapshot: Reads the sensor's whole configuration again;
+ * snapshotReady() follows once every item has been answered (or has failed).
+ * The per-item loaded()/failed() signals are held back meanwhile.
+ */
+void ConfigCache::snapshot()
+{
+    snapshotting = true;
+    snapshotTimer.start();
+    for (int i=0; i<CONFIG_NUM_ITEMS; i++) {
+        cached[i] = false;
+        pending[i] = false;
+    }
+
+    // a sensor seen before may only need a few items checked
+    validating = snapshotStore != nullptr && snapshotStore->knows(sensorId);
+    if (validating) {
+        for (int i=0; i<NUM_VALIDATE_ITEMS; i++) {
+            pending[VALIDATE_ITEMS[i]] = true;
+        }
+        for (int i=0; i<NUM_VALIDATE_ITEMS; i++) {
+            send(VALIDATE_ITEMS[i]);
+        }
+        return;
+    }
+    sendRest();
+}
+
+/**
+ * @brief ConfigCache::sendRest: Asks for every item not read yet
+ */
+void ConfigCache::sendRest()
+{
+    for (int i=0; i<CONFIG_NUM_ITEMS; i++) {
+        int item = SNAPSHOT_ORDER[i];
+        if (!cached[item] && !pending[item]) {
+            pending[item] = true;
+            send(item);
+        }
+    }
+}
+
+/**
+ * @brief ConfigCache::current: Decodes whatever is cached
+ * @return snapshot of the cached items
+ */
+SensorSnapshot ConfigCache::current() const
+{
+    return SensorSnapshot::decode(sensorId, responses, cached,
+                                  sentMs[CONFIG_TIME], receivedMs[CONFIG_TIME],
+                                  snapshotTimer.isValid() ? snapshotTimer.elapsed() : 0);
+}
+
+/**
+ * @brief ConfigCache::forgetStored: Drops what the snapshot store holds for
+ * the connected sensor, after its configuration was written
+ */
+void ConfigCache::forgetStored()
+{
+    if (snapshotStore != nullptr && cached[CONFIG_GENERAL]) {
+        snapshotStore->forget(responses[CONFIG_GENERAL]);
+    }
+}
+
+/**
+ * @brief ConfigCache::persist: Updates the snapshot store with one item read
+ * again on its own
+ * @param item
+ */
+void ConfigCache::persist(int item)
+{
+    if (snapshotStore == nullptr) {
+        return;
+    }
+    bool only[CONFIG_NUM_ITEMS] = {};
+    only[item] = true;
+    only[CONFIG_GENERAL] = cached[CONFIG_GENERAL];
+    snapshotStore->save(sensorId, responses, only);
+}
+
+/**
+ * @brief ConfigCache::store: Caches a response read some other way (a
+ * blocking read while the link is suspended)
+ * @param item
+ * @param resp
+ */
+void ConfigCache::store(int item, const QByteArray &resp)
+{
+    if (item < 0 || item >= CONFIG_NUM_ITEMS) {
+        return;
+    }
+    responses[item] = resp;
+    cached[item] = true;
+    pending[item] = false;
+    tags[item] = 0;
+    receivedMs[item] = QDateTime::currentMSecsSinceEpoch();
+    persist(item);
+}
+
+void ConfigCache::invalidate(int item)
+{
+    if (item >= 0 && item < CONFIG_NUM_ITEMS) {
+        cached[item] = false;
+    }
+}
+
+bool ConfigCache::isCached(int item) const
+{
+    return item >= 0 && item < CONFIG_NUM_ITEMS && cached[item];
+}
+
+bool ConfigCache::isLoading(int item) const
+{
+    return item >= 0 && item < CONFIG_NUM_ITEMS && pending[item];
+}
+
+const QByteArray &ConfigCache::response(int item) const
+{
+    return responses[item];
+}
+
+QByteArray ConfigCache::requestFor(int item)
+{
+    switch (item) {
+    case CONFIG_APPROACHES:
+        return genReadMsg(crc8Table, 0x28, 4, sensorId);
+    case CONFIG_CLASSES:
+        return genReadMsg(crc8Table, 0x13, 0, sensorId);
+    case CONFIG_LANES:
+        return genReadMsg(crc8Table, 0x27, 10, sensorId);
+    case CONFIG_SPEED_BINS:
+        return genReadMsg(crc8Table, 0x1D, 15, sensorId);
+    case CONFIG_GENERAL:
+        return genReadMsg(crc8Table, 0x2A, 0, sensorId);
+    case CONFIG_DATA:
+        return genReadMsg(crc8Table, 0x03, 0, sensorId);
+    case CONFIG_PUSH_MODE:
+        return genReadMsg(crc8Table, 0x0D, 0, sensorId);
+    case CONFIG_TIME:
+        return genReadMsg(crc8Table, 0x0E, 0, sensorId);
+    default:
+        return QByteArray();
+    }
+}
+
+void ConfigCache::send(int item)
+{
+    if (device == nullptr || suspendDepth > 0 || tags[item] != 0) {
+        return;
+    }
+    if (link == nullptr) {
+        link = new SensorLink(device, this);
+        // one at a time keeps slow serial links simple; through a gateway
+        // every read costs a network round trip, so send them all at once
+        if (qobject_cast<QAbstractSocket *>(device) != nullptr) {
+            link->setWindow(CONFIG_NUM_ITEMS);
+        } else {
+            link->setWindow(1);
+        }
+        connect(link, &SensorLink::responseReady, this, &ConfigCache::responseReady);
+        connect(link, &SensorLink::requestTimedOut, this, &ConfigCache::requestTimedOut);
+    }
+    sentMs[item] = QDateTime::currentMSecsSinceEpoch();
+    tags[item] = link->send(requestFor(item));
+}
+
+/**
+ * @brief ConfigCache::dropLink: Takes the link off the device at once (it may
+ * be mid-signal, so it is deleted later); requests in flight stay pending
+ */
+void ConfigCache::dropLink()
+{
+    if (link == nullptr) {
+        return;
+    }
+    disconnect(link, nullptr, this, nullptr);
+    if (device != nullptr) {
+        disconnect(device, nullptr, link, nullptr);
+    }
+    link->deleteLater();
+    link = nullptr;
+    for (int i=0; i<CONFIG_NUM_ITEMS; i++) {
+        tags[i] = 0;
+    }
+}
+
+int ConfigCache::itemOf(int tag) const
+{
+    for (int i=0; i<CONFIG_NUM_ITEMS; i++) {
+        if (tags[i] == tag) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void ConfigCache::responseReady(int tag, QList<QByteArray> frames, uint16_t errorCode)
+{
+    int item = itemOf(tag);
+    if (item < 0) {
+        return;
+    }
+    tags[item] = 0;
+    pending[item] = false;
+    receivedMs[item] = QDateTime::currentMSecsSinceEpoch();
+    if (errorCode != 0 || frames.isEmpty()) {
+        if (!snapshotting) {
+            emit failed(item, QString("Sensor returned error %1").arg(errorCode));
+        }
+        answered();
+        return;
+    }
+    responses[item] = frames.first();
+    cached[item] = true;
+    if (!snapshotting) {
+        persist(item);
+        emit loaded(item);
+    }
+    answered();
+}
+
+void ConfigCache::requestTimedOut(int tag)
+{
+    int item = itemOf(tag);
+    if (item < 0) {
+        return;
+    }
+    tags[item] = 0;
+    pending[item] = false;
+    if (!snapshotting) {
+        emit failed(item, "Read timed out");
+    }
+    answered();
+}
+
+/**
+ * @brief ConfigCache::answered: Finishes an outstanding snapshot once the
+ * last of its items is in
+ */
+void ConfigCache::answered()
+{
+    if (!snapshotting) {
+        return;
+    }
+    for (int i=0; i<CONFIG_NUM_ITEMS; i++) {
+        if (pending[i]) {
+            return;
+        }
+    }
+
+    if (validating) {
+        validating = false;
+        bool checked = true;
+        for (int i=0; i<NUM_VALIDATE_ITEMS; i++) {
+            checked = checked && (VALIDATE_ITEMS[i] == CONFIG_TIME || cached[VALIDATE_ITEMS[i]]);
+        }
+        QByteArray stored[CONFIG_NUM_ITEMS];
+        if (checked && snapshotStore->lookup(responses, cached, stored)) {
+            for (int i=0; i<CONFIG_NUM_ITEMS; i++) {
+                if (i != CONFIG_TIME && !cached[i]) {
+                    responses[i] = stored[i];
+                    cached[i] = true;
+                }
+            }
+            snapshotting = false;
+            printf("Sensor %u: configuration unchanged, taken from the snapshot store\n",
+                   sensorId);
+            emit snapshotReady(current());
+            return;
+        }
+        if (cached[CONFIG_GENERAL]) {
+            // changed, stale or a different sensor: read the rest as well
+            sendRest();
+            return;
+        }
+    }
+
+    snapshotting = false;
+    if (snapshotStore != nullptr) {
+        snapshotStore->save(sensorId, responses, cached);
+    }
+    emit snapshotReady(current());
+}
@@ -0,0 +1,87 @@
+#ifndef CONFIGCACHE_H
+#define CONFIGCACHE_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QList>
+#include <QObject>
+#include <QString>
+
+#include "sensorlink.h"
+#include "sensorsnapshot.h"
+#include "snapshotstore.h"
+#include "sensor_utils.h"
+
+// Raw responses to the configuration reads behind the config tabs, fetched in
+// the background through a SensorLink on the connected port or socket so the
+// GUI thread never waits on the sensor. Everything is prefetched right after
+// connecting and kept until the item is invalidated (refresh buttons, writes)
+// or the connection closes. snapshot() reads every item at once after
+// connecting: on a socket the reads go out back to back so the whole
+// configuration costs about one round trip through the gateway, on a serial
+// port they still go one at a time. With a SnapshotStore, a sensor seen
+// before is only asked for its time, general and data configuration and its
+// lanes; if those still match what was stored, the stored responses stand in
+// for the rest. The
+// workers still talk to the same device with
+// blocking reads, so the link is taken down while they do (suspend()) and
+// whatever was in flight is sent again on resume().
+class ConfigCache : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ConfigCache(QObject *parent = nullptr);
+    void setSnapshotStorePtr(SnapshotStore *s);
+    void attach(QIODevice *dev, uint16_t sensorId);
+    void detach();
+    void suspend();
+    void resume();
+    bool suspended() const;
+    bool fetch(int item);
+    void prefetch();
+    void snapshot();
+    SensorSnapshot current() const;
+    void forgetStored();
+    void store(int item, const QByteArray &response);
+    void invalidate(int item);
+    bool isCached(int item) const;
+    bool isLoading(int item) const;
+    const QByteArray &response(int item) const;
+    QByteArray requestFor(int item);
+
+signals:
+    void loaded(int item);
+    void failed(int item, QString reason);
+    void snapshotReady(SensorSnapshot s);
+
+private slots:
+    void responseReady(int tag, QList<QByteArray> frames, uint16_t errorCode);
+    void requestTimedOut(int tag);
+
+private:
+    void dropLink();
+    void send(int item);
+    int itemOf(int tag) const;
+    void answered();
+    void sendRest();
+    void persist(int item);
+
+    QIODevice *device;
+    SnapshotStore *snapshotStore;
+    SensorLink *link;
+    uint16_t sensorId;
+    int suspendDepth;
+    QByteArray responses[CONFIG_NUM_ITEMS];
+    bool cached[CONFIG_NUM_ITEMS];
+    bool pending[CONFIG_NUM_ITEMS];     // wanted, not answered yet
+    int tags[CONFIG_NUM_ITEMS];         // SensorLink tag while in flight, else 0
+    qint64 sentMs[CONFIG_NUM_ITEMS];    // host time of the last send
+    qint64 receivedMs[CONFIG_NUM_ITEMS];
+    bool snapshotting;                  // snapshot() outstanding
+    bool validating;                    // only VALIDATE_ITEMS asked for yet
+    QElapsedTimer snapshotTimer;
+    uint8_t crc8Table[COMMS_CRC8_TABLE_LENGTH];
+};
+
+#endif // CONFIGCACHE_H
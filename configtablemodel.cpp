@@ -0,0 +1,62 @@
+#include "configtablemodel.h"
+
+ConfigTableModel::ConfigTableModel(const QStringList &headers, QObject *parent)
+    : QAbstractTableModel(parent)
+{
+    this->headers = headers;
+    rightAligned.fill(false, headers.size());
+}
+
+int ConfigTableModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : rows.size();
+}
+
+int ConfigTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : headers.size();
+}
+
+void ConfigTableModel::setRightAligned(int column)
+{
+    if (column >= 0 && column < rightAligned.size()) {
+        rightAligned[column] = true;
+    }
+}
+
+/**
+ * @brief ConfigTableModel::setRows: Replaces the whole table
+ * @param newRows: one string per column; missing cells show empty
+ */
+void ConfigTableModel::setRows(const QVector<QStringList> &newRows)
+{
+    beginResetModel();
+    rows = newRows;
+    endResetModel();
+}
+
+QVariant ConfigTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= rows.size()) {
+        return QVariant();
+    }
+    if (role == Qt::TextAlignmentRole) {
+        return rightAligned.at(index.column()) ?
+                    static_cast<int>(Qt::AlignRight | Qt::AlignVCenter) :
+                    static_cast<int>(Qt::AlignLeft | Qt::AlignVCenter);
+    }
+    if (role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    const QStringList &row = rows.at(index.row());
+    return index.column() < row.size() ? QVariant(row.at(index.column())) : QVariant();
+}
+
+QVariant ConfigTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole || orientation != Qt::Horizontal ||
+            section < 0 || section >= headers.size()) {
+        return QVariant();
+    }
+    return headers.at(section);
+}
@@ -0,0 +1,31 @@
+#ifndef CONFIGTABLEMODEL_H
+#define CONFIGTABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <QStringList>
+#include <QVector>
+
+// Read-only table for one list out of the sensor configuration (active lanes,
+// speed bins, classes). It holds as many rows as the last read returned, so
+// there is no fixed limit, and a refresh is a single model reset however many
+// rows change.
+class ConfigTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    explicit ConfigTableModel(const QStringList &headers, QObject *parent = nullptr);
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+    void setRightAligned(int column);
+    void setRows(const QVector<QStringList> &newRows);
+
+private:
+    QStringList headers;
+    QVector<bool> rightAligned;
+    QVector<QStringList> rows;
+};
+
+#endif // CONFIGTABLEMODEL_H
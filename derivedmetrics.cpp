@@ -0,0 +1,217 @@
+#include "derivedmetrics.h"
+
+#include <QElapsedTimer>
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// upper density of LOS A-E, passenger cars per mile (and per km) per lane
+static const float LOS_BOUNDS_US[LOS_NUM_BOUNDS] = { 11, 18, 26, 35, 45 };
+static const float LOS_BOUNDS_METRIC[LOS_NUM_BOUNDS] = { 7, 11, 16, 22, 28 };
+
+const float *los_bounds(bool metric)
+{
+    return metric ? LOS_BOUNDS_METRIC : LOS_BOUNDS_US;
+}
+
+/**
+ * @brief gather_interval_columns: Copies the inputs of the derived metrics
+ * out of a batch of records into float columns and sizes the outputs
+ * @param recs
+ * @param count
+ * @param c
+ */
+void gather_interval_columns(const interval_record *recs, int count,
+                             interval_columns *c)
+{
+    c->count = count;
+    c->volume.resize(count);
+    c->duration.resize(count);
+    c->speed.resize(count);
+    c->flow.resize(count);
+    c->density.resize(count);
+    c->los.resize(count);
+
+    float *volume = c->volume.data();
+    float *duration = c->duration.data();
+    float *speed = c->speed.data();
+    for (int i=0; i<count; i++) {
+        volume[i] = static_cast<float>(recs[i].volume);
+        duration[i] = recs[i].interval_duration;
+        speed[i] = (recs[i].avg_speed & 0x800000) ?
+                    (recs[i].avg_speed & 0x7FFFFF) / 256.0f : 0.0f;
+    }
+}
+
+// one interval; also finishes the rows the SSE2 kernel leaves over
+static void derivedMetricsRow(interval_columns *c, int i, const float *losBounds)
+{
+    float volume = c->volume.at(i);
+    float duration = c->duration.at(i);
+    float speed = c->speed.at(i);
+
+    float flow = duration > 0.0f ? volume * 3600.0f / duration : 0.0f;
+    float density;
+    if (speed > 0.0f) {
+        density = flow / speed;
+    } else {
+        density = volume > 0.0f ? -1.0f : 0.0f;
+    }
+    char los = 0;
+    if (density >= 0.0f) {
+        los = 'A';
+        for (int b=0; b<LOS_NUM_BOUNDS; b++) {
+            if (density > losBounds[b]) {
+                los++;
+            }
+        }
+    }
+    c->flow[i] = flow;
+    c->density[i] = density;
+    c->los[i] = los;
+}
+
+void compute_derived_metrics_scalar(interval_columns *c, const float *losBounds)
+{
+    for (int i=0; i<c->count; i++) {
+        derivedMetricsRow(c, i, losBounds);
+    }
+}
+
+/**
+ * @brief compute_derived_metrics: Fills the flow, density and los columns
+ * from the gathered inputs
+ * @param c: as filled by gather_interval_columns
+ * @param losBounds: los_bounds() for the sensor's units
+ */
+void compute_derived_metrics(interval_columns *c, const float *losBounds)
+{
+    int i = 0;
+#ifdef __SSE2__
+    const float *volume = c->volume.constData();
+    const float *duration = c->duration.constData();
+    const float *speed = c->speed.constData();
+    float *flowOut = c->flow.data();
+    float *densityOut = c->density.data();
+    char *losOut = c->los.data();
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 hour = _mm_set1_ps(3600.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 minusOne = _mm_set1_ps(-1.0f);
+    __m128 bounds[LOS_NUM_BOUNDS];
+    for (int b=0; b<LOS_NUM_BOUNDS; b++) {
+        bounds[b] = _mm_set1_ps(losBounds[b]);
+    }
+
+    for (; i+4<=c->count; i+=4) {
+        __m128 v = _mm_loadu_ps(volume + i);
+        __m128 d = _mm_loadu_ps(duration + i);
+        __m128 s = _mm_loadu_ps(speed + i);
+
+        // lanes with a zero divisor divide by one and are masked to their fallback
+        __m128 hasDuration = _mm_cmpgt_ps(d, zero);
+        __m128 flow = _mm_div_ps(_mm_mul_ps(v, hour),
+                                 _mm_or_ps(_mm_and_ps(hasDuration, d),
+                                           _mm_andnot_ps(hasDuration, one)));
+        flow = _mm_and_ps(hasDuration, flow);
+
+        __m128 hasSpeed = _mm_cmpgt_ps(s, zero);
+        __m128 density = _mm_div_ps(flow, _mm_or_ps(_mm_and_ps(hasSpeed, s),
+                                                    _mm_andnot_ps(hasSpeed, one)));
+        __m128 unknown = _mm_and_ps(_mm_cmpgt_ps(v, zero), minusOne);
+        density = _mm_or_ps(_mm_and_ps(hasSpeed, density),
+                            _mm_andnot_ps(hasSpeed, unknown));
+
+        // each bound exceeded adds one (compare masks are -1) to 'A'
+        __m128i los = _mm_set1_epi32('A');
+        for (int b=0; b<LOS_NUM_BOUNDS; b++) {
+            los = _mm_sub_epi32(los, _mm_castps_si128(_mm_cmpgt_ps(density, bounds[b])));
+        }
+        los = _mm_and_si128(los, _mm_castps_si128(_mm_cmpge_ps(density, zero)));
+
+        _mm_storeu_ps(flowOut + i, flow);
+        _mm_storeu_ps(densityOut + i, density);
+        int packed = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(los, los), los));
+        memcpy(losOut + i, &packed, 4);
+    }
+#endif
+    for (; i<c->count; i++) {
+        derivedMetricsRow(c, i, losBounds);
+    }
+}
+
+/**
+ * @brief derived_metrics_benchmark: Times the kernels over one poll cycle of
+ * many lanes, checks the vectorized results against the scalar ones and
+ * prints how much of a core it takes to keep up with the sensors
+ * @param lanes
+ */
+void derived_metrics_benchmark(int lanes)
+{
+    const int cycles = 200;
+    const int intervalSecs = 20;
+
+    QVector<interval_record> recs(lanes);
+    for (int i=0; i<lanes; i++) {
+        interval_record &r = recs[i];
+        memset(&r, 0, sizeof(r));
+        r.sensor_id = static_cast<uint16_t>(1 + i / 8);
+        r.request_type = 1;
+        r.lane_appr_num = static_cast<uint8_t>(i % 8);
+        r.interval_duration = intervalSecs;
+        r.volume = static_cast<uint32_t>(i % 23);
+        r.avg_speed = (i % 17 == 0) ? 0 :
+                0x800000 | static_cast<uint32_t>((15 + i % 60) << 8 | (i * 37) % 256);
+    }
+
+    interval_columns simd, scalar;
+    qint64 ns[2] = { 0, 0 };
+    for (int mode=0; mode<2; mode++) {
+        interval_columns *c = (mode == 0) ? &simd : &scalar;
+        QElapsedTimer timer;
+        timer.start();
+        for (int k=0; k<cycles; k++) {
+            gather_interval_columns(recs.constData(), lanes, c);
+            if (mode == 0) {
+                compute_derived_metrics(c, los_bounds(false));
+            } else {
+                compute_derived_metrics_scalar(c, los_bounds(false));
+            }
+        }
+        ns[mode] = timer.nsecsElapsed();
+    }
+
+    int losDiffs = 0;
+    float maxDiff = 0.0f;
+    for (int i=0; i<lanes; i++) {
+        if (simd.los.at(i) != scalar.los.at(i)) {
+            losDiffs++;
+        }
+        float d = fabsf(simd.density.at(i) - scalar.density.at(i)) +
+                fabsf(simd.flow.at(i) - scalar.flow.at(i));
+        if (d > maxDiff) {
+            maxDiff = d;
+        }
+    }
+
+    double perInterval[2];
+    for (int mode=0; mode<2; mode++) {
+        perInterval[mode] = static_cast<double>(ns[mode]) / cycles / lanes;
+    }
+    // every lane delivers one interval per interval length
+    double needed = static_cast<double>(lanes) / intervalSecs;
+    printf("Derived metrics over %d lanes x %d cycles\n", lanes, cycles);
+#ifdef __SSE2__
+    printf("  SSE2:   %6.2f ns/interval\n", perInterval[0]);
+#else
+    printf("  (no SSE2, both runs are scalar)\n");
+#endif
+    printf("  scalar: %6.2f ns/interval\n", perInterval[1]);
+    printf("  %d lanes at %d s intervals: %.0f intervals/s, %.5f%% of a core\n",
+           lanes, intervalSecs, needed, needed * perInterval[0] / 1e7);
+    printf("  max flow+density difference %g, %d LOS differences\n", maxDiff, losDiffs);
+}
@@ -0,0 +1,35 @@
+#ifndef DERIVEDMETRICS_H
+#define DERIVEDMETRICS_H
+
+#include <QVector>
+
+#include "sensor_utils.h"
+
+#define LOS_NUM_BOUNDS 5
+
+// Flow rate, density and level of service of a batch of intervals, computed
+// column by column so the kernels run four intervals at a time with SSE2
+// (with a scalar version for other targets):
+//  - flow: vehicles per hour, volume * 3600 / duration
+//  - density: vehicles per mile (km with metric units), flow / speed; 0 with
+//    no vehicles, -1 when vehicles were counted without a valid speed
+//  - LOS: 'A' to 'F' from density against the HCM basic freeway segment
+//    thresholds, or 0 when density is unknown
+struct interval_columns {
+    int count;
+    QVector<float> volume;
+    QVector<float> duration;
+    QVector<float> speed;       // 0 when the speed isn't valid
+    QVector<float> flow;
+    QVector<float> density;
+    QVector<char> los;
+};
+
+void gather_interval_columns(const interval_record *recs, int count,
+                             interval_columns *c);
+void compute_derived_metrics(interval_columns *c, const float *losBounds);
+void compute_derived_metrics_scalar(interval_columns *c, const float *losBounds);
+const float *los_bounds(bool metric);
+void derived_metrics_benchmark(int lanes);
+
+#endif // DERIVEDMETRICS_H
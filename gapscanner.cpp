@@ -0,0 +1,288 @@
+#include "gapscanner.h"
+#include "commands.h"
+
+#include <QDateTime>
+#include <QTimer>
+
+// the longest a single gap fetch may wait for the sensor
+#define GAP_FETCH_TIMEOUT_MS 3000
+
+GapScanner::GapScanner(QObject *parent) : QObject(parent)
+{
+    pipeline = nullptr;
+    link = nullptr;
+    device = nullptr;
+    deadline = 0;
+    tag = 0;
+    gapsFound = 0;
+    gapsFilled = 0;
+    gapsUnavailable = 0;
+    gapsLost = 0;
+    fillLatencyMs = 0;
+    maxFillLatencyMs = 0;
+    SmCommsGenerateCrc8Table(crc8Table, COMMS_CRC8_TABLE_LENGTH);
+    clock.start();
+}
+
+void GapScanner::setPipelinePtr(IntervalPipeline *p)
+{
+    pipeline = p;
+}
+
+/**
+ * @brief GapScanner::watch: Starts (or keeps) checking a polled selection for
+ * missing intervals
+ * @param from: where polling started, UTC seconds; nothing before it is expected
+ */
+void GapScanner::watch(uint16_t sensorId, uint8_t requestType, uint8_t laneApprNum,
+                       uint16_t duration, int framesPerInterval, uint8_t numLanes,
+                       qint64 from)
+{
+    gap_grid g;
+    g.sensor_id = sensorId;
+    g.request_type = requestType;
+    g.lane_appr_num = laneApprNum;
+    g.duration = duration > 0 ? duration : 60;
+    g.frames_per_interval = framesPerInterval > 0 ? framesPerInterval : 1;
+    g.num_lanes = numLanes;
+    g.scanned_to = from;
+
+    // restarting the same selection keeps scanning where it left off
+    quint32 key = interval_key(sensorId, requestType, laneApprNum);
+    if (grids.contains(key) && grids.value(key).duration == g.duration) {
+        g.scanned_to = grids.value(key).scanned_to;
+    }
+    grids[key] = g;
+}
+
+/**
+ * @brief GapScanner::scan: Queues every interval on the grid between the last
+ * scan and `upTo` that isn't stored
+ * @param upTo: the poll cursor; intervals before it should all be stored by now
+ * @return number of new gaps
+ */
+int GapScanner::scan(uint16_t sensorId, uint8_t requestType, uint8_t laneApprNum,
+                     qint64 upTo)
+{
+    QHash<quint32, gap_grid>::iterator it =
+            grids.find(interval_key(sensorId, requestType, laneApprNum));
+    if (it == grids.end() || pipeline == nullptr) {
+        return 0;
+    }
+    gap_grid &g = it.value();
+    qint64 d = g.duration;
+
+    // anything older than the lookback is left to a backfill
+    qint64 t = g.scanned_to;
+    if (t < upTo - GAP_MAX_LOOKBACK_SECS) {
+        t = upTo - GAP_MAX_LOOKBACK_SECS;
+    }
+    t = ((t + d - 1) / d) * d;
+
+    int found = 0;
+    while (t < upTo) {
+        qint64 next = pipeline->firstUnindexed(g.sensor_id, g.request_type,
+                                               g.lane_appr_num, t, g.duration);
+        if (next >= upTo) {
+            break;
+        }
+        if (next != t) {
+            t = next;
+            continue;
+        }
+        gap_slot s;
+        s.grid = it.key();
+        s.timestamp = t;
+        s.foundMs = clock.elapsed();
+        s.attempts = 0;
+        slotQueue.append(s);
+        found++;
+        t += d;
+    }
+    if (upTo > g.scanned_to) {
+        g.scanned_to = upTo;
+    }
+
+    if (found > 0) {
+        gapsFound += found;
+        printf("Gap scan: %d missing intervals for sensor %u\n", found, g.sensor_id);
+    }
+    return found;
+}
+
+/**
+ * @brief GapScanner::fill: Starts fetching queued gaps, oldest first, one at
+ * a time and only while each fetch is sure to finish before the deadline.
+ * Returns at once; the fetches run from the event loop.
+ * @param dev: the worker's serial port or socket, only used from its thread
+ * @param deadlineMs: UTC milliseconds when the device is needed again
+ */
+void GapScanner::fill(QIODevice *dev, qint64 deadlineMs)
+{
+    if (link != nullptr && device != dev) {
+        pause();
+    }
+    device = dev;
+    deadline = deadlineMs;
+    if (link == nullptr) {
+        link = new SensorLink(device, this);
+        link->setWindow(1);
+        link->setTimeout(GAP_FETCH_TIMEOUT_MS);
+        connect(link, &SensorLink::responseReady, this, &GapScanner::responseReady);
+        connect(link, &SensorLink::requestTimedOut, this, &GapScanner::requestTimedOut);
+    }
+    sendNext();
+}
+
+/**
+ * @brief GapScanner::pause: Takes the link off the device before the worker
+ * uses it; a fetch still in flight goes back to the front of the queue
+ */
+void GapScanner::pause()
+{
+    if (tag != 0) {
+        slotQueue.prepend(current);
+        tag = 0;
+    }
+    dropLink();
+    deadline = 0;
+}
+
+void GapScanner::dropLink()
+{
+    if (link == nullptr) {
+        return;
+    }
+    // it may be mid-signal, so it is deleted later
+    disconnect(link, nullptr, this, nullptr);
+    disconnect(device, nullptr, link, nullptr);
+    link->deleteLater();
+    link = nullptr;
+}
+
+void GapScanner::sendNext()
+{
+    while (link != nullptr && tag == 0 && !slotQueue.isEmpty() &&
+           QDateTime::currentMSecsSinceEpoch() + GAP_FETCH_TIMEOUT_MS <= deadline) {
+        gap_slot s = slotQueue.takeFirst();
+        if (!grids.contains(s.grid)) {
+            continue;
+        }
+        const gap_grid g = grids.value(s.grid);
+
+        // the live poll may have stored it since the scan
+        if (isHeld(g, s.timestamp)) {
+            continue;
+        }
+
+        QByteArray msg = getVarSizeIntervalDataByTimestamp(
+                    crc8Table, g.request_type, g.sensor_id, 0, 0,
+                    QDateTime::fromSecsSinceEpoch(s.timestamp, Qt::UTC),
+                    g.lane_appr_num);
+        current = s;
+        tag = link->send(msg, g.frames_per_interval);
+    }
+}
+
+void GapScanner::responseReady(int t, QList<QByteArray> frames, uint16_t errorCode)
+{
+    if (t != tag) {
+        return;
+    }
+    tag = 0;
+    gap_slot s = current;
+    const gap_grid g = grids.value(s.grid);
+
+    if (errorCode == 0x000F) {
+        // the sensor doesn't have it either
+        gapsUnavailable++;
+    } else if (errorCode != 0) {
+        // busy: try again on a later tick
+        retry(s);
+        return;
+    } else if (grids.contains(s.grid) && ingest(g, frames) > 0) {
+        qint64 latency = clock.elapsed() - s.foundMs;
+        fillLatencyMs += latency;
+        if (latency > maxFillLatencyMs) {
+            maxFillLatencyMs = latency;
+        }
+        gapsFilled++;
+        report();
+    }
+
+    // the next fetch waits for the event loop to come round again
+    QTimer::singleShot(0, this, &GapScanner::sendNext);
+}
+
+void GapScanner::requestTimedOut(int t)
+{
+    if (t != tag) {
+        return;
+    }
+    tag = 0;
+    retry(current);
+}
+
+/**
+ * @brief GapScanner::retry: Puts a fetch that timed out or found the sensor
+ * busy back on the queue; nothing more is asked for until the next tick
+ * @param s
+ */
+void GapScanner::retry(gap_slot s)
+{
+    if (++s.attempts >= GAP_MAX_ATTEMPTS) {
+        gapsLost++;
+        printf("Gap fill: giving up on sensor %u at %s\n",
+               grids.value(s.grid).sensor_id,
+               QDateTime::fromSecsSinceEpoch(s.timestamp, Qt::UTC)
+                   .toString("MM/dd/yyyy hh:mm:ss").toLatin1().constData());
+    } else {
+        slotQueue.append(s);
+    }
+    deadline = 0;
+}
+
+int GapScanner::queued() const
+{
+    return slotQueue.size();
+}
+
+void GapScanner::report() const
+{
+    printf("Gaps: %lld found, %lld filled, %lld not on sensor, %lld lost, %d queued;"
+           " fill latency avg %.1f s, max %.1f s\n",
+           gapsFound, gapsFilled, gapsUnavailable, gapsLost, slotQueue.size(),
+           gapsFilled > 0 ? fillLatencyMs / 1000.0 / gapsFilled : 0.0,
+           maxFillLatencyMs / 1000.0);
+}
+
+bool GapScanner::isHeld(const gap_grid &g, qint64 ts) const
+{
+    return pipeline->firstUnindexed(g.sensor_id, g.request_type, g.lane_appr_num,
+                                    ts, g.duration) != ts;
+}
+
+/**
+ * @brief GapScanner::ingest: Hands the interval frames of one response to the pipeline
+ * @return records ingested
+ */
+int GapScanner::ingest(const gap_grid &g, const QList<QByteArray> &frames)
+{
+    int n = 0;
+    for (int i=0; i<frames.size(); i++) {
+        QByteArray frame = frames.at(i);
+        interval_record rec;
+        if (!parse_interval_data_resp(&frame, &rec)) {
+            continue;
+        }
+        rec.sensor_id = g.sensor_id;
+        if (g.request_type == 3) {
+            rec.request_type = (i < g.num_lanes) ? 1 : 2;
+        } else {
+            rec.request_type = g.request_type;
+        }
+        pipeline->ingest(rec);
+        n++;
+    }
+    return n;
+}
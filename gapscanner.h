@@ -0,0 +1,90 @@
+#ifndef GAPSCANNER_H
+#define GAPSCANNER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QIODevice>
+#include <QList>
+#include <QObject>
+
+#include "intervalpipeline.h"
+#include "sensorlink.h"
+#include "sensor_utils.h"
+
+#define GAP_MAX_ATTEMPTS 5
+#define GAP_MAX_LOOKBACK_SECS (7 * 86400)
+#define GAP_POLL_MARGIN_MS 500
+
+// one interval the grid says should be stored but isn't
+struct gap_slot {
+    quint32 grid;           // interval_key of the watched selection
+    qint64 timestamp;       // interval start, UTC seconds
+    qint64 foundMs;         // when the scan noticed it
+    int attempts;
+};
+
+// Finds intervals that are missing from the index of a polled sensor
+// selection (every `duration` seconds between where polling started and the
+// poll cursor) and fetches them again. Fetches go through a SensorLink on
+// the worker's own port or socket, one request per event loop turn, and only
+// while the time left before the next live poll allows; the worker pauses
+// the fill before it talks to the sensor itself, so the poller never waits
+// behind a gap and nothing blocks the thread.
+class GapScanner : public QObject
+{
+    Q_OBJECT
+public:
+    explicit GapScanner(QObject *parent = nullptr);
+    void setPipelinePtr(IntervalPipeline *p);
+    void watch(uint16_t sensorId, uint8_t requestType, uint8_t laneApprNum,
+               uint16_t duration, int framesPerInterval, uint8_t numLanes,
+               qint64 from);
+    int scan(uint16_t sensorId, uint8_t requestType, uint8_t laneApprNum,
+             qint64 upTo);
+    void fill(QIODevice *dev, qint64 deadlineMs);
+    void pause();
+    int queued() const;
+    void report() const;
+
+private slots:
+    void sendNext();
+    void responseReady(int tag, QList<QByteArray> frames, uint16_t errorCode);
+    void requestTimedOut(int tag);
+
+private:
+    struct gap_grid {
+        uint16_t sensor_id;
+        uint8_t request_type;
+        uint8_t lane_appr_num;
+        uint16_t duration;
+        int frames_per_interval;
+        uint8_t num_lanes;      // request type 3: frames before this are lanes
+        qint64 scanned_to;
+    };
+
+    bool isHeld(const gap_grid &g, qint64 ts) const;
+    int ingest(const gap_grid &g, const QList<QByteArray> &frames);
+    void retry(gap_slot s);
+    void dropLink();
+
+    uint8_t crc8Table[COMMS_CRC8_TABLE_LENGTH];
+    IntervalPipeline *pipeline;
+    QHash<quint32, gap_grid> grids;
+    QList<gap_slot> slotQueue;
+
+    SensorLink *link;
+    QIODevice *device;
+    qint64 deadline;        // UTC milliseconds when the device is needed again
+    int tag;                // SensorLink tag of the fetch in flight, else 0
+    gap_slot current;
+
+    qint64 gapsFound;
+    qint64 gapsFilled;
+    qint64 gapsUnavailable;
+    qint64 gapsLost;
+    qint64 fillLatencyMs;
+    qint64 maxFillLatencyMs;
+    QElapsedTimer clock;
+};
+
+#endif // GAPSCANNER_H
@@ -0,0 +1,315 @@
+#include "interval_codec.h"
+
+using namespace std;
+
+static inline uint64_t zigzag(int64_t v)
+{
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t u)
+{
+    return static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+}
+
+static inline void putVarint(QByteArray *out, uint64_t v)
+{
+    char buf[10];
+    int n = 0;
+    while (v >= 0x80) {
+        buf[n++] = static_cast<char>((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    buf[n++] = static_cast<char>(v);
+    out->append(buf, n);
+}
+
+static inline bool getVarint(const uint8_t *&p, const uint8_t *end, uint64_t *v)
+{
+    // most values (deltas, small counts) fit in a single byte
+    if (p < end && *p < 0x80) {
+        *v = *p++;
+        return true;
+    }
+    uint64_t result = 0;
+    int shift = 0;
+    while (p < end && shift < 64) {
+        uint8_t b = *p++;
+        result |= static_cast<uint64_t>(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *v = result;
+            return true;
+        }
+        shift += 7;
+    }
+    return false;
+}
+
+static void putLE(QByteArray *out, uint64_t v, int bytes)
+{
+    for (int i=0; i<bytes; i++) {
+        out->append(static_cast<char>((v >> (8 * i)) & 0xFF));
+    }
+}
+
+static uint64_t getLE(const uint8_t *p, int bytes)
+{
+    uint64_t v = 0;
+    for (int i=0; i<bytes; i++) {
+        v |= static_cast<uint64_t>(p[i]) << (8 * i);
+    }
+    return v;
+}
+
+/**
+ * @brief encode_interval_segment: Encodes a closed run of intervals. All records must belong to the same sensor, request type and lane/approach as recs[0].
+ * @param recs
+ * @param count
+ * @return header followed by the column payload
+ */
+QByteArray encode_interval_segment(const interval_record *recs, int count)
+{
+    QByteArray payload;
+    payload.reserve(count * 24);
+
+    int i, j;
+    int64_t prev;
+
+    uint32_t volMin = 0xFFFFFFFF;
+    uint32_t volMax = 0;
+    int64_t tsMin = count ? recs[0].timestamp : 0;
+    int64_t tsMax = tsMin;
+
+    // timestamps: first value, then step from the previous interval
+    prev = 0;
+    for (i=0; i<count; i++) {
+        putVarint(&payload, zigzag(recs[i].timestamp - prev));
+        prev = recs[i].timestamp;
+        if (prev < tsMin) tsMin = prev;
+        if (prev > tsMax) tsMax = prev;
+    }
+    for (i=0; i<count; i++) {
+        putVarint(&payload, recs[i].ms);
+    }
+
+#define DELTA_COLUMN(field)                                         \
+    prev = 0;                                                       \
+    for (i=0; i<count; i++) {                                       \
+        putVarint(&payload, zigzag(static_cast<int64_t>(recs[i].field) - prev)); \
+        prev = recs[i].field;                                       \
+    }
+
+    DELTA_COLUMN(interval_duration)
+    DELTA_COLUMN(num_lanes)
+    DELTA_COLUMN(num_apprs)
+    DELTA_COLUMN(avg_speed)
+    DELTA_COLUMN(avg_occupancy)
+    DELTA_COLUMN(speed_85)
+
+    for (i=0; i<count; i++) {
+        uint32_t v = recs[i].volume;
+        putVarint(&payload, v);
+        if (v < volMin) volMin = v;
+        if (v > volMax) volMax = v;
+    }
+    for (i=0; i<count; i++) {
+        putVarint(&payload, recs[i].headway);
+    }
+    for (i=0; i<count; i++) {
+        putVarint(&payload, recs[i].gap);
+    }
+    for (i=0; i<count; i++) {
+        putVarint(&payload, recs[i].quality);
+    }
+
+    DELTA_COLUMN(num_class_bins)
+    DELTA_COLUMN(num_speed_bins)
+    DELTA_COLUMN(num_dir_bins)
+#undef DELTA_COLUMN
+
+    for (i=0; i<count; i++) {
+        for (j=0; j<recs[i].num_class_bins; j++) {
+            putVarint(&payload, recs[i].class_bins[j]);
+        }
+    }
+    for (i=0; i<count; i++) {
+        for (j=0; j<recs[i].num_speed_bins; j++) {
+            putVarint(&payload, recs[i].speed_bins[j]);
+        }
+    }
+    for (i=0; i<count; i++) {
+        for (j=0; j<recs[i].num_dir_bins; j++) {
+            putVarint(&payload, recs[i].dir_bins[j]);
+        }
+    }
+
+    if (count == 0) {
+        volMin = 0;
+    }
+
+    QByteArray seg;
+    seg.reserve(INTERVAL_SEGMENT_HEADER_SIZE + payload.size());
+    putLE(&seg, INTERVAL_SEGMENT_MAGIC, 4);
+    putLE(&seg, count ? recs[0].sensor_id : 0, 2);
+    putLE(&seg, count ? recs[0].request_type : 0, 1);
+    putLE(&seg, count ? recs[0].lane_appr_num : 0, 1);
+    putLE(&seg, static_cast<uint32_t>(count), 4);
+    putLE(&seg, static_cast<uint32_t>(payload.size()), 4);
+    putLE(&seg, static_cast<uint64_t>(tsMin), 8);
+    putLE(&seg, static_cast<uint64_t>(tsMax), 8);
+    putLE(&seg, volMin, 4);
+    putLE(&seg, volMax, 4);
+    seg.append(payload);
+    return seg;
+}
+
+/**
+ * @brief read_interval_segment_header: Reads the fixed-size segment header without touching the payload.
+ * @param data
+ * @param len
+ * @param h
+ * @return false if data does not start with a complete segment header, or
+ * the header claims more records than its payload has bytes
+ */
+bool read_interval_segment_header(const char *data, int len,
+                                  interval_segment_header *h)
+{
+    if (len < INTERVAL_SEGMENT_HEADER_SIZE) {
+        return false;
+    }
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+    h->magic = static_cast<uint32_t>(getLE(p, 4));
+    if (h->magic != INTERVAL_SEGMENT_MAGIC && h->magic != INTERVAL_SEGMENT_MAGIC_V1) {
+        return false;
+    }
+    h->sensor_id = static_cast<uint16_t>(getLE(p + 4, 2));
+    h->request_type = p[6];
+    h->lane_appr_num = p[7];
+    h->count = static_cast<uint32_t>(getLE(p + 8, 4));
+    h->payload_size = static_cast<uint32_t>(getLE(p + 12, 4));
+    h->ts_min = static_cast<int64_t>(getLE(p + 16, 8));
+    h->ts_max = static_cast<int64_t>(getLE(p + 24, 8));
+    h->volume_min = static_cast<uint32_t>(getLE(p + 32, 4));
+    h->volume_max = static_cast<uint32_t>(getLE(p + 36, 4));
+    // every record takes at least a byte, so count is bounded before anyone
+    // sizes a buffer by it
+    return h->count <= h->payload_size;
+}
+
+/**
+ * @brief decode_interval_segment: Decodes a segment produced by encode_interval_segment.
+ * @param data: start of the segment header
+ * @param len: bytes available from data
+ * @param out: room for at least maxCount records
+ * @param maxCount
+ * @param withBins: false stops before the bin columns (the bulk of a segment)
+ * and leaves every record with no bins
+ * @return number of records decoded, or -1 if the segment is corrupt or out is too small
+ */
+int decode_interval_segment(const char *data, int len,
+                            interval_record *out, int maxCount, bool withBins)
+{
+    interval_segment_header h;
+    if (!read_interval_segment_header(data, len, &h)) {
+        return -1;
+    }
+    int count = static_cast<int>(h.count);
+    if (count > maxCount ||
+            INTERVAL_SEGMENT_HEADER_SIZE + static_cast<int64_t>(h.payload_size) > len) {
+        return -1;
+    }
+
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(data) + INTERVAL_SEGMENT_HEADER_SIZE;
+    const uint8_t *end = p + h.payload_size;
+    uint64_t v;
+    int64_t prev;
+    int i, j;
+
+    for (i=0; i<count; i++) {
+        out[i].sensor_id = h.sensor_id;
+        out[i].request_type = h.request_type;
+        out[i].lane_appr_num = h.lane_appr_num;
+    }
+
+    prev = 0;
+    for (i=0; i<count; i++) {
+        if (!getVarint(p, end, &v)) return -1;
+        prev += unzigzag(v);
+        out[i].timestamp = prev;
+    }
+    for (i=0; i<count; i++) {
+        if (!getVarint(p, end, &v)) return -1;
+        out[i].ms = static_cast<uint16_t>(v);
+    }
+
+#define DELTA_COLUMN(field, type)                                   \
+    prev = 0;                                                       \
+    for (i=0; i<count; i++) {                                       \
+        if (!getVarint(p, end, &v)) return -1;                      \
+        prev += unzigzag(v);                                        \
+        out[i].field = static_cast<type>(prev);                     \
+    }
+#define PLAIN_COLUMN(field, type)                                   \
+    for (i=0; i<count; i++) {                                       \
+        if (!getVarint(p, end, &v)) return -1;                      \
+        out[i].field = static_cast<type>(v);                        \
+    }
+
+    DELTA_COLUMN(interval_duration, uint16_t)
+    DELTA_COLUMN(num_lanes, uint8_t)
+    DELTA_COLUMN(num_apprs, uint8_t)
+    DELTA_COLUMN(avg_speed, uint32_t)
+    DELTA_COLUMN(avg_occupancy, uint16_t)
+    DELTA_COLUMN(speed_85, uint32_t)
+    PLAIN_COLUMN(volume, uint32_t)
+    PLAIN_COLUMN(headway, uint32_t)
+    PLAIN_COLUMN(gap, uint32_t)
+    if (h.magic == INTERVAL_SEGMENT_MAGIC_V1) {
+        for (i=0; i<count; i++) {
+            out[i].quality = 0;
+        }
+    } else {
+        PLAIN_COLUMN(quality, uint16_t)
+    }
+    DELTA_COLUMN(num_class_bins, uint8_t)
+    DELTA_COLUMN(num_speed_bins, uint8_t)
+    DELTA_COLUMN(num_dir_bins, uint8_t)
+#undef DELTA_COLUMN
+#undef PLAIN_COLUMN
+
+    if (!withBins) {
+        for (i=0; i<count; i++) {
+            out[i].num_class_bins = 0;
+            out[i].num_speed_bins = 0;
+            out[i].num_dir_bins = 0;
+        }
+        return count;
+    }
+    for (i=0; i<count; i++) {
+        if (out[i].num_class_bins > MAX_CLASS_BINS ||
+                out[i].num_speed_bins > MAX_SPEED_BINS ||
+                out[i].num_dir_bins > MAX_DIR_BINS) {
+            return -1;
+        }
+    }
+    for (i=0; i<count; i++) {
+        for (j=0; j<out[i].num_class_bins; j++) {
+            if (!getVarint(p, end, &v)) return -1;
+            out[i].class_bins[j] = static_cast<uint32_t>(v);
+        }
+    }
+    for (i=0; i<count; i++) {
+        for (j=0; j<out[i].num_speed_bins; j++) {
+            if (!getVarint(p, end, &v)) return -1;
+            out[i].speed_bins[j] = static_cast<uint32_t>(v);
+        }
+    }
+    for (i=0; i<count; i++) {
+        for (j=0; j<out[i].num_dir_bins; j++) {
+            if (!getVarint(p, end, &v)) return -1;
+            out[i].dir_bins[j] = static_cast<uint32_t>(v);
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,41 @@
+#ifndef INTERVAL_CODEC_H
+#define INTERVAL_CODEC_H
+
+#include <stdint.h>
+#include <QByteArray>
+
+#include "sensor_utils.h"
+
+#define INTERVAL_SEGMENT_MAGIC 0x32475349    // "ISG2"
+#define INTERVAL_SEGMENT_MAGIC_V1 0x31475349 // "ISG1", before quality flags
+#define INTERVAL_SEGMENT_HEADER_SIZE 40
+
+// A closed segment holds consecutive intervals of a single sensor lane (or
+// approach). The header carries enough min/max metadata to skip a segment
+// without decoding it; the payload is column by column:
+//  - timestamps, duration, lane counts, speeds, occupancy: zigzag varint deltas
+//  - volume, headway, gap, quality flags and every bin count: varints
+// ISG1 segments, written before the quality column existed, still decode
+// (with quality 0).
+struct interval_segment_header {
+    uint32_t magic;
+    uint16_t sensor_id;
+    uint8_t request_type;
+    uint8_t lane_appr_num;
+    uint32_t count;
+    uint32_t payload_size;
+    int64_t ts_min;
+    int64_t ts_max;
+    uint32_t volume_min;
+    uint32_t volume_max;
+};
+
+QByteArray encode_interval_segment(const interval_record *recs, int count);
+
+bool read_interval_segment_header(const char *data, int len,
+                                  interval_segment_header *h);
+
+int decode_interval_segment(const char *data, int len,
+                            interval_record *out, int maxCount, bool withBins = true);
+
+#endif // INTERVAL_CODEC_H
@@ -0,0 +1,156 @@
+#include "intervalindex.h"
+
+#define SECS_PER_DAY 86400
+
+static quint64 dayKeyOf(quint32 laneKey, qint64 day)
+{
+    return (static_cast<quint64>(laneKey) << 32) | static_cast<quint32>(day);
+}
+
+static int gcd(int a, int b)
+{
+    while (b != 0) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// splits a UTC timestamp into day number and second of the day
+static void splitDay(qint64 ts, qint64 *day, int *secs)
+{
+    *day = ts / SECS_PER_DAY;
+    *secs = static_cast<int>(ts % SECS_PER_DAY);
+    if (*secs < 0) {
+        *secs += SECS_PER_DAY;
+        (*day)--;
+    }
+}
+
+IntervalIndex::IntervalIndex()
+{
+    count = 0;
+}
+
+int IntervalIndex::size() const
+{
+    return count;
+}
+
+/**
+ * @brief IntervalIndex::insert: Marks an interval as stored
+ * @param r
+ * @return false if it was already in the index
+ */
+bool IntervalIndex::insert(const interval_record &r)
+{
+    qint64 day;
+    int secs;
+    splitDay(r.timestamp, &day, &secs);
+
+    int step = gcd(r.interval_duration > 0 ? r.interval_duration : 1, secs);
+    day_bitmap &d = days[dayKeyOf(interval_key(r.sensor_id, r.request_type,
+                                               r.lane_appr_num), day)];
+    if (d.bits.isEmpty()) {
+        d.step = step;
+        d.bits.fill(0, (SECS_PER_DAY / step + 63) / 64);
+    } else if (step % d.step != 0) {
+        rebin(&d, gcd(d.step, step));
+    }
+
+    int slot = secs / d.step;
+    quint64 mask = Q_UINT64_C(1) << (slot & 63);
+    if (d.bits[slot >> 6] & mask) {
+        return false;
+    }
+    d.bits[slot >> 6] |= mask;
+    count++;
+    return true;
+}
+
+bool IntervalIndex::contains(uint16_t sensorId, uint8_t requestType,
+                             uint8_t laneApprNum, qint64 ts) const
+{
+    return containsKey(interval_key(sensorId, requestType, laneApprNum), ts);
+}
+
+/**
+ * @brief IntervalIndex::firstMissing: Where a request for intervals starting
+ * at `from` should really start. If the interval on the first `duration`
+ * boundary at or after `from` is held, steps over every held one and returns
+ * the first boundary that is missing; otherwise returns `from` unchanged.
+ * With laneApprNum 0xFF or request type 3 an interval only counts as held
+ * once every indexed lane (and approach) of the sensor holds it.
+ * @return UTC seconds
+ */
+qint64 IntervalIndex::firstMissing(uint16_t sensorId, uint8_t requestType,
+                                   uint8_t laneApprNum, qint64 from,
+                                   uint16_t duration) const
+{
+    if (duration == 0) {
+        return from;
+    }
+
+    QVector<quint32> lanes;
+    if (laneApprNum != 0xFF && requestType != 3) {
+        lanes.append(interval_key(sensorId, requestType, laneApprNum));
+    } else {
+        QHash<quint64, day_bitmap>::const_iterator it;
+        for (it = days.constBegin(); it != days.constEnd(); ++it) {
+            quint32 laneKey = static_cast<quint32>(it.key() >> 32);
+            uint8_t t = static_cast<uint8_t>((laneKey >> 8) & 0xFF);
+            if ((laneKey >> 16) == sensorId && (requestType == 3 || t == requestType)
+                    && !lanes.contains(laneKey)) {
+                lanes.append(laneKey);
+            }
+        }
+        if (lanes.isEmpty()) {
+            return from;
+        }
+    }
+
+    qint64 ts = from + duration - 1;
+    ts -= ts % duration;
+
+    // never look further than a day ahead
+    int n;
+    for (n=0; n<SECS_PER_DAY / duration; n++, ts += duration) {
+        int i;
+        for (i=0; i<lanes.size() && containsKey(lanes.at(i), ts); i++);
+        if (i < lanes.size()) {
+            break;
+        }
+    }
+    return n == 0 ? from : ts;
+}
+
+bool IntervalIndex::containsKey(quint32 laneKey, qint64 ts) const
+{
+    qint64 day;
+    int secs;
+    splitDay(ts, &day, &secs);
+
+    QHash<quint64, day_bitmap>::const_iterator it = days.constFind(dayKeyOf(laneKey, day));
+    if (it == days.constEnd() || secs % it.value().step != 0) {
+        return false;
+    }
+    int slot = secs / it.value().step;
+    return (it.value().bits.at(slot >> 6) >> (slot & 63)) & 1;
+}
+
+// re-spreads a day's bits over a finer step that divides the old one
+void IntervalIndex::rebin(day_bitmap *day, int step)
+{
+    QVector<quint64> bits((SECS_PER_DAY / step + 63) / 64, 0);
+    int ratio = day->step / step;
+    int numSlots = SECS_PER_DAY / day->step;
+    for (int slot=0; slot<numSlots; slot++) {
+        if ((day->bits.at(slot >> 6) >> (slot & 63)) & 1) {
+            int s = slot * ratio;
+            bits[s >> 6] |= Q_UINT64_C(1) << (s & 63);
+        }
+    }
+    day->bits = bits;
+    day->step = step;
+}
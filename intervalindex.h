@@ -0,0 +1,38 @@
+#ifndef INTERVALINDEX_H
+#define INTERVALINDEX_H
+
+#include <QHash>
+#include <QVector>
+
+#include "sensor_utils.h"
+
+// In-memory index of the intervals already stored, one bitmap per sensor
+// lane/approach per UTC day. A day's bitmap has one bit per `step` seconds,
+// where step is the largest value that divides every interval duration and
+// start time seen that day, so distinct intervals never share a bit (60 s
+// intervals cost 180 bytes per lane per day).
+class IntervalIndex
+{
+public:
+    IntervalIndex();
+    bool insert(const interval_record &r);
+    bool contains(uint16_t sensorId, uint8_t requestType, uint8_t laneApprNum,
+                  qint64 ts) const;
+    qint64 firstMissing(uint16_t sensorId, uint8_t requestType, uint8_t laneApprNum,
+                        qint64 from, uint16_t duration) const;
+    int size() const;
+
+private:
+    struct day_bitmap {
+        int step;
+        QVector<quint64> bits;
+    };
+
+    bool containsKey(quint32 laneKey, qint64 ts) const;
+    static void rebin(day_bitmap *day, int step);
+
+    QHash<quint64, day_bitmap> days;
+    int count;
+};
+
+#endif // INTERVALINDEX_H
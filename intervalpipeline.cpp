@@ -0,0 +1,367 @@
+#include "intervalpipeline.h"
+
+#include <QElapsedTimer>
+
+IntervalPipeline::IntervalPipeline(QObject *parent) : QObject(parent)
+{
+    dataFile = nullptr;
+    intervalStore = nullptr;
+    journal = nullptr;
+    sqliteSink = nullptr;
+    rollupStore = nullptr;
+    liveFeed = nullptr;
+    stateStore = nullptr;
+    duplicateCount = 0;
+    duplicatesReported = 0;
+    formatCount = 0;
+    formatNs = 0;
+
+    // journal entries are synced in batches, not one fsync per interval
+    journalSync.setSingleShot(true);
+    connect(&journalSync, &QTimer::timeout, this, &IntervalPipeline::syncJournal);
+}
+
+void IntervalPipeline::setFilePtr(QFile *f)
+{
+    dataFile = f;
+}
+
+void IntervalPipeline::setIntervalStorePtr(IntervalStore *s)
+{
+    intervalStore = s;
+}
+
+void IntervalPipeline::setJournalPtr(RecordJournal *j)
+{
+    journal = j;
+}
+
+void IntervalPipeline::setSqliteSinkPtr(SqliteSink *s)
+{
+    sqliteSink = s;
+}
+
+/**
+ * @brief IntervalPipeline::setRollupStorePtr: Turns on rollups; closed buckets
+ * go to this store and to the SQLite sink's rollup tables. A bucket amended
+ * by a late interval is appended again, and the last copy is the one that counts.
+ * @param s
+ */
+void IntervalPipeline::setRollupStorePtr(IntervalStore *s)
+{
+    rollupStore = s;
+}
+
+/**
+ * @brief IntervalPipeline::setLiveFeedPtr: Where intervals go for the live
+ * data table; they are queued there, not shown one by one
+ * @param f
+ */
+void IntervalPipeline::setLiveFeedPtr(LiveViewFeed *f)
+{
+    liveFeed = f;
+}
+
+void IntervalPipeline::setStateStorePtr(SensorStateStore *s)
+{
+    stateStore = s;
+}
+
+/**
+ * @brief IntervalPipeline::setSpeedBinBounds: Speed bin thresholds as read
+ * from the sensor; speed percentiles are only kept once these are known
+ * @param thresholds
+ * @param n
+ */
+void IntervalPipeline::setSpeedBinBounds(const float *thresholds, int n)
+{
+    speeds.setBounds(thresholds, n);
+}
+
+/**
+ * @brief IntervalPipeline::setApproaches: Lane-to-approach mapping of a sensor,
+ * from parse_approach_info_read_resp. From then on its approach intervals are
+ * built from its lane intervals.
+ */
+void IntervalPipeline::setApproaches(uint16_t sensorId, const approach *appr,
+                                     int numApproaches)
+{
+    approaches.setApproaches(sensorId, appr, numApproaches);
+}
+
+/**
+ * @brief IntervalPipeline::setApproachVerification: With this on, approach
+ * intervals built from lanes are not stored but compared with the ones the
+ * sensor sends, so both have to be polled (request type 3)
+ * @param on
+ */
+void IntervalPipeline::setApproachVerification(bool on)
+{
+    approaches.setVerify(on);
+}
+
+/**
+ * @brief IntervalPipeline::derivesApproaches: Whether polling a sensor's lanes
+ * is enough to also get its approach intervals
+ */
+bool IntervalPipeline::derivesApproaches(uint16_t sensorId) const
+{
+    return approaches.hasApproaches(sensorId) && !approaches.verifying();
+}
+
+/**
+ * @brief IntervalPipeline::openDataFile: Makes sure the RTDATA file is open for writing
+ * @return false if the file couldn't be opened
+ */
+bool IntervalPipeline::openDataFile()
+{
+    if (dataFile == nullptr) {
+        return false;
+    }
+    if (dataFile->isOpen()) {
+        printf("File is already open.\n");
+    } else if (dataFile->open(QIODevice::WriteOnly | QIODevice::Append)) {
+        printf("File opened.\n");
+    } else {
+        printf("Couldn't open file.\n");
+        return false;
+    }
+    return true;
+}
+
+void IntervalPipeline::closeDataFile()
+{
+    syncJournal();
+    if (rollupStore != nullptr) {
+        rollupStore->flush();
+    }
+    if (intervalStore != nullptr) {
+        // only once everything journaled so far is on disk in the segment file
+        if (intervalStore->flush() && journal != nullptr) {
+            journal->checkpoint();
+        }
+    }
+    if (dataFile != nullptr) {
+        dataFile->close();
+    }
+}
+
+void IntervalPipeline::syncJournal()
+{
+    journalSync.stop();
+    if (journal != nullptr) {
+        journal->sync();
+    }
+}
+
+void IntervalPipeline::writeHeader(int numClasses, int numSpeedBins)
+{
+    formatter.formatHeader(numClasses, numSpeedBins);
+    writeLine();
+}
+
+/**
+ * @brief IntervalPipeline::ingest: Flags, journals, stores, formats and
+ * publishes one decoded interval. Intervals already ingested this run, or
+ * already in the journal, are dropped before any formatting or I/O.
+ * @param in
+ */
+void IntervalPipeline::ingest(const interval_record &in)
+{
+    if (!index.insert(in)) {
+        // gap rescans and backfill overlap can drop thousands; report at most
+        // once per DUPLICATE_REPORT_MS
+        duplicateCount++;
+        if (!duplicateReport.isValid() || duplicateReport.elapsed() >= DUPLICATE_REPORT_MS) {
+            printf("Dropped %lld duplicate intervals (%lld since the last report)\n",
+                   duplicateCount, duplicateCount - duplicatesReported);
+            duplicatesReported = duplicateCount;
+            duplicateReport.start();
+        }
+        return;
+    }
+    // only what was journaled before this run; refetched gaps are older
+    // than the live position but still new
+    if (journal != nullptr &&
+            in.timestamp <= journal->lastRecovered(in.sensor_id, in.request_type,
+                                                   in.lane_appr_num)) {
+        return;
+    }
+
+    // flags travel with the record into every store below
+    interval_record r = in;
+    quality.check(&r);
+
+    if (journal != nullptr) {
+        journal->append(r);
+        if (!journalSync.isActive()) {
+            journalSync.start(JOURNAL_SYNC_MS);
+        }
+    }
+
+    if (intervalStore != nullptr) {
+        intervalStore->append(r);
+    }
+    if (sqliteSink != nullptr) {
+        sqliteSink->enqueue(r);
+    }
+    if (rollupStore != nullptr) {
+        rollUp(r);
+    }
+    speeds.add(r);
+
+    QElapsedTimer timer;
+    timer.start();
+    formatter.format(r);
+    writeLine();
+    formatNs += timer.nsecsElapsed();
+    formatCount++;
+    if (liveFeed != nullptr) {
+        liveFeed->push(r);
+    }
+    if (stateStore != nullptr) {
+        stateStore->interval(r);
+    }
+
+    if (formatCount % 1000 == 0) {
+        printf("Formatted %lld intervals, %lld ns/interval, %lld duplicates dropped\n",
+               formatCount, formatNs / formatCount, duplicateCount);
+    }
+
+    if (r.request_type == 1) {
+        derivedApproaches.clear();
+        if (approaches.add(r, &derivedApproaches) > 0) {
+            for (int i=0; i<derivedApproaches.size(); i++) {
+                ingest(derivedApproaches.at(i));
+            }
+        }
+    } else if (r.request_type == 2 && approaches.verifying()) {
+        approaches.verify(r);
+    }
+}
+
+/**
+ * @brief IntervalPipeline::replay: Stores the intervals a crash left only in
+ * the journal (RecordJournal::recover) the way ingest() would have: segment
+ * store, SQLite, rollups and the RTDATA file. They are marked as stored in the
+ * journal once the segment file is on disk, before polling resumes after them.
+ * @param recs
+ * @return number of intervals stored
+ */
+int IntervalPipeline::replay(const QVector<interval_record> &recs)
+{
+    if (recs.isEmpty()) {
+        return 0;
+    }
+    if (!openDataFile()) {
+        printf("Journal replay: RTDATA file not written\n");
+    }
+
+    int stored = 0;
+    int classBins = -1;
+    int speedBins = -1;
+    for (int i=0; i<recs.size(); i++) {
+        const interval_record &r = recs.at(i);
+        if (!index.insert(r)) {
+            continue;
+        }
+        if (intervalStore != nullptr) {
+            intervalStore->append(r);
+        }
+        if (sqliteSink != nullptr) {
+            sqliteSink->enqueue(r);
+        }
+        if (rollupStore != nullptr) {
+            rollUp(r);
+        }
+        speeds.add(r);
+        if (r.num_class_bins != classBins || r.num_speed_bins != speedBins) {
+            classBins = r.num_class_bins;
+            speedBins = r.num_speed_bins;
+            writeHeader(classBins, speedBins);
+        }
+        formatter.format(r);
+        writeLine();
+        stored++;
+    }
+
+    if (intervalStore != nullptr && intervalStore->flush() && journal != nullptr) {
+        journal->checkpoint();
+    }
+    printf("Journal replay: %d intervals stored again\n", stored);
+    return stored;
+}
+
+/**
+ * @brief IntervalPipeline::lastDurable: Where the poller should resume for a lane/approach
+ * @return UTC seconds of the newest journaled interval, or -1 if there is none
+ */
+qint64 IntervalPipeline::lastDurable(uint16_t sensorId, uint8_t requestType,
+                                     uint8_t laneApprNum) const
+{
+    if (journal == nullptr) {
+        return -1;
+    }
+    return journal->lastDurable(sensorId, requestType, laneApprNum);
+}
+
+/**
+ * @brief IntervalPipeline::firstMissing: Moves a request start past intervals
+ * that are already stored, this run or in the journal
+ * @return UTC seconds the request should start from
+ */
+qint64 IntervalPipeline::firstMissing(uint16_t sensorId, uint8_t requestType,
+                                      uint8_t laneApprNum, qint64 from,
+                                      uint16_t duration) const
+{
+    qint64 last = lastDurable(sensorId, requestType, laneApprNum);
+    if (last >= 0 && last + duration > from) {
+        from = last + duration;
+    }
+    return index.firstMissing(sensorId, requestType, laneApprNum, from, duration);
+}
+
+/**
+ * @brief IntervalPipeline::speedSketch: Speed distribution of some lanes or
+ * approaches over [from, to), for percentiles such as sketch.quantile(0.95)
+ * @param lanes: interval_key of each lane/approach
+ */
+SpeedSketch IntervalPipeline::speedSketch(qint64 from, qint64 to,
+                                          const QVector<quint32> &lanes) const
+{
+    return speeds.query(from, to, lanes);
+}
+
+/**
+ * @brief IntervalPipeline::firstUnindexed: Like firstMissing, but only looks at
+ * what was ingested this run, so older intervals missing behind the journal's
+ * resume point still show up
+ * @return UTC seconds
+ */
+qint64 IntervalPipeline::firstUnindexed(uint16_t sensorId, uint8_t requestType,
+                                        uint8_t laneApprNum, qint64 from,
+                                        uint16_t duration) const
+{
+    return index.firstMissing(sensorId, requestType, laneApprNum, from, duration);
+}
+
+void IntervalPipeline::rollUp(const interval_record &r)
+{
+    closedRollups.clear();
+    if (rollups.add(r, &closedRollups) == 0) {
+        return;
+    }
+    for (int i=0; i<closedRollups.size(); i++) {
+        rollupStore->append(closedRollups.at(i));
+        if (sqliteSink != nullptr) {
+            sqliteSink->enqueueRollup(closedRollups.at(i));
+        }
+    }
+}
+
+void IntervalPipeline::writeLine()
+{
+    if (dataFile != nullptr && dataFile->isOpen()) {
+        dataFile->write(formatter.data(), formatter.size());
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef INTERVALPIPELINE_H
+#define INTERVALPIPELINE_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+#include "approachaggregator.h"
+#include "intervalindex.h"
+#include "intervalstore.h"
+#include "liveviewfeed.h"
+#include "qualitymonitor.h"
+#include "recordjournal.h"
+#include "recordformatter.h"
+#include "rollupengine.h"
+#include "sensorstatestore.h"
+#include "speedsketch.h"
+#include "sqlitesink.h"
+#include "sensor_utils.h"
+
+#define DUPLICATE_REPORT_MS 60000
+
+// Everything that happens to a decoded interval after the workers read it:
+// quality flags, the journal, segment storage, the optional SQLite sink,
+// 1/5/15/60 minute rollups, the RTDATA text file, the live data table and
+// the fleet dashboard's sensor states.
+// Each record is formatted once, for the file; the table formats only the
+// rows it shows, batched per frame by LiveViewFeed. Intervals that were
+// already ingested are dropped up front.
+// Lane intervals of sensors with a known approach mapping also produce that
+// sensor's approach intervals.
+class IntervalPipeline : public QObject
+{
+    Q_OBJECT
+public:
+    explicit IntervalPipeline(QObject *parent = nullptr);
+    void setFilePtr(QFile *f);
+    void setIntervalStorePtr(IntervalStore *s);
+    void setJournalPtr(RecordJournal *j);
+    void setSqliteSinkPtr(SqliteSink *s);
+    void setRollupStorePtr(IntervalStore *s);
+    void setLiveFeedPtr(LiveViewFeed *f);
+    void setStateStorePtr(SensorStateStore *s);
+    void setSpeedBinBounds(const float *thresholds, int n);
+    void setApproaches(uint16_t sensorId, const approach *appr, int numApproaches);
+    void setApproachVerification(bool on);
+    bool derivesApproaches(uint16_t sensorId) const;
+    bool openDataFile();
+    void closeDataFile();
+    void writeHeader(int numClasses, int numSpeedBins);
+    void ingest(const interval_record &in);
+    int replay(const QVector<interval_record> &recs);
+    qint64 lastDurable(uint16_t sensorId, uint8_t requestType,
+                       uint8_t laneApprNum) const;
+    qint64 firstMissing(uint16_t sensorId, uint8_t requestType,
+                        uint8_t laneApprNum, qint64 from,
+                        uint16_t duration) const;
+    SpeedSketch speedSketch(qint64 from, qint64 to, const QVector<quint32> &lanes) const;
+    qint64 firstUnindexed(uint16_t sensorId, uint8_t requestType,
+                          uint8_t laneApprNum, qint64 from,
+                          uint16_t duration) const;
+
+private slots:
+    void syncJournal();
+
+private:
+    void writeLine();
+    void rollUp(const interval_record &r);
+
+    QFile *dataFile;
+    IntervalStore *intervalStore;
+    RecordJournal *journal;
+    SqliteSink *sqliteSink;
+    IntervalStore *rollupStore;
+    LiveViewFeed *liveFeed;
+    SensorStateStore *stateStore;
+    RollupEngine rollups;
+    QVector<interval_record> closedRollups;
+    RecordFormatter formatter;
+    IntervalIndex index;
+    SpeedSketchIndex speeds;
+    ApproachAggregator approaches;
+    QualityMonitor quality;
+    QVector<interval_record> derivedApproaches;
+    QTimer journalSync;
+
+    qint64 duplicateCount;
+    qint64 duplicatesReported;
+    QElapsedTimer duplicateReport;
+    qint64 formatCount;
+    qint64 formatNs;
+};
+
+#endif // INTERVALPIPELINE_H
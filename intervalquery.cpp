@@ -0,0 +1,630 @@
+#include "intervalquery.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QtConcurrent>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+// segments handed to one thread at a time
+#define QUERY_TASK_BYTES (256 * 1024)
+
+static const char *COLUMN_NAMES[QUERY_NUM_COLS] = { "ts", "lane", "duration", "volume",
+                                                   "speed", "occupancy", "speed85",
+                                                   "headway", "gap", "quality" };
+
+/**
+ * @brief query_column_value: One column of an interval, in the units printed
+ * @param r
+ * @param column: QUERY_COL_*
+ * @return speeds in mph/kph (NaN when not valid), occupancy in percent
+ */
+double query_column_value(const interval_record &r, int column)
+{
+    switch (column) {
+    case QUERY_COL_TS: return static_cast<double>(r.timestamp);
+    case QUERY_COL_LANE: return r.lane_appr_num;
+    case QUERY_COL_DURATION: return r.interval_duration;
+    case QUERY_COL_VOLUME: return r.volume;
+    case QUERY_COL_SPEED:
+        return (r.avg_speed & 0x800000) ? (r.avg_speed & 0x7FFFFF) / 256.0 : NAN;
+    case QUERY_COL_OCCUPANCY: return r.avg_occupancy / 256.0;
+    case QUERY_COL_SPEED_85:
+        return (r.speed_85 & 0x800000) ? (r.speed_85 & 0x7FFFFF) / 256.0 : NAN;
+    case QUERY_COL_HEADWAY: return r.headway;
+    case QUERY_COL_GAP: return r.gap;
+    case QUERY_COL_QUALITY: return r.quality;
+    default: return NAN;
+    }
+}
+
+static int columnIndex(const QString &name)
+{
+    for (int i=0; i<QUERY_NUM_COLS; i++) {
+        if (name == COLUMN_NAMES[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool compare(double v, char op, double value)
+{
+    switch (op) {
+    case '>': return v > value;
+    case '<': return v < value;
+    case '=': return v == value;
+    case '!': return v != value;
+    case 'g': return v >= value;
+    case 'l': return v <= value;
+    default: return false;
+    }
+}
+
+IntervalQuery::IntervalQuery(const interval_query &q)
+{
+    query = q;
+    segments = 0;
+    skipped = 0;
+    scanned = 0;
+    elapsedNs = 0;
+    overlapping = false;
+}
+
+void IntervalQuery::defaults(interval_query *q)
+{
+    q->sensorId = 0;
+    q->requestType = 1;
+    q->lanes.clear();
+    q->from = 0;
+    q->to = 0x7FFFFFFFFFFFLL;
+    q->duration = 0;
+    q->where.clear();
+    q->speedValid = false;
+    q->clean = false;
+    q->columns.clear();
+    q->columns << QUERY_COL_TS << QUERY_COL_LANE << QUERY_COL_VOLUME
+               << QUERY_COL_SPEED << QUERY_COL_OCCUPANCY;
+    q->groupSecs = 0;
+    q->byLane = false;
+}
+
+const QVector<interval_record> &IntervalQuery::rows() const
+{
+    return result;
+}
+
+/**
+ * @brief IntervalQuery::segmentMayMatch: Decides from the header alone
+ * whether a segment can hold matching intervals. One that overlaps an earlier
+ * segment of its lane/approach may hold newer copies of that one's intervals,
+ * so it is never skipped on volume.
+ */
+bool IntervalQuery::segmentMayMatch(const interval_segment_header &h)
+{
+    if (h.count == 0 || h.sensor_id != query.sensorId ||
+            h.request_type != query.requestType ||
+            h.ts_max < query.from || h.ts_min >= query.to) {
+        return false;
+    }
+    if (!query.lanes.isEmpty() && !query.lanes.contains(h.lane_appr_num)) {
+        return false;
+    }
+
+    QHash<quint32, qint64>::iterator newest = newestScanned.find(h.lane_appr_num);
+    if (newest != newestScanned.end() && h.ts_min <= newest.value()) {
+        overlapping = true;
+    } else {
+        for (int i=0; i<query.where.size(); i++) {
+            const query_predicate &p = query.where.at(i);
+            if (p.column != QUERY_COL_VOLUME) {
+                continue;
+            }
+            double lo = h.volume_min;
+            double hi = h.volume_max;
+            if ((p.op == '>' && hi <= p.value) || (p.op == 'g' && hi < p.value) ||
+                    (p.op == '<' && lo >= p.value) || (p.op == 'l' && lo > p.value) ||
+                    (p.op == '=' && (p.value < lo || p.value > hi))) {
+                return false;
+            }
+        }
+    }
+    if (newest == newestScanned.end() || h.ts_max > newest.value()) {
+        newestScanned[h.lane_appr_num] = h.ts_max;
+    }
+    return true;
+}
+
+bool IntervalQuery::inScope(const interval_record &r) const
+{
+    if (r.timestamp < query.from || r.timestamp >= query.to) {
+        return false;
+    }
+    return query.duration == 0 || r.interval_duration == query.duration;
+}
+
+bool IntervalQuery::matches(const interval_record &r) const
+{
+    if (!inScope(r)) {
+        return false;
+    }
+    if (query.speedValid && !(r.avg_speed & 0x800000)) {
+        return false;
+    }
+    if (query.clean && (r.quality & QUALITY_EXCLUDE)) {
+        return false;
+    }
+    for (int i=0; i<query.where.size(); i++) {
+        const query_predicate &p = query.where.at(i);
+        if (!compare(query_column_value(r, p.column), p.op, p.value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void IntervalQuery::group(const interval_record &r, QHash<quint64, interval_sum> *groups) const
+{
+    qint64 bucket = r.timestamp - r.timestamp % query.groupSecs;
+    uint8_t lane = query.byLane ? r.lane_appr_num : 0xFF;
+    quint64 key = (static_cast<quint64>(bucket) << 8) | lane;
+    QHash<quint64, interval_sum>::iterator it = groups->find(key);
+    if (it == groups->end()) {
+        interval_sum g;
+        interval_sum_open(&g, r, bucket,
+                          static_cast<uint16_t>(qMin(query.groupSecs, 0xFFFF)));
+        g.acc.lane_appr_num = lane;
+        it = groups->insert(key, g);
+    }
+    interval_sum_add(&it.value(), r);
+}
+
+/**
+ * @brief IntervalQuery::planBuffer: Walks the segment headers of one file and
+ * splits the segments that may match into tasks of about QUERY_TASK_BYTES
+ */
+void IntervalQuery::planBuffer(const char *data, qint64 len, QVector<scan_task> *tasks)
+{
+    scan_task t;
+    t.data = data;
+    t.len = len;
+    t.scanned = 0;
+    qint64 taskBytes = 0;
+
+    qint64 pos = 0;
+    interval_segment_header h;
+    while (read_interval_segment_header(data + pos,
+                                        static_cast<int>(qMin<qint64>(len - pos, 0x7FFFFFFF)),
+                                        &h)) {
+        qint64 size = INTERVAL_SEGMENT_HEADER_SIZE + static_cast<qint64>(h.payload_size);
+        if (pos + size > len) {
+            break;
+        }
+        segments++;
+        if (segmentMayMatch(h)) {
+            t.offsets.append(pos);
+            taskBytes += size;
+            if (taskBytes >= QUERY_TASK_BYTES) {
+                tasks->append(t);
+                t.offsets.clear();
+                taskBytes = 0;
+            }
+        } else {
+            skipped++;
+        }
+        pos += size;
+    }
+    if (!t.offsets.isEmpty()) {
+        tasks->append(t);
+    }
+}
+
+/**
+ * @brief IntervalQuery::scan: Decodes a task's segments and filters (and
+ * groups) their intervals. Runs on a pool thread; only touches the task.
+ */
+void IntervalQuery::scan(scan_task &t) const
+{
+    QVector<interval_record> buf;
+    for (int s=0; s<t.offsets.size(); s++) {
+        const char *seg = t.data + t.offsets.at(s);
+        interval_segment_header h;
+        int avail = static_cast<int>(qMin<qint64>(t.len - t.offsets.at(s), 0x7FFFFFFF));
+        if (!read_interval_segment_header(seg, avail, &h) ||
+                h.payload_size > static_cast<quint32>(avail - INTERVAL_SEGMENT_HEADER_SIZE)) {
+            continue;
+        }
+        if (buf.size() < static_cast<int>(h.count)) {
+            buf.resize(h.count);
+        }
+        int n = decode_interval_segment(seg, avail, buf.data(), h.count, false);
+        if (n < 0) {
+            continue;
+        }
+        t.scanned += n;
+
+        for (int i=0; i<n; i++) {
+            const interval_record &r = buf.at(i);
+            if (overlapping) {
+                // filtered once the older copies are gone
+                if (inScope(r)) {
+                    t.rows.append(r);
+                }
+                continue;
+            }
+            if (!matches(r)) {
+                continue;
+            }
+            if (query.groupSecs <= 0) {
+                t.rows.append(r);
+                continue;
+            }
+            group(r, &t.groups);
+        }
+    }
+}
+
+static bool earlier(const interval_record &a, const interval_record &b)
+{
+    if (a.timestamp != b.timestamp) {
+        return a.timestamp < b.timestamp;
+    }
+    return a.lane_appr_num < b.lane_appr_num;
+}
+
+/**
+ * @brief IntervalQuery::keepLastCopies: Drops every interval that is stored
+ * again later on (tasks, their segments and the intervals in them are in
+ * file order), then filters and groups what is left
+ */
+void IntervalQuery::keepLastCopies(QVector<scan_task> &tasks)
+{
+    // the sensor and request type are the query's; ts takes the top 40 bits
+    QHash<quint64, QPair<int, int> > last;
+    for (int i=0; i<tasks.size(); i++) {
+        const QVector<interval_record> &rows = tasks.at(i).rows;
+        for (int j=0; j<rows.size(); j++) {
+            const interval_record &r = rows.at(j);
+            quint64 key = (static_cast<quint64>(r.timestamp) << 24) |
+                    (static_cast<quint64>(r.interval_duration) << 8) | r.lane_appr_num;
+            last[key] = qMakePair(i, j);
+        }
+    }
+
+    QHash<quint64, QPair<int, int> >::const_iterator it;
+    for (it = last.constBegin(); it != last.constEnd(); ++it) {
+        const interval_record &r = tasks.at(it.value().first).rows.at(it.value().second);
+        if (!matches(r)) {
+            continue;
+        }
+        if (query.groupSecs <= 0) {
+            result.append(r);
+        } else {
+            group(r, &tasks[0].groups);
+        }
+    }
+    for (int i=0; i<tasks.size(); i++) {
+        tasks[i].rows.clear();
+    }
+}
+
+void IntervalQuery::collect(QVector<scan_task> &tasks)
+{
+    QtConcurrent::blockingMap(tasks, [this](scan_task &t) { scan(t); });
+    if (overlapping && !tasks.isEmpty()) {
+        keepLastCopies(tasks);
+    }
+
+    QHash<quint64, interval_sum> groups;
+    for (int i=0; i<tasks.size(); i++) {
+        scan_task &t = tasks[i];
+        scanned += t.scanned;
+        if (query.groupSecs <= 0) {
+            result += t.rows;
+            continue;
+        }
+        QHash<quint64, interval_sum>::const_iterator it;
+        for (it = t.groups.constBegin(); it != t.groups.constEnd(); ++it) {
+            QHash<quint64, interval_sum>::iterator g = groups.find(it.key());
+            if (g == groups.end()) {
+                groups.insert(it.key(), it.value());
+            } else {
+                interval_sum_merge(&g.value(), it.value());
+            }
+        }
+    }
+    if (query.groupSecs > 0) {
+        QHash<quint64, interval_sum>::const_iterator it;
+        for (it = groups.constBegin(); it != groups.constEnd(); ++it) {
+            result.append(interval_sum_finish(it.value()));
+        }
+    }
+    std::sort(result.begin(), result.end(), earlier);
+}
+
+/**
+ * @brief IntervalQuery::runBuffer: Runs the query over segments already in memory
+ * @return number of result rows
+ */
+int IntervalQuery::runBuffer(const char *data, qint64 len)
+{
+    QElapsedTimer timer;
+    timer.start();
+    result.clear();
+    newestScanned.clear();
+    overlapping = false;
+    QVector<scan_task> tasks;
+    planBuffer(data, len, &tasks);
+    collect(tasks);
+    elapsedNs = timer.nsecsElapsed();
+    return result.size();
+}
+
+/**
+ * @brief IntervalQuery::runFiles: Runs the query over segment files, mapped
+ * into memory rather than read
+ * @return number of result rows, or -1 if a file couldn't be opened
+ */
+int IntervalQuery::runFiles(const QStringList &files)
+{
+    QElapsedTimer timer;
+    timer.start();
+    result.clear();
+    newestScanned.clear();
+    overlapping = false;
+
+    QVector<QFile *> opened;
+    QVector<QByteArray> copies;
+    QVector<scan_task> tasks;
+    copies.reserve(files.size());
+    int rc = 0;
+    for (int i=0; i<files.size(); i++) {
+        QFile *f = new QFile(files.at(i));
+        opened.append(f);
+        if (!f->open(QIODevice::ReadOnly)) {
+            fprintf(stderr, "Couldn't open %s\n", files.at(i).toLatin1().constData());
+            rc = -1;
+            break;
+        }
+        qint64 size = f->size();
+        const char *data = reinterpret_cast<const char *>(f->map(0, size));
+        if (data == nullptr && size > 0) {
+            copies.append(f->readAll());
+            data = copies.last().constData();
+        }
+        planBuffer(data, size, &tasks);
+    }
+    if (rc == 0) {
+        collect(tasks);
+        rc = result.size();
+    }
+    for (int i=0; i<opened.size(); i++) {
+        opened.at(i)->close();
+        delete opened.at(i);
+    }
+    elapsedNs = timer.nsecsElapsed();
+    return rc;
+}
+
+/**
+ * @brief IntervalQuery::print: Writes the projected columns as CSV to stdout
+ * and the scan statistics to stderr
+ */
+void IntervalQuery::print() const
+{
+    for (int c=0; c<query.columns.size(); c++) {
+        printf("%s%s", c ? "," : "", COLUMN_NAMES[query.columns.at(c)]);
+    }
+    printf("\n");
+
+    for (int i=0; i<result.size(); i++) {
+        const interval_record &r = result.at(i);
+        for (int c=0; c<query.columns.size(); c++) {
+            int col = query.columns.at(c);
+            if (c) {
+                printf(",");
+            }
+            if (col == QUERY_COL_TS) {
+                printf("%s", QDateTime::fromSecsSinceEpoch(r.timestamp, Qt::UTC)
+                       .toString("yyyy-MM-dd hh:mm:ss").toLatin1().constData());
+            } else if (col == QUERY_COL_LANE && r.lane_appr_num == 0xFF) {
+                printf("all");
+            } else {
+                double v = query_column_value(r, col);
+                if (!isnan(v)) {
+                    printf("%g", v);
+                }
+            }
+        }
+        printf("\n");
+    }
+
+    fprintf(stderr, "%d rows; %lld of %lld segments skipped, %lld intervals scanned "
+            "in %.1f ms\n", result.size(), skipped, segments, scanned, elapsedNs / 1e6);
+}
+
+static bool parseTime(const QString &s, qint64 *t)
+{
+    QDateTime dt = QDateTime::fromString(s, "yyyy-MM-ddThh:mm:ss");
+    if (!dt.isValid()) {
+        dt = QDateTime::fromString(s, "yyyy-MM-dd");
+    }
+    dt.setTimeSpec(Qt::UTC);
+    if (!dt.isValid()) {
+        return false;
+    }
+    *t = dt.toSecsSinceEpoch();
+    return true;
+}
+
+static bool parsePredicate(const QString &s, query_predicate *p)
+{
+    const char *ops[6] = { ">=", "<=", "!=", ">", "<", "=" };
+    const char codes[6] = { 'g', 'l', '!', '>', '<', '=' };
+    for (int i=0; i<6; i++) {
+        int at = s.indexOf(ops[i]);
+        if (at <= 0) {
+            continue;
+        }
+        bool ok;
+        p->column = columnIndex(s.left(at).trimmed());
+        p->op = codes[i];
+        p->value = s.mid(at + static_cast<int>(strlen(ops[i]))).trimmed().toDouble(&ok);
+        return ok && p->column >= 0;
+    }
+    return false;
+}
+
+/**
+ * @brief IntervalQuery::parseArgs: Reads a query from the command line:
+ *   --query <file>... --sensor <id> [--approaches] [--lanes 0,1] [--from <date>]
+ *   [--to <date>] [--duration <secs>] [--where <column><op><value>]...
+ *   [--where speed-valid] [--where clean] [--columns ts,lane,volume]
+ *   [--group <secs>] [--by-lane]
+ * Dates are yyyy-MM-dd or yyyy-MM-ddThh:mm:ss, UTC.
+ * @param at: index of --query
+ * @return false on a bad argument
+ */
+bool IntervalQuery::parseArgs(const QStringList &args, int at, interval_query *q,
+                              QStringList *files)
+{
+    defaults(q);
+    int i = at + 1;
+    for (; i<args.size() && !args.at(i).startsWith("--"); i++) {
+        files->append(args.at(i));
+    }
+    bool haveSensor = false;
+    for (; i<args.size(); i++) {
+        const QString &a = args.at(i);
+        bool hasValue = i + 1 < args.size();
+        bool ok = true;
+        if (a == "--sensor" && hasValue) {
+            q->sensorId = static_cast<uint16_t>(args.at(++i).toUInt(&ok));
+            haveSensor = ok;
+        } else if (a == "--approaches") {
+            q->requestType = 2;
+        } else if (a == "--lanes" && hasValue) {
+            QStringList l = args.at(++i).split(',');
+            for (int k=0; k<l.size() && ok; k++) {
+                q->lanes.append(static_cast<uint8_t>(l.at(k).toUInt(&ok)));
+            }
+        } else if (a == "--from" && hasValue) {
+            ok = parseTime(args.at(++i), &q->from);
+        } else if (a == "--to" && hasValue) {
+            ok = parseTime(args.at(++i), &q->to);
+        } else if (a == "--duration" && hasValue) {
+            q->duration = static_cast<uint16_t>(args.at(++i).toUInt(&ok));
+        } else if (a == "--where" && hasValue) {
+            QString w = args.at(++i);
+            if (w == "speed-valid") {
+                q->speedValid = true;
+            } else if (w == "clean") {
+                q->clean = true;
+            } else {
+                query_predicate p;
+                ok = parsePredicate(w, &p);
+                q->where.append(p);
+            }
+        } else if (a == "--columns" && hasValue) {
+            QStringList c = args.at(++i).split(',');
+            q->columns.clear();
+            for (int k=0; k<c.size() && ok; k++) {
+                int col = columnIndex(c.at(k).trimmed());
+                ok = col >= 0;
+                q->columns.append(col);
+            }
+        } else if (a == "--group" && hasValue) {
+            q->groupSecs = args.at(++i).toInt(&ok);
+            ok = ok && q->groupSecs > 0;
+        } else if (a == "--by-lane") {
+            q->byLane = true;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            fprintf(stderr, "Bad query argument %s\n", a.toLatin1().constData());
+            return false;
+        }
+    }
+    if (files->isEmpty() || !haveSensor) {
+        fprintf(stderr, "usage: --query <file>... --sensor <id> [--approaches] [--lanes 0,1] "
+                "[--from date] [--to date] [--duration secs] [--where expr]... "
+                "[--columns list] [--group secs] [--by-lane]\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief IntervalQuery::benchmark: Writes a year of 1 minute intervals for
+ * two 4-lane sensors to a segment file, then asks for one sensor's hourly
+ * volume over the year and prints how long it took
+ * @param fileName: removed afterwards
+ */
+void IntervalQuery::benchmark(const QString &fileName)
+{
+    const qint64 start = 1546300800;    // 2019-01-01
+    const int minutes = 365 * 24 * 60;
+    const int perSegment = 288;
+
+    QFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        printf("Couldn't create %s\n", fileName.toLatin1().constData());
+        return;
+    }
+    QVector<interval_record> seg(perSegment);
+    quint64 expected = 0;
+    for (int m=0; m<minutes; m+=perSegment) {
+        int n = qMin(perSegment, minutes - m);
+        for (int sensor=1; sensor<=2; sensor++) {
+            for (int lane=0; lane<4; lane++) {
+                for (int k=0; k<n; k++) {
+                    interval_record &r = seg[k];
+                    memset(&r, 0, sizeof(r));
+                    r.sensor_id = static_cast<uint16_t>(sensor);
+                    r.request_type = 1;
+                    r.lane_appr_num = static_cast<uint8_t>(lane);
+                    r.timestamp = start + static_cast<qint64>(m + k) * 60;
+                    r.interval_duration = 60;
+                    r.num_lanes = 4;
+                    r.volume = static_cast<uint32_t>((m + k + lane * 7) % 31);
+                    r.avg_speed = 0x800000 | static_cast<uint32_t>((35 + (m + k) % 30) << 8);
+                    r.avg_occupancy = static_cast<uint16_t>(((m + k) % 40) << 8);
+                    r.speed_85 = r.avg_speed + (5 << 8);
+                    r.num_speed_bins = 8;
+                    for (int b=0; b<8; b++) {
+                        r.speed_bins[b] = r.volume / 8;
+                    }
+                    if (sensor == 1) {
+                        expected += r.volume;
+                    }
+                }
+                f.write(encode_interval_segment(seg.constData(), n));
+            }
+        }
+    }
+    f.close();
+
+    interval_query q;
+    defaults(&q);
+    q.sensorId = 1;
+    q.from = start;
+    q.to = start + static_cast<qint64>(minutes) * 60;
+    q.groupSecs = 3600;
+    q.columns.clear();
+    q.columns << QUERY_COL_TS << QUERY_COL_VOLUME;
+
+    IntervalQuery query(q);
+    int rows = query.runFiles(QStringList() << fileName);
+    quint64 total = 0;
+    for (int i=0; i<query.rows().size(); i++) {
+        total += query.rows().at(i).volume;
+    }
+    printf("One year, one sensor, hourly volume: %d rows in %.1f ms "
+           "(%lld of %lld segments skipped, %lld intervals scanned), volume %s\n",
+           rows, query.elapsedNs / 1e6, query.skipped, query.segments, query.scanned,
+           total == expected ? "matches" : "MISMATCH");
+    QFile::remove(fileName);
+}
@@ -0,0 +1,105 @@
+#ifndef INTERVALQUERY_H
+#define INTERVALQUERY_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "interval_codec.h"
+#include "rollupengine.h"
+#include "sensor_utils.h"
+
+// columns a query can return or filter on
+#define QUERY_COL_TS            0
+#define QUERY_COL_LANE          1
+#define QUERY_COL_DURATION      2
+#define QUERY_COL_VOLUME        3
+#define QUERY_COL_SPEED         4
+#define QUERY_COL_OCCUPANCY     5
+#define QUERY_COL_SPEED_85      6
+#define QUERY_COL_HEADWAY       7
+#define QUERY_COL_GAP           8
+#define QUERY_COL_QUALITY       9
+#define QUERY_NUM_COLS          10
+
+// column op value, e.g. volume > 0; op is one of > < = ! (not equal), g (>=), l (<=)
+struct query_predicate {
+    int column;
+    char op;
+    double value;
+};
+
+struct interval_query {
+    uint16_t sensorId;
+    uint8_t requestType;        // 1 = lanes, 2 = approaches
+    QVector<uint8_t> lanes;     // empty = all
+    qint64 from;                // [from, to), UTC seconds
+    qint64 to;
+    uint16_t duration;          // only intervals of this length, 0 = any
+    QVector<query_predicate> where;
+    bool speedValid;
+    bool clean;                 // leave out intervals flagged QUALITY_EXCLUDE
+    QVector<int> columns;       // QUERY_COL_*, in output order
+    int groupSecs;              // 0 = no grouping
+    bool byLane;                // grouped: one row per lane instead of per sensor
+};
+
+// Scans segment files (the interval store's .seg files, raw or rollups) for
+// one sensor's lanes or approaches over a time range. Segment headers are
+// checked first, so segments of other lanes, outside the range or whose
+// volume min/max can't satisfy a volume predicate are never decoded; the
+// rest are decoded without their bins and scanned on all cores, each thread
+// filtering and grouping its own share before the partial groups are merged.
+// Grouping combines intervals the same way rollups do (interval_sum).
+// A rollup bucket amended by a late interval is stored again further on, so
+// when a segment overlaps an earlier one of the same lane/approach (as the
+// levels of a rollup file always do) only the last copy of each interval
+// counts: the threads then just decode, and the copies are weeded out before
+// filtering and grouping.
+class IntervalQuery
+{
+public:
+    explicit IntervalQuery(const interval_query &q);
+    int runFiles(const QStringList &files);
+    int runBuffer(const char *data, qint64 len);
+    const QVector<interval_record> &rows() const;
+    void print() const;
+
+    static bool parseArgs(const QStringList &args, int at, interval_query *q,
+                          QStringList *files);
+    static void defaults(interval_query *q);
+    static void benchmark(const QString &fileName);
+
+private:
+    struct scan_task {
+        const char *data;
+        qint64 len;
+        QVector<qint64> offsets;        // candidate segments in data
+        QVector<interval_record> rows;
+        QHash<quint64, interval_sum> groups;
+        qint64 scanned;
+    };
+
+    bool segmentMayMatch(const interval_segment_header &h);
+    bool inScope(const interval_record &r) const;
+    bool matches(const interval_record &r) const;
+    void group(const interval_record &r, QHash<quint64, interval_sum> *groups) const;
+    void keepLastCopies(QVector<scan_task> &tasks);
+    void planBuffer(const char *data, qint64 len, QVector<scan_task> *tasks);
+    void scan(scan_task &t) const;
+    void collect(QVector<scan_task> &tasks);
+
+    interval_query query;
+    QVector<interval_record> result;
+    QHash<quint32, qint64> newestScanned;   // ts_max of segments to decode, per lane
+    bool overlapping;                       // some interval may be stored twice
+    qint64 segments;
+    qint64 skipped;
+    qint64 scanned;
+    qint64 elapsedNs;
+};
+
+double query_column_value(const interval_record &r, int column);
+
+#endif // INTERVALQUERY_H
@@ -0,0 +1,165 @@
+#include "intervalstore.h"
+
+#include <QElapsedTimer>
+
+IntervalStore::IntervalStore(const QString &fileName, int segmentCapacity)
+{
+    file.setFileName(fileName);
+    journal = nullptr;
+    capacity = segmentCapacity;
+    writeFailed = false;
+}
+
+IntervalStore::~IntervalStore()
+{
+    flush();
+    file.close();
+}
+
+void IntervalStore::setJournalPtr(RecordJournal *j)
+{
+    journal = j;
+}
+
+QString IntervalStore::fileName() const
+{
+    return file.fileName();
+}
+
+void IntervalStore::append(const interval_record &r)
+{
+    // intervals of different lengths (rollup levels) never share a segment
+    quint64 key = (static_cast<quint64>(r.interval_duration) << 32) |
+            interval_key(r.sensor_id, r.request_type, r.lane_appr_num);
+    QVector<interval_record> &seg = openSegments[key];
+    if (seg.isEmpty()) {
+        seg.reserve(capacity);
+    }
+    seg.append(r);
+    if (seg.size() >= capacity) {
+        closeSegment(&seg);
+    }
+}
+
+/**
+ * @brief IntervalStore::flush: Closes every open segment, however short, and
+ * writes it out to disk
+ * @return true once everything appended so far is on disk
+ */
+bool IntervalStore::flush()
+{
+    QHash<quint64, QVector<interval_record> >::iterator it;
+    for (it = openSegments.begin(); it != openSegments.end(); ++it) {
+        if (!it.value().isEmpty()) {
+            closeSegment(&it.value());
+        }
+    }
+    if (file.isOpen() && !flushToDisk(&file)) {
+        printf("Couldn't sync segment file.\n");
+        return false;
+    }
+    // a segment lost earlier stays lost; the journal has to keep it
+    return !writeFailed;
+}
+
+void IntervalStore::closeSegment(QVector<interval_record> *seg)
+{
+    if (!file.isOpen() && !file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        printf("Couldn't open segment file.\n");
+        writeFailed = true;
+        return;
+    }
+
+    QByteArray encoded = encode_interval_segment(seg->constData(), seg->size());
+    if (file.write(encoded) != encoded.size()) {
+        printf("Segment write failed.\n");
+        writeFailed = true;
+    } else if (journal != nullptr) {
+        // the journal only lets go of intervals that are on disk here
+        if (flushToDisk(&file)) {
+            journal->markStored(seg->constData(), seg->size());
+        } else {
+            printf("Couldn't sync segment file.\n");
+        }
+    }
+
+    printf("Segment closed: %d intervals, %d bytes\n", seg->size(), encoded.size());
+    seg->clear();
+}
+
+/**
+ * @brief keep_last_copies: Drops intervals that are stored again further on
+ * (rollup buckets amended by a late interval), keeping the order of the rest
+ * @param recs
+ * @param from: only intervals from here on are looked at
+ * @return number dropped
+ */
+static int keep_last_copies(QVector<interval_record> *recs, int from)
+{
+    // per lane/approach: (ts << 16 | duration) -> index of the last copy
+    QHash<quint32, QHash<quint64, int> > last;
+    for (int i=from; i<recs->size(); i++) {
+        const interval_record &r = recs->at(i);
+        quint64 k = (static_cast<quint64>(r.timestamp) << 16) | r.interval_duration;
+        last[interval_key(r.sensor_id, r.request_type, r.lane_appr_num)][k] = i;
+    }
+    int kept = from;
+    for (int i=from; i<recs->size(); i++) {
+        const interval_record &r = recs->at(i);
+        quint64 k = (static_cast<quint64>(r.timestamp) << 16) | r.interval_duration;
+        if (last.value(interval_key(r.sensor_id, r.request_type, r.lane_appr_num)).value(k) == i) {
+            (*recs)[kept++] = r;
+        }
+    }
+    int dropped = recs->size() - kept;
+    recs->resize(kept);
+    return dropped;
+}
+
+/**
+ * @brief IntervalStore::readAll: Decodes every segment in a segment file.
+ * Where an interval is stored more than once, the last copy is the one kept.
+ * @param fileName
+ * @param out: decoded intervals are appended here
+ * @return number of intervals appended, or -1 if the file couldn't be read
+ */
+int IntervalStore::readAll(const QString &fileName, QVector<interval_record> *out)
+{
+    QFile f(fileName);
+    if (!f.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    QByteArray data = f.readAll();
+    f.close();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int total = 0;
+    int pos = 0;
+    interval_segment_header h;
+    while (read_interval_segment_header(data.constData() + pos, data.size() - pos, &h)) {
+        if (h.payload_size > static_cast<quint32>(data.size() - pos - INTERVAL_SEGMENT_HEADER_SIZE)) {
+            // torn last segment
+            break;
+        }
+        int start = out->size();
+        out->resize(start + h.count);
+        int n = decode_interval_segment(data.constData() + pos, data.size() - pos,
+                                        out->data() + start, h.count);
+        if (n < 0) {
+            // torn or corrupt segment: keep what was decoded so far
+            out->resize(start);
+            break;
+        }
+        total += n;
+        pos += INTERVAL_SEGMENT_HEADER_SIZE + h.payload_size;
+    }
+
+    qint64 ns = timer.nsecsElapsed();
+    if (ns > 0 && total > 0) {
+        printf("Decoded %d intervals from %d bytes in %.3f ms (%.2f GB/s)\n",
+               total, pos, ns / 1e6, static_cast<double>(pos) / ns);
+    }
+    return total - keep_last_copies(out, out->size() - total);
+}
@@ -0,0 +1,39 @@
+#ifndef INTERVALSTORE_H
+#define INTERVALSTORE_H
+
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include "interval_codec.h"
+#include "recordjournal.h"
+#include "sensor_utils.h"
+
+// Collects decoded intervals per sensor lane/approach and appends each run
+// to the segment file as a compressed segment once it fills up (or on flush).
+// With a journal set, a segment is synced as it is written and its intervals
+// are then marked as stored in the journal.
+class IntervalStore
+{
+public:
+    explicit IntervalStore(const QString &fileName, int segmentCapacity = 288);
+    ~IntervalStore();
+    void setJournalPtr(RecordJournal *j);
+    void append(const interval_record &r);
+    bool flush();
+    QString fileName() const;
+
+    static int readAll(const QString &fileName, QVector<interval_record> *out);
+
+private:
+    void closeSegment(QVector<interval_record> *seg);
+
+    QFile file;
+    RecordJournal *journal;
+    int capacity;
+    bool writeFailed;       // a segment never made it to the file
+    QHash<quint64, QVector<interval_record> > openSegments;
+};
+
+#endif // INTERVALSTORE_H
@@ -0,0 +1,269 @@
+#include "lanechart.h"
+#include "commands.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPolygonF>
+#include <QWheelEvent>
+
+static const char *PANEL_NAMES[CHART_NUM_PANELS] = { "Avg Speed", "Volume", "Occupancy (%)" };
+static const QRgb PANEL_COLORS[CHART_NUM_PANELS] = { 0x1f77b4, 0x2ca02c, 0xd62728 };
+
+// room for the value labels left of the panels and the time labels below
+#define CHART_LEFT_MARGIN       64
+#define CHART_BOTTOM_MARGIN     20
+
+LaneChart::LaneChart(QWidget *parent) : QWidget(parent)
+{
+    currentLane = 0;
+    following = true;
+    viewEnd = 0;
+    viewSpan = CHART_DEFAULT_SPAN;
+    dragX = 0;
+    dragEnd = 0;
+    paints = 0;
+    paintNs = 0;
+    pointsDrawn = 0;
+    // every pixel is painted, so Qt needn't clear the background first
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setMinimumHeight(240);
+}
+
+/**
+ * @brief LaneChart::appendBatch: Adds a frame's worth of intervals to their
+ * lanes' series; repaints once if the lane shown got newer data and the view
+ * is following it
+ * @param batch
+ */
+void LaneChart::appendBatch(const QVector<interval_record> &batch)
+{
+    bool changed = false;
+    for (int i=0; i<batch.size(); i++) {
+        const interval_record &r = batch.at(i);
+        quint32 key = interval_key(r.sensor_id, r.request_type, r.lane_appr_num);
+        QHash<quint32, lane_series>::iterator it = lanes.find(key);
+        if (it == lanes.end()) {
+            it = lanes.insert(key, lane_series());
+            it->latest = 0;
+            emit laneAdded(key, QString("Sensor %1 %2 %3").arg(r.sensor_id)
+                           .arg(r.request_type == 2 ? "Appr" : "Lane")
+                           .arg(r.lane_appr_num));
+        }
+        if (r.quality & QUALITY_EXCLUDE) {
+            continue;
+        }
+
+        if (r.avg_speed & 0x800000) {
+            it->panels[0].append(r.timestamp, static_cast<float>(fixedPt24ToDouble(r.avg_speed)));
+        }
+        it->panels[1].append(r.timestamp, r.volume);
+        it->panels[2].append(r.timestamp, r.avg_occupancy / 256.0f);
+        if (r.timestamp + r.interval_duration > it->latest) {
+            it->latest = r.timestamp + r.interval_duration;
+        }
+        if (key == currentLane) {
+            changed = true;
+        }
+    }
+    if (changed && following && isVisible()) {
+        update();
+    }
+}
+
+/**
+ * @brief LaneChart::setLane: Shows another lane/approach, following its
+ * newest intervals
+ * @param key: interval_key of the lane/approach
+ */
+void LaneChart::setLane(quint32 key)
+{
+    currentLane = key;
+    following = true;
+    update();
+}
+
+QRect LaneChart::plotArea() const
+{
+    return rect().adjusted(CHART_LEFT_MARGIN, 4, -8, -CHART_BOTTOM_MARGIN);
+}
+
+qint64 LaneChart::timeAt(int x) const
+{
+    QRect plot = plotArea();
+    if (plot.width() <= 0) {
+        return viewEnd;
+    }
+    return viewEnd - viewSpan + (x - plot.left()) * viewSpan / plot.width();
+}
+
+/**
+ * @brief LaneChart::setViewEnd: Moves the right edge of the view; reaching the
+ * newest interval turns following back on
+ * @param end
+ */
+void LaneChart::setViewEnd(qint64 end)
+{
+    QHash<quint32, lane_series>::const_iterator it = lanes.constFind(currentLane);
+    qint64 latest = it != lanes.constEnd() ? it->latest : end;
+    following = end >= latest;
+    viewEnd = following ? latest : end;
+}
+
+void LaneChart::paintEvent(QPaintEvent *)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QPainter p(this);
+    p.fillRect(rect(), palette().color(QPalette::Base));
+    QRect plot = plotArea();
+    QHash<quint32, lane_series>::const_iterator it = lanes.constFind(currentLane);
+    if (it == lanes.constEnd() || plot.width() < 3 || plot.height() < 3 * CHART_NUM_PANELS) {
+        p.setPen(palette().color(QPalette::Text));
+        p.drawText(rect(), Qt::AlignCenter, "No data yet");
+        return;
+    }
+    if (following) {
+        viewEnd = it->latest;
+    }
+
+    int h = plot.height() / CHART_NUM_PANELS;
+    for (int i=0; i<CHART_NUM_PANELS; i++) {
+        drawPanel(&p, QRect(plot.left(), plot.top() + i * h, plot.width(), h - 8),
+                  it->panels[i], i);
+    }
+
+    // time axis: both ends and the span
+    QString fmt = viewSpan > 2 * 86400 ? "MM/dd hh:mm" : "MM/dd hh:mm:ss";
+    QRect axis(plot.left(), plot.bottom() + 2, plot.width(), CHART_BOTTOM_MARGIN - 2);
+    p.setPen(palette().color(QPalette::Text));
+    p.drawText(axis, Qt::AlignLeft | Qt::AlignVCenter,
+               QDateTime::fromSecsSinceEpoch(viewEnd - viewSpan, Qt::UTC).toString(fmt));
+    p.drawText(axis, Qt::AlignRight | Qt::AlignVCenter,
+               QDateTime::fromSecsSinceEpoch(viewEnd, Qt::UTC).toString(fmt) +
+               (following ? " (live)" : ""));
+    p.drawText(axis, Qt::AlignHCenter | Qt::AlignVCenter,
+               viewSpan >= 2 * 86400 ? QString("%1 days").arg(viewSpan / 86400.0, 0, 'f', 1) :
+                                       QString("%1 h").arg(viewSpan / 3600.0, 0, 'f', 1));
+
+    paintNs += timer.nsecsElapsed();
+    paints++;
+    if (paints % CHART_REPORT_PAINTS == 0) {
+        printf("Chart: %lld repaints, %.3f ms and %lld points per repaint\n",
+               paints, paintNs / 1e6 / paints, pointsDrawn / paints);
+    }
+}
+
+/**
+ * @brief LaneChart::drawPanel: One metric over the view, downsampled to the
+ * panel's pixel width and scaled to the range of what is shown
+ * @param p
+ * @param r: panel rectangle
+ * @param s
+ * @param panel: 0 speed, 1 volume, 2 occupancy
+ */
+void LaneChart::drawPanel(QPainter *p, const QRect &r, const LttbSeries &s, int panel)
+{
+    qint64 from = viewEnd - viewSpan;
+    s.select(from, viewEnd, r.width(), &points);
+    pointsDrawn += points.size();
+
+    p->setPen(palette().color(QPalette::Mid));
+    p->drawRect(r);
+    p->setPen(palette().color(QPalette::Text));
+    p->drawText(r.adjusted(6, 2, -6, -2), Qt::AlignLeft | Qt::AlignTop,
+                s.size() > 0 ? QString("%1  %2").arg(PANEL_NAMES[panel])
+                               .arg(s.lastValue(), 0, 'f', panel == 1 ? 0 : 2) :
+                               QString(PANEL_NAMES[panel]));
+    if (points.isEmpty()) {
+        return;
+    }
+
+    // volume and occupancy from zero, speed over its own range
+    float lo = points.at(0).v;
+    float hi = lo;
+    for (int i=1; i<points.size(); i++) {
+        if (points.at(i).v < lo) {
+            lo = points.at(i).v;
+        }
+        if (points.at(i).v > hi) {
+            hi = points.at(i).v;
+        }
+    }
+    if (panel != 0) {
+        lo = 0;
+    }
+    if (hi <= lo) {
+        hi = lo + 1;
+    }
+    p->drawText(QRect(0, r.top(), CHART_LEFT_MARGIN - 4, 16), Qt::AlignRight | Qt::AlignTop,
+                QString::number(hi, 'f', panel == 1 ? 0 : 1));
+    p->drawText(QRect(0, r.bottom() - 16, CHART_LEFT_MARGIN - 4, 16),
+                Qt::AlignRight | Qt::AlignBottom, QString::number(lo, 'f', panel == 1 ? 0 : 1));
+
+    QPolygonF line;
+    line.reserve(points.size());
+    double xScale = static_cast<double>(r.width()) / viewSpan;
+    double yScale = r.height() / static_cast<double>(hi - lo);
+    for (int i=0; i<points.size(); i++) {
+        line.append(QPointF(r.left() + (static_cast<qint64>(points.at(i).t) - from) * xScale,
+                            r.bottom() - (points.at(i).v - lo) * yScale));
+    }
+    p->save();
+    p->setClipRect(r);
+    p->setRenderHint(QPainter::Antialiasing);
+    p->setPen(QPen(QColor(PANEL_COLORS[panel]), 1.5));
+    p->drawPolyline(line);
+    p->restore();
+}
+
+/**
+ * @brief LaneChart::wheelEvent: Zooms around the time under the cursor
+ * @param event
+ */
+void LaneChart::wheelEvent(QWheelEvent *event)
+{
+    qint64 anchor = timeAt(event->pos().x());
+    double factor = event->angleDelta().y() > 0 ? 0.8 : 1.25;
+    qint64 span = static_cast<qint64>(viewSpan * factor);
+    if (span < CHART_MIN_SPAN) {
+        span = CHART_MIN_SPAN;
+    }
+    if (span > CHART_MAX_SPAN) {
+        span = CHART_MAX_SPAN;
+    }
+    qint64 end = anchor + (viewEnd - anchor) * span / viewSpan;
+    viewSpan = span;
+    setViewEnd(end);
+    update();
+    event->accept();
+}
+
+void LaneChart::mousePressEvent(QMouseEvent *event)
+{
+    dragX = event->x();
+    dragEnd = viewEnd;
+}
+
+/**
+ * @brief LaneChart::mouseMoveEvent: Pans while the left button is held
+ * @param event
+ */
+void LaneChart::mouseMoveEvent(QMouseEvent *event)
+{
+    int w = plotArea().width();
+    if (!(event->buttons() & Qt::LeftButton) || w <= 0) {
+        return;
+    }
+    setViewEnd(dragEnd + (dragX - event->x()) * viewSpan / w);
+    update();
+}
+
+void LaneChart::mouseDoubleClickEvent(QMouseEvent *)
+{
+    following = true;
+    viewSpan = CHART_DEFAULT_SPAN;
+    update();
+}
@@ -0,0 +1,68 @@
+#ifndef LANECHART_H
+#define LANECHART_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+#include <QWidget>
+
+#include "lttb.h"
+#include "sensor_utils.h"
+
+#define CHART_NUM_PANELS        3
+#define CHART_DEFAULT_SPAN      (6 * 3600)
+#define CHART_MIN_SPAN          600
+#define CHART_MAX_SPAN          (14 * 24 * 3600)
+#define CHART_REPORT_PAINTS     600
+
+// Speed, volume and occupancy of one lane or approach over time, stacked,
+// drawn with QPainter straight from LTTB series kept per lane. Intervals come
+// in once per frame from LiveViewFeed. Each panel draws about one point per
+// pixel of width whatever the span shown, so zooming (wheel) and panning
+// (drag) over a week of intervals only costs a few thousand points per
+// repaint. Double-click goes back to following the newest intervals.
+// Intervals flagged with any of QUALITY_EXCLUDE aren't plotted.
+class LaneChart : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit LaneChart(QWidget *parent = nullptr);
+    void appendBatch(const QVector<interval_record> &batch);
+    void setLane(quint32 key);
+
+signals:
+    void laneAdded(quint32 key, QString name);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+
+private:
+    struct lane_series {
+        LttbSeries panels[CHART_NUM_PANELS];   // speed, volume, occupancy
+        qint64 latest;                          // end of the newest interval
+    };
+
+    QRect plotArea() const;
+    qint64 timeAt(int x) const;
+    void setViewEnd(qint64 end);
+    void drawPanel(QPainter *p, const QRect &r, const LttbSeries &s, int panel);
+
+    QHash<quint32, lane_series> lanes;
+    quint32 currentLane;
+    bool following;
+    qint64 viewEnd;
+    qint64 viewSpan;
+    int dragX;
+    qint64 dragEnd;
+    QVector<chart_point> points;
+
+    qint64 paints;
+    qint64 paintNs;
+    qint64 pointsDrawn;
+};
+
+#endif // LANECHART_H
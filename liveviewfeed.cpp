@@ -0,0 +1,169 @@
+#include "liveviewfeed.h"
+
+#include <QEvent>
+#include <QScrollBar>
+
+LiveViewFeed::LiveViewFeed(QObject *parent)
+    : QObject(parent), queue(LIVE_VIEW_QUEUE_SIZE)
+{
+    model = nullptr;
+    view = nullptr;
+    chart = nullptr;
+    statusBar = nullptr;
+    statusPending = false;
+    coalesced = true;
+    guiNs = 0;
+    records = 0;
+    updates = 0;
+    repaints = 0;
+    dropped.store(0);
+    frame.reserve(queue.capacity());
+
+    frameTimer = new QTimer(this);
+    frameTimer->setInterval(LIVE_VIEW_FRAME_MS);
+    connect(frameTimer, &QTimer::timeout, this, &LiveViewFeed::drainFrame);
+    frameTimer->start();
+}
+
+void LiveViewFeed::setModelPtr(RecordTableModel *m)
+{
+    model = m;
+}
+
+/**
+ * @brief LiveViewFeed::setViewPtr: The table to keep scrolled to the newest
+ * row; its repaints are counted for the report
+ * @param v
+ */
+void LiveViewFeed::setViewPtr(QTableView *v)
+{
+    view = v;
+    view->viewport()->installEventFilter(this);
+}
+
+void LiveViewFeed::setChartPtr(LaneChart *c)
+{
+    chart = c;
+}
+
+void LiveViewFeed::setStatusBarPtr(QStatusBar *s)
+{
+    statusBar = s;
+}
+
+/**
+ * @brief LiveViewFeed::setCoalesced: Off applies every interval and status
+ * line as it comes, one event each, for comparing against frames
+ * @param on
+ */
+void LiveViewFeed::setCoalesced(bool on)
+{
+    coalesced = on;
+    if (on) {
+        frameTimer->start();
+    } else {
+        frameTimer->stop();
+    }
+}
+
+/**
+ * @brief LiveViewFeed::push: Queues an interval for the next frame. Lock-free;
+ * must only be called from one thread at a time. If the GUI has fallen a whole
+ * queue behind the interval is left out of the table (it is stored either way).
+ * @param r
+ */
+void LiveViewFeed::push(const interval_record &r)
+{
+    if (!queue.push(r)) {
+        dropped++;
+        return;
+    }
+    if (!coalesced) {
+        QMetaObject::invokeMethod(this, "drainFrame", Qt::QueuedConnection);
+    }
+}
+
+/**
+ * @brief LiveViewFeed::postStatus: Worker status lines ("No New Data" and the
+ * like); only the newest one per frame reaches the status bar
+ * @param s
+ */
+void LiveViewFeed::postStatus(QString s)
+{
+    pendingStatus = s;
+    statusPending = true;
+    if (!coalesced) {
+        drainFrame();
+    }
+}
+
+bool LiveViewFeed::eventFilter(QObject *watched, QEvent *event)
+{
+    if (event->type() == QEvent::Paint && records > 0) {
+        repaints++;
+    }
+    return QObject::eventFilter(watched, event);
+}
+
+/**
+ * @brief LiveViewFeed::drainFrame: Applies everything queued since the last
+ * frame as one table update (one interval per call when not coalescing)
+ */
+void LiveViewFeed::drainFrame()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    frame.clear();
+    int n = queue.popAll(&frame, coalesced ? queue.capacity() : 1);
+    if (n > 0 && model != nullptr) {
+        if (records == 0) {
+            window.start();
+        }
+        QScrollBar *bar = view != nullptr ? view->verticalScrollBar() : nullptr;
+        bool following = bar != nullptr && bar->value() == bar->maximum();
+        if (n == 1) {
+            model->append(frame.at(0));
+        } else {
+            model->appendBatch(frame);
+        }
+        if (following) {
+            view->scrollToBottom();
+        }
+        if (chart != nullptr) {
+            chart->appendBatch(frame);
+        }
+        records += n;
+        updates++;
+    }
+    if (statusPending && statusBar != nullptr) {
+        statusBar->showMessage(pendingStatus);
+        statusPending = false;
+    }
+
+    if (records > 0) {
+        guiNs += timer.nsecsElapsed();
+        if (window.elapsed() >= LIVE_VIEW_REPORT_MS) {
+            report();
+        }
+    }
+}
+
+void LiveViewFeed::report()
+{
+    double secs = window.elapsed() / 1000.0;
+    printf("Live view (%s): %lld intervals in %lld updates, %lld repaints, "
+           "%.2f ms GUI time per s",
+           coalesced ? "per frame" : "per interval", records, updates, repaints,
+           guiNs / 1e6 / secs);
+    qint64 lost = dropped.exchange(0);
+    if (lost > 0) {
+        printf(", %lld not shown (queue full)", lost);
+    }
+    printf("\n");
+
+    records = 0;
+    updates = 0;
+    repaints = 0;
+    guiNs = 0;
+}
@@ -0,0 +1,73 @@
+#ifndef LIVEVIEWFEED_H
+#define LIVEVIEWFEED_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QStatusBar>
+#include <QString>
+#include <QTableView>
+#include <QTimer>
+#include <QVector>
+
+#include "lanechart.h"
+#include "recordtablemodel.h"
+#include "sensor_utils.h"
+#include "spscqueue.h"
+
+#define LIVE_VIEW_FRAME_MS      33
+#define LIVE_VIEW_QUEUE_SIZE    8192
+#define LIVE_VIEW_REPORT_MS     10000
+
+// Hands decoded intervals and worker status lines to the live data table at
+// most once per frame. push() only writes to a lock-free single-producer
+// queue, so it is cheap and safe from whichever thread ingests; a timer in the
+// GUI thread drains the queue every LIVE_VIEW_FRAME_MS, inserts everything
+// that arrived as one model update, scrolls once and shows only the newest
+// status line. With coalescing off every interval is its own event and its
+// own update, as before. The lane charts get the same batches. Time spent
+// applying updates and the number of table repaints they cause are reported
+// every LIVE_VIEW_REPORT_MS while data flows.
+class LiveViewFeed : public QObject
+{
+    Q_OBJECT
+public:
+    explicit LiveViewFeed(QObject *parent = nullptr);
+    void setModelPtr(RecordTableModel *m);
+    void setViewPtr(QTableView *v);
+    void setChartPtr(LaneChart *c);
+    void setStatusBarPtr(QStatusBar *s);
+    void setCoalesced(bool on);
+    void push(const interval_record &r);
+
+public slots:
+    void postStatus(QString s);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private slots:
+    void drainFrame();
+
+private:
+    void report();
+
+    SpscQueue<interval_record> queue;
+    QVector<interval_record> frame;
+    RecordTableModel *model;
+    QTableView *view;
+    LaneChart *chart;
+    QStatusBar *statusBar;
+    QTimer *frameTimer;
+    QString pendingStatus;
+    bool statusPending;
+    bool coalesced;
+
+    QElapsedTimer window;
+    qint64 guiNs;
+    qint64 records;
+    qint64 updates;
+    qint64 repaints;
+    std::atomic<qint64> dropped;     // written by the producer
+};
+
+#endif // LIVEVIEWFEED_H
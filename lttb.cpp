@@ -0,0 +1,237 @@
+#include "lttb.h"
+
+#include <algorithm>
+#include <math.h>
+
+static bool pointBefore(const chart_point &p, qint64 t)
+{
+    return p.t < t;
+}
+
+static bool timeBefore(qint64 t, const chart_point &p)
+{
+    return t < p.t;
+}
+
+// twice the area of the triangle a, b, c
+static double triangleArea(const chart_point &a, const chart_point &b,
+                           double cT, double cV)
+{
+    return fabs((static_cast<double>(a.t) - cT) * (b.v - a.v) -
+                (static_cast<double>(a.t) - b.t) * (cV - a.v));
+}
+
+/**
+ * @brief lttb_downsample: Largest-Triangle-Three-Buckets. Keeps the first and
+ * last points and, from each of threshold - 2 equal buckets in between, the
+ * point making the largest triangle with the point kept from the previous
+ * bucket and the average of the next one.
+ * @param in: points in time order
+ * @param n
+ * @param threshold: number of points wanted
+ * @param out
+ * @return number of points in out
+ */
+int lttb_downsample(const chart_point *in, int n, int threshold,
+                    QVector<chart_point> *out)
+{
+    out->clear();
+    if (n <= threshold || threshold < 3) {
+        for (int i=0; i<n; i++) {
+            out->append(in[i]);
+        }
+        return out->size();
+    }
+
+    double every = static_cast<double>(n - 2) / (threshold - 2);
+    int a = 0;
+    out->append(in[0]);
+    for (int i=0; i<threshold-2; i++) {
+        int avgStart = static_cast<int>((i + 1) * every) + 1;
+        int avgEnd = static_cast<int>((i + 2) * every) + 1;
+        if (avgEnd > n) {
+            avgEnd = n;
+        }
+        double avgT = 0;
+        double avgV = 0;
+        for (int j=avgStart; j<avgEnd; j++) {
+            avgT += in[j].t;
+            avgV += in[j].v;
+        }
+        if (avgEnd > avgStart) {
+            avgT /= avgEnd - avgStart;
+            avgV /= avgEnd - avgStart;
+        }
+
+        int start = static_cast<int>(i * every) + 1;
+        int end = static_cast<int>((i + 1) * every) + 1;
+        double maxArea = -1;
+        int next = start;
+        for (int j=start; j<end; j++) {
+            double area = triangleArea(in[a], in[j], avgT, avgV);
+            if (area > maxArea) {
+                maxArea = area;
+                next = j;
+            }
+        }
+        out->append(in[next]);
+        a = next;
+    }
+    out->append(in[n - 1]);
+    return out->size();
+}
+
+LttbSeries::LttbSeries()
+{
+}
+
+int LttbSeries::bucketSize(int level)
+{
+    int b = LTTB_BASE_BUCKET;
+    for (int i=0; i<level; i++) {
+        b *= LTTB_LEVEL_FACTOR;
+    }
+    return b;
+}
+
+/**
+ * @brief LttbSeries::append: Adds a point after the last one. Points that
+ * aren't newer than the last (refetched history) are left out.
+ * @param t
+ * @param v
+ */
+void LttbSeries::append(qint64 t, float v)
+{
+    if (!raw.isEmpty() && t <= raw.last().t) {
+        return;
+    }
+    chart_point p;
+    p.t = static_cast<quint32>(t);
+    p.v = v;
+    raw.append(p);
+
+    if (raw.size() > LTTB_MAX_POINTS) {
+        // bucket boundaries move with the start, so the levels are redone
+        raw.remove(0, raw.size() / 2);
+        for (int l=0; l<LTTB_NUM_LEVELS; l++) {
+            levels[l].clear();
+        }
+    }
+    for (int l=0; l<LTTB_NUM_LEVELS; l++) {
+        extendLevel(l);
+    }
+}
+
+/**
+ * @brief LttbSeries::extendLevel: Picks a point for every bucket of the level
+ * whose following bucket is complete
+ * @param level
+ */
+void LttbSeries::extendLevel(int level)
+{
+    int b = bucketSize(level);
+    QVector<chart_point> &lv = levels[level];
+
+    while (raw.size() >= (lv.size() + 2) * b) {
+        int start = lv.size() * b;
+        if (lv.isEmpty()) {
+            // LTTB keeps the first point as is
+            lv.append(raw.at(0));
+            continue;
+        }
+        double avgT = 0;
+        double avgV = 0;
+        for (int k=start+b; k<start+2*b; k++) {
+            avgT += raw.at(k).t;
+            avgV += raw.at(k).v;
+        }
+        avgT /= b;
+        avgV /= b;
+
+        const chart_point &a = lv.last();
+        double maxArea = -1;
+        int best = start;
+        for (int k=start; k<start+b; k++) {
+            double area = triangleArea(a, raw.at(k), avgT, avgV);
+            if (area > maxArea) {
+                maxArea = area;
+                best = k;
+            }
+        }
+        lv.append(raw.at(best));
+    }
+}
+
+int LttbSeries::size() const
+{
+    return raw.size();
+}
+
+qint64 LttbSeries::lastTime() const
+{
+    return raw.isEmpty() ? 0 : raw.last().t;
+}
+
+float LttbSeries::lastValue() const
+{
+    return raw.isEmpty() ? 0 : raw.last().v;
+}
+
+/**
+ * @brief LttbSeries::select: Downsamples [from, to] to width points, plus the
+ * nearest point either side so lines run to the edges
+ * @param from
+ * @param to
+ * @param width: pixels
+ * @param out
+ * @return number of points in out
+ */
+int LttbSeries::select(qint64 from, qint64 to, int width, QVector<chart_point> *out) const
+{
+    out->clear();
+    if (raw.isEmpty() || width < 3) {
+        return 0;
+    }
+    int i0 = static_cast<int>(std::lower_bound(raw.begin(), raw.end(), from, pointBefore) -
+                              raw.begin()) - 1;
+    int i1 = static_cast<int>(std::upper_bound(raw.begin(), raw.end(), to, timeBefore) -
+                              raw.begin()) + 1;
+    if (i0 < 0) {
+        i0 = 0;
+    }
+    if (i1 > raw.size()) {
+        i1 = raw.size();
+    }
+    if (i1 <= i0) {
+        return 0;
+    }
+
+    int level = -1;
+    for (int l=LTTB_NUM_LEVELS-1; l>=0; l--) {
+        if ((i1 - i0) / bucketSize(l) >= width) {
+            level = l;
+            break;
+        }
+    }
+
+    // the chosen level up to where it is cached, then finer levels, then raw
+    candidates.clear();
+    int pos = i0;
+    for (int l=level; l>=0 && pos<i1; l--) {
+        int b = bucketSize(l);
+        int last = (i1 + b - 1) / b;
+        if (last > levels[l].size()) {
+            last = levels[l].size();
+        }
+        for (int j=pos/b; j<last; j++) {
+            candidates.append(levels[l].at(j));
+        }
+        if (last * b > pos) {
+            pos = last * b;
+        }
+    }
+    for (int i=pos; i<i1; i++) {
+        candidates.append(raw.at(i));
+    }
+    return lttb_downsample(candidates.constData(), candidates.size(), width, out);
+}
@@ -0,0 +1,51 @@
+#ifndef LTTB_H
+#define LTTB_H
+
+#include <QVector>
+#include <QtGlobal>
+
+// raw points per bucket at the finest cached level; each coarser level's
+// buckets are LTTB_LEVEL_FACTOR times wider
+#define LTTB_BASE_BUCKET        4
+#define LTTB_LEVEL_FACTOR       4
+#define LTTB_NUM_LEVELS         7
+// two weeks of 10 s intervals; past this the oldest half is dropped
+#define LTTB_MAX_POINTS         (14 * 24 * 360)
+
+struct chart_point {
+    quint32 t;      // seconds since epoch, UTC
+    float v;
+};
+
+int lttb_downsample(const chart_point *in, int n, int threshold,
+                    QVector<chart_point> *out);
+
+// One time series for a chart, with its Largest-Triangle-Three-Buckets
+// downsampling cached at LTTB_NUM_LEVELS resolutions. Each level keeps the
+// point LTTB picks from every fixed bucket of raw points; a bucket is picked
+// once the bucket after it is complete, so appending only ever extends the
+// levels and never redoes them. select() takes the coarsest level that still
+// has at least one point per pixel over the requested range, fills in the
+// not yet cached tail from finer levels, and runs LTTB once more over that to
+// get exactly the pixel width. Its cost depends on the width, not on how many
+// raw points the range spans.
+class LttbSeries
+{
+public:
+    LttbSeries();
+    void append(qint64 t, float v);
+    int size() const;
+    qint64 lastTime() const;
+    float lastValue() const;
+    int select(qint64 from, qint64 to, int width, QVector<chart_point> *out) const;
+
+private:
+    static int bucketSize(int level);
+    void extendLevel(int level);
+
+    QVector<chart_point> raw;
+    QVector<chart_point> levels[LTTB_NUM_LEVELS];
+    mutable QVector<chart_point> candidates;
+};
+
+#endif // LTTB_H
@@ -1,10 +1,234 @@
 #include "mainwindow.h"
+#include "backfilljob.h"
+#include "derivedmetrics.h"
+#include "intervalquery.h"
+#include "sensorfleetmodel.h"
+#include "speedsketch.h"
+#include "sqlitesink.h"
 #include <QApplication>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSerialPort>
+#include <QTcpSocket>
+#include <QThread>
+
+/**
+ * @brief runBackfill: Headless backfill of interval history
+ *   --backfill <from yyyy-MM-dd> <to yyyy-MM-dd> [--window n] [--sqlite <file>] target...
+ * where each target is <host:port or COM port>/<sensor id>/<lanes>[/<interval secs>].
+ * Targets behind the same host:port or COM port share one link.
+ * @return exit code
+ */
+static int runBackfill(QApplication *a, const QStringList &args, int at)
+{
+    if (at + 2 >= args.size()) {
+        printf("usage: --backfill <from> <to> [--window n] [--sqlite file] target...\n");
+        return 1;
+    }
+    QDateTime from = QDateTime::fromString(args.at(at + 1), "yyyy-MM-dd");
+    QDateTime to = QDateTime::fromString(args.at(at + 2), "yyyy-MM-dd");
+    from.setTimeSpec(Qt::UTC);
+    to.setTimeSpec(Qt::UTC);
+    if (!from.isValid() || !to.isValid() || to <= from) {
+        printf("Bad backfill range.\n");
+        return 1;
+    }
+
+    int window = LINK_DEFAULT_WINDOW;
+    QString sqliteName;
+    QHash<QString, SensorLink*> links;
+    QList<backfill_target> targets;
+
+    for (int i=at+3; i<args.size(); i++) {
+        if (args.at(i) == "--window" && i + 1 < args.size()) {
+            window = args.at(++i).toInt();
+            continue;
+        }
+        if (args.at(i) == "--sqlite" && i + 1 < args.size()) {
+            sqliteName = args.at(++i);
+            continue;
+        }
+
+        QStringList parts = args.at(i).split('/');
+        if (parts.size() < 3) {
+            printf("Bad backfill target %s\n", args.at(i).toLatin1().constData());
+            return 1;
+        }
+        QString endpoint = parts.at(0);
+        if (!links.contains(endpoint)) {
+            QIODevice *dev;
+            int colon = endpoint.lastIndexOf(':');
+            if (colon > 0) {
+                QTcpSocket *sock = new QTcpSocket(a);
+                sock->connectToHost(endpoint.left(colon), endpoint.mid(colon + 1).toUShort());
+                if (!sock->waitForConnected(5000)) {
+                    printf("Couldn't reach %s\n", endpoint.toLatin1().constData());
+                    return 1;
+                }
+                dev = sock;
+            } else {
+                QSerialPort *serial = new QSerialPort(a);
+                serial->setPortName(endpoint);
+                if (!serial->open(QIODevice::ReadWrite)) {
+                    printf("Couldn't open %s\n", endpoint.toLatin1().constData());
+                    return 1;
+                }
+                dev = serial;
+            }
+            links[endpoint] = new SensorLink(dev, a);
+        }
+
+        backfill_target t;
+        t.link = links.value(endpoint);
+        t.sensor_id = static_cast<uint16_t>(parts.at(1).toUInt());
+        t.request_type = 1;
+        t.lane_appr_num = 0xFF;
+        t.num_lanes = static_cast<uint8_t>(parts.at(2).toUInt());
+        t.frames_per_interval = t.num_lanes;
+        t.interval_duration = parts.size() > 3 ? static_cast<uint16_t>(parts.at(3).toUInt()) : 60;
+        targets.append(t);
+    }
+    if (targets.isEmpty()) {
+        printf("No backfill targets.\n");
+        return 1;
+    }
+
+    QHash<QString, SensorLink*>::iterator it;
+    for (it = links.begin(); it != links.end(); ++it) {
+        it.value()->setWindow(window);
+    }
+
+    // history bypasses the journal, which only tracks the real-time position
+    QString name = "BACKFILL_" + args.at(at + 1) + "_" + args.at(at + 2);
+    IntervalStore store(name + ".seg");
+    IntervalPipeline pipeline;
+    pipeline.setIntervalStorePtr(&store);
+
+    QThread sqliteThread;
+    SqliteSink *sink = nullptr;
+    if (!sqliteName.isEmpty()) {
+        sink = new SqliteSink(sqliteName);
+        sink->moveToThread(&sqliteThread);
+        QObject::connect(&sqliteThread, &QThread::started,
+                         sink, &SqliteSink::openDatabase);
+        QObject::connect(&sqliteThread, &QThread::finished,
+                         sink, &SqliteSink::closeDatabase, Qt::DirectConnection);
+        sqliteThread.start();
+        pipeline.setSqliteSinkPtr(sink);
+    }
+
+    BackfillJob job(from.toSecsSinceEpoch(), to.toSecsSinceEpoch(), name + ".checkpoint");
+    job.setPipelinePtr(&pipeline);
+    for (int i=0; i<targets.size(); i++) {
+        job.addTarget(targets.at(i));
+    }
+    QObject::connect(&job, &BackfillJob::finished, a, &QApplication::quit,
+                     Qt::QueuedConnection);
+    job.start();
+    int rc = a->exec();
+
+    store.flush();
+    if (sink != nullptr) {
+        sqliteThread.quit();
+        sqliteThread.wait();
+        delete sink;
+    }
+    return rc;
+}
 
 int main(int argc, char *argv[])
 {
+    QElapsedTimer coldStart;
+    coldStart.start();
     QApplication a(argc, argv);
+    QStringList args = a.arguments();
+
+    // --sqlite-bench <file> [rows]: compare per-row commits with batched inserts
+    int i = args.indexOf("--sqlite-bench");
+    if (i >= 0 && i + 1 < args.size()) {
+        int rows = (i + 2 < args.size()) ? args.at(i + 2).toInt() : 20000;
+        SqliteSink::benchmark(args.at(i + 1), rows > 0 ? rows : 20000);
+        return 0;
+    }
+
+    // --sketch-check [events]: speed percentiles from bins against exact ones
+    i = args.indexOf("--sketch-check");
+    if (i >= 0) {
+        int events = (i + 1 < args.size()) ? args.at(i + 1).toInt() : 200000;
+        SpeedSketch::accuracyCheck(events > 0 ? events : 200000);
+        return 0;
+    }
+
+    // --metrics-bench [lanes]: flow/density/LOS kernels, vectorized against scalar
+    i = args.indexOf("--metrics-bench");
+    if (i >= 0) {
+        int lanes = (i + 1 < args.size()) ? args.at(i + 1).toInt() : 5000;
+        derived_metrics_benchmark(lanes > 0 ? lanes : 5000);
+        return 0;
+    }
+
+    // --query <file>... --sensor <id> [...]: time-range query over segment files
+    i = args.indexOf("--query");
+    if (i >= 0) {
+        interval_query q;
+        QStringList files;
+        if (!IntervalQuery::parseArgs(args, i, &q, &files)) {
+            return 1;
+        }
+        IntervalQuery query(q);
+        if (query.runFiles(files) < 0) {
+            return 1;
+        }
+        query.print();
+        return 0;
+    }
+
+    // --query-bench [file]: a year of one sensor's hourly volume
+    i = args.indexOf("--query-bench");
+    if (i >= 0) {
+        IntervalQuery::benchmark((i + 1 < args.size()) ? args.at(i + 1) : "query_bench.seg");
+        return 0;
+    }
+
+    // --fleet-bench [sensors]: GUI thread cost of the fleet dashboard
+    i = args.indexOf("--fleet-bench");
+    if (i >= 0) {
+        int sensors = (i + 1 < args.size()) ? args.at(i + 1).toInt() : 500;
+        SensorFleetModel::benchmark(sensors > 0 ? sensors : 500);
+        return 0;
+    }
+
+    i = args.indexOf("--backfill");
+    if (i >= 0) {
+        return runBackfill(&a, args, i);
+    }
+
     MainWindow w;
+    w.setColdStartTimer(coldStart);
+
+    // --sqlite <file>: mirror retrieved intervals into a SQLite database
+    i = args.indexOf("--sqlite");
+    if (i >= 0 && i + 1 < args.size()) {
+        w.enableSqliteSink(args.at(i + 1));
+    }
+
+    // --verify-approaches: compare approach totals built from lanes with the
+    // sensor's own (poll lanes + approaches)
+    if (args.contains("--verify-approaches")) {
+        w.setApproachVerification(true);
+    }
+
+    // --no-clock-correction: estimate sensor clock offset and drift, but never
+    // set the sensor clocks
+    if (args.contains("--no-clock-correction")) {
+        w.setClockCorrection(false);
+    }
+
+    // --ui-per-interval: one table update per interval instead of per frame,
+    // to compare the GUI time reported by the live view
+    if (args.contains("--ui-per-interval")) {
+        w.setCoalescedViewUpdates(false);
+    }
     w.show();
 
     return a.exec();
@@ -7,9 +7,9 @@
 #include <QByteArray>
 #include <QDateTime>
 #include <QFileInfo>
+#include <QHeaderView>
 #include <QMessageBox>
 #include <QSerialPort>
-#include <QSerialPortInfo>
 #include <QString>
 
 #define GATEWAY_IP "166.153.62.218"
@@ -19,11 +19,14 @@ MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow)
 {
+    QElapsedTimer built;
+    built.start();
     ui->setupUi(this);
 
     sensorConnected = false;
-    classConfigChecked = false;
     dataRetrievalHasBeenClicked = false;
+    sqliteSink = nullptr;
+    sqliteThread = nullptr;
 
     // set up serial port (declared in header file)
     port = new QSerialPort();
@@ -33,25 +36,117 @@ MainWindow::MainWindow(QWidget *parent) :
     const QString s = "RTDATA_" +
             QDateTime::currentDateTime().toString("MM-dd-yyyy hh.mm.ss") +
             ".txt";
+    // opened by the pipeline when retrieval starts
     file = new QFile(s);
-    file->open(QIODevice::WriteOnly);
+
+    // compressed copy of every interval, one segment per lane/approach run
+    intervalStore = new IntervalStore("RTDATA_" +
+            QDateTime::currentDateTime().toString("MM-dd-yyyy hh.mm.ss") +
+            ".seg");
+
+    // closed 1/5/15/60 minute rollup buckets
+    rollupStore = new IntervalStore("RTDATA_" +
+            QDateTime::currentDateTime().toString("MM-dd-yyyy hh.mm.ss") +
+            "_rollups.seg");
+
+    // intervals that survived the last run, so retrieval resumes after them;
+    // read in finishStartup, once the window is up
+    journal = new RecordJournal("RTDATA.journal");
+    intervalStore->setJournalPtr(journal);
+    startupDone = false;
+    firstPaintSeen = false;
+    coldStart.start();
+
+    // decoded intervals go through the pipeline: journal, segment store, text file, UI
+    pipeline = new IntervalPipeline();
+    pipeline->setFilePtr(file);
+    pipeline->setIntervalStorePtr(intervalStore);
+    pipeline->setJournalPtr(journal);
+    pipeline->setRollupStorePtr(rollupStore);
 
     serialWorker = new SerialWorker;
     serialWorker->setSerialPortPtr(port);
-    serialWorker->setFilePtr(file);
+    serialWorker->setPipelinePtr(pipeline);
 
     tcpWorker = new TCPWorker();
-    tcpWorker->setFilePtr(file);
+    tcpWorker->setPipelinePtr(pipeline);
+
+    // both workers share one scheduler so their polls don't bunch up
+    pollScheduler = new PollScheduler();
+    serialWorker->setPollSchedulerPtr(pollScheduler);
+    tcpWorker->setPollSchedulerPtr(pollScheduler);
+
+    // sensor clocks: read now and then, drift fitted, set when they wander
+    clockModel = new ClockModel();
+    serialWorker->setClockModelPtr(clockModel);
+    tcpWorker->setClockModelPtr(clockModel);
 
     QTimer *dataRetrievalTimer = new QTimer();
     serialWorker->setTimerPtr(dataRetrievalTimer);
     tcpWorker->setTimerPtr(dataRetrievalTimer);
 
+    // live data table: a bounded ring of the newest intervals, rows of one height
+    recordModel = new RecordTableModel(RECORD_TABLE_CAPACITY, this);
+    ui->dataView->setModel(recordModel);
+    ui->dataView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    ui->dataView->verticalHeader()->setDefaultSectionSize(
+                ui->dataView->fontMetrics().height() + 4);
+    ui->dataView->verticalHeader()->hide();
+    ui->dataView->horizontalHeader()->setStretchLastSection(true);
+    // intervals and worker status lines reach the window once per frame
+    liveFeed = new LiveViewFeed(this);
+    liveFeed->setModelPtr(recordModel);
+    liveFeed->setViewPtr(ui->dataView);
+    liveFeed->setStatusBarPtr(ui->statusBar);
+    liveFeed->setChartPtr(ui->laneChart);
+    connect(ui->laneChart, &LaneChart::laneAdded, this, &MainWindow::addChartLane);
+    pipeline->setLiveFeedPtr(liveFeed);
     connect(serialWorker, &SerialWorker::fileReadyForRead,
-            this, &MainWindow::updateDataView);
+            liveFeed, &LiveViewFeed::postStatus);
     connect(tcpWorker, &TCPWorker::fileReadyForRead,
-            this, &MainWindow::updateDataView);
-
+            liveFeed, &LiveViewFeed::postStatus);
+
+    // every sensor seen, for the fleet dashboard; its table only repaints
+    // the cells that changed
+    stateStore = new SensorStateStore();
+    pipeline->setStateStorePtr(stateStore);
+    serialWorker->setStateStorePtr(stateStore);
+    tcpWorker->setStateStorePtr(stateStore);
+    fleetModel = new SensorFleetModel(stateStore, this);
+    ui->fleetView->setModel(fleetModel);
+    ui->fleetView->verticalHeader()->hide();
+    ui->fleetView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    ui->fleetView->verticalHeader()->setDefaultSectionSize(
+                ui->fleetView->fontMetrics().height() + 4);
+
+    // configuration tabs load in the background and are kept until refreshed
+    configCache = new ConfigCache(this);
+    cacheHeldForRetrieval = false;
+    // what each sensor answered last time, so reconnecting can skip the reads
+    snapshotStore = new SnapshotStore("SENSORCONF");
+    configCache->setSnapshotStorePtr(snapshotStore);
+    connect(configCache, &ConfigCache::loaded, this, &MainWindow::configLoaded);
+    connect(configCache, &ConfigCache::failed, this, &MainWindow::configFailed);
+    connect(configCache, &ConfigCache::snapshotReady, this, &MainWindow::snapshotReady);
+
+    // configuration lists, sized by whatever the sensor reports
+    laneModel = new ConfigTableModel(QStringList() << "Lane Number" << "Lane Description"
+                                     << "Direction (R/L)", this);
+    speedBinModel = new ConfigTableModel(QStringList() << "Bin Number"
+                                         << "Lower Bound Speed", this);
+    speedBinModel->setRightAligned(1);
+    classModel = new ConfigTableModel(QStringList() << "Class" << "Bound", this);
+    classModel->setRightAligned(1);
+    QTableView *configViews[3] = { ui->laneView, ui->speedBinView, ui->classView };
+    ConfigTableModel *configModels[3] = { laneModel, speedBinModel, classModel };
+    for (int i=0; i<3; i++) {
+        configViews[i]->setModel(configModels[i]);
+        configViews[i]->verticalHeader()->hide();
+        configViews[i]->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+        configViews[i]->verticalHeader()->setDefaultSectionSize(
+                    configViews[i]->fontMetrics().height() + 4);
+        configViews[i]->horizontalHeader()->setStretchLastSection(true);
+    }
 
     // one-time CRC table generation
     SmCommsGenerateCrc8Table(Crc8Table, COMMS_CRC8_TABLE_LENGTH);
@@ -67,20 +162,12 @@ MainWindow::MainWindow(QWidget *parent) :
     lastReadDataConf = new sensor_data_config;
     sensorDateTime = new sensor_datetime;
 
-    // memory allocations assume worst-case of max # approaches and lanes
-    appr = new approach[4];
-
-    // initialize list of serial port devices
+    // serial port devices are listed in the background and kept up to date
     ui->comPortSelect->clear();
-    if (QSerialPortInfo::availablePorts().isEmpty()) {
-        ui->comPortSelect->addItem("No ports available");
-    } else {
-        // iterate over all available ports
-        foreach(QSerialPortInfo p, QSerialPortInfo::availablePorts()) {
-            ui->comPortSelect->addItem(QString(p.portName() + " (" +
-                                               p.description() + ")"));
-        }
-    }
+    ui->comPortSelect->addItem("Searching for ports...");
+    portWatcher = new PortWatcher(this);
+    connect(portWatcher, &PortWatcher::portsChanged, this, &MainWindow::updatePortList);
+    portWatcher->start();
 
     ui->dCDateTimeSelect->setDateTime(QDateTime::currentDateTime());
     ui->connectViaCom->setChecked(true);
@@ -97,28 +184,90 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->ipConnect->hide();
 
     ui->sensorIdEntry->setText("0x0168");
+
+    printf("Startup: window built in %lld ms\n", static_cast<long long>(built.elapsed()));
 }
 
 MainWindow::~MainWindow()
 {
+    // closing while polling: everything stored so far is checkpointed, so
+    // the next start doesn't replay it
+    pipeline->closeDataFile();
     if (port->isOpen()) {
         port->close();
     }
 
     delete serialWorker;
     delete tcpWorker;
+    delete pollScheduler;
+    delete clockModel;
+    delete pipeline;
+    delete stateStore;
+    delete snapshotStore;
+
+    if (sqliteThread != nullptr) {
+        // the sink writes out its queue as the thread finishes
+        sqliteThread->quit();
+        sqliteThread->wait();
+        delete sqliteSink;
+        delete sqliteThread;
+    }
 
     delete file;
+    delete intervalStore;
+    delete rollupStore;
+    delete journal;
     delete ui;
     delete port;
 
     // sensorConfig pointers
-    delete[] appr;
     delete sensorConf;
     delete lastReadDataConf;
     delete sensorDateTime;
 }
 
+/**
+ * @brief MainWindow::enableSqliteSink: Also writes every decoded interval to a
+ * SQLite database, from a thread of its own
+ * @param dbName
+ */
+void MainWindow::enableSqliteSink(const QString &dbName)
+{
+    if (sqliteSink != nullptr) {
+        return;
+    }
+    sqliteThread = new QThread();
+    sqliteSink = new SqliteSink(dbName);
+    sqliteSink->moveToThread(sqliteThread);
+    connect(sqliteThread, &QThread::started,
+            sqliteSink, &SqliteSink::openDatabase);
+    connect(sqliteThread, &QThread::finished,
+            sqliteSink, &SqliteSink::closeDatabase, Qt::DirectConnection);
+    sqliteThread->start();
+
+    pipeline->setSqliteSinkPtr(sqliteSink);
+}
+
+/**
+ * @brief MainWindow::setClockCorrection: Off only estimates sensor clock
+ * offset and drift; the sensor clocks are never set
+ * @param on
+ */
+void MainWindow::setClockCorrection(bool on)
+{
+    clockModel->setCorrecting(on);
+}
+
+/**
+ * @brief MainWindow::setApproachVerification: Keep polling the sensor's own
+ * approach data and compare it with the approach totals built from lanes
+ * @param on
+ */
+void MainWindow::setApproachVerification(bool on)
+{
+    pipeline->setApproachVerification(on);
+}
+
 bool isEqual (float f1, float f2)
 {
     float epsilon = 0.01;
@@ -130,20 +279,81 @@ bool isEqual (float f1, float f2)
 }
 
 
-// Updates the list of available serial port devices
+/**
+ * @brief MainWindow::setColdStartTimer: Time since process start, so the
+ * startup report covers QApplication set-up as well
+ * @param t: started at the top of main()
+ */
+void MainWindow::setColdStartTimer(const QElapsedTimer &t)
+{
+    coldStart = t;
+}
+
+/**
+ * @brief MainWindow::paintEvent: Reports the time to the first paint and
+ * leaves the rest of the startup work until after it
+ * @param event
+ */
+void MainWindow::paintEvent(QPaintEvent *event)
+{
+    QMainWindow::paintEvent(event);
+    if (!firstPaintSeen) {
+        firstPaintSeen = true;
+        printf("Startup: first paint %lld ms after start\n",
+               static_cast<long long>(coldStart.elapsed()));
+        QTimer::singleShot(0, this, &MainWindow::finishStartup);
+    }
+}
+
+/**
+ * @brief MainWindow::finishStartup: Startup work that doesn't need to hold up
+ * the window; runs after the first paint, or before retrieval if that's sooner
+ */
+void MainWindow::finishStartup()
+{
+    if (startupDone) {
+        return;
+    }
+    startupDone = true;
+    QElapsedTimer timer;
+    timer.start();
+    // whatever a crash kept out of the segment store goes in before polling
+    QVector<interval_record> unstored;
+    int recovered = journal->recover(&unstored);
+    pipeline->replay(unstored);
+    printf("Startup: journal (%d intervals, %d replayed) read in %lld ms after first paint\n",
+           recovered, unstored.size(), static_cast<long long>(timer.elapsed()));
+    snapshotStore->load();
+}
+
+// Rescans the serial port devices; the list also follows hotplug on its own
 void MainWindow::on_refreshComPorts_clicked()
 {
+    portWatcher->rescan();
+}
+
+/**
+ * @brief MainWindow::updatePortList: Puts the ports found in the background
+ * into the port list, keeping the selected port selected if it's still there
+ * @param names: port names, to open
+ * @param labels: names with descriptions, to show
+ */
+void MainWindow::updatePortList(QStringList names, QStringList labels)
+{
+    QString selected = ui->comPortSelect->itemData(ui->comPortSelect->currentIndex()).toString();
     ui->comPortSelect->clear();
-    if (QSerialPortInfo::availablePorts().isEmpty()) {
+    if (names.isEmpty()) {
         ui->comPortSelect->addItem("No ports available");
-    } else {
-        // iterate over all available ports
-        foreach(QSerialPortInfo p, QSerialPortInfo::availablePorts()) {
-            QString q = QString(p.portName() + " (" +
-                                p.description() + ")");
-            ui->comPortSelect->addItem(q);
+        return;
+    }
+    int index = 0;
+    for (int i=0; i<names.size(); i++) {
+        ui->comPortSelect->addItem(labels.at(i), names.at(i));
+        if (names.at(i) == selected) {
+            index = i;
         }
     }
+    ui->comPortSelect->setCurrentIndex(index);
 }
 
 /**
@@ -159,6 +369,8 @@ void MainWindow::sendToSensor(QByteArray *memo, char msgType)
         return;
     }
 
+    // background config reads must not see the blocking read's response
+    configCache->suspend();
     if (port->isOpen()) {
         // write via serial
         if (msgType == 0) {
@@ -178,10 +390,12 @@ void MainWindow::sendToSensor(QByteArray *memo, char msgType)
                 tcpWorker->writeToSensor(memo, &writeResp, &errCode, len);
             }
         } else {
+            configCache->resume();
             QMessageBox::critical(this, "Talk2SSHD", "Not connected to sensor.");
             return;
         }
     }
+    configCache->resume();
 }
 
 /**
@@ -199,6 +413,9 @@ bool MainWindow::refreshSensorConfig()
         return false;
     } else {
         parse_gen_conf_read_response(resp, sensorConf, errString);
+        if (sqliteSink != nullptr) {
+            sqliteSink->setMetricUnits(sensorConf->units != 0);
+        }
         return true;
     }
 }
@@ -215,7 +432,7 @@ void MainWindow::on_connectToCom_clicked()
         // disable button
         ui->connectToCom->setEnabled(false);
         // set port name
-        port->setPortName(ui->comPortSelect->currentText().left(4));
+        port->setPortName(ui->comPortSelect->itemData(ui->comPortSelect->currentIndex()).toString());
 
         // open port
         if (!port->open(QIODevice::ReadWrite)) {
@@ -243,36 +460,15 @@ void MainWindow::on_connectToCom_clicked()
         QString q = QString("Sensor ID: %1").arg(sensorId);
         QMessageBox::information(this, "Talk2SSHD", q);
 
-        // now that COM port connected, check if sensor is connected
-        if (refreshSensorConfig()) {
-
-            // update connection status text
-            QString q = "<html><head/><body><p align=\"center\"><span style=\"font-size:9pt; font-weight:600; color:#0d9332;\">CONNECTED </span></p></body></html>";
-            ui->conxnStatus->setText(q);
-            // re-enable button, set it to Close
-            ui->connectToCom->setEnabled(true);
-            ui->connectToCom->setText("Close Port");
-
-            // update config data section
-            ui->sensorLocnEntry->setText(sensorConf->location);
-            ui->sensorDescEntry->setText(sensorConf->description);
-            q = sensorConf->orientation;
-            ui->sensorOrientation->setText(q);
-            if (sensorConf->units == 0) {
-                ui->unitsMetric->setChecked(false);
-                ui->unitsAmerican->setChecked(true);
-            } else {
-                ui->unitsMetric->setChecked(true);
-                ui->unitsAmerican->setChecked(false);
-            }
-
-//            refreshDataConfig();
-//            refreshActiveLanes();
-//            refreshApproachInfo();
-        } else {
-            ui->connectToCom->setEnabled(true);
-            port->close();
+        // now that COM port connected, check if sensor is connected: the
+        // whole configuration is read in one go, snapshotReady() finishes up
+        QString connecting = "<html><head/><body><p align=\"center\"><span style=\"font-size:9pt; font-weight:600; color:#b08000;\">CONNECTING </span></p></body></html>";
+        ui->conxnStatus->setText(connecting);
+        configCache->attach(port, sensorId);
+        for (int i=0; i<CONFIG_NUM_ITEMS; i++) {
+            showLoading(i);
         }
+        configCache->snapshot();
     } else {
         if (port->isOpen()) {
             port->close();
@@ -280,6 +476,8 @@ void MainWindow::on_connectToCom_clicked()
             ui->conxnStatus->setText(q);
             ui->connectToCom->setText("Open Port");
 
+            configCache->detach();
+            stateStore->setLink(sensorId, SENSOR_OFFLINE);
             sensorConnected = false;
         }
     }
@@ -342,6 +540,7 @@ void MainWindow::on_writeSensorConfig_clicked()
 
     memo = gen_config_write(Crc8Table, sensorConf, sensorId);
     sendToSensor(&memo, 1);
+    configCache->forgetStored();
     if (errCode == 0) {
         QMessageBox::information(this, "T2SSHD", "Success!");
     } else {
@@ -361,10 +560,23 @@ void MainWindow::refreshDataConfig()
         return;
     }
 
-    dataInfoRead = 1;
     memo = genReadMsg(Crc8Table, 0x03, 0, sensorId);
     sendToSensor(&memo, 0);
     parse_data_conf_read_response(&resp, lastReadDataConf, errString);
+
+    memo = genReadMsg(Crc8Table, 0x0D, 0, sensorId);
+    sendToSensor(&memo, 0);
+    showDataConfig(parse_global_push_mode_read_resp(&resp, errString) != 0);
+}
+
+/**
+ * @brief MainWindow::showDataConfig
+ * Shows the last read data configuration
+ * @param globalPush: whether global UART push mode is on
+ */
+void MainWindow::showDataConfig(bool globalPush)
+{
+    dataInfoRead = 1;
     ui->dataIntervalEdit->setValue(lastReadDataConf->data_interval);
     switch(lastReadDataConf->interval_mode) {
         case 0:
@@ -420,9 +632,7 @@ void MainWindow::refreshDataConfig()
     q = QString("%1").arg(intg);
     ui->loopSize->setText(q);
 
-    memo = genReadMsg(Crc8Table, 0x0D, 0, sensorId);
-    sendToSensor(&memo, 0);
-    if (parse_global_push_mode_read_resp(&resp, errString)) {
+    if (globalPush) {
         ui->uartLocalPushMode->setChecked(true);
     } else {
         ui->uartLocalPushMode->setChecked(false);
@@ -435,121 +645,28 @@ void MainWindow::on_loadDataConf_clicked()
 }
 
 /**
- * @brief MainWindow::updateSensorTime : increments the time presented in the GUI
+ * @brief MainWindow::updateSensorTime : shows the sensor's time as the clock
+ * model predicts it, so the display follows the sensor without reading it
  */
 void MainWindow::updateSensorTime()
 {
-    sensor_datetime *d = sensorDateTime;
-    char minChanged = 0;
-    char hrChanged = 0;
-    char dayChanged = 0;
-    char monChanged = 0;
-    char yrChanged = 0;
-
-    if (d->secs == 59) {
-        minChanged = 1;
-        d->secs = 0;
-        d->mins++;
-        if (d->mins == 60) {
-            hrChanged = 1;
-            d->mins = 0;
-            d->hrs++;
-            if (d->hrs == 24) {
-                dayChanged = 1;
-                d->hrs = 0;
-//                d->day++;
-                if (d->mon % 2 == 0) {
-                    if (d->mon == 2) {          // February (28/29)
-                        if (d->day == 28) {
-                            if (d->yr % 4 == 0) {
-                                d->day++;
-                            } else {
-                                d->day = 1;
-                                d->mon++;
-                                monChanged = 1;
-                            }
-                        } else if (d->day == 29) {
-                            d->day = 1;
-                            d->mon = 3;
-                        } else {
-                            d->day++;
-                        }
-                    } else if (d->mon < 8) {    // April, June (30)
-                        if (d->day == 30) {
-                            d->day = 1;
-                            d->mon++;
-                        } else {
-                            d->day++;
-                        }
-                    } else {                    // Aug, Oct, Dec (31)
-                        if (d->day == 31) {
-                            d->day = 1;
-                            d->mon++;
-                            if (d->mon == 13) {
-                                d->mon = 1;
-                                d->yr++;
-                            }
-                        } else {
-                            d->day++;
-                        }
-                    }
-                } else {
-                    if (d->mon < 9) {   // Jan, Mar, May, July (31)
-                        if (d->day == 31) {
-                            d->day = 1;
-                            d->mon++;
-                        } else {
-                            d->day++;
-                        }
-                    } else {            // Sep, Nov (30)
-                        if (d->day == 30) {
-                            d->day = 1;
-                            d->mon++;
-                        } else {
-                            d->day++;
-                        }
-                    }
-                }
-            }
-        }
-        QString q = ui->sensorTime->text();
-        // update seconds
-        QString app = QString("%1").arg(sensorDateTime->secs, 2, 10, QChar(48));
-        q.replace(89, 2, app);
-        // update mins
-        if (minChanged) {
-            app = QString("%1").arg(sensorDateTime->mins, 2, 10, QChar(48));
-            q.replace(86, 2, app);
-        }
-        if (hrChanged) {
-            app = QString("%1").arg(sensorDateTime->hrs, 2, 10, QChar(48));
-            q.replace(83, 2, app);
-        }
-        ui->sensorTime->setText(q);
-        if (dayChanged || monChanged || yrChanged) {
-            QString q2 = ui->sensorDate->text();
-            if (dayChanged) {
-                app = QString("%1").arg(sensorDateTime->day, 2, 10, QChar(48));
-                q2.replace(86, 2, app);
-            }
-            if (monChanged) {
-                app = QString("%1").arg(sensorDateTime->mon, 2, 10, QChar(48));
-                q2.replace(83, 2, app);
-            }
-            if (yrChanged) {
-                app = QString("%1").arg(sensorDateTime->yr, 4, 10, QChar(48));
-                q2.replace(89, 4, app);
-            }
-            ui->sensorDate->setText(q2);
-        }
-    } else {
-        // only update seconds
-        d->secs++;
-        QString q = ui->sensorTime->text();
-        QString app = QString("%1").arg(d->secs, 2, 10, QChar(48));
-        q.replace(89, 2, app);
-        ui->sensorTime->setText(q);
-    }
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    showSensorTime(now + clockModel->offsetMs(sensorId, now));
+}
+
+/**
+ * @brief MainWindow::showSensorTime
+ * @param sensorMs: sensor time, UTC milliseconds
+ */
+void MainWindow::showSensorTime(qint64 sensorMs)
+{
+    QDateTime t = QDateTime::fromMSecsSinceEpoch(sensorMs, Qt::UTC);
+    QString f = "<html><head/><body><p align=\"left\"><span style=\" font-size:12pt; font-weight:600;\">" +
+            t.toString("hh:mm:ss") + " UTC</span></p></body></html>";
+    ui->sensorTime->setText(f);
+    f = "<html><head/><body><p align=\"left\"><span style=\" font-size:12pt; font-weight:600;\">" +
+            t.toString("MM/dd/yyyy") + "</span></p></body></html>";
+    ui->sensorDate->setText(f);
 }
 
 /**
@@ -566,122 +683,69 @@ void MainWindow::refreshDateTime()
         return;
     }
     memo = genReadMsg(Crc8Table, 0x0E, 0, sensorId);
+    qint64 sentMs = QDateTime::currentMSecsSinceEpoch();
     sendToSensor(&memo, 0);
+    qint64 receivedMs = QDateTime::currentMSecsSinceEpoch();
+    sensorDateTime->yr = 0;
     parse_sensor_time_read_resp(&resp, errString, sensorDateTime);
+    qint64 sensorMs = sensor_time_msecs(*sensorDateTime);
+    if (sensorMs < 0) {
+        return;
+    }
+    // every reading, here or by the workers, goes into the clock model
+    clockModel->addSample(sensorId, sentMs, receivedMs, sensorMs);
 
     if (!sensorClock->isActive()) {
         connect(sensorClock, SIGNAL(timeout()), this, SLOT(updateSensorTime()));
         sensorClock->start(1000);
     }
-
-    sensor_datetime *d = sensorDateTime;
-    QString q = QString("%1:%2:%3 UTC").arg(d->hrs, 2, 10, QChar(48)).arg(d->mins, 2, 10, QChar(48)).arg(d->secs, 2, 10, QChar(48));
-    QString f = "<html><head/><body><p align=\"left\"><span style=\" font-size:12pt; font-weight:600;\">" + q + "</span></p></body></html>";
-    ui->sensorTime->setText(f);
-    q = QString("%1/%2/%3").arg(d->mon, 2, 10, QChar(48)).arg(d->day, 2, 10, QChar(48)).arg(d->yr, 2, 10, QChar(48));
-    f = "<html><head/><body><p align=\"left\"><span style=\" font-size:12pt; font-weight:600;\">" + q +
-            "</span></p></body></html>";
-    ui->sensorDate->setText(f);
+    showSensorTime(sensorMs + (QDateTime::currentMSecsSinceEpoch() - receivedMs));
 }
 
 /**
- * @brief MainWindow::refreshActiveLanes
- * Refreshes active lane information from the sensor
+ * @brief MainWindow::showActiveLanes
+ * Shows active lane information read from the sensor
+ * @param s: snapshot holding the active lane information
  */
-void MainWindow::refreshActiveLanes()
+void MainWindow::showActiveLanes(const SensorSnapshot &s)
 {
-    if (!sensorConnected) {
-        QMessageBox::critical(this, "T2SSHD", "Error: not connected to sensor");
-        return;
-    }
     laneInfoRead = 1;
-    memo = genReadMsg(Crc8Table, 0x27, 10, sensorId);
-    sendToSensor(&memo, 0);
-    parse_active_lane_info_read_resp(&resp, laneArr, &numLanes, errString);
-    if (errString.startsWith('E')) return;
+    const QVector<snapshot_lane> &lanes = s.lanes();
+    numLanes = lanes.size();
     QString q = QString("<html><head/><body><p align=\"right\"><span style=\" font-size:12pt; font-weight:600;\">%1</span></p></body></html>").arg(numLanes);
     ui->numLanesConfigd->setText(q);
 
-    for (int r = 0; r < numLanes; r++) {
-        q = QString("Lane %1").arg(r + 1);
-        if (laneGridInitialized == 0) {
-            laneLabels[r][0] = new QLabel();
-            laneLabels[r][1] = new QLabel();
-            laneLabels[r][2] = new QLabel();
-        }
-
-        laneLabels[r][0]->setText(q);
-        char *p = (laneArr + r)->description;
-        QString q2 = QString::fromLocal8Bit(p, 8);
-        laneLabels[r][1]->setText(q2);
-        char c = (laneArr + r)->direction;
-        laneLabels[r][2]->setText(QString(c));
-        if (laneGridInitialized) {}
-        else {
-            if (r == 0) {
-                QLabel *t0 = new QLabel("Lane Number");
-                QLabel *t1 = new QLabel("Lane Description");
-                QLabel *t2 = new QLabel("Direction (R/L)");
-                ui->laneGrid->addWidget(t0, 0, 0);
-                ui->laneGrid->addWidget(t1, 0, 1);
-                ui->laneGrid->addWidget(t2, 0, 2);
-            }
-            ui->laneGrid->addWidget(laneLabels[r][0], r+1, 0);
-            ui->laneGrid->addWidget(laneLabels[r][1], r+1, 1);
-            ui->laneGrid->addWidget(laneLabels[r][2], r+1, 2);
-        }
+    QVector<QStringList> rows;
+    for (int r = 0; r < lanes.size(); r++) {
+        rows.append(QStringList() << QString("Lane %1").arg(r + 1)
+                    << lanes.at(r).description
+                    << QString(lanes.at(r).direction));
     }
-    laneGridInitialized = 1;
+    laneModel->setRows(rows);
 }
 
 /**
- * @brief MainWindow::refreshSpeedBins
- * Refreshes speed bins from the sensor
+ * @brief MainWindow::showSpeedBins
+ * Shows speed bins read from the sensor
+ * @param s: snapshot holding the speed bin configuration
  */
-
-void MainWindow::refreshSpeedBins()
+void MainWindow::showSpeedBins(const SensorSnapshot &s)
 {
-    if (!sensorConnected) {
-        QMessageBox::critical(this, "T2SSHD", "Error: not connected to sensor");
-        return;
-    }
-    memo = genReadMsg(Crc8Table, 0x1D, 15, sensorId);
-    sendToSensor(&memo, 0);
-    parse_speed_bin_conf_read(&resp, &numSpeedBins, speedBins, errString);
-    if (errString.startsWith('E')) return;
+    speedBins = s.speedBins();
+    numSpeedBins = speedBins.size();
+    pipeline->setSpeedBinBounds(speedBins.constData(), speedBins.size());
     QString q = QString("<html><head/><body><p align=\"right\"><span style=\" font-size:12pt; font-weight:600;\">%1</span></p></body></html>").arg(numSpeedBins);
     ui->numSpeedBinsConfigd->setText(q);
 
-    for (int r = 0; r < numSpeedBins; r++) {
-        q = QString("Bin %1").arg(r + 1);
-        if (speedBinGridInitialized == 0) {
-            speedBinLabels[r][0] = new QLabel();
-            speedBinLabels[r][1] = new QLabel();
-        }
-        speedBinLabels[r][0]->setText(q);
-        QString q2;
-        if (isEqual(*(speedBins + r), 255)) {
-             q2 = QString("%1 (all other events)").arg(static_cast<double>(*(speedBins+r)));
-        } else {
-             q2 = QString("%1").arg(static_cast<double>(*(speedBins + r)));
-        }
-        speedBinLabels[r][1]->setText(q2);
-        speedBinLabels[r][1]->setAlignment(Qt::AlignRight);
-
-        if (speedBinGridInitialized) {}
-        else {
-            if (r==0) {
-                QLabel *t0 = new QLabel("Bin Number");
-                QLabel *t1 = new QLabel("Lower Bound Speed");
-                t1->setAlignment(Qt::AlignCenter);
-                ui->speedBinGrid->addWidget(t0, 0, 0);
-                ui->speedBinGrid->addWidget(t1, 0, 1);
-            }
-            ui->speedBinGrid->addWidget(speedBinLabels[r][0], r+1, 0);
-            ui->speedBinGrid->addWidget(speedBinLabels[r][1], r+1, 1);
-        }
+    QVector<QStringList> rows;
+    for (int r = 0; r < speedBins.size(); r++) {
+        double bound = static_cast<double>(speedBins.at(r));
+        rows.append(QStringList() << QString("Bin %1").arg(r + 1)
+                    << (isEqual(speedBins.at(r), 255) ?
+                            QString("%1 (all other events)").arg(bound) :
+                            QString("%1").arg(bound)));
     }
-    speedBinGridInitialized = 1;
+    speedBinModel->setRows(rows);
 }
 
 void MainWindow::on_dataTypeSelect_currentIndexChanged(const QString &arg1)
@@ -765,27 +829,200 @@ void MainWindow::on_refreshDateTime_clicked()
 
 void MainWindow::on_confTabs_tabBarClicked(int index)
 {
+    // config tabs are prefetched on connect, so normally already filled in
     if (index == 1) {
         refreshDateTime();
+    } else if (index == 2) {
+        loadConfig(CONFIG_APPROACHES, false);
+    } else if (index == 3) {
+        loadConfig(CONFIG_CLASSES, false);
     } else if (index == 4) {
-        refreshActiveLanes();
+        loadConfig(CONFIG_LANES, false);
     } else if (index == 5) {
-        refreshSpeedBins();
+        loadConfig(CONFIG_SPEED_BINS, false);
     }
 }
 
-void MainWindow::refreshApproachInfo()
+/**
+ * @brief MainWindow::loadConfig: Fills in a config tab from the cache, or
+ * shows it as loading and has the cache read it in the background. While
+ * data retrieval holds the device it is read the blocking way instead.
+ * @param item: CONFIG_*
+ * @param reload: read it again even if cached
+ */
+void MainWindow::loadConfig(int item, bool reload)
 {
     if (!sensorConnected) {
         QMessageBox::critical(this, "T2SSHD", "Error: not connected to sensor");
         return;
     }
+    if (reload) {
+        configCache->invalidate(item);
+    }
+    if (configCache->isCached(item) || configCache->isLoading(item)) {
+        return;
+    }
 
-    approachInfoRead = 1;
-    memo = genReadMsg(Crc8Table, 0x28, 4, sensorId);
-    sendToSensor(&memo, 0);
+    if (configCache->suspended()) {
+        memo = configCache->requestFor(item);
+        sendToSensor(&memo, 0);
+        if (!resp.isEmpty() && resp.at(0) != 'E') {
+            configCache->store(item, resp);
+            configLoaded(item);
+        }
+        return;
+    }
+
+    showLoading(item);
+    configCache->fetch(item);
+}
+
+/**
+ * @brief MainWindow::showLoading: Marks an item's tab as being read
+ * @param item: CONFIG_*
+ */
+void MainWindow::showLoading(int item)
+{
+    QString loading = "<html><head/><body><p align=\"right\"><span style=\" font-size:12pt; font-weight:600;\">...</span></p></body></html>";
+    QVector<QStringList> loadingRows;
+    loadingRows.append(QStringList() << "Loading...");
+    switch (item) {
+    case CONFIG_APPROACHES: ui->numApproachesConfigd->setText(loading); break;
+    case CONFIG_CLASSES: ui->numClasses->setText(loading); classModel->setRows(loadingRows); break;
+    case CONFIG_LANES: ui->numLanesConfigd->setText(loading); laneModel->setRows(loadingRows); break;
+    case CONFIG_SPEED_BINS: ui->numSpeedBinsConfigd->setText(loading); speedBinModel->setRows(loadingRows); break;
+    }
+}
+
+/**
+ * @brief MainWindow::configLoaded: A config read came back; fills in its tab
+ * @param item: CONFIG_*
+ */
+void MainWindow::configLoaded(int item)
+{
+    config = configCache->current();
+    applySnapshot(config, item);
+}
+
+void MainWindow::configFailed(int item, QString reason)
+{
+    QVector<QStringList> failedRows;
+    failedRows.append(QStringList() << reason);
+    switch (item) {
+    case CONFIG_CLASSES: classModel->setRows(failedRows); break;
+    case CONFIG_LANES: laneModel->setRows(failedRows); break;
+    case CONFIG_SPEED_BINS: speedBinModel->setRows(failedRows); break;
+    }
+    ui->statusBar->showMessage("Couldn't read sensor configuration: " + reason);
+}
+
+/**
+ * @brief MainWindow::snapshotReady: The configuration read on connecting is
+ * in; the sensor counts as connected if it answered at least the general
+ * configuration read
+ * @param s
+ */
+void MainWindow::snapshotReady(SensorSnapshot s)
+{
+    bool serial = port->isOpen();
+    if (!s.has(CONFIG_GENERAL)) {
+        configCache->detach();
+        sensorConnected = false;
+        QString q = "<html><head/><body><p align=\"center\"><span style=\"font-size:9pt; font-weight:600; color:#ff0000;\">DISCONNECTED </span></p></body></html>";
+        ui->conxnStatus->setText(q);
+        if (serial) {
+            port->close();
+            ui->connectToCom->setEnabled(true);
+        } else {
+            tcpWorker->closeConnection();
+            ui->ipConnect->setText("Connect via IP");
+            ui->ipConnect->setEnabled(true);
+        }
+        QMessageBox::critical(this, "Talk2SSHD", "Connection to sensor "
+                                                 "failed. Please retry.");
+        return;
+    }
+
+    // update connection status text
+    QString q = "<html><head/><body><p align=\"center\"><span style=\"font-size:9pt; font-weight:600; color:#0d9332;\">CONNECTED </span></p></body></html>";
+    ui->conxnStatus->setText(q);
+    // re-enable button, set it to Close
+    if (serial) {
+        ui->connectToCom->setEnabled(true);
+        ui->connectToCom->setText("Close Port");
+    } else {
+        ui->ipConnect->setText("Close IP Connection");
+        ui->ipConnect->setEnabled(true);
+    }
+    stateStore->setLink(sensorId, SENSOR_CONNECTED);
 
-    numApproaches = parse_approach_info_read_resp(&resp, appr, errString);
+    config = s;
+    applySnapshot(config);
+    printf("Sensor %u: configuration read in %lld ms\n", sensorId,
+           static_cast<long long>(s.readMs()));
+}
+
+/**
+ * @brief MainWindow::applySnapshot: Fills in the configuration sections from
+ * a snapshot; items it lacks are shown as failed
+ * @param s
+ * @param only: just this item (CONFIG_*), or -1 for all of them
+ */
+void MainWindow::applySnapshot(const SensorSnapshot &s, int only)
+{
+    for (int item=0; item<CONFIG_NUM_ITEMS; item++) {
+        if (only >= 0 && item != only) {
+            continue;
+        }
+        if (!s.has(item)) {
+            configFailed(item, "Sensor gave no answer");
+            continue;
+        }
+        switch (item) {
+        case CONFIG_GENERAL:
+            *sensorConf = s.general();
+            if (sqliteSink != nullptr) {
+                sqliteSink->setMetricUnits(sensorConf->units != 0);
+            }
+            showSensorConfig();
+            break;
+        case CONFIG_DATA:
+            *lastReadDataConf = s.dataConfig();
+            showDataConfig(s.globalPush());
+            break;
+        case CONFIG_PUSH_MODE:
+            if (!s.has(CONFIG_DATA)) {
+                ui->uartLocalPushMode->setChecked(s.globalPush());
+            }
+            break;
+        case CONFIG_TIME:
+            clockModel->addSample(sensorId, s.timeSentMs(), s.timeReceivedMs(),
+                                  s.sensorTimeMs());
+            if (!sensorClock->isActive()) {
+                connect(sensorClock, SIGNAL(timeout()), this, SLOT(updateSensorTime()));
+                sensorClock->start(1000);
+            }
+            updateSensorTime();
+            break;
+        case CONFIG_APPROACHES: showApproachInfo(s); break;
+        case CONFIG_CLASSES: showClassConfig(s); break;
+        case CONFIG_LANES: showActiveLanes(s); break;
+        case CONFIG_SPEED_BINS: showSpeedBins(s); break;
+        }
+    }
+}
+
+/**
+ * @brief MainWindow::showApproachInfo
+ * Shows approach information read from the sensor
+ * @param s: snapshot holding the approach information
+ */
+void MainWindow::showApproachInfo(const SensorSnapshot &s)
+{
+    approachInfoRead = 1;
+    const approach *appr = s.approaches();
+    numApproaches = s.numApproaches();
+    pipeline->setApproaches(sensorId, appr, numApproaches);
     QString q = QString("<html><head/><body><p align=\"right\"><span style=\"font-size:12pt; font-weight:600;\">%1</span></p></body></html>").arg(numApproaches);
     ui->numApproachesConfigd->setText(q);
     int i;
@@ -818,35 +1055,34 @@ void MainWindow::refreshApproachInfo()
 
 void MainWindow::on_readApproachConfBtn_clicked()
 {
-    refreshApproachInfo();
+    loadConfig(CONFIG_APPROACHES, true);
 }
 
 void MainWindow::on_refreshClassConfig_clicked()
 {
-    if (!sensorConnected) {
-        QMessageBox::critical(this, "T2SSHD", "Error: not connected to sensor");
-        return;
-    }
-    memo = genReadMsg(Crc8Table, 0x13, 0, sensorId);
-    sendToSensor(&memo, 0);
-    parse_classif_read_resp(&resp, classBounds, &numClasses, errString);
+    loadConfig(CONFIG_CLASSES, true);
+}
+
+/**
+ * @brief MainWindow::showClassConfig
+ * Shows the classification bounds read from the sensor
+ * @param s: snapshot holding the classification configuration
+ */
+void MainWindow::showClassConfig(const SensorSnapshot &s)
+{
+    classBounds = s.classBounds();
+    numClasses = classBounds.size();
     QString str = QString("<html><head/><body><p><span style=\" font-size:12pt; font-weight:600;\">%1</span></p></body></html>").arg(numClasses);
     ui->numClasses->setText(str);
 
     QString unitAbbr = "ft";
 
-    if (!classConfigChecked) {
-        // create new labels
-        int i;
-        for (i=0; i<numClasses; i++) {
-            QString q = QString("<html><head/><body><p><span style=\" font-size:10pt; font-weight:600;\">Class %1</span></p></body></html>").arg(i+1);
-            QString q2= QString("<html><head/><body><p align=\"right\"><span style=\" font-size:10pt; font-weight:600;\">%1%2</span></p></body></html>").arg(*(classBounds + i)).arg(unitAbbr);
-            QLabel *l = new QLabel(q);
-            QLabel *l2 = new QLabel(q2);
-            ui->classGrid->addRow(l, l2);
-        }
-        classConfigChecked = true;
+    QVector<QStringList> rows;
+    for (int i=0; i<classBounds.size(); i++) {
+        rows.append(QStringList() << QString("Class %1").arg(i + 1)
+                    << QString("%1%2").arg(classBounds.at(i)).arg(unitAbbr));
     }
+    classModel->setRows(rows);
 }
 
 bool MainWindow::validateIntervalDataSetup()
@@ -980,6 +1216,21 @@ void MainWindow::startRealTimeDataRetrieval(int reqType,
         return;
     } else {
         dataRetrievalHasBeenClicked = true;
+        // retrieval resumes after the journal, so it has to have been read
+        finishStartup();
+        // the workers poll with blocking reads from here on
+        if (!cacheHeldForRetrieval) {
+            configCache->suspend();
+            cacheHeldForRetrieval = true;
+        }
+        // the workers write the data configuration first
+        configCache->forgetStored();
+        // lanes + approaches: the approaches can be built from the lanes
+        if (reqType == 3 && pipeline->derivesApproaches(sensorId)) {
+            printf("Polling lanes only, approaches derived from lane data\n");
+            reqType = 1;
+            individualLaneApprNum = 0xFF;
+        }
         if (port->isOpen()) {
             // write via serial
             serialWorker->startRealTimeDataRetrieval(reqType, individualLaneApprNum, Crc8Table,
@@ -1002,18 +1253,26 @@ void MainWindow::startRealTimeDataRetrieval(int reqType,
 void MainWindow::on_refreshSensorConfig_clicked()
 {
     if (refreshSensorConfig()) {
-        // update config data section
-        ui->sensorLocnEntry->setText(sensorConf->location);
-        ui->sensorDescEntry->setText(sensorConf->description);
-        uint8_t q = sensorConf->orientation;
-        ui->sensorOrientation->setText(QChar(q));
-        if (sensorConf->units == 0) {
-            ui->unitsMetric->setChecked(false);
-            ui->unitsAmerican->setChecked(true);
-        } else {
-            ui->unitsMetric->setChecked(true);
-            ui->unitsAmerican->setChecked(false);
-        }
+        showSensorConfig();
+    }
+}
+
+/**
+ * @brief MainWindow::showSensorConfig
+ * Updates the sensor configuration section from the last read configuration
+ */
+void MainWindow::showSensorConfig()
+{
+    ui->sensorLocnEntry->setText(sensorConf->location);
+    ui->sensorDescEntry->setText(sensorConf->description);
+    uint8_t q = sensorConf->orientation;
+    ui->sensorOrientation->setText(QChar(q));
+    if (sensorConf->units == 0) {
+        ui->unitsMetric->setChecked(false);
+        ui->unitsAmerican->setChecked(true);
+    } else {
+        ui->unitsMetric->setChecked(true);
+        ui->unitsAmerican->setChecked(false);
     }
 }
 
@@ -1028,12 +1287,45 @@ void MainWindow::on_dataIntrvlRTD_valueChanged(int arg1)
 
 void MainWindow::on_stopDataRetrieval_clicked()
 {
-    serialWorker->stopRealTimeDataRetrieval();
+    // the same worker startRealTimeDataRetrieval picked; the cache mustn't
+    // share the device with one that is still polling
+    if (port->isOpen()) {
+        serialWorker->stopRealTimeDataRetrieval();
+    } else {
+        tcpWorker->stopRealTimeDataRetrieval();
+    }
+    if (cacheHeldForRetrieval) {
+        configCache->resume();
+        cacheHeldForRetrieval = false;
+    }
 }
 
-void MainWindow::updateDataView(QString dataLine)
+/**
+ * @brief MainWindow::setCoalescedViewUpdates: Off shows every interval as its
+ * own table update, for measuring against the per-frame default
+ * @param on
+ */
+void MainWindow::setCoalescedViewUpdates(bool on)
 {
-    ui->dataView->appendPlainText(dataLine);
+    liveFeed->setCoalesced(on);
+}
+
+/**
+ * @brief MainWindow::addChartLane: Lists a lane/approach the charts have data
+ * for; the first one is shown straight away
+ * @param key: interval_key of the lane/approach
+ * @param name
+ */
+void MainWindow::addChartLane(quint32 key, QString name)
+{
+    ui->chartLaneSelect->addItem(name, key);
+}
+
+void MainWindow::on_chartLaneSelect_currentIndexChanged(int index)
+{
+    if (index >= 0) {
+        ui->laneChart->setLane(ui->chartLaneSelect->itemData(index).toUInt());
+    }
 }
 
 void MainWindow::on_connectViaCom_clicked()
@@ -1107,18 +1399,22 @@ void MainWindow::on_ipConnect_clicked()
             return;
         }
 
-        // connection successful! update state accordingly
+        // connection successful! the configuration reads all go out at once,
+        // so the gateway costs one round trip; snapshotReady() finishes up
         sensorConnected = true;
 
-        ui->ipConnect->setText("Close IP Connection");
-        ui->ipConnect->setEnabled(true);
-
-        // update connected text
-        QString q = "<html><head/><body><p align=\"center\"><span style=\"font-size:9pt; font-weight:600; color:#0d9332;\">CONNECTED </span></p></body></html>";
+        QString q = "<html><head/><body><p align=\"center\"><span style=\"font-size:9pt; font-weight:600; color:#b08000;\">CONNECTING </span></p></body></html>";
         ui->conxnStatus->setText(q);
 
+        configCache->attach(tcpWorker->socket(), sensorId);
+        for (int i=0; i<CONFIG_NUM_ITEMS; i++) {
+            showLoading(i);
+        }
+        configCache->snapshot();
     } else {
         // disconnecting
+        configCache->detach();
+        stateStore->setLink(sensorId, SENSOR_OFFLINE);
         tcpWorker->closeConnection();
         QString q = "<html><head/><body><p align=\"center\"><span style=\"font-size:9pt; font-weight:600; color:#ff0000;\">DISCONNECTED </span></p></body></html>";
         ui->conxnStatus->setText(q);
@@ -1201,13 +1497,18 @@ void MainWindow::on_setDateTimeBtn_clicked()
 
     memo = gen_sensor_time_write(Crc8Table, sensorDateTime, sensorId);
     sendToSensor(&memo, 1);
+    // set by hand: what the model knew of this clock no longer holds
+    clockModel->forget(sensorId);
     if (errCode == 0) { QMessageBox::information(this, "T2SSHD", "Success!"); }
     refreshDateTime();
 }
 
 void MainWindow::on_approachSelect_currentIndexChanged(int index)
 {
-    approach selectedApproach = *(appr + index);
+    if (index < 0 || index >= config.numApproaches()) {
+        return;
+    }
+    approach selectedApproach = config.approaches()[index];
     uint8_t numLanes = selectedApproach.numLanes;
     uint8_t *lanesInThisApproach = selectedApproach.lanesAssigned;
 
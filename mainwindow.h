@@ -2,6 +2,7 @@
 #define MAINWINDOW_H
 
 
+#include <QElapsedTimer>
 #include <QFile>
 #include <QLabel>
 #include <QMainWindow>
@@ -10,6 +11,18 @@
 #include <QThread>
 #include <QTimer>
 
+#include "clockmodel.h"
+#include "configcache.h"
+#include "configtablemodel.h"
+#include "intervalpipeline.h"
+#include "intervalstore.h"
+#include "liveviewfeed.h"
+#include "pollscheduler.h"
+#include "portwatcher.h"
+#include "recordtablemodel.h"
+#include "sensorfleetmodel.h"
+#include "sensorsnapshot.h"
+#include "sensorstatestore.h"
 #include "tcpworker.h"
 #include "sensor_utils.h"
 #include "serialworker.h"
@@ -37,15 +50,8 @@ class MainWindow : public QMainWindow
     int numApproaches;
     int numLanes;
 
-    double classBounds[8] = {0};
-    lane laneArr[10];
-
-    char laneGridInitialized = 0;
-    QLabel* laneLabels[10][3];
-    QLabel* speedBinLabels[15][2];
-
-    float speedBins[15];
-    char speedBinGridInitialized = 0;
+    QVector<double> classBounds;
+    QVector<float> speedBins;
 
     int numClasses;
     int numSpeedBins;
@@ -61,7 +67,7 @@ class MainWindow : public QMainWindow
 //    sensor_config *lastWrittenConf;
     sensor_data_config *lastReadDataConf;
     sensor_datetime *sensorDateTime;
-    approach *appr;
+    SensorSnapshot config;
 
     bool sensorConnected;
     CXN_MODE connectionMode;
@@ -71,29 +77,68 @@ class MainWindow : public QMainWindow
 public:
     explicit MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
+    void enableSqliteSink(const QString &dbName);
+    void setApproachVerification(bool on);
+    void setClockCorrection(bool on);
+    void setCoalescedViewUpdates(bool on);
+    void setColdStartTimer(const QElapsedTimer &t);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
 
 private:
-    bool classConfigChecked;
-    void refreshApproachInfo();
-    void refreshActiveLanes();
+    void loadConfig(int item, bool reload);
+    void showLoading(int item);
+    void applySnapshot(const SensorSnapshot &s, int only = -1);
     void refreshDataConfig();
     void refreshDateTime();
     bool refreshSensorConfig();
-    void refreshSpeedBins();
+    void showSensorConfig();
+    void showDataConfig(bool globalPush);
+    void showActiveLanes(const SensorSnapshot &s);
+    void showApproachInfo(const SensorSnapshot &s);
+    void showClassConfig(const SensorSnapshot &s);
+    void showSpeedBins(const SensorSnapshot &s);
     void sendToSensor(QByteArray *msg, char msgType);
+    void showSensorTime(qint64 sensorMs);
     bool validateIntervalDataSetup();
     void startRealTimeDataRetrieval(int requestType,
                                     int indvLaneApprNum);
 
     QFile *file;
+    IntervalStore *intervalStore;
+    IntervalStore *rollupStore;
+    IntervalPipeline *pipeline;
+    PollScheduler *pollScheduler;
+    ClockModel *clockModel;
+    PortWatcher *portWatcher;
+    RecordTableModel *recordModel;
+    ConfigCache *configCache;
+    SnapshotStore *snapshotStore;
+    bool cacheHeldForRetrieval;
+    ConfigTableModel *laneModel;
+    ConfigTableModel *speedBinModel;
+    ConfigTableModel *classModel;
+    LiveViewFeed *liveFeed;
+    SensorStateStore *stateStore;
+    SensorFleetModel *fleetModel;
+    RecordJournal *journal;
+    SqliteSink *sqliteSink;
+    QThread *sqliteThread;
     QSerialPort *port;
     QThread *serialThread;
     SerialWorker *serialWorker;
     TCPWorker *tcpWorker;
     Ui::MainWindow *ui;
 
+    QElapsedTimer coldStart;
+    bool firstPaintSeen;
+    bool startupDone;
+
 private slots:
     void on_refreshComPorts_clicked();
+    void updatePortList(QStringList names, QStringList labels);
+    void finishStartup();
 
     void on_connectToCom_clicked();
 
@@ -113,7 +158,11 @@ private slots:
 
     void on_refreshClassConfig_clicked();
 
-    void updateDataView(QString dataLine);
+    void configLoaded(int item);
+    void configFailed(int item, QString reason);
+    void snapshotReady(SensorSnapshot s);
+    void addChartLane(quint32 key, QString name);
+    void on_chartLaneSelect_currentIndexChanged(int index);
 
     void on_writeDataSetup_clicked();
     void on_refreshSensorConfig_clicked();
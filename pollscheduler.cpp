@@ -0,0 +1,173 @@
+#include "pollscheduler.h"
+
+#include <QDateTime>
+
+// report close-to-stored latency every this many stored intervals
+#define POLL_REPORT_EVERY 10
+
+PollScheduler::PollScheduler()
+{
+}
+
+/**
+ * @brief PollScheduler::addSensor: Starts scheduling a sensor selection and
+ * re-spreads every selection's phase
+ * @param key: interval_key of the selection
+ * @param duration: data interval, seconds
+ */
+void PollScheduler::addSensor(quint32 key, uint16_t duration)
+{
+    if (!lanes.contains(key)) {
+        poll_lane l;
+        l.offsetMs = 0;
+        l.settleMs = POLL_SETTLE_INITIAL_MS;
+        l.stored = 0;
+        l.notReady = 0;
+        l.latencyMs = 0;
+        l.maxLatencyMs = 0;
+        lanes[key] = l;
+        order.append(key);
+    }
+    lanes[key].duration = duration > 0 ? duration : 60;
+    spreadPhases();
+}
+
+void PollScheduler::removeSensor(quint32 key)
+{
+    lanes.remove(key);
+    order.removeAll(key);
+    spreadPhases();
+}
+
+/**
+ * @brief PollScheduler::setClockOffset: Where the sensor's clock is relative to ours
+ * @param offsetMs: sensor time minus host time, milliseconds
+ */
+void PollScheduler::setClockOffset(quint32 key, qint64 offsetMs)
+{
+    if (lanes.contains(key)) {
+        lanes[key].offsetMs = offsetMs;
+        printf("Sensor clock offset: %lld ms\n", offsetMs);
+    }
+}
+
+/**
+ * @brief PollScheduler::pollTarget: Which interval a poll should ask for.
+ * After an outage that is the newest finished one; the ones in between are
+ * left to the gap scanner instead of catching up one per tick. Both checks
+ * go by the sensor's clock.
+ * @param key
+ * @param next: first interval not stored yet, UTC seconds
+ * @param duration: data interval, seconds
+ * @param closed: set to whether the returned interval has finished on the
+ * sensor, i.e. whether it can be read yet
+ * @return interval start to poll, UTC seconds
+ */
+qint64 PollScheduler::pollTarget(quint32 key, qint64 next, uint16_t duration,
+                                 bool *closed) const
+{
+    qint64 offsetMs = lanes.contains(key) ? lanes.value(key).offsetMs : 0;
+    qint64 now = (QDateTime::currentMSecsSinceEpoch() + offsetMs) / 1000;
+    if (duration > 0) {
+        qint64 newest = now - now % duration - duration;
+        if (next < newest) {
+            next = newest;
+        }
+    }
+    *closed = next + duration <= now;
+    return next;
+}
+
+/**
+ * @brief PollScheduler::msUntilDue: How long to wait before asking for an interval
+ * @param intervalStart: interval start on the sensor's clock, UTC seconds
+ * @return milliseconds from now, 0 if it is already due
+ */
+int PollScheduler::msUntilDue(quint32 key, qint64 intervalStart) const
+{
+    if (!lanes.contains(key)) {
+        return 0;
+    }
+    const poll_lane l = lanes.value(key);
+
+    // the interval closes on the sensor's clock; convert to ours
+    qint64 closeMs = (intervalStart + l.duration) * 1000 - l.offsetMs;
+    qint64 wait = closeMs + l.settleMs + l.phaseMs - QDateTime::currentMSecsSinceEpoch();
+    if (wait < 0) {
+        return 0;
+    }
+    // a cursor that ran ahead shouldn't park the poller
+    if (wait > 2 * l.duration * 1000) {
+        wait = 2 * l.duration * 1000;
+    }
+    return static_cast<int>(wait);
+}
+
+/**
+ * @brief PollScheduler::record: Learns from how a poll went
+ * @param intervalEnd: for POLL_STORED, the end of the interval that was
+ * stored, UTC seconds on the sensor's clock
+ */
+void PollScheduler::record(quint32 key, POLL_OUTCOME outcome, qint64 intervalEnd)
+{
+    if (!lanes.contains(key)) {
+        return;
+    }
+    poll_lane &l = lanes[key];
+
+    if (outcome == POLL_NOT_READY) {
+        // asked too early: wait longer after the boundary
+        l.notReady++;
+        l.settleMs *= 2;
+        if (l.settleMs > POLL_SETTLE_MAX_MS) {
+            l.settleMs = POLL_SETTLE_MAX_MS;
+        }
+        if (l.settleMs > l.duration * 500) {
+            l.settleMs = l.duration * 500;
+        }
+        return;
+    }
+    if (outcome != POLL_STORED) {
+        return;
+    }
+
+    // probe for a shorter settle delay
+    l.settleMs -= l.settleMs / 8;
+    if (l.settleMs < POLL_SETTLE_MIN_MS) {
+        l.settleMs = POLL_SETTLE_MIN_MS;
+    }
+
+    qint64 latency = QDateTime::currentMSecsSinceEpoch() -
+            (intervalEnd * 1000 - l.offsetMs);
+    l.latencyMs += latency;
+    if (latency > l.maxLatencyMs) {
+        l.maxLatencyMs = latency;
+    }
+    l.stored++;
+    if (l.stored % POLL_REPORT_EVERY == 0) {
+        report(key);
+    }
+}
+
+void PollScheduler::report(quint32 key) const
+{
+    if (!lanes.contains(key)) {
+        return;
+    }
+    const poll_lane l = lanes.value(key);
+    printf("Polling sensor %u: settle %d ms, phase %d ms, %lld stored, %lld early;"
+           " close-to-stored avg %.2f s, max %.2f s\n",
+           key >> 16, l.settleMs, l.phaseMs, l.stored, l.notReady,
+           l.stored > 0 ? l.latencyMs / 1000.0 / l.stored : 0.0,
+           l.maxLatencyMs / 1000.0);
+}
+
+// evenly offsets the selections over the first half of their interval
+void PollScheduler::spreadPhases()
+{
+    int n = order.size();
+    for (int i=0; i<n; i++) {
+        poll_lane &l = lanes[order.at(i)];
+        l.phaseMs = static_cast<int>(static_cast<qint64>(i) * l.duration * 500 / n);
+    }
+}
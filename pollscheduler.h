@@ -0,0 +1,53 @@
+#ifndef POLLSCHEDULER_H
+#define POLLSCHEDULER_H
+
+#include <QHash>
+#include <QList>
+
+#include "sensor_utils.h"
+
+#define POLL_SETTLE_INITIAL_MS 1000
+#define POLL_SETTLE_MIN_MS 100
+#define POLL_SETTLE_MAX_MS 30000
+#define POLL_RETRY_MS 1000
+
+// how a poll for one interval went
+enum POLL_OUTCOME { POLL_STORED, POLL_NOT_READY, POLL_FAILED, POLL_EARLY };
+
+// Decides when each polled sensor selection asks for its next interval: once
+// the interval has closed on the sensor's clock, plus a settle delay the
+// sensor needs before the interval can be read, plus a phase that spreads
+// the selections sharing the scheduler over the first half of the interval.
+// The settle delay is learned: it doubles whenever the sensor answers that
+// the interval isn't there yet and creeps back down after every success.
+class PollScheduler
+{
+public:
+    PollScheduler();
+    void addSensor(quint32 key, uint16_t duration);
+    void removeSensor(quint32 key);
+    void setClockOffset(quint32 key, qint64 offsetMs);
+    int msUntilDue(quint32 key, qint64 intervalStart) const;
+    qint64 pollTarget(quint32 key, qint64 next, uint16_t duration, bool *closed) const;
+    void record(quint32 key, POLL_OUTCOME outcome, qint64 intervalEnd);
+    void report(quint32 key) const;
+
+private:
+    struct poll_lane {
+        uint16_t duration;
+        qint64 offsetMs;        // sensor clock minus host clock
+        int settleMs;
+        int phaseMs;
+        qint64 stored;
+        qint64 notReady;
+        qint64 latencyMs;
+        qint64 maxLatencyMs;
+    };
+
+    void spreadPhases();
+
+    QHash<quint32, poll_lane> lanes;
+    QList<quint32> order;
+};
+
+#endif // POLLSCHEDULER_H
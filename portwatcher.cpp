@@ -0,0 +1,104 @@
+#include "portwatcher.h"
+
+#include <stdio.h>
+
+#include <QtConcurrent>
+
+PortWatcher::PortWatcher(QObject *parent) : QObject(parent)
+{
+    devWatcher = nullptr;
+    started = false;
+    rescanPending = false;
+    reported = false;
+    scans = 0;
+
+    settleTimer = new QTimer(this);
+    settleTimer->setSingleShot(true);
+    settleTimer->setInterval(PORT_SETTLE_MS);
+    connect(settleTimer, &QTimer::timeout, this, &PortWatcher::rescan);
+
+    pollTimer = new QTimer(this);
+    pollTimer->setInterval(PORT_POLL_MS);
+    connect(pollTimer, &QTimer::timeout, this, &PortWatcher::rescan);
+
+    connect(&scanner, &QFutureWatcher<QList<QSerialPortInfo> >::finished,
+            this, &PortWatcher::scanFinished);
+}
+
+/**
+ * @brief PortWatcher::start: Starts the first scan and the hotplug watch
+ */
+void PortWatcher::start()
+{
+    if (started) {
+        return;
+    }
+    started = true;
+    rescan();
+
+    bool watching = false;
+#ifdef Q_OS_UNIX
+    devWatcher = new QFileSystemWatcher(this);
+    watching = devWatcher->addPath("/dev");
+    connect(devWatcher, &QFileSystemWatcher::directoryChanged,
+            this, &PortWatcher::deviceChanged);
+#endif
+    if (!watching) {
+        pollTimer->start();
+    }
+}
+
+/**
+ * @brief PortWatcher::rescan: Enumerates the ports on a pool thread; if a scan
+ * is already running another one follows it
+ */
+void PortWatcher::rescan()
+{
+    if (scanner.isRunning()) {
+        rescanPending = true;
+        return;
+    }
+    rescanPending = false;
+    scanTime.start();
+    scanner.setFuture(QtConcurrent::run(&PortWatcher::enumerate));
+}
+
+void PortWatcher::deviceChanged()
+{
+    // (re)started on every change, so a burst of device nodes is one scan
+    settleTimer->start();
+}
+
+QList<QSerialPortInfo> PortWatcher::enumerate()
+{
+    return QSerialPortInfo::availablePorts();
+}
+
+void PortWatcher::scanFinished()
+{
+    QList<QSerialPortInfo> ports = scanner.result();
+    qint64 ms = scanTime.elapsed();
+    scans++;
+
+    QStringList names;
+    QStringList labels;
+    foreach(QSerialPortInfo p, ports) {
+        names.append(p.portName());
+        labels.append(QString(p.portName() + " (" + p.description() + ")"));
+    }
+
+    if (!reported) {
+        printf("Ports: %d found in %lld ms, off the GUI thread\n",
+               names.size(), static_cast<long long>(ms));
+        reported = true;
+    }
+    if (names != lastNames || labels != lastLabels || scans == 1) {
+        lastNames = names;
+        lastLabels = labels;
+        emit portsChanged(names, labels);
+    }
+
+    if (rescanPending) {
+        rescan();
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef PORTWATCHER_H
+#define PORTWATCHER_H
+
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
+#include <QFutureWatcher>
+#include <QList>
+#include <QObject>
+#include <QSerialPortInfo>
+#include <QStringList>
+#include <QTimer>
+
+#define PORT_SETTLE_MS  300     // hotplug events are bursty; scan once they stop
+#define PORT_POLL_MS    3000    // where device nodes can't be watched
+
+// Keeps the list of serial ports current without blocking the GUI thread.
+// QSerialPortInfo::availablePorts() walks every device and can take a long
+// time with many ports or USB adapters, so it runs on a pool thread and the
+// result comes back as a signal. On unix /dev is watched (inotify on Linux),
+// so plugging or pulling an adapter triggers a rescan; elsewhere, or if /dev
+// can't be watched, the ports are rescanned every PORT_POLL_MS. The signal is
+// only emitted when the set of ports actually changed.
+class PortWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PortWatcher(QObject *parent = nullptr);
+    void start();
+    void rescan();
+
+signals:
+    void portsChanged(QStringList names, QStringList labels);
+
+private slots:
+    void deviceChanged();
+    void scanFinished();
+
+private:
+    static QList<QSerialPortInfo> enumerate();
+
+    QFutureWatcher<QList<QSerialPortInfo> > scanner;
+    QFileSystemWatcher *devWatcher;
+    QTimer *settleTimer;
+    QTimer *pollTimer;
+    QStringList lastNames;
+    QStringList lastLabels;
+    bool started;
+    bool rescanPending;
+    bool reported;
+
+    QElapsedTimer scanTime;
+    int scans;
+};
+
+#endif // PORTWATCHER_H
@@ -0,0 +1,139 @@
+#include "qualitymonitor.h"
+
+#include <QDateTime>
+
+// a lane with no vehicles for this long might have stopped detecting
+#define QUALITY_ZERO_STREAK_SECS 3600
+// identical nonzero readings this many times in a row
+#define QUALITY_STUCK_REPEATS 4
+// in the sensor's units (mph or kph), and occupancy in percent
+#define QUALITY_MAX_SPEED 200
+#define QUALITY_MAX_OCCUPANCY 100
+#define QUALITY_REPORT_EVERY 1000
+
+static const char *FLAG_NAMES[7] = { "no speed", "zero-volume run", "stuck",
+                                     "inconsistent", "implausible", "clock jump",
+                                     "partial" };
+
+QualityMonitor::QualityMonitor()
+{
+    checked = 0;
+    for (int i=0; i<7; i++) {
+        flagged[i] = 0;
+    }
+}
+
+/**
+ * @brief QualityMonitor::check: Sets r->quality from the interval itself and
+ * from the previous interval of the same lane/approach. Flags already set
+ * (e.g. QUALITY_PARTIAL on derived intervals) are kept.
+ * @param r
+ * @return the flags
+ */
+uint16_t QualityMonitor::check(interval_record *r)
+{
+    uint16_t q = r->quality;
+    bool speedValid = (r->avg_speed & 0x800000) != 0;
+    uint32_t speed = r->avg_speed & 0x7FFFFF;
+
+    if (!speedValid || !(r->speed_85 & 0x800000)) {
+        q |= QUALITY_NO_SPEED;
+    }
+    if ((r->volume == 0 && (r->avg_occupancy > 0 || (speedValid && speed > 0))) ||
+            (r->volume > 0 && r->avg_occupancy == 0 && !speedValid)) {
+        q |= QUALITY_INCONSISTENT;
+    }
+    // a lane can't take more than about one vehicle a second
+    if ((r->avg_occupancy >> 8) > QUALITY_MAX_OCCUPANCY ||
+            (speedValid && (speed >> 8) > QUALITY_MAX_SPEED) ||
+            (r->request_type == 1 && r->interval_duration > 0 &&
+             r->volume > r->interval_duration)) {
+        q |= QUALITY_IMPLAUSIBLE;
+    }
+    if (r->timestamp > QDateTime::currentSecsSinceEpoch() + r->interval_duration) {
+        q |= QUALITY_CLOCK_JUMP;
+    }
+
+    quint32 key = interval_key(r->sensor_id, r->request_type, r->lane_appr_num);
+    QHash<quint32, lane_state>::iterator it = lanes.find(key);
+    if (it == lanes.end()) {
+        lane_state s;
+        s.lastTs = r->timestamp;
+        s.duration = r->interval_duration;
+        s.zeroSecs = 0;
+        s.repeats = 0;
+        s.lastVolume = 0;
+        s.lastSpeed = 0;
+        s.lastOccupancy = 0;
+        it = lanes.insert(key, s);
+    }
+    lane_state &s = it.value();
+    qint64 step = r->timestamp - s.lastTs;
+    bool nextInLine = step == r->interval_duration && s.duration == r->interval_duration;
+
+    if (step > 0 && r->interval_duration > 0 && step % r->interval_duration != 0) {
+        q |= QUALITY_CLOCK_JUMP;
+    }
+    // out-of-order intervals are checked on their own and don't touch the streaks
+    if (step >= 0) {
+        if (r->volume == 0) {
+            s.zeroSecs = (nextInLine ? s.zeroSecs : 0) + r->interval_duration;
+            if (s.zeroSecs >= QUALITY_ZERO_STREAK_SECS) {
+                q |= QUALITY_ZERO_STREAK;
+            }
+        } else {
+            s.zeroSecs = 0;
+        }
+        if (nextInLine && r->volume > 0 && r->volume == s.lastVolume &&
+                r->avg_speed == s.lastSpeed && r->avg_occupancy == s.lastOccupancy) {
+            s.repeats++;
+            if (s.repeats >= QUALITY_STUCK_REPEATS - 1) {
+                q |= QUALITY_STUCK;
+            }
+        } else {
+            s.repeats = 0;
+        }
+        s.lastTs = r->timestamp;
+        s.duration = r->interval_duration;
+        s.lastVolume = r->volume;
+        s.lastSpeed = r->avg_speed;
+        s.lastOccupancy = r->avg_occupancy;
+    }
+
+    r->quality = q;
+    checked++;
+    for (int i=0; i<7; i++) {
+        if (q & (1 << i)) {
+            flagged[i]++;
+        }
+    }
+    if (checked % QUALITY_REPORT_EVERY == 0) {
+        report();
+    }
+    return q;
+}
+
+/**
+ * @brief QualityMonitor::flaggedCount: Intervals flagged so far
+ * @param flag: one QUALITY_* flag
+ */
+qint64 QualityMonitor::flaggedCount(uint16_t flag) const
+{
+    for (int i=0; i<7; i++) {
+        if (flag == (1 << i)) {
+            return flagged[i];
+        }
+    }
+    return 0;
+}
+
+void QualityMonitor::report() const
+{
+    printf("Quality: %lld intervals checked;", checked);
+    for (int i=0; i<7; i++) {
+        if (flagged[i] > 0) {
+            printf(" %s %lld", FLAG_NAMES[i], flagged[i]);
+        }
+    }
+    printf("\n");
+}
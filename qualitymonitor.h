@@ -0,0 +1,38 @@
+#ifndef QUALITYMONITOR_H
+#define QUALITYMONITOR_H
+
+#include <QHash>
+
+#include "sensor_utils.h"
+
+// Sets the QUALITY_* flags of intervals as they arrive, from a few counters
+// kept per lane/approach, so stored intervals carry their flags and
+// aggregates can leave bad ones out as they go. Streak checks only follow
+// intervals that arrive back to back; refetched or backfilled intervals that
+// arrive out of order start a new streak.
+class QualityMonitor
+{
+public:
+    QualityMonitor();
+    uint16_t check(interval_record *r);
+    qint64 flaggedCount(uint16_t flag) const;
+
+private:
+    struct lane_state {
+        qint64 lastTs;
+        uint16_t duration;
+        qint64 zeroSecs;        // length of the current zero-volume run
+        int repeats;            // intervals equal to the last one
+        uint32_t lastVolume;
+        uint32_t lastSpeed;
+        uint16_t lastOccupancy;
+    };
+
+    void report() const;
+
+    QHash<quint32, lane_state> lanes;
+    qint64 checked;
+    qint64 flagged[7];
+};
+
+#endif // QUALITYMONITOR_H
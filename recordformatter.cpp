@@ -0,0 +1,215 @@
+#include "recordformatter.h"
+
+#include <charconv>
+#include <string.h>
+
+using namespace std;
+
+// Appends v right-aligned in a field of the given width
+static char *putUInt(char *p, char *end, uint32_t v, int width = 0, char pad = ' ')
+{
+    char tmp[12];
+    to_chars_result res = to_chars(tmp, tmp + sizeof(tmp), v);
+    int n = static_cast<int>(res.ptr - tmp);
+    for (int i=n; i<width && p < end; i++) {
+        *p++ = pad;
+    }
+    if (p + n <= end) {
+        memcpy(p, tmp, n);
+        p += n;
+    }
+    return p;
+}
+
+static char *putText(char *p, char *end, const char *s)
+{
+    int n = static_cast<int>(strlen(s));
+    if (p + n <= end) {
+        memcpy(p, s, n);
+        p += n;
+    }
+    return p;
+}
+
+// Appends an 8-bit fractional fixed point value with two decimals
+static char *putFixed8(char *p, char *end, uint32_t intPart, uint32_t frac, int width)
+{
+    uint32_t hundredths = (frac * 100 + 128) / 256;
+    if (hundredths >= 100) {
+        intPart++;
+        hundredths -= 100;
+    }
+    int intWidth = width > 3 ? width - 3 : 0;
+    p = putUInt(p, end, intPart, intWidth);
+    if (p + 3 <= end) {
+        *p++ = '.';
+        *p++ = static_cast<char>('0' + hundredths / 10);
+        *p++ = static_cast<char>('0' + hundredths % 10);
+    }
+    return p;
+}
+
+// two hex digits, e.g. quality flags
+static char *putHex8(char *p, char *end, uint32_t v)
+{
+    const char *digits = "0123456789ABCDEF";
+    if (p + 2 <= end) {
+        *p++ = digits[(v >> 4) & 0xF];
+        *p++ = digits[v & 0xF];
+    }
+    return p;
+}
+
+// 24-bit speed field; invalid speeds keep the 3.125 marker of doubleFrom24BitFixedPt
+static char *putSpeed(char *p, char *end, uint32_t raw, int width)
+{
+    if (!(raw & 0x800000)) {
+        for (int i=5; i<width && p < end; i++) {
+            *p++ = ' ';
+        }
+        return putText(p, end, "3.125");
+    }
+    return putFixed8(p, end, (raw >> 8) & 0x7FFF, raw & 0xFF, width);
+}
+
+// days since 1970-01-01 to a civil date (proleptic Gregorian)
+static void civilFromDays(int64_t z, int *y, unsigned *m, unsigned *d)
+{
+    z += 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    unsigned doe = static_cast<unsigned>(z - era * 146097);
+    unsigned yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+    int64_t yr = static_cast<int64_t>(yoe) + era * 400;
+    unsigned doy = doe - (365*yoe + yoe/4 - yoe/100);
+    unsigned mp = (5*doy + 2) / 153;
+    *d = doy - (153*mp + 2)/5 + 1;
+    *m = mp < 10 ? mp + 3 : mp - 9;
+    *y = static_cast<int>(yr + (*m <= 2));
+}
+
+RecordFormatter::RecordFormatter()
+{
+    len = 0;
+    buf[0] = 0;
+}
+
+const char *RecordFormatter::data() const
+{
+    return buf;
+}
+
+int RecordFormatter::size() const
+{
+    return len;
+}
+
+/**
+ * @brief RecordFormatter::formatHeader: Header row matching the columns written by format()
+ * @param numClasses
+ * @param numSpeedBins
+ * @return length of the line in the buffer
+ */
+int RecordFormatter::formatHeader(int numClasses, int numSpeedBins)
+{
+    char *p = buf;
+    char *end = buf + RECORD_LINE_MAX;
+    const char *spacer = "    ";
+
+    p = putText(p, end, "Datetime");
+    p = putText(p, end, spacer);
+    p = putText(p, end, "Interval Duration");
+    p = putText(p, end, spacer);
+    p = putText(p, end, "Total # Lanes/Apprs");
+    p = putText(p, end, spacer);
+    p = putText(p, end, "Avg Speed");
+    p = putText(p, end, spacer);
+    p = putText(p, end, "Volume");
+    p = putText(p, end, spacer);
+    p = putText(p, end, "Avg Occupancy");
+    p = putText(p, end, spacer);
+    p = putText(p, end, "85th Pctle Speed");
+    p = putText(p, end, spacer);
+    p = putText(p, end, "Headway (ms)");
+    p = putText(p, end, spacer);
+    p = putText(p, end, "Gap (ms)");
+    p = putText(p, end, spacer);
+
+    int i;
+    for (i=0; i<numClasses && i<MAX_CLASS_BINS; i++) {
+        p = putText(p, end, "Length Bin ");
+        p = putUInt(p, end, i + 1);
+        p = putText(p, end, spacer);
+    }
+    for (i=0; i<numSpeedBins && i<MAX_SPEED_BINS; i++) {
+        p = putText(p, end, "Speed Bin ");
+        p = putUInt(p, end, i + 1);
+        p = putText(p, end, spacer);
+    }
+    p = putText(p, end, "Quality");
+    p = putText(p, end, "\n");
+
+    len = static_cast<int>(p - buf);
+    return len;
+}
+
+/**
+ * @brief RecordFormatter::format: Formats one interval as a text line. The
+ * buffer is reused, so the result is only valid until the next call.
+ * @param r
+ * @return length of the line in the buffer
+ */
+int RecordFormatter::format(const interval_record &r)
+{
+    char *p = buf;
+    char *end = buf + RECORD_LINE_MAX;
+
+    int64_t days = r.timestamp / 86400;
+    int64_t secsOfDay = r.timestamp % 86400;
+    if (secsOfDay < 0) {
+        secsOfDay += 86400;
+        days--;
+    }
+    int year;
+    unsigned month, day;
+    civilFromDays(days, &year, &month, &day);
+
+    p = putUInt(p, end, month, 2, '0');
+    p = putText(p, end, "/");
+    p = putUInt(p, end, day, 2, '0');
+    p = putText(p, end, "/");
+    p = putUInt(p, end, static_cast<uint32_t>(year), 4, '0');
+    p = putText(p, end, " ");
+    p = putUInt(p, end, static_cast<uint32_t>(secsOfDay / 3600), 2, '0');
+    p = putText(p, end, ":");
+    p = putUInt(p, end, static_cast<uint32_t>((secsOfDay / 60) % 60), 2, '0');
+    p = putText(p, end, ":");
+    p = putUInt(p, end, static_cast<uint32_t>(secsOfDay % 60), 2, '0');
+
+    p = putUInt(p, end, r.interval_duration, 6);
+    p = putUInt(p, end, r.num_lanes, 3);
+    p = putUInt(p, end, r.num_apprs, 3);
+    p = putSpeed(p, end, r.avg_speed, 8);
+    p = putUInt(p, end, r.volume, 7);
+    p = putFixed8(p, end, r.avg_occupancy >> 8, r.avg_occupancy & 0xFF, 7);
+    p = putSpeed(p, end, r.speed_85, 8);
+    p = putUInt(p, end, r.headway, 8);
+    p = putUInt(p, end, r.gap, 8);
+
+    int j;
+    for (j=0; j<r.num_class_bins; j++) {
+        p = putUInt(p, end, r.class_bins[j], 5);
+    }
+    for (j=0; j<r.num_speed_bins; j++) {
+        p = putUInt(p, end, r.speed_bins[j], 5);
+    }
+    for (j=0; j<r.num_dir_bins; j++) {
+        p = putUInt(p, end, r.dir_bins[j], 5);
+    }
+    // QUALITY_* flags last, so the columns before it don't move
+    p = putText(p, end, "   ");
+    p = putHex8(p, end, r.quality);
+    p = putText(p, end, "\n");
+
+    len = static_cast<int>(p - buf);
+    return len;
+}
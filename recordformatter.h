@@ -0,0 +1,24 @@
+#ifndef RECORDFORMATTER_H
+#define RECORDFORMATTER_H
+
+#include "sensor_utils.h"
+
+#define RECORD_LINE_MAX 512
+
+// Formats interval_records as text lines into one reusable buffer, using
+// std::to_chars on the raw integer fields so no per-record allocation is made.
+class RecordFormatter
+{
+public:
+    RecordFormatter();
+    int formatHeader(int numClasses, int numSpeedBins);
+    int format(const interval_record &r);
+    const char *data() const;
+    int size() const;
+
+private:
+    char buf[RECORD_LINE_MAX];
+    int len;
+};
+
+#endif // RECORDFORMATTER_H
@@ -0,0 +1,302 @@
+#include "recordjournal.h"
+#include "interval_codec.h"
+
+#include <QSaveFile>
+#include <string.h>
+
+// a one-record segment is well under this; anything bigger is garbage
+#define JOURNAL_MAX_ENTRY 4096
+// set in an entry's length word once its interval is in the segment store;
+// outside the CRC, which starts after the length and CRC words
+#define JOURNAL_ENTRY_STORED 0x80000000u
+
+static void putLE(char *p, uint64_t v, int bytes)
+{
+    for (int i=0; i<bytes; i++) {
+        p[i] = static_cast<char>((v >> (8 * i)) & 0xFF);
+    }
+}
+
+static uint64_t getLE(const char *p, int bytes)
+{
+    uint64_t v = 0;
+    for (int i=0; i<bytes; i++) {
+        v |= static_cast<uint64_t>(static_cast<uint8_t>(p[i])) << (8 * i);
+    }
+    return v;
+}
+
+RecordJournal::RecordJournal(const QString &fileName)
+{
+    file.setFileName(fileName);
+    generateCrc32Table(crc32Table);
+    unsynced = false;
+}
+
+RecordJournal::~RecordJournal()
+{
+    file.close();
+}
+
+/**
+ * @brief RecordJournal::recover: Opens the journal, checks every entry and
+ * truncates the file at the first torn or corrupt one
+ * @param unstored: if given, gets every interval that was journaled but not
+ * yet marked as stored by a checkpoint, i.e. what a crash kept from the
+ * segment store; the caller stores them and checkpoints
+ * @return number of intervals found in the journal, or -1 if it couldn't be opened
+ */
+int RecordJournal::recover(QVector<interval_record> *unstored)
+{
+    if (!file.open(QIODevice::ReadWrite)) {
+        printf("Couldn't open journal %s.\n", file.fileName().toLatin1().constData());
+        return -1;
+    }
+    QByteArray data = file.readAll();
+    const char *p = data.constData();
+    int size = data.size();
+
+    lastTimestamps.clear();
+    lastEntries.clear();
+    unstoredAt.clear();
+
+    int count = 0;
+    int pos = 0;
+    while (size - pos >= JOURNAL_ENTRY_HEADER_SIZE) {
+        uint32_t lenWord = static_cast<uint32_t>(getLE(p + pos, 4));
+        bool stored = (lenWord & JOURNAL_ENTRY_STORED) != 0;
+        int len = static_cast<int>(lenWord & ~JOURNAL_ENTRY_STORED);
+        if (len <= 0 || len > JOURNAL_MAX_ENTRY ||
+                len > size - pos - JOURNAL_ENTRY_HEADER_SIZE) {
+            break;
+        }
+        uint32_t crc = static_cast<uint32_t>(getLE(p + pos + 4, 4));
+        if (computeCrc32(crc32Table, p + pos + 8,
+                         JOURNAL_ENTRY_HEADER_SIZE - 8 + len) != crc) {
+            break;
+        }
+
+        uint16_t sensorId = static_cast<uint16_t>(getLE(p + pos + 8, 2));
+        uint8_t requestType = static_cast<uint8_t>(p[pos + 10]);
+        uint8_t laneApprNum = static_cast<uint8_t>(p[pos + 11]);
+        qint64 ts = static_cast<qint64>(getLE(p + pos + 12, 8));
+
+        quint32 key = interval_key(sensorId, requestType, laneApprNum);
+        if (!stored) {
+            unstoredAt[key][ts] = pos;
+            interval_record r;
+            if (unstored != nullptr &&
+                    decode_interval_segment(p + pos + JOURNAL_ENTRY_HEADER_SIZE, len, &r, 1) == 1) {
+                unstored->append(r);
+            }
+        }
+
+        if (!lastTimestamps.contains(key) || ts > lastTimestamps.value(key)) {
+            lastTimestamps[key] = ts;
+            lastEntries[key] = QByteArray(p + pos, JOURNAL_ENTRY_HEADER_SIZE + len);
+        }
+        pos += JOURNAL_ENTRY_HEADER_SIZE + len;
+        count++;
+    }
+
+    if (pos < size) {
+        printf("Journal: dropping %d torn bytes after %d intervals\n",
+               size - pos, count);
+        file.resize(pos);
+        syncToDisk();
+    }
+    file.seek(pos);
+    recoveredTimestamps = lastTimestamps;
+    printf("Journal: recovered %d intervals for %d lanes/approaches\n",
+           count, lastTimestamps.size());
+    return count;
+}
+
+/**
+ * @brief RecordJournal::append: Writes one interval and hands it to the OS;
+ * it reaches the disk with the next sync()
+ * @param r
+ * @return false if the entry couldn't be written
+ */
+bool RecordJournal::append(const interval_record &r)
+{
+    if (!file.isOpen() && recover() < 0) {
+        return false;
+    }
+
+    QByteArray segment = encode_interval_segment(&r, 1);
+    QByteArray entry(JOURNAL_ENTRY_HEADER_SIZE + segment.size(), 0);
+    char *p = entry.data();
+    putLE(p, static_cast<uint32_t>(segment.size()), 4);
+    putLE(p + 8, r.sensor_id, 2);
+    p[10] = static_cast<char>(r.request_type);
+    p[11] = static_cast<char>(r.lane_appr_num);
+    putLE(p + 12, static_cast<uint64_t>(r.timestamp), 8);
+    memcpy(p + JOURNAL_ENTRY_HEADER_SIZE, segment.constData(), segment.size());
+    putLE(p + 4, computeCrc32(crc32Table, p + 8,
+                              JOURNAL_ENTRY_HEADER_SIZE - 8 + segment.size()), 4);
+
+    qint64 at = file.pos();
+    if (file.write(entry) != entry.size() || !file.flush()) {
+        printf("Journal write failed.\n");
+        return false;
+    }
+    unsynced = true;
+
+    quint32 key = interval_key(r.sensor_id, r.request_type, r.lane_appr_num);
+    unstoredAt[key][r.timestamp] = at;
+    if (!lastTimestamps.contains(key) || r.timestamp > lastTimestamps.value(key)) {
+        lastTimestamps[key] = r.timestamp;
+        lastEntries[key] = entry;
+    }
+    return true;
+}
+
+/**
+ * @brief RecordJournal::sync: Waits until every entry written so far is on disk
+ * @return false if the sync failed
+ */
+bool RecordJournal::sync()
+{
+    if (!unsynced || !file.isOpen()) {
+        return true;
+    }
+    if (!syncToDisk()) {
+        printf("Journal sync failed.\n");
+        return false;
+    }
+    unsynced = false;
+    return true;
+}
+
+/**
+ * @brief RecordJournal::markStored: Sets the stored bit on the entries of
+ * intervals the segment store has just put on disk, so a later recover()
+ * doesn't hand them out again
+ * @param recs
+ * @param n
+ */
+void RecordJournal::markStored(const interval_record *recs, int n)
+{
+    if (!file.isOpen()) {
+        return;
+    }
+    qint64 end = file.pos();
+    bool marked = false;
+    for (int i=0; i<n; i++) {
+        quint32 key = interval_key(recs[i].sensor_id, recs[i].request_type,
+                                   recs[i].lane_appr_num);
+        QHash<quint32, QHash<qint64, qint64> >::iterator lane = unstoredAt.find(key);
+        if (lane == unstoredAt.end() || !lane.value().contains(recs[i].timestamp)) {
+            continue;
+        }
+        qint64 at = lane.value().take(recs[i].timestamp);
+        if (lane.value().isEmpty()) {
+            unstoredAt.erase(lane);
+        }
+
+        char word[4];
+        if (!file.seek(at) || file.read(word, 4) != 4) {
+            continue;
+        }
+        uint32_t lenWord = static_cast<uint32_t>(getLE(word, 4));
+        putLE(word, lenWord | JOURNAL_ENTRY_STORED, 4);
+        if (file.seek(at) && file.write(word, 4) == 4) {
+            marked = true;
+        }
+    }
+    file.seek(end);
+    if (marked) {
+        unsynced = true;
+        sync();
+    }
+}
+
+/**
+ * @brief RecordJournal::checkpoint: Once everything in the journal is safely in
+ * the segment store (flushed to disk), shrinks it to the newest entry of each
+ * lane/approach, marked as stored so recover() doesn't hand it out again
+ */
+void RecordJournal::checkpoint()
+{
+    if (lastEntries.isEmpty()) {
+        return;
+    }
+    QSaveFile out(file.fileName());
+    if (!out.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    QHash<quint32, QByteArray>::const_iterator it;
+    for (it = lastEntries.constBegin(); it != lastEntries.constEnd(); ++it) {
+        QByteArray entry = it.value();
+        uint32_t lenWord = static_cast<uint32_t>(getLE(entry.constData(), 4));
+        putLE(entry.data(), lenWord | JOURNAL_ENTRY_STORED, 4);
+        out.write(entry);
+    }
+    file.close();
+    bool committed = out.commit();
+    if (!committed) {
+        printf("Journal checkpoint failed.\n");
+    }
+    // not Append: markStored writes in place
+    if (file.open(QIODevice::ReadWrite)) {
+        file.seek(file.size());
+    }
+    if (committed) {
+        // the entries left are all marked as stored
+        unstoredAt.clear();
+    }
+    unsynced = !committed;
+}
+
+// newest timestamp of a lane/approach, or the oldest of the matching ones
+// for laneApprNum 0xFF (all) and request type 3 (lanes and approaches)
+static qint64 newestFor(const QHash<quint32, qint64> &timestamps, uint16_t sensorId,
+                        uint8_t requestType, uint8_t laneApprNum)
+{
+    if (laneApprNum != 0xFF && requestType != 3) {
+        return timestamps.value(interval_key(sensorId, requestType, laneApprNum), -1);
+    }
+
+    qint64 oldest = -1;
+    QHash<quint32, qint64>::const_iterator it;
+    for (it = timestamps.constBegin(); it != timestamps.constEnd(); ++it) {
+        uint16_t s = static_cast<uint16_t>(it.key() >> 16);
+        uint8_t t = static_cast<uint8_t>((it.key() >> 8) & 0xFF);
+        if (s != sensorId || (requestType != 3 && t != requestType)) {
+            continue;
+        }
+        if (oldest < 0 || it.value() < oldest) {
+            oldest = it.value();
+        }
+    }
+    return oldest;
+}
+
+/**
+ * @brief RecordJournal::lastDurable: Newest timestamp journaled for a lane or
+ * approach. With laneApprNum 0xFF (all) or request type 3 (lanes and
+ * approaches) it is the oldest of the matching ones, so nothing is skipped.
+ * @return UTC seconds, or -1 if nothing has been journaled for it
+ */
+qint64 RecordJournal::lastDurable(uint16_t sensorId, uint8_t requestType,
+                                  uint8_t laneApprNum) const
+{
+    return newestFor(lastTimestamps, sensorId, requestType, laneApprNum);
+}
+
+/**
+ * @brief RecordJournal::lastRecovered: lastDurable as of the last recover(),
+ * i.e. what an earlier run already journaled
+ * @return UTC seconds, or -1 if nothing was recovered for it
+ */
+qint64 RecordJournal::lastRecovered(uint16_t sensorId, uint8_t requestType,
+                                    uint8_t laneApprNum) const
+{
+    return newestFor(recoveredTimestamps, sensorId, requestType, laneApprNum);
+}
+
+bool RecordJournal::syncToDisk()
+{
+    return flushToDisk(&file);
+}
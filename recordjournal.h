@@ -0,0 +1,52 @@
+#ifndef RECORDJOURNAL_H
+#define RECORDJOURNAL_H
+
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include "sensor_utils.h"
+
+#define JOURNAL_ENTRY_HEADER_SIZE 20
+// longest an appended entry waits for its fsync
+#define JOURNAL_SYNC_MS 1000
+
+// Write-ahead journal of decoded intervals. Every entry is
+//   [u32 length][u32 crc32][u16 sensor][u8 type][u8 lane][i64 timestamp][segment]
+// where segment is a one-record interval segment of `length` bytes and the CRC
+// covers everything after it. Entries are handed to the OS as they are
+// written, so a crash of the program loses none, and synced to disk by sync()
+// in batches (the pipeline calls it within JOURNAL_SYNC_MS). Once the segment
+// store has an interval on disk its entry is marked as stored in place; a
+// checkpoint keeps only the newest entry per lane/approach, also marked. The
+// entries not marked are handed back by recover() to be stored again.
+class RecordJournal
+{
+public:
+    explicit RecordJournal(const QString &fileName);
+    ~RecordJournal();
+    int recover(QVector<interval_record> *unstored = nullptr);
+    bool append(const interval_record &r);
+    bool sync();
+    void markStored(const interval_record *recs, int n);
+    void checkpoint();
+    qint64 lastDurable(uint16_t sensorId, uint8_t requestType,
+                       uint8_t laneApprNum) const;
+    qint64 lastRecovered(uint16_t sensorId, uint8_t requestType,
+                         uint8_t laneApprNum) const;
+
+private:
+    bool syncToDisk();
+
+    QFile file;
+    uint32_t crc32Table[CRC32_TABLE_LENGTH];
+    QHash<quint32, qint64> lastTimestamps;
+    QHash<quint32, qint64> recoveredTimestamps;
+    QHash<quint32, QByteArray> lastEntries;
+    // file offset of every entry not marked as stored yet, per lane/approach and timestamp
+    QHash<quint32, QHash<qint64, qint64> > unstoredAt;
+    bool unsynced;
+};
+
+#endif // RECORDJOURNAL_H
@@ -0,0 +1,158 @@
+#include "recordtablemodel.h"
+#include "commands.h"
+
+#include <QColor>
+#include <QDateTime>
+
+static const char *HEADERS[RECORD_NUM_COLS] = { "Datetime", "Lane/Appr", "Duration",
+                                                "Avg Speed", "Volume", "Occupancy",
+                                                "85th Pctle Speed", "Headway (ms)",
+                                                "Gap (ms)", "Quality" };
+
+RecordTableModel::RecordTableModel(int capacity, QObject *parent)
+    : QAbstractTableModel(parent)
+{
+    ring.resize(capacity > RECORD_TABLE_TRIM ? capacity : RECORD_TABLE_TRIM + 1);
+    first = 0;
+    count = 0;
+}
+
+int RecordTableModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : count;
+}
+
+int RecordTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : RECORD_NUM_COLS;
+}
+
+const interval_record &RecordTableModel::record(int row) const
+{
+    return ring.at((first + row) % ring.size());
+}
+
+/**
+ * @brief RecordTableModel::append: Adds an interval as the last row. When the
+ * ring is full the oldest RECORD_TABLE_TRIM rows are dropped first.
+ * @param r
+ */
+void RecordTableModel::append(const interval_record &r)
+{
+    if (count == ring.size()) {
+        beginRemoveRows(QModelIndex(), 0, RECORD_TABLE_TRIM - 1);
+        first = (first + RECORD_TABLE_TRIM) % ring.size();
+        count -= RECORD_TABLE_TRIM;
+        endRemoveRows();
+    }
+    beginInsertRows(QModelIndex(), count, count);
+    ring[(first + count) % ring.size()] = r;
+    count++;
+    endInsertRows();
+}
+
+/**
+ * @brief RecordTableModel::appendBatch: Adds intervals as the last rows with
+ * one removal (if the ring overflows) and one insertion, so the view relayouts
+ * once per batch rather than once per interval
+ * @param batch: oldest first; only the newest capacity() of them are kept
+ */
+void RecordTableModel::appendBatch(const QVector<interval_record> &batch)
+{
+    int start = batch.size() > ring.size() ? batch.size() - ring.size() : 0;
+    int n = batch.size() - start;
+    if (n <= 0) {
+        return;
+    }
+
+    int overflow = count + n - ring.size();
+    if (overflow > 0) {
+        // whole trims, as in append()
+        int drop = ((overflow + RECORD_TABLE_TRIM - 1) / RECORD_TABLE_TRIM) * RECORD_TABLE_TRIM;
+        if (drop > count) {
+            drop = count;
+        }
+        beginRemoveRows(QModelIndex(), 0, drop - 1);
+        first = (first + drop) % ring.size();
+        count -= drop;
+        endRemoveRows();
+    }
+
+    beginInsertRows(QModelIndex(), count, count + n - 1);
+    for (int i=0; i<n; i++) {
+        ring[(first + count + i) % ring.size()] = batch.at(start + i);
+    }
+    count += n;
+    endInsertRows();
+}
+
+void RecordTableModel::clear()
+{
+    beginResetModel();
+    first = 0;
+    count = 0;
+    endResetModel();
+}
+
+QVariant RecordTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= count) {
+        return QVariant();
+    }
+    const interval_record &r = record(index.row());
+
+    if (role == Qt::TextAlignmentRole) {
+        return index.column() == RECORD_COL_TIME ?
+                    static_cast<int>(Qt::AlignLeft | Qt::AlignVCenter) :
+                    static_cast<int>(Qt::AlignRight | Qt::AlignVCenter);
+    }
+    if (role == Qt::ForegroundRole) {
+        // intervals aggregates leave out are greyed
+        return (r.quality & QUALITY_EXCLUDE) ? QVariant(QColor(Qt::gray)) : QVariant();
+    }
+    if (role != Qt::DisplayRole) {
+        return QVariant();
+    }
+
+    switch (index.column()) {
+    case RECORD_COL_TIME:
+        return QDateTime::fromSecsSinceEpoch(r.timestamp, Qt::UTC)
+                .toString("MM/dd/yyyy hh:mm:ss");
+    case RECORD_COL_LANE:
+        return QString("%1 %2").arg(r.request_type == 2 ? "Appr" : "Lane")
+                .arg(r.lane_appr_num);
+    case RECORD_COL_DURATION:
+        return r.interval_duration;
+    case RECORD_COL_SPEED:
+        // no speed rather than the 3.125 marker
+        return (r.avg_speed & 0x800000) ?
+                    QVariant(QString::number(fixedPt24ToDouble(r.avg_speed), 'f', 2)) :
+                    QVariant();
+    case RECORD_COL_VOLUME:
+        return r.volume;
+    case RECORD_COL_OCCUPANCY:
+        return QString::number(r.avg_occupancy / 256.0, 'f', 2);
+    case RECORD_COL_SPEED_85:
+        return (r.speed_85 & 0x800000) ?
+                    QVariant(QString::number(fixedPt24ToDouble(r.speed_85), 'f', 2)) :
+                    QVariant();
+    case RECORD_COL_HEADWAY:
+        return r.headway;
+    case RECORD_COL_GAP:
+        return r.gap;
+    case RECORD_COL_QUALITY:
+        return r.quality ? QVariant(QString("%1").arg(r.quality, 2, 16, QChar('0')).toUpper()) :
+                           QVariant();
+    default:
+        return QVariant();
+    }
+}
+
+QVariant RecordTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole || orientation != Qt::Horizontal ||
+            section < 0 || section >= RECORD_NUM_COLS) {
+        return QVariant();
+    }
+    return QString(HEADERS[section]);
+}
@@ -0,0 +1,53 @@
+#ifndef RECORDTABLEMODEL_H
+#define RECORDTABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <QVector>
+
+#include "sensor_utils.h"
+
+#define RECORD_TABLE_CAPACITY 10000
+// rows dropped at once when the table is full, so the view is told about
+// removals once per this many appends instead of on every one
+#define RECORD_TABLE_TRIM (RECORD_TABLE_CAPACITY / 10)
+
+#define RECORD_COL_TIME         0
+#define RECORD_COL_LANE         1
+#define RECORD_COL_DURATION     2
+#define RECORD_COL_SPEED        3
+#define RECORD_COL_VOLUME       4
+#define RECORD_COL_OCCUPANCY    5
+#define RECORD_COL_SPEED_85     6
+#define RECORD_COL_HEADWAY      7
+#define RECORD_COL_GAP          8
+#define RECORD_COL_QUALITY      9
+#define RECORD_NUM_COLS         10
+
+// Live data table: the newest decoded intervals in a ring buffer of fixed
+// capacity, so memory stays flat and an append costs the same however long
+// retrieval runs. Cells are only formatted when the view asks for them,
+// i.e. for the rows on screen.
+class RecordTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    explicit RecordTableModel(int capacity = RECORD_TABLE_CAPACITY, QObject *parent = nullptr);
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+    const interval_record &record(int row) const;
+
+public slots:
+    void append(const interval_record &r);
+    void appendBatch(const QVector<interval_record> &batch);
+    void clear();
+
+private:
+    QVector<interval_record> ring;
+    int first;
+    int count;
+};
+
+#endif // RECORDTABLEMODEL_H
@@ -0,0 +1,264 @@
+#include "rollupengine.h"
+
+#include <string.h>
+
+const int RollupEngine::LEVELS[ROLLUP_NUM_LEVELS] = { 60, 300, 900, 3600 };
+
+RollupEngine::RollupEngine()
+{
+    late = 0;
+    amended = 0;
+}
+
+qint64 RollupEngine::lateCount() const
+{
+    return late;
+}
+
+qint64 RollupEngine::amendedCount() const
+{
+    return amended;
+}
+
+/**
+ * @brief RollupEngine::add: Folds one interval into every level's open bucket
+ * for its lane/approach
+ * @param r
+ * @param closed: buckets closed by this interval, or closed before and
+ * changed by it, are appended here, finest level first
+ * @return number of buckets appended
+ */
+int RollupEngine::add(const interval_record &r, QVector<interval_record> *closed)
+{
+    if (r.interval_duration == 0) {
+        return 0;
+    }
+    quint32 laneKey = interval_key(r.sensor_id, r.request_type, r.lane_appr_num);
+    int n = 0;
+    bool wasLate = false;
+
+    for (int l=0; l<ROLLUP_NUM_LEVELS; l++) {
+        int level = LEVELS[l];
+        if (level <= r.interval_duration || level % r.interval_duration != 0) {
+            continue;
+        }
+        qint64 start = r.timestamp - r.timestamp % level;
+        quint64 key = (static_cast<quint64>(laneKey) << 8) | l;
+        interval_sum &b = buckets[key];
+
+        if (b.acc.interval_duration == 0) {
+            interval_sum_open(&b, r, start, static_cast<uint16_t>(level));
+        } else if (start < b.acc.timestamp ||
+                   (start == b.acc.timestamp && b.covered >= level)) {
+            if (amend(key, &b, start, level, r, closed)) {
+                n++;
+            } else {
+                wasLate = true;
+            }
+            continue;
+        } else if (start > b.acc.timestamp) {
+            // a later bucket started before this one was covered
+            if (b.covered < level) {
+                closed->append(finish(b, level));
+                n++;
+            }
+            keep(key, b);
+            interval_sum_open(&b, r, start, static_cast<uint16_t>(level));
+        }
+
+        interval_sum_add(&b, r);
+        if (b.covered >= level) {
+            closed->append(finish(b, level));
+            n++;
+        }
+    }
+
+    if (wasLate) {
+        late++;
+    }
+    return n;
+}
+
+/**
+ * @brief RollupEngine::amend: Adds a late interval to the bucket it belongs
+ * to, if that is still kept, and hands the bucket back again
+ * @param key: lane/approach and level
+ * @param open: the level's open bucket
+ * @param start: start of r's bucket
+ * @return false if the bucket is older than every kept one
+ */
+bool RollupEngine::amend(quint64 key, interval_sum *open, qint64 start, int level,
+                         const interval_record &r, QVector<interval_record> *closed)
+{
+    interval_sum *b = open;
+    if (start != open->acc.timestamp) {
+        QMap<qint64, interval_sum> &k = kept[key];
+        QMap<qint64, interval_sum>::iterator it = k.find(start);
+        if (it == k.end()) {
+            // nothing came in for it before; start it if it's inside what's kept
+            if (k.size() >= ROLLUP_KEEP_CLOSED && start < k.firstKey()) {
+                return false;
+            }
+            it = k.insert(start, interval_sum());
+            interval_sum_open(&it.value(), r, start, static_cast<uint16_t>(level));
+            if (k.size() > ROLLUP_KEEP_CLOSED) {
+                k.erase(k.begin());
+            }
+        }
+        b = &it.value();
+    }
+    interval_sum_add(b, r);
+    closed->append(finish(*b, level));
+    amended++;
+    return true;
+}
+
+void RollupEngine::keep(quint64 key, const interval_sum &b)
+{
+    QMap<qint64, interval_sum> &k = kept[key];
+    k.insert(b.acc.timestamp, b);
+    if (k.size() > ROLLUP_KEEP_CLOSED) {
+        k.erase(k.begin());
+    }
+}
+
+// a bucket its intervals don't cover yet went out early
+interval_record RollupEngine::finish(const interval_sum &b, int level)
+{
+    interval_record r = interval_sum_finish(b);
+    if (b.covered < level) {
+        r.quality |= QUALITY_PARTIAL;
+    }
+    return r;
+}
+
+/**
+ * @brief interval_sum_open: Starts an empty combined interval for r's lane/approach
+ * @param b
+ * @param r
+ * @param timestamp: start of the combined interval
+ * @param duration: its length, seconds
+ */
+void interval_sum_open(interval_sum *b, const interval_record &r, qint64 timestamp,
+                       uint16_t duration)
+{
+    memset(&b->acc, 0, sizeof(b->acc));
+    b->acc.sensor_id = r.sensor_id;
+    b->acc.request_type = r.request_type;
+    b->acc.lane_appr_num = r.lane_appr_num;
+    b->acc.timestamp = timestamp;
+    b->acc.interval_duration = duration;
+    b->covered = 0;
+    b->measured = 0;
+    b->speedSum = 0;
+    b->speedVolume = 0;
+    b->speed85Sum = 0;
+    b->speed85Volume = 0;
+    b->occupancySum = 0;
+    b->headwaySum = 0;
+    b->gapSum = 0;
+}
+
+void interval_sum_add(interval_sum *b, const interval_record &r)
+{
+    interval_record &acc = b->acc;
+    acc.num_lanes = r.num_lanes;
+    acc.num_apprs = r.num_apprs;
+    b->covered += r.interval_duration;
+    if (r.quality & QUALITY_EXCLUDE) {
+        acc.quality |= QUALITY_PARTIAL;
+        return;
+    }
+    acc.volume += r.volume;
+
+    // bit 23 flags a valid speed; the rest is speed * 256
+    if (r.avg_speed & 0x800000) {
+        b->speedSum += static_cast<quint64>(r.avg_speed & 0x7FFFFF) * r.volume;
+        b->speedVolume += r.volume;
+    }
+    if (r.speed_85 & 0x800000) {
+        b->speed85Sum += static_cast<quint64>(r.speed_85 & 0x7FFFFF) * r.volume;
+        b->speed85Volume += r.volume;
+    }
+    b->occupancySum += static_cast<quint64>(r.avg_occupancy) * r.interval_duration;
+    b->headwaySum += static_cast<quint64>(r.headway) * r.volume;
+    b->gapSum += static_cast<quint64>(r.gap) * r.volume;
+    b->measured += r.interval_duration;
+
+    if (r.num_class_bins > acc.num_class_bins) {
+        acc.num_class_bins = r.num_class_bins;
+    }
+    if (r.num_speed_bins > acc.num_speed_bins) {
+        acc.num_speed_bins = r.num_speed_bins;
+    }
+    if (r.num_dir_bins > acc.num_dir_bins) {
+        acc.num_dir_bins = r.num_dir_bins;
+    }
+    for (int i=0; i<r.num_class_bins && i<MAX_CLASS_BINS; i++) {
+        acc.class_bins[i] += r.class_bins[i];
+    }
+    for (int i=0; i<r.num_speed_bins && i<MAX_SPEED_BINS; i++) {
+        acc.speed_bins[i] += r.speed_bins[i];
+    }
+    for (int i=0; i<r.num_dir_bins && i<MAX_DIR_BINS; i++) {
+        acc.dir_bins[i] += r.dir_bins[i];
+    }
+}
+
+/**
+ * @brief interval_sum_merge: Adds another partial sum over the same
+ * lane/approach and period, e.g. one built on another thread
+ * @param b
+ * @param o
+ */
+void interval_sum_merge(interval_sum *b, const interval_sum &o)
+{
+    interval_record &acc = b->acc;
+    acc.volume += o.acc.volume;
+    acc.quality |= o.acc.quality;
+    b->covered += o.covered;
+    b->measured += o.measured;
+    b->speedSum += o.speedSum;
+    b->speedVolume += o.speedVolume;
+    b->speed85Sum += o.speed85Sum;
+    b->speed85Volume += o.speed85Volume;
+    b->occupancySum += o.occupancySum;
+    b->headwaySum += o.headwaySum;
+    b->gapSum += o.gapSum;
+
+    if (o.acc.num_class_bins > acc.num_class_bins) {
+        acc.num_class_bins = o.acc.num_class_bins;
+    }
+    if (o.acc.num_speed_bins > acc.num_speed_bins) {
+        acc.num_speed_bins = o.acc.num_speed_bins;
+    }
+    if (o.acc.num_dir_bins > acc.num_dir_bins) {
+        acc.num_dir_bins = o.acc.num_dir_bins;
+    }
+    for (int i=0; i<MAX_CLASS_BINS; i++) {
+        acc.class_bins[i] += o.acc.class_bins[i];
+    }
+    for (int i=0; i<MAX_SPEED_BINS; i++) {
+        acc.speed_bins[i] += o.acc.speed_bins[i];
+    }
+    for (int i=0; i<MAX_DIR_BINS; i++) {
+        acc.dir_bins[i] += o.acc.dir_bins[i];
+    }
+}
+
+interval_record interval_sum_finish(const interval_sum &b)
+{
+    interval_record r = b.acc;
+    r.avg_speed = b.speedVolume > 0 ?
+                static_cast<uint32_t>(b.speedSum / b.speedVolume) | 0x800000 : 0;
+    r.speed_85 = b.speed85Volume > 0 ?
+                static_cast<uint32_t>(b.speed85Sum / b.speed85Volume) | 0x800000 : 0;
+    r.avg_occupancy = b.measured > 0 ?
+                static_cast<uint16_t>(b.occupancySum / b.measured) : 0;
+    r.headway = r.volume > 0 ? static_cast<uint32_t>(b.headwaySum / r.volume) : 0;
+    r.gap = r.volume > 0 ? static_cast<uint32_t>(b.gapSum / r.volume) : 0;
+    if (b.speedVolume == 0 || b.speed85Volume == 0) {
+        r.quality |= QUALITY_NO_SPEED;
+    }
+    return r;
+}
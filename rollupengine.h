@@ -0,0 +1,73 @@
+#ifndef ROLLUPENGINE_H
+#define ROLLUPENGINE_H
+
+#include <QHash>
+#include <QMap>
+#include <QVector>
+
+#include "sensor_utils.h"
+
+#define ROLLUP_NUM_LEVELS 4
+// closed buckets kept per lane/approach and level for late intervals
+#define ROLLUP_KEEP_CLOSED 96
+
+// Running sums behind an interval made by combining others, whether over
+// time (rollups) or over lanes (approach totals):
+//  - volume and bins: summed
+//  - average speed, 85th percentile speed, headway, gap: volume-weighted
+//    (speeds only over intervals that had a valid speed)
+//  - occupancy: weighted by interval duration, i.e. the mean over lanes
+// Inputs flagged with any of QUALITY_EXCLUDE only count towards coverage;
+// the result is then flagged QUALITY_PARTIAL.
+struct interval_sum {
+    interval_record acc;
+    qint64 covered;         // seconds of input, summed over every input
+    qint64 measured;        // the same, over the inputs that were used
+    quint64 speedSum;
+    quint64 speedVolume;
+    quint64 speed85Sum;
+    quint64 speed85Volume;
+    quint64 occupancySum;
+    quint64 headwaySum;
+    quint64 gapSum;
+};
+
+void interval_sum_open(interval_sum *s, const interval_record &r, qint64 timestamp,
+                       uint16_t duration);
+void interval_sum_add(interval_sum *s, const interval_record &r);
+void interval_sum_merge(interval_sum *s, const interval_sum &o);
+interval_record interval_sum_finish(const interval_sum &s);
+
+// Rolls decoded intervals up into 1, 5, 15 and 60 minute buckets per lane and
+// per approach as they arrive. Each lane/approach keeps one open bucket per
+// level plus the last ROLLUP_KEEP_CLOSED closed ones, so memory only grows
+// with the number of lanes. A bucket is closed (and handed back to the
+// caller) once its intervals cover it, or when an interval for a later bucket
+// shows up, in which case it is flagged QUALITY_PARTIAL. Levels no longer
+// than the sensor's own data interval are skipped. An interval older than
+// the open bucket (e.g. a refetched gap) is added to the closed bucket it
+// belongs to, which is handed back again to replace the earlier copy; only
+// intervals older than every kept bucket are counted as late and left out.
+class RollupEngine
+{
+public:
+    RollupEngine();
+    int add(const interval_record &r, QVector<interval_record> *closed);
+    qint64 lateCount() const;
+    qint64 amendedCount() const;
+
+    static const int LEVELS[ROLLUP_NUM_LEVELS];
+
+private:
+    bool amend(quint64 key, interval_sum *open, qint64 start, int level,
+               const interval_record &r, QVector<interval_record> *closed);
+    void keep(quint64 key, const interval_sum &b);
+    static interval_record finish(const interval_sum &b, int level);
+
+    QHash<quint64, interval_sum> buckets;
+    QHash<quint64, QMap<qint64, interval_sum> > kept;
+    qint64 late;
+    qint64 amended;
+};
+
+#endif // ROLLUPENGINE_H
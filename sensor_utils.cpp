@@ -1,5 +1,11 @@
 #include "sensor_utils.h"
 
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
 using namespace std;
 
 void SmCommsGenerateCrc8Table(uint8_t *table, int table_size)
@@ -40,3 +46,72 @@ unsigned char SmCommsComputeCrc8(uint8_t *Crc8Table, QByteArray *bufferPtr,
     }
     return (crcValue & 0x00FF);
 }
+
+/**
+ * @brief interval_key: Key for per sensor lane/approach maps
+ * @return sensor ID << 16 | request type << 8 | lane/approach number
+ */
+uint32_t interval_key(uint16_t sensorId, uint8_t requestType, uint8_t laneApprNum)
+{
+    return (static_cast<uint32_t>(sensorId) << 16) |
+           (static_cast<uint32_t>(requestType) << 8) |
+           laneApprNum;
+}
+
+// standard reflected CRC-32 (polynomial 0xEDB88320), used for on-disk records
+void generateCrc32Table(uint32_t *table)
+{
+    uint32_t crcValue;
+    unsigned int i, j;
+
+    for (i=0; i<CRC32_TABLE_LENGTH; i++)
+    {
+        crcValue = i;
+        for (j=0; j<8; j++)
+        {
+            if (crcValue & 1) {
+                crcValue = (crcValue >> 1) ^ 0xEDB88320;
+            } else {
+                crcValue = crcValue >> 1;
+            }
+        }
+        table[i] = crcValue;
+    }
+}
+
+/**
+ * @brief computeCrc32: CRC-32 of a buffer
+ * @param table: filled by generateCrc32Table
+ * @param data
+ * @param len
+ * @param crc: result of a previous call, to continue over several buffers
+ * @return
+ */
+uint32_t computeCrc32(const uint32_t *table, const char *data, int len,
+                      uint32_t crc)
+{
+    crc = ~crc;
+    for (int i=0; i<len; i++)
+    {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/**
+ * @brief flushToDisk: Writes out Qt's buffer and waits until the OS has the
+ * file's data on disk
+ * @param f: open file
+ * @return false if either step failed
+ */
+bool flushToDisk(QFile *f)
+{
+    if (!f->flush()) {
+        return false;
+    }
+#ifdef Q_OS_WIN
+    return _commit(f->handle()) == 0;
+#else
+    return fsync(f->handle()) == 0;
+#endif
+}
@@ -2,12 +2,31 @@
 #define SENSOR_UTILS_H
 
 #define COMMS_CRC8_TABLE_LENGTH 256
+#define CRC32_TABLE_LENGTH 256
 #define OCTET_MASK 0x000000ff
 
+// most bins the sensor will report per interval, by bin type
+#define MAX_CLASS_BINS 8
+#define MAX_SPEED_BINS 15
+#define MAX_DIR_BINS 2
+
+// interval_record::quality flags, set by QualityMonitor as intervals arrive
+#define QUALITY_NO_SPEED        0x01    // speed valid bit clear: the speed is the 3.125 marker
+#define QUALITY_ZERO_STREAK     0x02    // within a run of zero-volume intervals of an hour or more
+#define QUALITY_STUCK           0x04    // same nonzero volume, speed and occupancy repeated
+#define QUALITY_INCONSISTENT    0x08    // volume contradicts occupancy/speed
+#define QUALITY_IMPLAUSIBLE     0x10    // occupancy, speed or flow out of range
+#define QUALITY_CLOCK_JUMP      0x20    // timestamp off the interval grid or ahead of the host clock
+#define QUALITY_PARTIAL         0x40    // aggregate that left some of its inputs out
+// intervals aggregates leave out
+#define QUALITY_EXCLUDE (QUALITY_STUCK | QUALITY_INCONSISTENT | QUALITY_IMPLAUSIBLE | \
+                         QUALITY_CLOCK_JUMP)
+
 #include <stdint.h>
 #include <stdlib.h>
 #include <QByteArray>
 #include <QDateTime>
+#include <QFile>
 #include <QString>
 
 using namespace std;
@@ -89,20 +108,42 @@ struct lane {
     }
 };
 
-struct realTimeDataNibble {
-    QDateTime dateTime;
-    uint16_t intervalDuration;
-    uint32_t avgSpeed;
+// one decoded interval from an interval data (0x74) response. Speeds and
+// occupancy are kept in the sensor's fixed-point format (appendix A.2) so
+// that nothing is lost before the data is stored.
+struct interval_record {
+    uint16_t sensor_id;
+    uint8_t request_type;       // 1 = lane, 2 = approach
+    uint8_t lane_appr_num;
+    qint64 timestamp;           // seconds since epoch, UTC
+    uint16_t ms;
+    uint16_t interval_duration;
+    uint8_t num_lanes;
+    uint8_t num_apprs;
+    uint32_t avg_speed;         // 24-bit fixed pt, bit 23 = speed valid
     uint32_t volume;
-    uint16_t avgOccupancy;
-    uint32_t eightyFifthPctlSpeed;
+    uint16_t avg_occupancy;     // 16-bit fixed pt
+    uint32_t speed_85;          // 24-bit fixed pt, bit 23 = speed valid
     uint32_t headway;
     uint32_t gap;
+    uint16_t quality;           // QUALITY_* flags, 0 = clean
+
+    uint8_t num_class_bins;
+    uint8_t num_speed_bins;
+    uint8_t num_dir_bins;
+    uint32_t class_bins[MAX_CLASS_BINS];
+    uint32_t speed_bins[MAX_SPEED_BINS];
+    uint32_t dir_bins[MAX_DIR_BINS];
 };
 
 void SmCommsGenerateCrc8Table(uint8_t *crc_table, int length);
 unsigned char SmCommsComputeCrc8(uint8_t *crc_table,
                                  QByteArray *bufferPtr,
                                  unsigned int bufferLength);
+uint32_t interval_key(uint16_t sensorId, uint8_t requestType, uint8_t laneApprNum);
+void generateCrc32Table(uint32_t *table);
+uint32_t computeCrc32(const uint32_t *table, const char *data, int len,
+                      uint32_t crc = 0);
+bool flushToDisk(QFile *f);
 
 #endif // SENSOR_UTILS_H
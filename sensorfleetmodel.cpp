@@ -0,0 +1,314 @@
+#include "sensorfleetmodel.h"
+#include "commands.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <QApplication>
+#include <QColor>
+#include <QDateTime>
+#include <QHeaderView>
+#include <QTableView>
+
+// shown in the state column when polling but no interval is coming in
+#define FLEET_STATE_LATE (SENSOR_FAILING + 1)
+
+static const char *STATE_NAMES[FLEET_STATE_LATE + 1] = { "Offline", "Connected", "Polling",
+                                                         "Failing", "Late" };
+
+SensorFleetModel::SensorFleetModel(SensorStateStore *s, QObject *parent)
+    : QAbstractTableModel(parent)
+{
+    store = s;
+    lastNow = 0;
+    refreshNs = 0;
+    refreshes = 0;
+    cellUpdates = 0;
+    window.start();
+
+    refreshTimer = new QTimer(this);
+    refreshTimer->setInterval(FLEET_REFRESH_MS);
+    connect(refreshTimer, &QTimer::timeout, this, &SensorFleetModel::tick);
+    refreshTimer->start();
+}
+
+int SensorFleetModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : rows.size();
+}
+
+int SensorFleetModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : FLEET_NUM_COLS;
+}
+
+void SensorFleetModel::tick()
+{
+    refresh(QDateTime::currentSecsSinceEpoch());
+}
+
+/**
+ * @brief SensorFleetModel::shownState: The link state, or late if the sensor
+ * is being polled but its newest interval is FLEET_LATE_INTERVALS old
+ * @param s
+ * @param now: UTC seconds
+ * @return SENSOR_* or FLEET_STATE_LATE
+ */
+int SensorFleetModel::shownState(const sensor_state &s, qint64 now) const
+{
+    if (s.link == SENSOR_POLLING && s.last_interval >= 0 && s.interval_duration > 0 &&
+            now - (s.last_interval + s.interval_duration) >
+            FLEET_LATE_INTERVALS * s.interval_duration) {
+        return FLEET_STATE_LATE;
+    }
+    return s.link;
+}
+
+bool SensorFleetModel::differs(const sensor_state &a, const sensor_state &b, int column)
+{
+    switch (column) {
+    case FLEET_COL_SENSOR:
+        return a.sensor_id != b.sensor_id;
+    case FLEET_COL_STATE:
+        return a.link != b.link;
+    case FLEET_COL_LAST:
+        return a.last_interval != b.last_interval;
+    case FLEET_COL_ERRORS:
+        return a.poll_errors != b.poll_errors;
+    case FLEET_COL_FLAGGED:
+        return a.flagged != b.flagged;
+    default:
+        break;
+    }
+    int appr = (column - FLEET_COL_APPROACHES) / 2;
+    if ((column - FLEET_COL_APPROACHES) % 2 == 0) {
+        return a.volume[appr] != b.volume[appr] || (appr < a.num_apprs) != (appr < b.num_apprs);
+    }
+    return a.avg_speed[appr] != b.avg_speed[appr] || (appr < a.num_apprs) != (appr < b.num_apprs);
+}
+
+/**
+ * @brief SensorFleetModel::refresh: Applies the store's changes since the last
+ * refresh. New sensors are one row insertion; each changed row is one
+ * dataChanged spanning just its differing cells.
+ * @param now: UTC seconds, for lateness
+ */
+void SensorFleetModel::refresh(qint64 now)
+{
+    QElapsedTimer timer;
+    timer.start();
+    lastNow = now;
+
+    int total = store->takeChanges(&changedRows, &changedStates);
+    int oldSize = rows.size();
+    if (total > oldSize) {
+        beginInsertRows(QModelIndex(), oldSize, total - 1);
+        rows.resize(total);
+        shown.resize(total);
+        for (int i=0; i<changedRows.size(); i++) {
+            int row = changedRows.at(i);
+            if (row >= oldSize) {
+                rows[row] = changedStates.at(i);
+                shown[row] = shownState(rows.at(row), now);
+            }
+        }
+        endInsertRows();
+    }
+
+    for (int i=0; i<changedRows.size(); i++) {
+        int row = changedRows.at(i);
+        if (row >= oldSize) {
+            continue;
+        }
+        const sensor_state &s = changedStates.at(i);
+        int first = -1;
+        int last = -1;
+        for (int c=0; c<FLEET_NUM_COLS; c++) {
+            if (c != FLEET_COL_STATE && differs(rows.at(row), s, c)) {
+                if (first < 0) {
+                    first = c;
+                }
+                last = c;
+            }
+        }
+        rows[row] = s;
+        if (first >= 0) {
+            emit dataChanged(index(row, first), index(row, last));
+            cellUpdates += last - first + 1;
+        }
+    }
+
+    // the state column also follows the clock
+    for (int row=0; row<oldSize; row++) {
+        int state = shownState(rows.at(row), now);
+        if (state != shown.at(row)) {
+            shown[row] = state;
+            QModelIndex cell = index(row, FLEET_COL_STATE);
+            emit dataChanged(cell, cell);
+            cellUpdates++;
+        }
+    }
+
+    refreshNs += timer.nsecsElapsed();
+    refreshes++;
+    if (window.elapsed() >= FLEET_REPORT_MS) {
+        report();
+    }
+}
+
+void SensorFleetModel::report()
+{
+    qint64 ms = window.restart();
+    if (cellUpdates > 0) {
+        printf("Fleet: %d sensors, %lld refreshes, %lld cell updates, %.3f ms/s in the GUI thread\n",
+               rows.size(), refreshes, cellUpdates,
+               ms > 0 ? (refreshNs / 1e6) * 1000.0 / ms : 0.0);
+    }
+    refreshNs = 0;
+    refreshes = 0;
+    cellUpdates = 0;
+}
+
+QVariant SensorFleetModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= rows.size()) {
+        return QVariant();
+    }
+    const sensor_state &s = rows.at(index.row());
+    int column = index.column();
+
+    if (role == Qt::TextAlignmentRole) {
+        return column == FLEET_COL_STATE || column == FLEET_COL_LAST ?
+                    static_cast<int>(Qt::AlignLeft | Qt::AlignVCenter) :
+                    static_cast<int>(Qt::AlignRight | Qt::AlignVCenter);
+    }
+    if (role == Qt::ForegroundRole && column == FLEET_COL_STATE) {
+        int state = shown.at(index.row());
+        if (state == SENSOR_FAILING) {
+            return QColor(Qt::red);
+        } else if (state == FLEET_STATE_LATE) {
+            return QColor(Qt::darkYellow);
+        } else if (state == SENSOR_OFFLINE) {
+            return QColor(Qt::gray);
+        }
+        return QVariant();
+    }
+    if (role != Qt::DisplayRole) {
+        return QVariant();
+    }
+
+    switch (column) {
+    case FLEET_COL_SENSOR:
+        return QString("0x%1").arg(s.sensor_id, 4, 16, QChar('0'));
+    case FLEET_COL_STATE:
+        return QString(STATE_NAMES[shown.at(index.row())]);
+    case FLEET_COL_LAST:
+        return s.last_interval < 0 ? QVariant() :
+                                     QVariant(QDateTime::fromSecsSinceEpoch(s.last_interval, Qt::UTC)
+                                              .toString("MM/dd/yyyy hh:mm:ss"));
+    case FLEET_COL_ERRORS:
+        return s.poll_errors;
+    case FLEET_COL_FLAGGED:
+        return s.flagged;
+    default:
+        break;
+    }
+    int appr = (column - FLEET_COL_APPROACHES) / 2;
+    if (appr >= s.num_apprs || s.appr_interval[appr] < 0) {
+        return QVariant();
+    }
+    if ((column - FLEET_COL_APPROACHES) % 2 == 0) {
+        return s.volume[appr];
+    }
+    // no speed rather than the 3.125 marker
+    return (s.avg_speed[appr] & 0x800000) ?
+                QVariant(QString::number(fixedPt24ToDouble(s.avg_speed[appr]), 'f', 1)) :
+                QVariant();
+}
+
+QVariant SensorFleetModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole || orientation != Qt::Horizontal ||
+            section < 0 || section >= FLEET_NUM_COLS) {
+        return QVariant();
+    }
+    switch (section) {
+    case FLEET_COL_SENSOR: return QString("Sensor");
+    case FLEET_COL_STATE: return QString("State");
+    case FLEET_COL_LAST: return QString("Last Interval");
+    case FLEET_COL_ERRORS: return QString("Poll Errors");
+    case FLEET_COL_FLAGGED: return QString("Flagged");
+    default: break;
+    }
+    int appr = (section - FLEET_COL_APPROACHES) / 2;
+    return QString("Appr %1 %2").arg(appr)
+            .arg((section - FLEET_COL_APPROACHES) % 2 == 0 ? "Volume" : "Speed");
+}
+
+/**
+ * @brief SensorFleetModel::benchmark: A fleet of sensors with four approaches
+ * each, reporting every 20 s, replayed an hour at a time as fast as possible
+ * into a store, this model and a visible table. The time the refreshes and
+ * the repaints take per simulated second is the GUI thread's share of a core.
+ * @param sensors
+ */
+void SensorFleetModel::benchmark(int sensors)
+{
+    const int duration = 20;
+    const int seconds = 3600;
+    SensorStateStore store;
+    SensorFleetModel model(&store);
+    model.refreshTimer->stop();
+
+    QTableView view;
+    view.setModel(&model);
+    view.verticalHeader()->hide();
+    view.verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    view.verticalHeader()->setDefaultSectionSize(view.fontMetrics().height() + 4);
+    view.resize(1400, 900);
+    view.show();
+    QApplication::processEvents();
+
+    interval_record r;
+    memset(&r, 0, sizeof(r));
+    r.request_type = 2;
+    r.interval_duration = duration;
+    r.num_apprs = FLEET_MAX_APPROACHES;
+
+    qint64 start = QDateTime::currentSecsSinceEpoch() - seconds;
+    for (int i=0; i<sensors; i++) {
+        store.setLink(static_cast<uint16_t>(i + 1), SENSOR_POLLING);
+    }
+
+    // only the refreshes and repaints are timed; feeding the store is the
+    // pollers' cost, not the table's
+    QElapsedTimer timer;
+    qint64 ns = 0;
+    qint64 updates = 0;
+    for (int t=0; t<seconds; t++) {
+        qint64 now = start + t;
+        // sensors are spread over the interval, as the poll scheduler does
+        for (int i=t % duration; i<sensors; i+=duration) {
+            uint16_t id = static_cast<uint16_t>(i + 1);
+            store.pollOutcome(id, (i + t) % 997 == 0 ? POLL_FAILED : POLL_STORED);
+            r.sensor_id = id;
+            r.timestamp = now - duration;
+            for (int a=0; a<FLEET_MAX_APPROACHES; a++) {
+                r.lane_appr_num = static_cast<uint8_t>(a);
+                r.volume = static_cast<uint32_t>((i * 7 + a * 3 + t) % 23);
+                r.avg_speed = 0x800000 | static_cast<uint32_t>(((i + a + t) % 40 + 20) << 8);
+                store.interval(r);
+                updates++;
+            }
+        }
+        timer.start();
+        model.refresh(now);
+        QApplication::processEvents();
+        ns += timer.nsecsElapsed();
+    }
+
+    printf("Fleet bench: %d sensors, %d s intervals, %d simulated s, %lld approach updates\n",
+           sensors, duration, seconds, updates);
+    printf("  %.3f ms per simulated second = %.2f%% of one core (refresh + repaint)\n",
+           ns / 1e6 / seconds, ns / 1e7 / seconds);
+}
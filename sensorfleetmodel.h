@@ -0,0 +1,68 @@
+#ifndef SENSORFLEETMODEL_H
+#define SENSORFLEETMODEL_H
+
+#include <QAbstractTableModel>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QVector>
+
+#include "sensorstatestore.h"
+
+#define FLEET_REFRESH_MS        1000
+#define FLEET_REPORT_MS         60000
+// polling and no interval for this many interval lengths: shown as late
+#define FLEET_LATE_INTERVALS    3
+
+#define FLEET_COL_SENSOR        0
+#define FLEET_COL_STATE         1
+#define FLEET_COL_LAST          2
+#define FLEET_COL_ERRORS        3
+#define FLEET_COL_FLAGGED       4
+#define FLEET_COL_APPROACHES    5       // then volume, speed per approach
+#define FLEET_NUM_COLS          (FLEET_COL_APPROACHES + 2 * FLEET_MAX_APPROACHES)
+
+// Fleet dashboard: one row per sensor in the SensorStateStore. Every
+// FLEET_REFRESH_MS it takes the rows that changed since the last refresh,
+// compares them with its own copy and tells the view only about the cells
+// that actually differ, so the view repaints those and nothing else; rows
+// are only ever appended. Lateness depends on the clock rather than on
+// updates, so the state column of every row is rechecked on each refresh,
+// which is a comparison per row. Time spent refreshing is reported every
+// FLEET_REPORT_MS.
+class SensorFleetModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    explicit SensorFleetModel(SensorStateStore *s, QObject *parent = nullptr);
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+    void refresh(qint64 now);
+
+    static void benchmark(int sensors);
+
+private slots:
+    void tick();
+
+private:
+    static bool differs(const sensor_state &a, const sensor_state &b, int column);
+    int shownState(const sensor_state &s, qint64 now) const;
+    void report();
+
+    SensorStateStore *store;
+    QVector<sensor_state> rows;
+    QVector<int> shown;             // state column as shown, lateness included
+    QVector<int> changedRows;
+    QVector<sensor_state> changedStates;
+    qint64 lastNow;
+    QTimer *refreshTimer;
+
+    QElapsedTimer window;
+    qint64 refreshNs;
+    qint64 refreshes;
+    qint64 cellUpdates;
+};
+
+#endif // SENSORFLEETMODEL_H
@@ -0,0 +1,182 @@
+#include "sensorlink.h"
+
+// header (10), header CRC (1), body (payload size), body CRC (1)
+#define Z1_HEADER_SIZE 11
+
+SensorLink::SensorLink(QIODevice *d, QObject *parent) : QObject(parent)
+{
+    dev = d;
+    window = LINK_DEFAULT_WINDOW;
+    timeoutMs = LINK_DEFAULT_TIMEOUT_MS;
+    lastTag = 0;
+    seq = 0;
+    SmCommsGenerateCrc8Table(crc8Table, COMMS_CRC8_TABLE_LENGTH);
+
+    connect(dev, &QIODevice::readyRead, this, &SensorLink::readAvailable);
+    connect(&timeoutTimer, &QTimer::timeout, this, &SensorLink::checkTimeouts);
+    timeoutTimer.setInterval(100);
+}
+
+void SensorLink::setWindow(int n)
+{
+    window = n > 0 ? n : 1;
+}
+
+int SensorLink::windowSize() const
+{
+    return window;
+}
+
+void SensorLink::setTimeout(int ms)
+{
+    timeoutMs = ms;
+}
+
+int SensorLink::inFlight() const
+{
+    return active.size();
+}
+
+int SensorLink::queued() const
+{
+    return waiting.size();
+}
+
+QIODevice *SensorLink::device() const
+{
+    return dev;
+}
+
+/**
+ * @brief SensorLink::send: Queues a request frame built by one of the gen_*
+ * functions. Its sequence number and header CRC are rewritten when it goes out.
+ * @param frame
+ * @param expectedFrames: response frames that complete the request (one per
+ * lane/approach for interval requests on all lanes)
+ * @return tag passed back with responseReady/requestTimedOut
+ */
+int SensorLink::send(const QByteArray &frame, int expectedFrames)
+{
+    link_request r;
+    r.tag = ++lastTag;
+    r.seq = 0;
+    r.expectedFrames = expectedFrames > 0 ? expectedFrames : 1;
+    r.frame = frame;
+    waiting.append(r);
+    sendQueued();
+    return r.tag;
+}
+
+uint8_t SensorLink::nextSeq()
+{
+    // skip 0 and anything still waiting for an answer
+    bool used;
+    do {
+        seq++;
+        if (seq == 0) {
+            seq = 1;
+        }
+        used = false;
+        for (int i=0; i<active.size() && !used; i++) {
+            used = (active.at(i).seq == seq);
+        }
+    } while (used);
+    return seq;
+}
+
+void SensorLink::sendQueued()
+{
+    while (active.size() < window && !waiting.isEmpty()) {
+        link_request r = waiting.takeFirst();
+        r.seq = nextSeq();
+        if (r.frame.size() > Z1_HEADER_SIZE) {
+            char *p = r.frame.data();
+            p[8] = static_cast<char>(r.seq);
+            p[10] = static_cast<char>(SmCommsComputeCrc8(crc8Table, &r.frame, 10));
+        }
+        dev->write(r.frame);
+        r.sent.start();
+        active.append(r);
+    }
+    if (!active.isEmpty() && !timeoutTimer.isActive()) {
+        timeoutTimer.start();
+    }
+}
+
+void SensorLink::readAvailable()
+{
+    rxBuffer.append(dev->readAll());
+
+    while (rxBuffer.size() >= Z1_HEADER_SIZE) {
+        // resync on the "Z1" message version and a good header CRC
+        if (rxBuffer.at(0) != 'Z' || rxBuffer.at(1) != '1' ||
+                static_cast<uint8_t>(rxBuffer.at(10)) !=
+                SmCommsComputeCrc8(crc8Table, &rxBuffer, 10)) {
+            rxBuffer.remove(0, 1);
+            continue;
+        }
+        int len = (rxBuffer.at(9) & 0xFF) + Z1_HEADER_SIZE + 1;
+        if (rxBuffer.size() < len) {
+            return;
+        }
+        QByteArray frame = rxBuffer.left(len);
+        rxBuffer.remove(0, len);
+
+        // body CRC covers everything between the header CRC and itself
+        unsigned char crc = 0x00;
+        for (int i=Z1_HEADER_SIZE; i<len-1; i++) {
+            crc = crc8Table[crc ^ (frame.at(i) & 0xFF)];
+        }
+        if (crc != static_cast<uint8_t>(frame.at(len - 1))) {
+            printf("Link: dropped frame with bad body CRC\n");
+            continue;
+        }
+
+        uint8_t frameSeq = static_cast<uint8_t>(frame.at(8));
+        int i;
+        for (i=0; i<active.size() && active.at(i).seq != frameSeq; i++);
+        if (i == active.size()) {
+            // late answer to a request that already timed out
+            continue;
+        }
+
+        // result responses end the request, with or without an error
+        if (frame.size() >= 16 && frame.at(13) == 2) {
+            uint16_t errorCode = static_cast<uint16_t>(((frame.at(14) & 0xFF) << 8) |
+                                                       (frame.at(15) & 0xFF));
+            active[i].frames.append(frame);
+            finish(i, errorCode);
+            continue;
+        }
+        active[i].frames.append(frame);
+        if (active.at(i).frames.size() >= active.at(i).expectedFrames) {
+            finish(i, 0);
+        }
+    }
+}
+
+void SensorLink::finish(int index, uint16_t errorCode)
+{
+    link_request r = active.takeAt(index);
+    sendQueued();
+    emit responseReady(r.tag, r.frames, errorCode);
+    if (active.isEmpty() && waiting.isEmpty()) {
+        timeoutTimer.stop();
+        emit idle();
+    }
+}
+
+void SensorLink::checkTimeouts()
+{
+    for (int i=active.size()-1; i>=0; i--) {
+        if (active.at(i).sent.elapsed() > timeoutMs) {
+            int tag = active.takeAt(i).tag;
+            emit requestTimedOut(tag);
+        }
+    }
+    sendQueued();
+    if (active.isEmpty() && waiting.isEmpty()) {
+        timeoutTimer.stop();
+        emit idle();
+    }
+}
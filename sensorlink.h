@@ -0,0 +1,71 @@
+#ifndef SENSORLINK_H
+#define SENSORLINK_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QList>
+#include <QObject>
+#include <QTimer>
+
+#include "sensor_utils.h"
+
+#define LINK_DEFAULT_WINDOW 4
+#define LINK_DEFAULT_TIMEOUT_MS 3000
+
+// Non-blocking request/response channel to the sensors behind one serial
+// port or socket. Requests are queued and up to `window` of them are kept in
+// flight at once; each gets its own sequence number, and response frames are
+// matched back to their request by it. Unlike the workers, nothing here waits
+// on the device: everything is driven by readyRead and a timeout timer.
+class SensorLink : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SensorLink(QIODevice *dev, QObject *parent = nullptr);
+    void setWindow(int n);
+    int windowSize() const;
+    void setTimeout(int ms);
+    int send(const QByteArray &frame, int expectedFrames = 1);
+    int inFlight() const;
+    int queued() const;
+    QIODevice *device() const;
+
+signals:
+    // frames: every response frame in order; errorCode is set when the
+    // sensor answered with a result (error) response instead
+    void responseReady(int tag, QList<QByteArray> frames, uint16_t errorCode);
+    void requestTimedOut(int tag);
+    void idle();
+
+private slots:
+    void readAvailable();
+    void checkTimeouts();
+
+private:
+    struct link_request {
+        int tag;
+        uint8_t seq;
+        int expectedFrames;
+        QByteArray frame;
+        QList<QByteArray> frames;
+        QElapsedTimer sent;
+    };
+
+    void sendQueued();
+    void finish(int index, uint16_t errorCode);
+    uint8_t nextSeq();
+
+    QIODevice *dev;
+    QByteArray rxBuffer;
+    QList<link_request> waiting;
+    QList<link_request> active;
+    QTimer timeoutTimer;
+    uint8_t crc8Table[COMMS_CRC8_TABLE_LENGTH];
+    int window;
+    int timeoutMs;
+    int lastTag;
+    uint8_t seq;
+};
+
+#endif // SENSORLINK_H
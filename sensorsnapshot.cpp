@@ -0,0 +1,206 @@
+#include "sensorsnapshot.h"
+#include "clockmodel.h"
+#include "commands.h"
+
+#include <string.h>
+
+// the smallest answer worth decoding: header and message id
+#define SNAPSHOT_MIN_RESPONSE 12
+
+SensorSnapshot::snapshot_data::snapshot_data()
+{
+    sensorId = 0;
+    for (int i=0; i<CONFIG_NUM_ITEMS; i++) {
+        present[i] = false;
+    }
+    readMs = 0;
+    general.orientation = 0;
+    general.units = 0;
+    memset(&data, 0, sizeof(data));
+    globalPush = false;
+    sensorMs = -1;
+    timeSentMs = 0;
+    timeReceivedMs = 0;
+    numApproaches = 0;
+    for (int i=0; i<SNAPSHOT_MAX_APPROACHES; i++) {
+        approaches[i].direction = ' ';
+        approaches[i].numLanes = 0;
+        approaches[i].lanesAssigned = nullptr;
+    }
+}
+
+SensorSnapshot::snapshot_data::~snapshot_data()
+{
+    for (int i=0; i<SNAPSHOT_MAX_APPROACHES; i++) {
+        delete[] approaches[i].lanesAssigned;
+    }
+}
+
+SensorSnapshot::SensorSnapshot()
+{
+}
+
+/**
+ * @brief SensorSnapshot::decode: Decodes the configuration responses
+ * @param sensorId
+ * @param responses: CONFIG_NUM_ITEMS raw responses, indexed by CONFIG_*
+ * @param present: whether each response was received
+ * @param timeSentMs: host time the time read went out
+ * @param timeReceivedMs: host time its answer came back
+ * @param readMs: how long reading all of it took
+ * @return the snapshot
+ */
+SensorSnapshot SensorSnapshot::decode(uint16_t sensorId, const QByteArray *responses,
+                                      const bool *present, qint64 timeSentMs,
+                                      qint64 timeReceivedMs, qint64 readMs)
+{
+    snapshot_data *s = new snapshot_data;
+    s->sensorId = sensorId;
+    s->readMs = readMs;
+    s->timeSentMs = timeSentMs;
+    s->timeReceivedMs = timeReceivedMs;
+
+    for (int item=0; item<CONFIG_NUM_ITEMS; item++) {
+        QByteArray r = responses[item];
+        if (!present[item] || r.size() < SNAPSHOT_MIN_RESPONSE || r.at(0) == 'E') {
+            continue;
+        }
+        bool ok = true;
+        switch (item) {
+        case CONFIG_GENERAL:
+            parse_gen_conf_read_response(r, &s->general, QString());
+            break;
+        case CONFIG_DATA:
+            parse_data_conf_read_response(&r, &s->data, QString());
+            break;
+        case CONFIG_PUSH_MODE:
+            s->globalPush = parse_global_push_mode_read_resp(&r, QString()) != 0;
+            break;
+        case CONFIG_TIME: {
+            sensor_datetime t;
+            t.yr = 0;
+            parse_sensor_time_read_resp(&r, QString(), &t);
+            s->sensorMs = sensor_time_msecs(t);
+            ok = s->sensorMs >= 0;
+            break;
+        }
+        case CONFIG_APPROACHES: {
+            // the parser writes one entry per configured approach; none
+            // configured is a valid answer, a result (error) response isn't
+            int n = -1;
+            if (r.size() > 14 && r.at(13) != 2 &&
+                    static_cast<uint8_t>(r.at(14)) <= SNAPSHOT_MAX_APPROACHES) {
+                n = parse_approach_info_read_resp(&r, s->approaches, QString());
+            }
+            ok = n >= 0;
+            s->numApproaches = ok ? n : 0;
+            break;
+        }
+        case CONFIG_LANES: {
+            QVector<lane> lanes;
+            int numLanes = 0;
+            parse_active_lane_info_read_resp(&r, &lanes, &numLanes, QString());
+            for (int i=0; i<lanes.size(); i++) {
+                snapshot_lane l;
+                // the name is NUL padded to 8 bytes
+                const char *d = lanes.at(i).description;
+                l.description = QString::fromLocal8Bit(d, static_cast<int>(strnlen(d, 8)));
+                l.direction = lanes.at(i).direction;
+                s->lanes.append(l);
+                delete[] lanes.at(i).description;
+            }
+            break;
+        }
+        case CONFIG_CLASSES: {
+            int numClasses = 0;
+            parse_classif_read_resp(&r, &s->classBounds, &numClasses, QString());
+            break;
+        }
+        case CONFIG_SPEED_BINS: {
+            int numBins = 0;
+            parse_speed_bin_conf_read(&r, &numBins, &s->speedBins, QString());
+            break;
+        }
+        }
+        s->present[item] = ok;
+    }
+
+    SensorSnapshot snap;
+    snap.d = QSharedPointer<const snapshot_data>(s);
+    return snap;
+}
+
+bool SensorSnapshot::isEmpty() const
+{
+    return d.isNull();
+}
+
+bool SensorSnapshot::has(int item) const
+{
+    return !d.isNull() && item >= 0 && item < CONFIG_NUM_ITEMS && d->present[item];
+}
+
+uint16_t SensorSnapshot::sensorId() const
+{
+    return d.isNull() ? 0 : d->sensorId;
+}
+
+qint64 SensorSnapshot::readMs() const
+{
+    return d.isNull() ? 0 : d->readMs;
+}
+
+const sensor_config &SensorSnapshot::general() const
+{
+    return d->general;
+}
+
+const sensor_data_config &SensorSnapshot::dataConfig() const
+{
+    return d->data;
+}
+
+bool SensorSnapshot::globalPush() const
+{
+    return !d.isNull() && d->globalPush;
+}
+
+qint64 SensorSnapshot::sensorTimeMs() const
+{
+    return d.isNull() ? -1 : d->sensorMs;
+}
+
+qint64 SensorSnapshot::timeSentMs() const
+{
+    return d.isNull() ? 0 : d->timeSentMs;
+}
+
+qint64 SensorSnapshot::timeReceivedMs() const
+{
+    return d.isNull() ? 0 : d->timeReceivedMs;
+}
+
+int SensorSnapshot::numApproaches() const
+{
+    return d.isNull() ? 0 : d->numApproaches;
+}
+
+const approach *SensorSnapshot::approaches() const
+{
+    return d->approaches;
+}
+
+const QVector<snapshot_lane> &SensorSnapshot::lanes() const
+{
+    return d->lanes;
+}
+
+const QVector<double> &SensorSnapshot::classBounds() const
+{
+    return d->classBounds;
+}
+
+const QVector<float> &SensorSnapshot::speedBins() const
+{
+    return d->speedBins;
+}
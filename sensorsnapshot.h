@@ -0,0 +1,84 @@
+#ifndef SENSORSNAPSHOT_H
+#define SENSORSNAPSHOT_H
+
+#include <QByteArray>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+#include "sensor_utils.h"
+
+// configuration reads, one response each
+#define CONFIG_APPROACHES       0       // 0x28
+#define CONFIG_CLASSES          1       // 0x13
+#define CONFIG_LANES            2       // 0x27
+#define CONFIG_SPEED_BINS       3       // 0x1D
+#define CONFIG_GENERAL          4       // 0x2A
+#define CONFIG_DATA             5       // 0x03
+#define CONFIG_PUSH_MODE        6       // 0x0D
+#define CONFIG_TIME             7       // 0x0E
+#define CONFIG_NUM_ITEMS        8
+
+#define SNAPSHOT_MAX_APPROACHES 8
+
+// one lane as configured on the sensor
+struct snapshot_lane {
+    QString description;
+    char direction;
+};
+
+// A sensor's configuration as read at one moment, decoded once. Copies share
+// the decoded data and nothing changes it afterwards, so a snapshot can be
+// passed around freely and always describes a single read. Items the sensor
+// didn't answer, or answered with an error, are left out; has() tells which
+// are there.
+class SensorSnapshot
+{
+public:
+    SensorSnapshot();
+    static SensorSnapshot decode(uint16_t sensorId, const QByteArray *responses,
+                                 const bool *present, qint64 timeSentMs,
+                                 qint64 timeReceivedMs, qint64 readMs);
+
+    bool isEmpty() const;
+    bool has(int item) const;
+    uint16_t sensorId() const;
+    qint64 readMs() const;
+
+    const sensor_config &general() const;
+    const sensor_data_config &dataConfig() const;
+    bool globalPush() const;
+    qint64 sensorTimeMs() const;
+    qint64 timeSentMs() const;
+    qint64 timeReceivedMs() const;
+    int numApproaches() const;
+    const approach *approaches() const;
+    const QVector<snapshot_lane> &lanes() const;
+    const QVector<double> &classBounds() const;
+    const QVector<float> &speedBins() const;
+
+private:
+    struct snapshot_data {
+        snapshot_data();
+        ~snapshot_data();
+
+        uint16_t sensorId;
+        bool present[CONFIG_NUM_ITEMS];
+        qint64 readMs;
+        sensor_config general;
+        sensor_data_config data;
+        bool globalPush;
+        qint64 sensorMs;
+        qint64 timeSentMs;
+        qint64 timeReceivedMs;
+        int numApproaches;
+        approach approaches[SNAPSHOT_MAX_APPROACHES];
+        QVector<snapshot_lane> lanes;
+        QVector<double> classBounds;
+        QVector<float> speedBins;
+    };
+
+    QSharedPointer<const snapshot_data> d;
+};
+
+#endif // SENSORSNAPSHOT_H
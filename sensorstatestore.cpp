@@ -0,0 +1,146 @@
+#include "sensorstatestore.h"
+
+#include <string.h>
+
+#include <QMutexLocker>
+
+SensorStateStore::SensorStateStore()
+{
+}
+
+/**
+ * @brief SensorStateStore::stateOf: A sensor's row, added if it's new. Call
+ * with the lock held.
+ * @param sensorId
+ * @param row: set to the sensor's row
+ * @return the sensor's state
+ */
+sensor_state &SensorStateStore::stateOf(uint16_t sensorId, int *row)
+{
+    QHash<uint16_t, int>::const_iterator it = rowOf.constFind(sensorId);
+    if (it != rowOf.constEnd()) {
+        *row = it.value();
+        return states[*row];
+    }
+    sensor_state s;
+    memset(&s, 0, sizeof(s));
+    s.sensor_id = sensorId;
+    s.link = SENSOR_OFFLINE;
+    s.last_interval = -1;
+    for (int i=0; i<FLEET_MAX_APPROACHES; i++) {
+        s.appr_interval[i] = -1;
+    }
+    *row = states.size();
+    rowOf.insert(sensorId, *row);
+    states.append(s);
+    isDirty.append(false);
+    return states[*row];
+}
+
+void SensorStateStore::markDirty(int row)
+{
+    if (!isDirty.at(row)) {
+        isDirty[row] = true;
+        dirty.append(row);
+    }
+}
+
+void SensorStateStore::setLink(uint16_t sensorId, SENSOR_LINK_STATE link)
+{
+    QMutexLocker locker(&lock);
+    int row;
+    sensor_state &s = stateOf(sensorId, &row);
+    if (s.link != link) {
+        s.link = static_cast<uint8_t>(link);
+        markDirty(row);
+    }
+}
+
+/**
+ * @brief SensorStateStore::pollOutcome: Failed polls count as errors and mark
+ * the link failing until a poll gets an answer again
+ * @param sensorId
+ * @param outcome
+ */
+void SensorStateStore::pollOutcome(uint16_t sensorId, POLL_OUTCOME outcome)
+{
+    QMutexLocker locker(&lock);
+    int row;
+    sensor_state &s = stateOf(sensorId, &row);
+    uint8_t link = s.link;
+    if (outcome == POLL_FAILED) {
+        s.poll_errors++;
+        link = SENSOR_FAILING;
+    } else if (outcome != POLL_EARLY) {
+        link = SENSOR_POLLING;
+    }
+    if (outcome == POLL_FAILED || link != s.link) {
+        s.link = link;
+        markDirty(row);
+    }
+}
+
+/**
+ * @brief SensorStateStore::interval: Moves the sensor's newest interval time
+ * along and, for approach intervals, the approach's volume and speed.
+ * Older intervals (refetched gaps, backfill) only count towards the flags.
+ * @param r: with its quality flags set
+ */
+void SensorStateStore::interval(const interval_record &r)
+{
+    QMutexLocker locker(&lock);
+    int row;
+    sensor_state &s = stateOf(r.sensor_id, &row);
+    bool changed = false;
+    if (r.quality & QUALITY_EXCLUDE) {
+        s.flagged++;
+        changed = true;
+    }
+    if (r.timestamp > s.last_interval) {
+        s.last_interval = r.timestamp;
+        s.interval_duration = r.interval_duration;
+        changed = true;
+    }
+    int a = r.lane_appr_num;
+    if (r.request_type == 2 && a < FLEET_MAX_APPROACHES &&
+            r.timestamp >= s.appr_interval[a]) {
+        s.appr_interval[a] = r.timestamp;
+        s.volume[a] = r.volume;
+        s.avg_speed[a] = r.avg_speed;
+        if (a >= s.num_apprs) {
+            s.num_apprs = static_cast<uint8_t>(a + 1);
+        }
+        changed = true;
+    }
+    if (changed) {
+        markDirty(row);
+    }
+}
+
+/**
+ * @brief SensorStateStore::takeChanges: Copies out the rows changed since the
+ * last call and clears their dirty marks
+ * @param rows: set to the changed rows, in the order they first changed
+ * @param states: set to those rows' states
+ * @return number of rows in the store
+ */
+int SensorStateStore::takeChanges(QVector<int> *rows, QVector<sensor_state> *out)
+{
+    QMutexLocker locker(&lock);
+    rows->clear();
+    out->clear();
+    rows->swap(dirty);
+    out->reserve(rows->size());
+    for (int i=0; i<rows->size(); i++) {
+        int row = rows->at(i);
+        out->append(states.at(row));
+        isDirty[row] = false;
+    }
+    return states.size();
+}
+
+int SensorStateStore::size() const
+{
+    QMutexLocker locker(&lock);
+    return states.size();
+}
@@ -0,0 +1,57 @@
+#ifndef SENSORSTATESTORE_H
+#define SENSORSTATESTORE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+
+#include "pollscheduler.h"
+#include "sensor_utils.h"
+
+#define FLEET_MAX_APPROACHES 4
+
+// where the link to a sensor stands
+enum SENSOR_LINK_STATE { SENSOR_OFFLINE, SENSOR_CONNECTED, SENSOR_POLLING, SENSOR_FAILING };
+
+struct sensor_state {
+    uint16_t sensor_id;
+    uint8_t link;                   // SENSOR_LINK_STATE
+    uint8_t num_apprs;              // approaches seen so far
+    qint64 last_interval;           // start of the newest interval, UTC seconds, -1 = none
+    uint16_t interval_duration;
+    qint64 appr_interval[FLEET_MAX_APPROACHES];
+    uint32_t volume[FLEET_MAX_APPROACHES];
+    uint32_t avg_speed[FLEET_MAX_APPROACHES];   // 24-bit fixed pt, bit 23 = speed valid
+    qint64 poll_errors;
+    qint64 flagged;                 // intervals with any of QUALITY_EXCLUDE
+};
+
+// Latest state of every sensor seen, one row each in order of first sighting,
+// for the fleet dashboard. Workers report link changes and poll outcomes, the
+// pipeline reports intervals (approach intervals carry the per-approach
+// volume and speed). Every change marks its row dirty; takeChanges() hands
+// the reader copies of just the dirty rows, so a reader polling it does work
+// in proportion to what changed, not to the number of sensors. Locked, so
+// writers on other threads are fine.
+class SensorStateStore
+{
+public:
+    SensorStateStore();
+    void setLink(uint16_t sensorId, SENSOR_LINK_STATE link);
+    void pollOutcome(uint16_t sensorId, POLL_OUTCOME outcome);
+    void interval(const interval_record &r);
+    int takeChanges(QVector<int> *rows, QVector<sensor_state> *states);
+    int size() const;
+
+private:
+    sensor_state &stateOf(uint16_t sensorId, int *row);
+    void markDirty(int row);
+
+    mutable QMutex lock;
+    QVector<sensor_state> states;
+    QHash<uint16_t, int> rowOf;
+    QVector<int> dirty;
+    QVector<bool> isDirty;
+};
+
+#endif // SENSORSTATESTORE_H
@@ -3,7 +3,6 @@
 
 #include <QDateTime>
 #include <QFile>
-#include <QTextStream>
 #include <QTimer>
 
 SerialWorker::SerialWorker(QObject *parent) : QObject(parent)
@@ -13,13 +12,6 @@ SerialWorker::SerialWorker(QObject *parent) : QObject(parent)
 
 SerialWorker::~SerialWorker()
 {
-    delete retrievedDataStream;
-}
-
-void SerialWorker::setFilePtr(QFile *f)
-{
-    dataFile = f;
-    retrievedDataStream = new QTextStream(f);
 }
 
 void SerialWorker::setSerialPortPtr(QSerialPort *serialPtr)
@@ -32,12 +24,34 @@ void SerialWorker::setTimerPtr(QTimer *t)
     dataTimer = t;
 }
 
+void SerialWorker::setPipelinePtr(IntervalPipeline *p)
+{
+    pipeline = p;
+}
+
+void SerialWorker::setPollSchedulerPtr(PollScheduler *s)
+{
+    pollScheduler = s;
+}
+
+void SerialWorker::setStateStorePtr(SensorStateStore *s)
+{
+    stateStore = s;
+}
+
+void SerialWorker::setClockModelPtr(ClockModel *c)
+{
+    clockModel = c;
+}
+
 void SerialWorker::writeMsgToSensor(QByteArray *msg,
                                     QByteArray *response,
                                     uint8_t *Crc8Table,
                                     uint16_t *err_bytes)
 {
     (void)Crc8Table;
+    // a gap fill may be using the device
+    gaps.pause();
     serialPort->clear(QSerialPort::Input);
 
     // how much data are we waiting for?
@@ -131,103 +145,110 @@ void SerialWorker::startRealTimeDataRetrieval(uint8_t reqType, uint8_t lAN,
         printf("Data interval: %u\n", dataInterval);
         printf("Start DA RETreival!\n");
         requestType = reqType;
+        destId = sensorId;
+        intervalSeconds = dataInterval;
+        crc8Table = Crc8Table;
         numLanes = nL;
         numApprs = nA;
 
-        if (dataFile->exists()) {
-            printf("File exists.\n");
-            if (dataFile->isOpen()) {
-                printf("File is already open.\n");
-            } else if (dataFile->open(QIODevice::WriteOnly)) {
-                printf("File opened.\n");
-            } else {
-                printf("Couldn't open file.\n");
-                return;
-            }
-        } else {
-            printf("File does not exist.\n");
+        if (!pipeline->openDataFile()) {
+            return;
         }
 
-        // set up header row of the data file
-        QString headerLine;
-        QString spacer = "    ";
-        QString t;
-
-        (*retrievedDataStream) << qSetFieldWidth(25) << center << "Datetime";
-        t = QString("%1").arg("Datetime" + spacer);
-        headerLine.append(t);
-
-        (*retrievedDataStream) << qSetFieldWidth(5) << "Interval Duration" << spacer;
-        t = QString("%1").arg("Interval Duration" + spacer);
-        headerLine.append(t);
-
-        (*retrievedDataStream) << "Total # Lanes/Apprs" << spacer;
-        t = QString("%1").arg("Total # Lanes/Apprs" + spacer);
-        headerLine.append(t);
-
-        (*retrievedDataStream) << "Avg Speed" << spacer;
-        t = QString("%1").arg("Avg Speed" + spacer);
-        headerLine.append(t);
-
-        (*retrievedDataStream) << "Volume" << spacer;
-        t = QString("%1").arg("Volume" + spacer);
-        headerLine.append(t);
-
-        (*retrievedDataStream) << "Avg Occupancy" << spacer;
-        t = QString("%1").arg("Avg Occupancy" + spacer);
-        headerLine.append(t);
-
-        (*retrievedDataStream) << "85th Pctle Speed" << spacer;
-        t = QString("%1").arg("85th Pctle Speed" + spacer);
-        headerLine.append(t);
-
-        (*retrievedDataStream) << "Headway (ms)" << spacer;
-        t = QString("%1").arg("Headway (ms)" + spacer);
-        headerLine.append(t);
-
-        (*retrievedDataStream) << "Gap (ms)" << spacer;
-        t = QString("%1").arg("Gap (ms)" + spacer);
-        headerLine.append(t);
-
-        int i;
-        for (i=0; i<numClasses && i<10; i++) {
-            (*retrievedDataStream) << qSetFieldWidth(11) << "Length Bin "
-                                   << qSetFieldWidth(2) << i;
-            t = QString("%1").arg("Length Bin " + QString('1' + i));
-            t.append(spacer);
-            headerLine.append(t);
+        // resume after the last interval that made it into the journal
+        qint64 resumeTs = pipeline->lastDurable(sensorId, reqType, laneApprNum);
+        if (resumeTs >= 0) {
+            dt = QDateTime::fromSecsSinceEpoch(resumeTs, Qt::UTC);
+            printf("Resuming after %s\n",
+                   dt.toString("MM/dd/yyyy hh:mm:ss").toLatin1().constData());
         }
-        (*retrievedDataStream) << spacer;
-        for (i=0; i<numSpeedBins; i++) {
-            (*retrievedDataStream) << "Speed Bin " << i;
-            t = QString("%1").arg("Speed Bin " + QString('1' + i));
-            t.append(spacer);
-            headerLine.append(t);
-        }
-        (*retrievedDataStream) << "\n";
-        headerLine.append("\n");
-
 
+        // every lane/approach selection keeps its cursor across stop/start
+        cursorKey = interval_key(sensorId, reqType, laneApprNum);
+        if (!cursors.contains(cursorKey)) {
+            cursors[cursorKey] = dt.toSecsSinceEpoch();
+        }
+        dt = QDateTime::fromSecsSinceEpoch(cursors.value(cursorKey), Qt::UTC);
+
+        // intervals still missing behind the cursor are fetched between polls
+        int framesPerInterval;
+        if (reqType == 3) {
+            framesPerInterval = nL + nA;
+        } else if (lAN == 0xFF) {
+            framesPerInterval = (reqType == 1) ? nL : nA;
+        } else {
+            framesPerInterval = 1;
+        }
+        gaps.setPipelinePtr(pipeline);
+        gaps.watch(sensorId, reqType, laneApprNum, dataInterval, framesPerInterval,
+                   nL, cursors.value(cursorKey));
+        // polls line up with the sensor's interval boundaries
+        pollScheduler->addSensor(cursorKey, dataInterval);
+        if (stateStore != nullptr) {
+            stateStore->setLink(sensorId, SENSOR_POLLING);
+        }
+        measureClockOffset(Crc8Table);
         message = getVarSizeIntervalDataByTimestamp(Crc8Table, reqType, sensorId,
                                                 0, 0, dt, laneApprNum);
 
+        // Start can be pressed again after Stop: connect only once
         connect(dataTimer, &QTimer::timeout, this, &SerialWorker::getNewSensorData,
-                Qt::DirectConnection);
+                static_cast<Qt::ConnectionType>(Qt::DirectConnection | Qt::UniqueConnection));
 
-        dataTimer->start(dataInterval * 1000);
-        emit fileReadyForRead(headerLine);
+        dataTimer->setSingleShot(true);
+        dataTimer->start(pollScheduler->msUntilDue(cursorKey, cursors.value(cursorKey)));
+        pipeline->writeHeader(numClasses, numSpeedBins);
     }
 }
 
 void SerialWorker::stopRealTimeDataRetrieval()
 {
-    dataFile->close();
+    gaps.pause();
+    pipeline->closeDataFile();
     if (dataTimer->isActive()) {
         dataTimer->stop();
     }
+    pollScheduler->removeSensor(cursorKey);
+    if (stateStore != nullptr) {
+        stateStore->setLink(destId, SENSOR_CONNECTED);
+    }
 }
 
 void SerialWorker::getNewSensorData()
+{
+    gaps.pause();
+    qint64 intervalEnd = 0;
+    POLL_OUTCOME outcome = pollSensor(&intervalEnd);
+    pollScheduler->record(cursorKey, outcome, intervalEnd);
+    if (stateStore != nullptr) {
+        stateStore->pollOutcome(destId, outcome);
+    }
+
+    // the next poll waits for the interval the cursor points at to close
+    int wait = pollScheduler->msUntilDue(cursorKey, cursors.value(cursorKey));
+    if ((outcome == POLL_FAILED || outcome == POLL_NOT_READY) && wait < POLL_RETRY_MS) {
+        wait = POLL_RETRY_MS;
+    }
+    dataTimer->start(wait);
+
+    // the sensor clock is read now and then, not every poll, and set when
+    // the model says it has wandered off
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (clockModel != nullptr && clockModel->sampleDue(destId, now)) {
+        measureClockOffset(crc8Table);
+    }
+    if (clockModel != nullptr && clockModel->correctionDue(destId, now)) {
+        correctClock(crc8Table);
+    }
+    fillGaps();
+}
+
+/**
+ * @brief SerialWorker::pollSensor: Asks the sensor for the interval at the poll cursor
+ * @param intervalEnd: set to the end of the stored interval, UTC seconds
+ * @return how the poll went
+ */
+POLL_OUTCOME SerialWorker::pollSensor(qint64 *intervalEnd)
 {
     uint8_t seqNumber = 0;
     (void)seqNumber;
@@ -258,28 +279,25 @@ void SerialWorker::getNewSensorData()
     int totalBinCount = numClasses + numSpeedBins + numDirectionBins;
     (void)totalBinCount;
 
-    int packetNumber;
-    (void)packetNumber;
-    uint8_t day;
-    uint8_t month;
-    uint16_t year;
-    uint8_t tmpHi;
-    uint8_t tmpLo;
-    uint8_t hrs;
-    uint8_t mins;
-    uint8_t secs;
-    uint16_t ms;
-    (void)ms;
-    uint16_t intervalDuration;
-    double avgSpeed;
-    uint32_t volume;
-    double avgOccupancy;
-    double eightyFifthPctlSpeed;
-    uint32_t headway;
-    uint32_t gap;
-
     QString newDataLine;
 
+    // don't ask for intervals that are already stored
+    qint64 from = cursors.value(cursorKey);
+    qint64 next = pipeline->firstMissing(destId, requestType, laneApprNum,
+                                         from, intervalSeconds);
+    // after an outage, poll the newest interval; nothing that is still open
+    // on the sensor's clock
+    bool closed = false;
+    next = pollScheduler->pollTarget(cursorKey, next, intervalSeconds, &closed);
+    cursors[cursorKey] = next;
+    if (!closed) {
+        return POLL_EARLY;
+    }
+    set_interval_request_time(crc8Table, &message,
+                              QDateTime::fromSecsSinceEpoch(next, Qt::UTC));
+    int received = 0;
+    qint64 nextBoundary = -1;
+
     serialPort->clear(QSerialPort::Input);
     serialPort->write(message);
     while (!serialPort->waitForBytesWritten(waitTimeout));
@@ -313,6 +331,9 @@ void SerialWorker::getNewSensorData()
                         errorCode = (temp1 | temp2);
                     }
                 }
+            } else {
+                // this lane never answered; resp is stale, don't store it
+                return POLL_FAILED;
             }
             if (errorCode == 0x000F) {
                 intervalNotPresent = true;
@@ -322,173 +343,115 @@ void SerialWorker::getNewSensorData()
                 break;
             } else {
 
-            // extract date and time
-
-            if (resp.size() < 23) { return; }
-
-            // sensor date starts at byte indexed 14
-
-            int indexNumPos = 14;
-            int locn = indexNumPos + 3;
-
-
-            // lane/approach number: byte 17
-            packetNumber = resp.at(locn);
-            locn++;
-
-            // extract year
-            uint8_t y1 = resp.at(locn); locn++;
-            uint8_t y2 = resp.at(locn); locn++;
-
+            interval_record rec;
+            if (!parse_interval_data_resp(&resp, &rec)) { return POLL_FAILED; }
 
-            // fill up lower 8 bits
-            if (y1 & 0x1) {
-                // bit @ index 7 should be 1
-                tmpLo = (y2 >> 1) | 0x80;
+            // with request type 3 the lanes come back first, then approaches
+            rec.sensor_id = destId;
+            if (requestType == 3) {
+                rec.request_type = (i < numLanes) ? 1 : 2;
             } else {
-                // bit @ index 7 should be 0
-                tmpLo = (y2 >> 1) & 0x7F;
-            }
-            // upper 8 bits: index 1-5 from upper byte
-            tmpHi = (y1 & 0x1E) >> 1;
-            year = (tmpHi << 8) | ((tmpLo & 0x00FF));
-
-            // get lower 3 bits of month
-            month = (resp.at(locn)) >> 5; locn++;
-            if (y2 & 0x1) {
-                // MSB is 1
-                month |= 0x8;
-            } else {
-                month &= 0x7;
+                rec.request_type = requestType;
             }
+            pipeline->ingest(rec);
 
-            // extract day: lower 5 bits
-            day = (resp.at(locn)) & 0x1F; locn++;
-
-            tmpLo = (resp.at(19) & 0xC0) >> 6;
-            tmpHi = (resp.at(18) & 0x07) << 2;
-            hrs = (tmpHi | tmpLo);
-
-            mins = (resp.at(19) & 0x3F);
-            secs = (resp.at(20) & 0xFC) >> 2;
-
-            // milliseconds
-            tmpHi = (resp.at(20) & 0x3);
-            ms = (tmpHi << 8) | (resp.at(21) & 0x00FF);
-
-            (*retrievedDataStream).setPadChar('0');
-            (*retrievedDataStream) << qSetFieldWidth(2) << month << "/" << day << "/" <<
-                                      qSetFieldWidth(4) << year << " " <<
-                                      qSetFieldWidth(2) << hrs << ":" << mins <<
-                                      ":" << secs << " ";
-            QChar z = QChar(48);
-            QString q = QString("%1/%2/%3 %4:%5:%6").arg(month, 2, 10, z).arg(day, 2, 10, z).arg(year, 4).arg(hrs, 2, 10, z).arg(mins, 2, 10, z).arg(secs, 2, 10, z);
-            newDataLine.append(q);
-
-            tmpHi = resp.at(locn); locn++;
-            tmpLo = resp.at(locn); locn++;
-
-            intervalDuration = (static_cast<uint16_t>((tmpHi << 8) & 0xFF00));
-            intervalDuration |= ( (static_cast<uint16_t>(tmpLo)) & 0x00FF);
-
-            (*retrievedDataStream) << qSetFieldWidth(6) << intervalDuration;
-            q = QString("%1").arg(intervalDuration, 6);
-            newDataLine.append(q);
-
-            // num lanes & approaches configured, respectively
-            (*retrievedDataStream)  << qSetFieldWidth(2) << resp.at(locn);
-            q = QString("%1").arg(resp.at(locn), 2);
-            newDataLine.append(q);
-            locn++;
-            (*retrievedDataStream) << resp.at(locn);
-            q = QString("%1").arg(resp.at(locn), 2);
-            newDataLine.append(q);
-            locn++;
-
-            // avg speed
-            avgSpeed = doubleFrom24BitFixedPt(&resp, locn);
-            (*retrievedDataStream) << qSetFieldWidth(6) << avgSpeed;
-            q = QString("%1").arg(avgSpeed, 6);
-            newDataLine.append(q);
-            locn += 3;
-
-            // volume (3 bytes)
-            volume = static_cast<uint32_t>( (resp.at(locn) << 24) & 0xFF0000);
-            locn++;
-            volume |= static_cast<uint32_t>( (resp.at(locn) << 16) & 0x00FF00);
-            locn++;
-            volume |= static_cast<uint32_t>( (resp.at(locn) ) & 0x0000FF);
-            locn++;
-
-            (*retrievedDataStream) << qSetFieldWidth(6) << volume;
-            q = QString("%1").arg(volume, 6);
-            newDataLine.append(q);
-
-            avgOccupancy = static_cast<double>(fixedPtToFloat(extract16BitFixedPt(&resp, locn)));
-            locn += 2;
-            (*retrievedDataStream) << qSetFieldWidth(5) << avgOccupancy;
-            q = QString("%1").arg(avgOccupancy, 5);
-            newDataLine.append(q);
-
-            eightyFifthPctlSpeed = doubleFrom24BitFixedPt(&resp, locn);
-            (*retrievedDataStream) << qSetFieldWidth(4) << eightyFifthPctlSpeed;
-            q = QString("%1").arg(eightyFifthPctlSpeed, 4);
-            newDataLine.append(q);
-            locn += 3;
-
-            // headway (3 bytes)
-            headway = static_cast<uint32_t>( (resp.at(locn) << 24) & 0xFF0000);
-            locn++;
-            headway |= static_cast<uint32_t>( (resp.at(locn) << 16) & 0x00FF00);
-            locn++;
-            headway |= static_cast<uint32_t>( (resp.at(locn) ) & 0x0000FF);
-            locn++;
-
-            (*retrievedDataStream) << headway;
-            q = QString("%1").arg(headway);
-            newDataLine.append(q);
-
-            // gap (3 bytes)
-            gap = static_cast<uint32_t>( (resp.at(locn) << 24) & 0xFF0000);
-            locn++;
-            gap |= static_cast<uint32_t>( (resp.at(locn) << 16) & 0x00FF00);
-            locn++;
-            gap |= static_cast<uint32_t>( (resp.at(locn) ) & 0x0000FF);
-            locn++;
-
-            (*retrievedDataStream) << gap;
-            q = QString("%1").arg(gap);
-            newDataLine.append(q);
-
-            if (locn == dataExpected + 10) {
-                return;
-            } else {
-                while (locn < dataExpected) {
-                    char binType = resp.at(locn);
-                    (void)binType;
-                    char numBins;
-                    locn++;
-                    numBins = resp.at(locn);
-                    for (int j=0; j<numBins; j++) {
-                        uint32_t count;
-                        count = static_cast<uint32_t>( (resp.at(locn) << 24) & 0xFF0000);
-                        locn++;
-                        count |= static_cast<uint32_t>( (resp.at(locn) << 16) & 0x00FF00);
-                        locn++;
-                        count |= static_cast<uint32_t>( (resp.at(locn) ) & 0x0000FF);
-                        locn++;
-
-                        (*retrievedDataStream) << count;
-                        q = QString("%1").arg(count);
-                        newDataLine.append(q);
-                    }
-                }
+            // this lane is done up to the end of the interval
+            qint64 boundary = rec.timestamp + rec.interval_duration;
+            cursors[interval_key(destId, rec.request_type, rec.lane_appr_num)] = boundary;
+            if (nextBoundary < 0 || boundary < nextBoundary) {
+                nextBoundary = boundary;
             }
+            received++;
+        }
+    }
 
+    // move on once every requested lane/approach has reported
+    if (intervalNotPresent) {
+        return POLL_NOT_READY;
+    }
+    if (received < loopLimit) {
+        return POLL_FAILED;
+    }
+    if (nextBoundary > cursors.value(cursorKey)) {
+        cursors[cursorKey] = nextBoundary;
+    }
+    *intervalEnd = nextBoundary;
+    return POLL_STORED;
+}
 
-            (*retrievedDataStream) << "\n\n";
-            newDataLine.append("\n\n");
-            emit fileReadyForRead(newDataLine);
-        }
+/**
+ * @brief SerialWorker::fillGaps: Looks for intervals missing behind the poll cursor
+ * and starts fetching as many as fit before the next poll is due; the
+ * fetches run from the event loop and the next poll pauses them
+ */
+void SerialWorker::fillGaps()
+{
+    gaps.scan(destId, requestType, laneApprNum, cursors.value(cursorKey));
+    if (gaps.queued() > 0 && dataTimer->isActive()) {
+        gaps.fill(serialPort, QDateTime::currentMSecsSinceEpoch() +
+                  dataTimer->remainingTime() - GAP_POLL_MARGIN_MS);
+    }
+}
+
+/**
+ * @brief SerialWorker::measureClockOffset: Reads the sensor's clock and tells the
+ * scheduler how far it is from ours, taking the read's midpoint as the
+ * moment the sensor sampled it. With a clock model the reading goes into its
+ * fit and the scheduler gets the fitted offset.
+ * @param Crc8Table
+ */
+void SerialWorker::measureClockOffset(uint8_t *Crc8Table)
+{
+    QByteArray resp(128, '*');
+    uint16_t err = 0;
+    sensor_datetime d;
+    d.yr = 0;
+
+    QByteArray msg = genReadMsg(Crc8Table, 0x0E, 0, destId);
+    qint64 sentMs = QDateTime::currentMSecsSinceEpoch();
+    writeMsgToSensor(&msg, &resp, Crc8Table, &err);
+    qint64 receivedMs = QDateTime::currentMSecsSinceEpoch();
+    parse_sensor_time_read_resp(&resp, QString(), &d);
+    if (err != 0 || d.yr == 0) {
+        printf("Couldn't read sensor clock, assuming it matches ours\n");
+        return;
+    }
+
+    qint64 sensorMs = sensor_time_msecs(d);
+    if (sensorMs < 0) {
+        return;
+    }
+    if (clockModel == nullptr) {
+        pollScheduler->setClockOffset(cursorKey, sensorMs - (sentMs + receivedMs) / 2);
+        return;
+    }
+    clockModel->addSample(destId, sentMs, receivedMs, sensorMs);
+    pollScheduler->setClockOffset(cursorKey, clockModel->offsetMs(destId, receivedMs));
+}
+
+/**
+ * @brief SerialWorker::correctClock: Sets the sensor clock to ours. The time written
+ * is ours plus half the fastest round trip, i.e. what it will be when the
+ * sensor gets the message.
+ * @param Crc8Table
+ */
+void SerialWorker::correctClock(uint8_t *Crc8Table)
+{
+    QByteArray resp(128, '*');
+    uint16_t err = 0;
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    qint64 before = clockModel->offsetMs(destId, now);
+    sensor_datetime d;
+    sensor_time_from_msecs(now + clockModel->roundTripMs(destId) / 2, &d);
+
+    QByteArray msg = gen_sensor_time_write(Crc8Table, &d, destId);
+    writeMsgToSensor(&msg, &resp, Crc8Table, &err);
+    if (err != 0 || resp.at(0) == 'E') {
+        printf("Couldn't set sensor clock\n");
+        return;
     }
+    clockModel->stepped(destId, -before);
+    pollScheduler->setClockOffset(cursorKey, clockModel->offsetMs(destId, now));
+    printf("Set sensor 0x%04X clock, it was %lld ms off\n", destId,
+           static_cast<long long>(before));
 }
@@ -1,14 +1,20 @@
 #ifndef SERIALWORKER_H
 #define SERIALWORKER_H
 
+#include <QDateTime>
 #include <QFile>
+#include <QHash>
 #include <QObject>
 #include <QSerialPort>
-#include <QTextStream>
 #include <QTimer>
 
 
+#include <clockmodel.h>
+#include <gapscanner.h>
+#include <intervalpipeline.h>
+#include <pollscheduler.h>
 #include <sensor_utils.h>
+#include <sensorstatestore.h>
 
 class SerialWorker : public QObject
 {
@@ -17,8 +23,11 @@ public:
     ~SerialWorker();
     explicit SerialWorker(QObject *parent = nullptr);
     void setSerialPortPtr(QSerialPort*);
-    void setFilePtr(QFile*);
     void setTimerPtr(QTimer *t);
+    void setPipelinePtr(IntervalPipeline *p);
+    void setPollSchedulerPtr(PollScheduler *s);
+    void setStateStorePtr(SensorStateStore *s);
+    void setClockModelPtr(ClockModel *c);
     void startRealTimeDataRetrieval(uint8_t reqType, uint8_t laneApprNum,
                                     uint8_t *Crc8Table,
                                     sensor_data_config *sDC,
@@ -33,6 +42,11 @@ public:
                           uint16_t *errorBytes);
 
 private:
+    void fillGaps();
+    void measureClockOffset(uint8_t *Crc8Table);
+    void correctClock(uint8_t *Crc8Table);
+    POLL_OUTCOME pollSensor(qint64 *intervalEnd);
+
     int numClasses;
     int numDirectionBins;
     int numSpeedBins;
@@ -40,11 +54,19 @@ private:
     uint8_t requestType;
     uint8_t numLanes;
     uint8_t numApprs;
+    uint16_t destId;
+    uint16_t intervalSeconds;
+    uint8_t *crc8Table;
+    quint32 cursorKey;
+    QHash<quint32, qint64> cursors;
+    GapScanner gaps;
     QByteArray message;
-    QFile *dataFile;
+    IntervalPipeline *pipeline = nullptr;
+    PollScheduler *pollScheduler = nullptr;
+    SensorStateStore *stateStore = nullptr;
+    ClockModel *clockModel = nullptr;
     QSerialPort *serialPort;
     QString dataLine;
-    QTextStream *retrievedDataStream;
     QTimer *dataTimer;
 
 signals:
@@ -0,0 +1,228 @@
+#include "snapshotstore.h"
+#include "commands.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStringList>
+#include <QTextStream>
+
+// general configuration responses shorter than this are left unparsed
+#define SNAPSHOT_GENERAL_SIZE 98
+
+SnapshotStore::SnapshotStore(const QString &dirName)
+{
+    dir = dirName;
+}
+
+/**
+ * @brief SnapshotStore::load: Reads every stored snapshot
+ * @return number of sensors known
+ */
+int SnapshotStore::load()
+{
+    QDir d(dir);
+    QStringList names = d.entryList(QStringList() << "*.snap", QDir::Files);
+    for (int i=0; i<names.size(); i++) {
+        QFile f(d.filePath(names.at(i)));
+        if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            continue;
+        }
+        QTextStream in(&f);
+
+        QStringList header = in.readLine().split(' ');
+        if (header.size() != 4 || header.at(0) != "sensor" || header.at(2) != "saved") {
+            continue;
+        }
+        stored_snapshot s;
+        s.sensorId = static_cast<uint16_t>(header.at(1).toUInt());
+        s.savedAt = header.at(3).toLongLong();
+        while (!in.atEnd()) {
+            QStringList fields = in.readLine().split(' ');
+            if (fields.size() != 2) {
+                continue;
+            }
+            int item = fields.at(0).toInt();
+            if (item >= 0 && item < CONFIG_NUM_ITEMS && item != CONFIG_TIME) {
+                s.responses[item] = QByteArray::fromHex(fields.at(1).toLatin1());
+            }
+        }
+
+        sensor_config c;
+        if (snapshot_general_config(s.responses[CONFIG_GENERAL], &c)) {
+            snapshots.insert(c.serial, s);
+        }
+    }
+    printf("Snapshot store: %d sensors in %s\n", snapshots.size(),
+           dir.toLatin1().constData());
+    return snapshots.size();
+}
+
+/**
+ * @brief SnapshotStore::knows: Whether any stored sensor had this id, i.e.
+ * whether checking the general configuration first could pay off
+ * @param sensorId
+ */
+bool SnapshotStore::knows(uint16_t sensorId) const
+{
+    QHash<QString, stored_snapshot>::const_iterator it = snapshots.constBegin();
+    for (; it != snapshots.constEnd(); ++it) {
+        if (it.value().sensorId == sensorId) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief SnapshotStore::lookup: Finds the stored configuration of the sensor
+ * that just answered the general configuration read (and a few others)
+ * @param read: CONFIG_NUM_ITEMS responses, as read from the sensor now
+ * @param present: which of them were read; the general configuration has to be
+ * @param responses: CONFIG_NUM_ITEMS responses, the ones not read filled in if found
+ * @return true if a recent entry matches everything that was read
+ */
+bool SnapshotStore::lookup(const QByteArray *read, const bool *present,
+                           QByteArray *responses) const
+{
+    sensor_config now;
+    if (!present[CONFIG_GENERAL] || !snapshot_general_config(read[CONFIG_GENERAL], &now) ||
+            !snapshots.contains(now.serial)) {
+        return false;
+    }
+    const stored_snapshot &s = snapshots[now.serial];
+    qint64 age = QDateTime::currentMSecsSinceEpoch() / 1000 - s.savedAt;
+    if (age < 0 || age > SNAPSHOT_MAX_AGE_SECS) {
+        return false;
+    }
+
+    sensor_config then;
+    snapshot_general_config(s.responses[CONFIG_GENERAL], &then);
+    if (then.orientation != now.orientation || then.location != now.location ||
+            then.description != now.description || then.units != now.units) {
+        return false;
+    }
+    for (int i=0; i<CONFIG_NUM_ITEMS; i++) {
+        if (i != CONFIG_TIME && s.responses[i].isEmpty()) {
+            return false;
+        }
+        // lanes and the like carry nothing that changes on its own, so any
+        // difference means the configuration was changed
+        if (i != CONFIG_TIME && i != CONFIG_GENERAL && present[i] &&
+                read[i] != s.responses[i]) {
+            return false;
+        }
+    }
+    for (int i=0; i<CONFIG_NUM_ITEMS; i++) {
+        if (i != CONFIG_TIME && i != CONFIG_GENERAL && !present[i]) {
+            responses[i] = s.responses[i];
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief SnapshotStore::save: Stores what was just read from a sensor. A
+ * full read replaces the entry; single items re-read later are merged into
+ * it without making it any younger.
+ * @param sensorId
+ * @param responses: CONFIG_NUM_ITEMS responses
+ * @param present: which of them were read
+ */
+void SnapshotStore::save(uint16_t sensorId, const QByteArray *responses,
+                         const bool *present)
+{
+    sensor_config c;
+    if (!present[CONFIG_GENERAL] || !snapshot_general_config(responses[CONFIG_GENERAL], &c)) {
+        return;
+    }
+    bool full = true;
+    for (int i=0; i<CONFIG_NUM_ITEMS; i++) {
+        if (i != CONFIG_TIME && (!present[i] || responses[i].isEmpty() ||
+                                 responses[i].at(0) == 'E')) {
+            full = false;
+        }
+    }
+    if (!full && !snapshots.contains(c.serial)) {
+        return;
+    }
+
+    stored_snapshot &s = snapshots[c.serial];
+    s.sensorId = sensorId;
+    if (full) {
+        s.savedAt = QDateTime::currentMSecsSinceEpoch() / 1000;
+    }
+    for (int i=0; i<CONFIG_NUM_ITEMS; i++) {
+        if (i != CONFIG_TIME && present[i] && !responses[i].isEmpty() &&
+                responses[i].at(0) != 'E') {
+            s.responses[i] = responses[i];
+        }
+    }
+    write(c.serial, s);
+}
+
+/**
+ * @brief SnapshotStore::forget: Drops a sensor's entry, e.g. after writing
+ * its configuration
+ * @param general: the sensor's general configuration response
+ */
+void SnapshotStore::forget(const QByteArray &general)
+{
+    sensor_config c;
+    if (!snapshot_general_config(general, &c) || !snapshots.contains(c.serial)) {
+        return;
+    }
+    snapshots.remove(c.serial);
+    QFile::remove(fileFor(c.serial));
+}
+
+QString SnapshotStore::fileFor(const QString &serial) const
+{
+    QString name;
+    for (int i=0; i<serial.size(); i++) {
+        QChar ch = serial.at(i);
+        name += ch.isLetterOrNumber() ? ch : QChar('_');
+    }
+    return QDir(dir).filePath(name + ".snap");
+}
+
+/**
+ * @brief SnapshotStore::write: Replaces a sensor's file atomically
+ * @param serial
+ * @param s
+ */
+void SnapshotStore::write(const QString &serial, const stored_snapshot &s)
+{
+    QDir().mkpath(dir);
+    QSaveFile f(fileFor(serial));
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        return;
+    }
+    QTextStream out(&f);
+    out << "sensor " << s.sensorId << " saved " << s.savedAt << "\n";
+    for (int i=0; i<CONFIG_NUM_ITEMS; i++) {
+        if (!s.responses[i].isEmpty()) {
+            out << i << " " << s.responses[i].toHex() << "\n";
+        }
+    }
+    out.flush();
+    f.commit();
+}
+
+/**
+ * @brief snapshot_general_config: Parses a general configuration response
+ * @param response
+ * @param c
+ * @return true if it was a complete answer with a serial number
+ */
+bool snapshot_general_config(const QByteArray &response, sensor_config *c)
+{
+    if (response.size() < SNAPSHOT_GENERAL_SIZE || response.at(0) == 'E') {
+        return false;
+    }
+    c->orientation = 0;
+    c->units = 0;
+    parse_gen_conf_read_response(response, c, QString());
+    return !c->serial.isEmpty();
+}
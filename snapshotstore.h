@@ -0,0 +1,49 @@
+#ifndef SNAPSHOTSTORE_H
+#define SNAPSHOTSTORE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+#include "sensorsnapshot.h"
+#include "sensor_utils.h"
+
+// stored configuration older than this is read again in full; it bounds how
+// long a change to the items lookup() doesn't compare (approaches, classes,
+// speed bins, push mode) made by another tool can go unnoticed
+#define SNAPSHOT_MAX_AGE_SECS   (24 * 3600)
+
+// The configuration responses last read from each sensor, kept on disk (one
+// text file per sensor, named after its serial number) so a reconnect can skip
+// reading everything again. An entry only stands in for the sensor when its
+// stored general configuration, which carries the serial, and every other
+// item read again on the reconnect still match what the sensor answers now,
+// and it isn't older than SNAPSHOT_MAX_AGE_SECS. The time read is never
+// stored.
+class SnapshotStore
+{
+public:
+    explicit SnapshotStore(const QString &dirName);
+    int load();
+    bool knows(uint16_t sensorId) const;
+    bool lookup(const QByteArray *read, const bool *present, QByteArray *responses) const;
+    void save(uint16_t sensorId, const QByteArray *responses, const bool *present);
+    void forget(const QByteArray &general);
+
+private:
+    struct stored_snapshot {
+        uint16_t sensorId;
+        qint64 savedAt;             // UTC seconds of the last full read
+        QByteArray responses[CONFIG_NUM_ITEMS];
+    };
+
+    QString fileFor(const QString &serial) const;
+    void write(const QString &serial, const stored_snapshot &s);
+
+    QString dir;
+    QHash<QString, stored_snapshot> snapshots;   // by serial
+};
+
+bool snapshot_general_config(const QByteArray &response, sensor_config *c);
+
+#endif // SNAPSHOTSTORE_H
@@ -0,0 +1,340 @@
+#include "speedsketch.h"
+
+#include <algorithm>
+#include <random>
+#include <string.h>
+
+// the sensor's "all other events" threshold
+#define SPEED_BIN_CATCH_ALL 255.0f
+
+SpeedSketch::SpeedSketch()
+{
+    numBins = 0;
+    total = 0;
+    memset(bounds, 0, sizeof(bounds));
+    memset(counts, 0, sizeof(counts));
+}
+
+/**
+ * @brief SpeedSketch::setBounds: Sets the bin thresholds and empties the sketch
+ * @param thresholds: upper edge of each bin, as read by parse_speed_bin_conf_read
+ * @param n: number of bins
+ */
+void SpeedSketch::setBounds(const float *thresholds, int n)
+{
+    numBins = n < MAX_SPEED_BINS ? n : MAX_SPEED_BINS;
+    if (numBins < 0) {
+        numBins = 0;
+    }
+    memset(bounds, 0, sizeof(bounds));
+    memcpy(bounds, thresholds, numBins * sizeof(float));
+    memset(counts, 0, sizeof(counts));
+    total = 0;
+}
+
+bool SpeedSketch::sameBounds(const SpeedSketch &o) const
+{
+    return numBins == o.numBins && memcmp(bounds, o.bounds, numBins * sizeof(float)) == 0;
+}
+
+void SpeedSketch::addCounts(const uint32_t *binCounts, int n)
+{
+    for (int i=0; i<n && i<numBins; i++) {
+        counts[i] += binCounts[i];
+        total += binCounts[i];
+    }
+}
+
+void SpeedSketch::add(const interval_record &r)
+{
+    addCounts(r.speed_bins, r.num_speed_bins);
+}
+
+/**
+ * @brief SpeedSketch::merge: Adds another sketch's counts to this one
+ * @param o
+ * @return false if the two were built over different bin thresholds
+ */
+bool SpeedSketch::merge(const SpeedSketch &o)
+{
+    if (!sameBounds(o)) {
+        return false;
+    }
+    for (int i=0; i<numBins; i++) {
+        counts[i] += o.counts[i];
+    }
+    total += o.total;
+    return true;
+}
+
+quint64 SpeedSketch::count() const
+{
+    return total;
+}
+
+/**
+ * @brief SpeedSketch::quantile: Estimates a speed quantile, assuming speeds
+ * are spread evenly inside each bin. The catch-all bin is taken to be as
+ * wide as the bin before it.
+ * @param q: 0 to 1, e.g. 0.85 for the 85th percentile speed
+ * @return speed in the sensor's units, or -1 if the sketch is empty
+ */
+double SpeedSketch::quantile(double q) const
+{
+    if (total == 0) {
+        return -1.0;
+    }
+    if (q < 0.0) {
+        q = 0.0;
+    } else if (q > 1.0) {
+        q = 1.0;
+    }
+
+    double rank = q * static_cast<double>(total);
+    double below = 0.0;
+    int i;
+    for (i=0; i<numBins-1; i++) {
+        if (below + counts[i] >= rank && counts[i] > 0) {
+            break;
+        }
+        below += counts[i];
+    }
+
+    double lower = (i == 0) ? 0.0 : bounds[i - 1];
+    double upper = bounds[i];
+    if (upper >= SPEED_BIN_CATCH_ALL && i > 0) {
+        double prevLower = (i == 1) ? 0.0 : bounds[i - 2];
+        upper = lower + (lower - prevLower);
+    }
+    if (counts[i] == 0) {
+        return lower;
+    }
+    double frac = (rank - below) / counts[i];
+    if (frac > 1.0) {
+        frac = 1.0;
+    }
+    return lower + frac * (upper - lower);
+}
+
+// nearest-rank quantile of raw speeds, sorted ascending
+static double exactQuantile(const std::vector<double> &sorted, double q)
+{
+    if (sorted.empty()) {
+        return -1.0;
+    }
+    size_t k = static_cast<size_t>(q * sorted.size());
+    if (k >= sorted.size()) {
+        k = sorted.size() - 1;
+    }
+    return sorted[k];
+}
+
+/**
+ * @brief SpeedSketch::accuracyCheck: Compares sketch percentiles with exact
+ * ones over synthetic vehicle events (free flow plus a congested share),
+ * binned per lane and minute the way the sensor reports them, and prints
+ * the error next to the width of the bin the answer fell in
+ * @param events
+ */
+void SpeedSketch::accuracyCheck(int events)
+{
+    const int lanes = 4;
+    const int minutes = 60;
+    const float thresholds[MAX_SPEED_BINS] = { 20, 25, 30, 35, 40, 45, 50, 55,
+                                               60, 65, 70, 75, 80, 85, 255 };
+
+    std::mt19937 rng(1);
+    std::normal_distribution<double> freeFlow(62.0, 6.0);
+    std::normal_distribution<double> congested(38.0, 8.0);
+    std::uniform_real_distribution<double> pick(0.0, 1.0);
+
+    QVector<interval_record> recs(lanes * minutes);
+    for (int i=0; i<recs.size(); i++) {
+        interval_record &r = recs[i];
+        memset(&r, 0, sizeof(r));
+        r.sensor_id = 1;
+        r.request_type = 1;
+        r.lane_appr_num = static_cast<uint8_t>(i % lanes);
+        r.timestamp = 1560000000 + (i / lanes) * 60;
+        r.interval_duration = 60;
+        r.num_speed_bins = MAX_SPEED_BINS;
+    }
+
+    // all events, and the ones in a sub-window of two lanes over 15 minutes
+    std::vector<double> all, sub;
+    for (int e=0; e<events; e++) {
+        double v = pick(rng) < 0.8 ? freeFlow(rng) : congested(rng);
+        if (v < 1.0) {
+            v = 1.0;
+        }
+        int slot = static_cast<int>(pick(rng) * recs.size()) % recs.size();
+        interval_record &r = recs[slot];
+        int b;
+        for (b=0; b<MAX_SPEED_BINS-1 && v >= thresholds[b]; b++);
+        r.speed_bins[b]++;
+        r.volume++;
+
+        all.push_back(v);
+        int minute = slot / lanes;
+        if (r.lane_appr_num < 2 && minute >= 20 && minute < 35) {
+            sub.push_back(v);
+        }
+    }
+    std::sort(all.begin(), all.end());
+    std::sort(sub.begin(), sub.end());
+
+    SpeedSketchIndex index;
+    index.setBounds(thresholds, MAX_SPEED_BINS);
+    for (int i=0; i<recs.size(); i++) {
+        index.add(recs.at(i));
+    }
+
+    QVector<quint32> allLanes, twoLanes;
+    for (int l=0; l<lanes; l++) {
+        allLanes.append(interval_key(1, 1, static_cast<uint8_t>(l)));
+    }
+    twoLanes << allLanes.at(0) << allLanes.at(1);
+
+    struct window { const char *name; qint64 from; qint64 to;
+                    const QVector<quint32> *lanes; const std::vector<double> *raw; };
+    window windows[2] = {
+        { "all lanes, 60 min", 1560000000, 1560000000 + minutes * 60, &allLanes, &all },
+        { "lanes 0-1, 15 min", 1560000000 + 20 * 60, 1560000000 + 35 * 60, &twoLanes, &sub }
+    };
+    const double qs[3] = { 0.50, 0.85, 0.95 };
+
+    printf("Speed sketch accuracy, %d events over %d lanes x %d minutes\n",
+           events, lanes, minutes);
+    for (int w=0; w<2; w++) {
+        SpeedSketch s = index.query(windows[w].from, windows[w].to, *windows[w].lanes);
+        printf("  %s (%llu events):\n", windows[w].name,
+               static_cast<unsigned long long>(s.count()));
+        for (int k=0; k<3; k++) {
+            double est = s.quantile(qs[k]);
+            double exact = exactQuantile(*windows[w].raw, qs[k]);
+            int b;
+            for (b=0; b<MAX_SPEED_BINS-1 && exact >= thresholds[b]; b++);
+            double width = thresholds[b] - (b == 0 ? 0.0 : thresholds[b - 1]);
+            printf("    p%02d: sketch %6.2f  exact %6.2f  error %5.2f (bin width %.0f)\n",
+                   static_cast<int>(qs[k] * 100 + 0.5), est, exact, est - exact, width);
+        }
+    }
+}
+
+SpeedSketchIndex::SpeedSketchIndex()
+{
+    numBins = 0;
+}
+
+/**
+ * @brief SpeedSketchIndex::setBounds: Sets the sensor's speed bin thresholds.
+ * Changing them drops everything indexed so far, since the old counts can't
+ * be mapped onto new bins.
+ */
+void SpeedSketchIndex::setBounds(const float *thresholds, int n)
+{
+    SpeedSketch s;
+    s.setBounds(thresholds, n);
+    if (s.sameBounds(empty)) {
+        return;
+    }
+    empty = s;
+    numBins = empty.numBins;
+    series.clear();
+}
+
+void SpeedSketchIndex::add(const interval_record &r)
+{
+    if (numBins == 0 || r.num_speed_bins == 0 || (r.quality & QUALITY_EXCLUDE) ||
+            r.timestamp < 0) {
+        return;
+    }
+    QMap<qint64, day_rows> &days = series[interval_key(r.sensor_id, r.request_type,
+                                                       r.lane_appr_num)];
+    qint64 day = r.timestamp / 86400;
+    if (!days.isEmpty() && day <= days.lastKey() - SPEED_INDEX_KEEP_DAYS) {
+        return;
+    }
+    day_rows &rows = days[day];
+    int n = r.num_speed_bins < numBins ? r.num_speed_bins : numBins;
+
+    // intervals normally arrive in order; a refetched one is slotted into its day
+    int k = rowsBefore(rows, r.timestamp);
+    if (k < rows.size() && rows.at(k).timestamp == r.timestamp) {
+        return;
+    }
+    prefix_row row;
+    row.timestamp = r.timestamp;
+    for (int i=0; i<MAX_SPEED_BINS; i++) {
+        row.cumulative[i] = (k > 0) ? rows.at(k - 1).cumulative[i] : 0;
+    }
+    for (int i=0; i<n; i++) {
+        row.cumulative[i] += r.speed_bins[i];
+    }
+    rows.insert(k, row);
+    for (int j=k+1; j<rows.size(); j++) {
+        for (int i=0; i<n; i++) {
+            rows[j].cumulative[i] += r.speed_bins[i];
+        }
+    }
+
+    // a new day pushes the oldest out
+    while (days.firstKey() <= days.lastKey() - SPEED_INDEX_KEEP_DAYS) {
+        days.erase(days.begin());
+    }
+}
+
+/**
+ * @brief SpeedSketchIndex::query: Speed distribution of a set of lanes/approaches
+ * over [from, to)
+ * @param lanes: interval_key of each lane/approach
+ */
+SpeedSketch SpeedSketchIndex::query(qint64 from, qint64 to,
+                                    const QVector<quint32> &lanes) const
+{
+    SpeedSketch s = empty;
+    if (to <= from) {
+        return s;
+    }
+    qint64 firstDay = from > 0 ? from / 86400 : 0;
+    for (int l=0; l<lanes.size(); l++) {
+        QHash<quint32, QMap<qint64, day_rows> >::const_iterator it =
+                series.constFind(lanes.at(l));
+        if (it == series.constEnd()) {
+            continue;
+        }
+        const QMap<qint64, day_rows> &days = it.value();
+        QMap<qint64, day_rows>::const_iterator d;
+        for (d = days.lowerBound(firstDay); d != days.constEnd() && d.key() * 86400 < to; ++d) {
+            const day_rows &rows = d.value();
+            int a = rowsBefore(rows, from);
+            int b = rowsBefore(rows, to);
+            if (b <= a) {
+                continue;
+            }
+            for (int i=0; i<numBins; i++) {
+                quint64 c = rows.at(b - 1).cumulative[i] -
+                        (a > 0 ? rows.at(a - 1).cumulative[i] : 0);
+                s.counts[i] += c;
+                s.total += c;
+            }
+        }
+    }
+    return s;
+}
+
+// number of rows that start before ts
+int SpeedSketchIndex::rowsBefore(const day_rows &rows, qint64 ts)
+{
+    int lo = 0;
+    int hi = rows.size();
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (rows.at(mid).timestamp < ts) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
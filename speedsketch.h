@@ -0,0 +1,70 @@
+#ifndef SPEEDSKETCH_H
+#define SPEEDSKETCH_H
+
+#include <QHash>
+#include <QMap>
+#include <QVector>
+
+#include "sensor_utils.h"
+
+// UTC days of intervals the speed index keeps per lane/approach
+#define SPEED_INDEX_KEEP_DAYS 7
+
+// Speed distribution kept as counts over the sensor's configured speed bins.
+// Bin i holds speeds from the previous threshold up to threshold i (the
+// thresholds from parse_speed_bin_conf_read); a last threshold of 255 is the
+// sensor's "all other events" bin. Sketches with the same thresholds merge by
+// adding counts, and any quantile is read off in O(bins) by interpolating
+// inside the bin it falls in, so the error is bounded by that bin's width.
+class SpeedSketch
+{
+public:
+    SpeedSketch();
+    void setBounds(const float *thresholds, int n);
+    bool sameBounds(const SpeedSketch &o) const;
+    void addCounts(const uint32_t *binCounts, int n);
+    void add(const interval_record &r);
+    bool merge(const SpeedSketch &o);
+    quint64 count() const;
+    double quantile(double q) const;
+
+    static void accuracyCheck(int events);
+
+private:
+    friend class SpeedSketchIndex;
+
+    int numBins;
+    float bounds[MAX_SPEED_BINS];
+    quint64 counts[MAX_SPEED_BINS];
+    quint64 total;
+};
+
+// Per lane/approach running totals of speed bin counts, one row per interval,
+// restarting at every UTC day, so the sketch for a window inside a day is the
+// difference of two rows and a longer one adds a day's last row per day:
+// O(lanes * days * (log intervals + bins)). Only the newest
+// SPEED_INDEX_KEEP_DAYS days are kept, and an interval that arrives out of
+// order only touches the rows of its own day.
+class SpeedSketchIndex
+{
+public:
+    SpeedSketchIndex();
+    void setBounds(const float *thresholds, int n);
+    void add(const interval_record &r);
+    SpeedSketch query(qint64 from, qint64 to, const QVector<quint32> &lanes) const;
+
+private:
+    struct prefix_row {
+        qint64 timestamp;
+        quint64 cumulative[MAX_SPEED_BINS];
+    };
+    typedef QVector<prefix_row> day_rows;
+
+    static int rowsBefore(const day_rows &rows, qint64 ts);
+
+    SpeedSketch empty;
+    int numBins;
+    QHash<quint32, QMap<qint64, day_rows> > series;     // keyed by UTC day
+};
+
+#endif // SPEEDSKETCH_H
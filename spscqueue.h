@@ -0,0 +1,67 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <QVector>
+#include <atomic>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. The capacity is rounded up to a power of two; push() fails rather
+// than waits when the queue is full.
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(int capacity)
+    {
+        int n = 2;
+        while (n < capacity) {
+            n *= 2;
+        }
+        slotBuf.resize(n);
+        mask = n - 1;
+        head.store(0);
+        tail.store(0);
+    }
+
+    // producer side
+    bool push(const T &v)
+    {
+        unsigned t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) > mask) {
+            return false;
+        }
+        slotBuf[t & mask] = v;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side: moves up to max items to out, returns how many
+    int popAll(QVector<T> *out, int max)
+    {
+        unsigned h = head.load(std::memory_order_relaxed);
+        unsigned t = tail.load(std::memory_order_acquire);
+        int n = static_cast<int>(t - h);
+        if (n > max) {
+            n = max;
+        }
+        for (int i=0; i<n; i++) {
+            out->append(slotBuf.at((h + i) & mask));
+        }
+        head.store(h + n, std::memory_order_release);
+        return n;
+    }
+
+    int capacity() const
+    {
+        return static_cast<int>(mask) + 1;
+    }
+
+private:
+    QVector<T> slotBuf;
+    unsigned mask;
+    // kept on separate cache lines so the two threads don't share one
+    alignas(64) std::atomic<unsigned> head;
+    alignas(64) std::atomic<unsigned> tail;
+};
+
+#endif // SPSCQUEUE_H
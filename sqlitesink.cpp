@@ -0,0 +1,446 @@
+#include "sqlitesink.h"
+#include "commands.h"
+#include "derivedmetrics.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSqlError>
+#include <QVariant>
+#include <string.h>
+
+// multi-row inserts: the VALUES list is added per statement, one (?, ...)
+// group per row
+static const char *INTERVAL_INSERT =
+        "INSERT OR IGNORE INTO intervals (sensor, lane, ts, req_type, ms, duration, "
+        "num_lanes, num_apprs, avg_speed, volume, occupancy, speed_85, headway, gap, "
+        "quality, flow, density, los) VALUES ";
+#define INTERVAL_COLUMNS 18
+
+static const char *BIN_INSERT =
+        "INSERT OR IGNORE INTO bins (sensor, lane, ts, req_type, bin_type, bin_idx, count) "
+        "VALUES ";
+#define BIN_COLUMNS 7
+
+// rollups are keyed by their bucket length too; bins take it as the last column.
+// A bucket amended by a late interval comes round again and replaces its row.
+static const char *ROLLUP_INSERT =
+        "INSERT OR REPLACE INTO rollups (sensor, lane, ts, req_type, ms, duration, "
+        "num_lanes, num_apprs, avg_speed, volume, occupancy, speed_85, headway, gap, "
+        "quality, flow, density, los) VALUES ";
+
+static const char *ROLLUP_BIN_INSERT =
+        "INSERT OR REPLACE INTO rollup_bins (sensor, lane, ts, req_type, bin_type, "
+        "bin_idx, count, duration) VALUES ";
+#define ROLLUP_BIN_COLUMNS 8
+
+// SQLite builds before 3.32 allow at most 999 parameters per statement
+#define SQLITE_MAX_PARAMS 999
+
+/**
+ * @brief multi_row_sql: An insert of several rows in one statement
+ * @param head: the INSERT up to and including VALUES
+ * @param columns: per row
+ * @param rows
+ * @return SQL
+ */
+static QString multi_row_sql(const char *head, int columns, int rows)
+{
+    QString group = "(?";
+    for (int i=1; i<columns; i++) {
+        group += ", ?";
+    }
+    group += ")";
+
+    QString sql = head;
+    sql.reserve(sql.size() + rows * (group.size() + 2));
+    for (int r=0; r<rows; r++) {
+        if (r > 0) {
+            sql += ", ";
+        }
+        sql += group;
+    }
+    return sql;
+}
+
+// invalid speeds are stored as NULL rather than the 3.125 marker
+static QVariant speedValue(uint32_t raw)
+{
+    if (!(raw & 0x800000)) {
+        return QVariant();
+    }
+    return fixedPt24ToDouble(raw);
+}
+
+SqliteSink::SqliteSink(const QString &dbName, QObject *parent) : QObject(parent)
+{
+    fileName = dbName;
+    connectionName = "sqlitesink_" + dbName;
+    opened = false;
+    drainPending = false;
+    metricUnits = false;
+    rowsWritten = 0;
+    writeNs = 0;
+}
+
+/**
+ * @brief SqliteSink::enqueue: Hands an interval to the sink thread. Safe to
+ * call from any thread; never waits on the database.
+ * @param r
+ */
+void SqliteSink::enqueue(const interval_record &r)
+{
+    bool schedule;
+    queueLock.lock();
+    queue.append(r);
+    schedule = !drainPending;
+    drainPending = true;
+    queueLock.unlock();
+
+    if (schedule) {
+        QMetaObject::invokeMethod(this, "drain", Qt::QueuedConnection);
+    }
+}
+
+/**
+ * @brief SqliteSink::enqueueRollup: Like enqueue, for a closed rollup bucket;
+ * one that is already stored is replaced
+ * @param r
+ */
+void SqliteSink::enqueueRollup(const interval_record &r)
+{
+    bool schedule;
+    queueLock.lock();
+    rollupQueue.append(r);
+    schedule = !drainPending;
+    drainPending = true;
+    queueLock.unlock();
+
+    if (schedule) {
+        QMetaObject::invokeMethod(this, "drain", Qt::QueuedConnection);
+    }
+}
+
+/**
+ * @brief SqliteSink::openDatabase: Opens the database on the sink thread and
+ * prepares the insert statements. Connect to QThread::started.
+ */
+void SqliteSink::openDatabase()
+{
+    db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+    db.setDatabaseName(fileName);
+    if (!db.open()) {
+        printf("Couldn't open SQLite database: %s\n",
+               db.lastError().text().toLatin1().constData());
+        return;
+    }
+    if (!createSchema()) {
+        db.close();
+        return;
+    }
+
+    opened = true;
+    printf("SQLite sink writing to %s\n", fileName.toLatin1().constData());
+}
+
+/**
+ * @brief SqliteSink::setMetricUnits: Whether the sensor reports km/h, which
+ * decides the density thresholds used for LOS
+ * @param metric
+ */
+void SqliteSink::setMetricUnits(bool metric)
+{
+    queueLock.lock();
+    metricUnits = metric;
+    queueLock.unlock();
+}
+
+/**
+ * @brief SqliteSink::closeDatabase: Writes whatever is still queued and closes
+ * the database. Connect to QThread::finished.
+ */
+void SqliteSink::closeDatabase()
+{
+    drain();
+
+    opened = false;
+    qDeleteAll(statements);
+    statements.clear();
+    if (db.isOpen()) {
+        db.close();
+    }
+    db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(connectionName);
+}
+
+void SqliteSink::drain()
+{
+    QVector<interval_record> batch;
+    QVector<interval_record> rollups;
+    queueLock.lock();
+    batch.swap(queue);
+    rollups.swap(rollupQueue);
+    bool metric = metricUnits;
+    drainPending = false;
+    queueLock.unlock();
+
+    if (!opened) {
+        return;
+    }
+    for (int i=0; i<rollups.size(); i+=SQLITE_BATCH_ROWS) {
+        writeBatch(rollups.mid(i, SQLITE_BATCH_ROWS), true, metric);
+    }
+    if (batch.isEmpty()) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i=0; i<batch.size(); i+=SQLITE_BATCH_ROWS) {
+        writeBatch(batch.mid(i, SQLITE_BATCH_ROWS), false, metric);
+    }
+    writeNs += timer.nsecsElapsed();
+    rowsWritten += batch.size();
+
+    if (writeNs > 0) {
+        printf("SQLite sink: %lld intervals, %.0f intervals/s\n",
+               rowsWritten, rowsWritten * 1e9 / writeNs);
+    }
+}
+
+bool SqliteSink::createSchema()
+{
+    QSqlQuery q(db);
+    // WAL lets analysts read while we write; NORMAL is still crash safe in WAL mode
+    q.exec("PRAGMA journal_mode=WAL");
+    q.exec("PRAGMA synchronous=NORMAL");
+
+    // both tables are clustered on (sensor, lane, ts), so the primary key is
+    // a covering index for time range queries on a lane
+    bool ok = q.exec("CREATE TABLE IF NOT EXISTS intervals ("
+                     "sensor INTEGER NOT NULL, lane INTEGER NOT NULL, "
+                     "ts INTEGER NOT NULL, req_type INTEGER NOT NULL, "
+                     "ms INTEGER, duration INTEGER, num_lanes INTEGER, "
+                     "num_apprs INTEGER, avg_speed REAL, volume INTEGER, "
+                     "occupancy REAL, speed_85 REAL, headway INTEGER, gap INTEGER, "
+                     "quality INTEGER, flow REAL, density REAL, los TEXT, "
+                     "PRIMARY KEY (sensor, lane, ts, req_type)) WITHOUT ROWID");
+    ok = ok && q.exec("CREATE TABLE IF NOT EXISTS bins ("
+                      "sensor INTEGER NOT NULL, lane INTEGER NOT NULL, "
+                      "ts INTEGER NOT NULL, req_type INTEGER NOT NULL, "
+                      "bin_type INTEGER NOT NULL, bin_idx INTEGER NOT NULL, "
+                      "count INTEGER, "
+                      "PRIMARY KEY (sensor, lane, ts, req_type, bin_type, bin_idx)) "
+                      "WITHOUT ROWID");
+    ok = ok && q.exec("CREATE TABLE IF NOT EXISTS rollups ("
+                      "sensor INTEGER NOT NULL, lane INTEGER NOT NULL, "
+                      "ts INTEGER NOT NULL, req_type INTEGER NOT NULL, "
+                      "ms INTEGER, duration INTEGER NOT NULL, num_lanes INTEGER, "
+                      "num_apprs INTEGER, avg_speed REAL, volume INTEGER, "
+                      "occupancy REAL, speed_85 REAL, headway INTEGER, gap INTEGER, "
+                      "quality INTEGER, flow REAL, density REAL, los TEXT, "
+                      "PRIMARY KEY (sensor, lane, duration, ts, req_type)) WITHOUT ROWID");
+    ok = ok && q.exec("CREATE TABLE IF NOT EXISTS rollup_bins ("
+                      "sensor INTEGER NOT NULL, lane INTEGER NOT NULL, "
+                      "ts INTEGER NOT NULL, req_type INTEGER NOT NULL, "
+                      "bin_type INTEGER NOT NULL, bin_idx INTEGER NOT NULL, "
+                      "count INTEGER, duration INTEGER NOT NULL, "
+                      "PRIMARY KEY (sensor, lane, duration, ts, req_type, bin_type, bin_idx)) "
+                      "WITHOUT ROWID");
+    if (ok) {
+        // databases made before these columns; fails harmlessly once they're there
+        const char *added[4] = { "quality INTEGER", "flow REAL", "density REAL", "los TEXT" };
+        QSqlQuery alter(db);
+        for (int i=0; i<4; i++) {
+            alter.exec(QString("ALTER TABLE intervals ADD COLUMN %1").arg(added[i]));
+            alter.exec(QString("ALTER TABLE rollups ADD COLUMN %1").arg(added[i]));
+        }
+    }
+    if (!ok) {
+        printf("Couldn't create SQLite schema: %s\n",
+               q.lastError().text().toLatin1().constData());
+    }
+    return ok;
+}
+
+/**
+ * @brief SqliteSink::insertStatement: Prepared insert of a given number of
+ * rows, kept for reuse; full batches always use the same few sizes
+ * @param head: INTERVAL_INSERT etc.
+ * @param columns
+ * @param rows
+ * @return the statement, or nullptr if it couldn't be prepared
+ */
+QSqlQuery *SqliteSink::insertStatement(const char *head, int columns, int rows)
+{
+    QString sql = multi_row_sql(head, columns, rows);
+    QSqlQuery *q = statements.value(sql, nullptr);
+    if (q == nullptr) {
+        q = new QSqlQuery(db);
+        if (!q->prepare(sql)) {
+            printf("Couldn't prepare SQLite insert: %s\n",
+                   q->lastError().text().toLatin1().constData());
+            delete q;
+            return nullptr;
+        }
+        statements.insert(sql, q);
+    }
+    return q;
+}
+
+/**
+ * @brief SqliteSink::insertRows: Inserts rows with as few multi-row INSERT
+ * statements as the parameter limit allows
+ * @param head: INTERVAL_INSERT etc.
+ * @param columns: per row
+ * @param values: row after row, columns values each
+ * @return false on the first failed statement
+ */
+bool SqliteSink::insertRows(const char *head, int columns, const QVariantList &values)
+{
+    int rows = values.size() / columns;
+    int perStatement = SQLITE_MAX_PARAMS / columns;
+    for (int start=0; start<rows; start+=perStatement) {
+        int n = qMin(perStatement, rows - start);
+        QSqlQuery *q = insertStatement(head, columns, n);
+        if (q == nullptr) {
+            return false;
+        }
+        for (int k=0; k<n*columns; k++) {
+            q->addBindValue(values.at(start * columns + k));
+        }
+        if (!q->exec()) {
+            printf("SQLite batch failed: %s\n",
+                   q->lastError().text().toLatin1().constData());
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief SqliteSink::writeBatch: Inserts a batch of intervals and their bins
+ * with multi-row INSERTs, all in one transaction
+ * @param batch
+ * @param rollup: into the rollup tables, with each bin row's bucket length
+ * @param metric: the sensor's units, as enqueued with the batch
+ */
+void SqliteSink::writeBatch(const QVector<interval_record> &batch, bool rollup, bool metric)
+{
+    QVariantList rows;
+    QVariantList binRows;
+    rows.reserve(batch.size() * INTERVAL_COLUMNS);
+
+    // flow, density and LOS for the whole batch at once
+    gather_interval_columns(batch.constData(), batch.size(), &metrics);
+    compute_derived_metrics(&metrics, los_bounds(metric));
+
+    for (int i=0; i<batch.size(); i++) {
+        const interval_record &r = batch.at(i);
+        rows << r.sensor_id << r.lane_appr_num << r.timestamp << r.request_type
+             << r.ms << r.interval_duration << r.num_lanes << r.num_apprs
+             << speedValue(r.avg_speed) << r.volume
+             << static_cast<double>(fixedPtToFloat(r.avg_occupancy))
+             << speedValue(r.speed_85) << r.headway << r.gap << r.quality;
+        if (r.quality & QUALITY_EXCLUDE) {
+            rows << QVariant() << QVariant();
+        } else {
+            rows << static_cast<double>(metrics.flow.at(i));
+            rows << (metrics.density.at(i) >= 0.0f ?
+                         QVariant(static_cast<double>(metrics.density.at(i))) : QVariant());
+        }
+        // LOS is a per-lane measure
+        if (r.request_type == 1 && !(r.quality & QUALITY_EXCLUDE) && metrics.los.at(i) != 0) {
+            rows << QString(QChar(metrics.los.at(i)));
+        } else {
+            rows << QVariant();
+        }
+
+        const uint32_t *bins[3] = { r.class_bins, r.speed_bins, r.dir_bins };
+        int counts[3] = { r.num_class_bins, r.num_speed_bins, r.num_dir_bins };
+        for (int t=0; t<3; t++) {
+            for (int j=0; j<counts[t]; j++) {
+                binRows << r.sensor_id << r.lane_appr_num << r.timestamp
+                        << r.request_type << t << j << bins[t][j];
+                if (rollup) {
+                    binRows << r.interval_duration;
+                }
+            }
+        }
+    }
+
+    db.transaction();
+    bool ok;
+    if (rollup) {
+        ok = insertRows(ROLLUP_INSERT, INTERVAL_COLUMNS, rows) &&
+                insertRows(ROLLUP_BIN_INSERT, ROLLUP_BIN_COLUMNS, binRows);
+    } else {
+        ok = insertRows(INTERVAL_INSERT, INTERVAL_COLUMNS, rows) &&
+                insertRows(BIN_INSERT, BIN_COLUMNS, binRows);
+    }
+    if (ok) {
+        db.commit();
+    } else {
+        db.rollback();
+    }
+}
+
+/**
+ * @brief SqliteSink::benchmark: Inserts synthetic intervals once row by row in
+ * autocommit mode and once through the batched path, and prints both rates.
+ * The database file is removed before each run.
+ * @param dbName
+ * @param rows
+ */
+void SqliteSink::benchmark(const QString &dbName, int rows)
+{
+    QVector<interval_record> recs(rows);
+    for (int i=0; i<rows; i++) {
+        interval_record &r = recs[i];
+        memset(&r, 0, sizeof(r));
+        r.sensor_id = 1;
+        r.request_type = 1;
+        r.lane_appr_num = static_cast<uint8_t>(i % 4);
+        r.timestamp = 1560000000 + (i / 4) * 60;
+        r.interval_duration = 60;
+        r.num_lanes = 4;
+        r.avg_speed = 0x800000 | static_cast<uint32_t>((40 + i % 20) << 8);
+        r.volume = static_cast<uint32_t>(i % 30);
+        r.avg_occupancy = static_cast<uint16_t>((i % 50) << 8);
+        r.speed_85 = 0x800000 | static_cast<uint32_t>((50 + i % 20) << 8);
+        r.num_class_bins = 4;
+        r.num_speed_bins = 8;
+        for (int j=0; j<8; j++) {
+            r.speed_bins[j] = static_cast<uint32_t>((i + j) % 7);
+        }
+    }
+
+    for (int mode=0; mode<2; mode++) {
+        QFile::remove(dbName);
+        SqliteSink sink(dbName);
+        sink.openDatabase();
+        if (!sink.opened) {
+            return;
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        if (mode == 0) {
+            // one transaction (and one sync) per interval, like autocommit
+            QVector<interval_record> one(1);
+            for (int i=0; i<rows; i++) {
+                one[0] = recs.at(i);
+                sink.writeBatch(one, false, false);
+            }
+        } else {
+            for (int i=0; i<rows; i+=SQLITE_BATCH_ROWS) {
+                sink.writeBatch(recs.mid(i, SQLITE_BATCH_ROWS), false, false);
+            }
+        }
+        qint64 ns = timer.nsecsElapsed();
+        printf("%s: %d intervals in %.1f ms, %.0f intervals/s\n",
+               mode == 0 ? "per-row commits" : "batched",
+               rows, ns / 1e6, ns > 0 ? rows * 1e9 / ns : 0.0);
+        sink.closeDatabase();
+    }
+    QFile::remove(dbName);
+}
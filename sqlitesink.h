@@ -0,0 +1,63 @@
+#ifndef SQLITESINK_H
+#define SQLITESINK_H
+
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+#include "derivedmetrics.h"
+#include "sensor_utils.h"
+
+#define SQLITE_BATCH_ROWS 256
+
+// Optional sink that mirrors decoded intervals into a local SQLite database
+// for SQL queries. It lives on its own thread: enqueue() only appends to a
+// queue under a mutex, and the sink thread writes the queue out in batches,
+// one transaction per batch, each table's rows in as few multi-row INSERTs as
+// SQLite's parameter limit allows. Flow, density and LOS are computed per batch
+// and stored next to the raw columns.
+class SqliteSink : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SqliteSink(const QString &dbName, QObject *parent = nullptr);
+    void enqueue(const interval_record &r);
+    void enqueueRollup(const interval_record &r);
+    void setMetricUnits(bool metric);
+
+    static void benchmark(const QString &dbName, int rows);
+
+public slots:
+    void openDatabase();
+    void closeDatabase();
+    void drain();
+
+private:
+    bool createSchema();
+    QSqlQuery *insertStatement(const char *head, int columns, int rows);
+    bool insertRows(const char *head, int columns, const QVariantList &values);
+    void writeBatch(const QVector<interval_record> &batch, bool rollup, bool metric);
+
+    QString fileName;
+    QString connectionName;
+    QSqlDatabase db;
+    bool opened;
+    QHash<QString, QSqlQuery *> statements;     // prepared inserts by SQL
+
+    QMutex queueLock;
+    QVector<interval_record> queue;
+    QVector<interval_record> rollupQueue;
+    bool drainPending;
+    bool metricUnits;                       // under queueLock
+    interval_columns metrics;
+
+    qint64 rowsWritten;
+    qint64 writeNs;
+};
+
+#endif // SQLITESINK_H
@@ -1,7 +1,9 @@
 #ifndef TCPWORKER_H
 #define TCPWORKER_H
 
+#include <QDateTime>
 #include <QDebug>
+#include <QHash>
 #include <QFile>
 #include <QHostAddress>
 #include <QObject>
@@ -9,6 +11,11 @@
 #include <QTimer>
 
 #include "commands.h"
+#include "clockmodel.h"
+#include "gapscanner.h"
+#include "intervalpipeline.h"
+#include "pollscheduler.h"
+#include "sensorstatestore.h"
 #include "sensor_utils.h"
 
 class TCPWorker : public QObject
@@ -19,9 +26,13 @@ public:
     void closeConnection();
     bool getConnectionStatus();
     void setDest(QString addr);
-    void setFilePtr(QFile*);
     void setPort(int port);
+    void setPipelinePtr(IntervalPipeline *p);
+    void setPollSchedulerPtr(PollScheduler *s);
+    void setStateStorePtr(SensorStateStore *s);
+    void setClockModelPtr(ClockModel *c);
     void setTimerPtr(QTimer*);
+    QTcpSocket *socket() const;
     bool startConnection(QString addr, int port);
     void startRealTimeDataRetrieval(uint8_t reqType, uint8_t lAN,
                                     uint8_t *Crc8Table,
@@ -34,6 +45,11 @@ public:
                        uint16_t *errBytes, qint64 len);
 
 private:
+    void fillGaps();
+    void measureClockOffset(uint8_t *Crc8Table);
+    void correctClock(uint8_t *Crc8Table);
+    POLL_OUTCOME pollSensor(qint64 *intervalEnd);
+
     QTcpSocket *sock;
     QHostAddress *dest;
     quint16 port;
@@ -49,10 +65,18 @@ private:
     uint8_t requestType;
     uint8_t numLanes;
     uint8_t numApprs;
+    uint16_t destId;
+    uint16_t intervalSeconds;
+    uint8_t *crc8Table;
+    quint32 cursorKey;
+    QHash<quint32, qint64> cursors;
+    GapScanner gaps;
     QByteArray message;
-    QFile *dataFile;
+    IntervalPipeline *pipeline = nullptr;
+    PollScheduler *pollScheduler = nullptr;
+    SensorStateStore *stateStore = nullptr;
+    ClockModel *clockModel = nullptr;
     QString dataLine;
-    QTextStream *retrievedDataStream;
     QTimer *dataTimer;
 
 public slots: